@@ -0,0 +1,221 @@
+// Benchmark of the fixed step integrators of a particle system, in nanoseconds per particle step
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "nbody.hpp"
+#include "physics.hpp"
+#include "precision.hpp"
+#include "threadpool.hpp"
+#include "timeprofile.hpp"
+
+namespace {
+    typedef void (*SerialIntegrator)(Physics::ParticleSystem&, const float, const float);
+    typedef void (*ParallelIntegrator)(Physics::ParticleSystem&, const float, const float, Parallel::ThreadPool&);
+
+    struct IntegratorEntry {
+        const char* name;
+        SerialIntegrator serial;
+        ParallelIntegrator parallel;
+    };
+
+    const IntegratorEntry INTEGRATORS[] = {
+        { "euler", Propagation::explicitEuler, Propagation::explicitEuler },
+        { "symplectic", Propagation::simplecticEuler, Propagation::simplecticEuler },
+        { "rk4", Propagation::rungeKutta4, Propagation::rungeKutta4 },
+    };
+
+    struct ForceEntry {
+        const char* name;
+        std::unique_ptr<Physics::Force> force;
+    };
+
+    /// @brief One instance of every built-in force, and all of them summed by a CompositeForce
+    std::vector<ForceEntry> makeForces() {
+        std::vector<ForceEntry> forces;
+        forces.push_back(ForceEntry{ "electric", std::unique_ptr<Physics::Force>(new Physics::ElectricForce(1.0e-6f, -1.0e-6f)) });
+        forces.push_back(ForceEntry{ "gravitational", std::unique_ptr<Physics::Force>(new Physics::GravitationalForce(1.0e9f, 1.0f)) });
+        forces.push_back(ForceEntry{ "earth_gravitational", std::unique_ptr<Physics::Force>(new Physics::EarthGravitationalForce(1.0f)) });
+        forces.push_back(ForceEntry{ "hooke", std::unique_ptr<Physics::Force>(new Physics::HookeForce(1.0f)) });
+        forces.push_back(ForceEntry{ "air_resistance", std::unique_ptr<Physics::Force>(new Physics::AirResistanceForce(0.1f)) });
+        forces.push_back(ForceEntry{ "driving", std::unique_ptr<Physics::Force>(new Physics::DrivingForce(glm::vec3(1.0f, 0.0f, 0.0f), Physics::TimeProfile::sinusoidal(1.0f, 2.0f))) });
+
+        Physics::CompositeForce* composite = new Physics::CompositeForce();
+        for (const ForceEntry& entry : forces) composite->addForce(*entry.force);
+        forces.push_back(ForceEntry{ "composite", std::unique_ptr<Physics::Force>(composite) });
+        return forces;
+    }
+
+    /// @brief Particles of unit mass in a spherical shell around the anchor of the forces, far from the singularity
+    void fillSystem(Physics::ParticleSystem& system, size_t count) {
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+
+        system.reserve(count);
+        while (system.size() < count) {
+            glm::vec3 direction(coordinate(generator), coordinate(generator), coordinate(generator));
+            float length = glm::length(direction);
+            if (length > 1.0f || length < 1e-3f) continue;
+            system.addParticle(1.0f, (50.0f + 50.0f * length) * (direction / length), glm::vec3(coordinate(generator), coordinate(generator), 0.0f));
+        }
+    }
+
+    /// @brief Run steps until at least minimumTime has elapsed, returning the seconds per step
+    template<typename Step>
+    double measure(Step step, double minimumTime, unsigned long long& steps) {
+        step(); // warm-up
+
+        steps = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double elapsed = 0.0;
+        do {
+            step();
+            steps++;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < minimumTime);
+
+        return elapsed / steps;
+    }
+
+    struct Result {
+        const char* integrator;
+        const char* precision;
+        const char* force;
+        size_t particles;
+        bool parallel;
+        unsigned threads;
+        unsigned long long steps;
+        double nanosecondsPerParticleStep;
+    };
+
+    void writeJson(std::ostream& out, unsigned threads, double minimumTime, const std::vector<Result>& results) {
+        out << "{\n"
+            << "  \"benchmark\": \"integrators\",\n"
+            << "  \"unit\": \"ns/particle-step\",\n"
+            << "  \"pool_threads\": " << threads << ",\n"
+            << "  \"simd\": \"" << Physics::getSimdLevelName(Physics::getSupportedSimdLevel()) << "\",\n"
+            << "  \"min_time\": " << minimumTime << ",\n"
+            << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& result = results[i];
+            out << "    { \"integrator\": \"" << result.integrator << "\", \"precision\": \"" << result.precision << "\", \"force\": \"" << result.force << "\""
+                << ", \"particles\": " << result.particles << ", \"mode\": \"" << (result.parallel ? "parallel" : "serial") << "\""
+                << ", \"threads\": " << result.threads
+                << ", \"steps\": " << result.steps << ", \"ns_per_particle_step\": " << result.nanosecondsPerParticleStep << " }"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n"
+            << "}\n";
+    }
+
+    void printUsage(const char* program) {
+        std::cerr << "Usage: " << program << " [options]\n"
+            << "  --threads <n>        threads of the multi-threaded runs, 0 for one per hardware thread (default 0)\n"
+            << "  --max-particles <n>  largest system, the sizes are the powers of 10 up to it (default 1000000)\n"
+            << "  --min-time <s>       minimum measured time of each case (default 0.2)\n"
+            << "  --precision <name>   single, double, mixed or all: precision of the state and the forces, see include/precision.hpp (default single)\n"
+            << "  --json <file>        also write the results as JSON, - for the standard output\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned threads = 0;
+    size_t maxParticles = 1000000;
+    double minimumTime = 0.2;
+    std::string json;
+    std::string precisionName = "single";
+
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        if (std::strcmp(option, "--help") == 0 || i + 1 >= argc) {
+            printUsage(argv[0]);
+            return std::strcmp(option, "--help") == 0 ? 0 : 1;
+        }
+
+        const char* value = argv[++i];
+        if (std::strcmp(option, "--threads") == 0) threads = (unsigned)std::atoi(value);
+        else if (std::strcmp(option, "--max-particles") == 0) maxParticles = (size_t)std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(option, "--min-time") == 0) minimumTime = std::atof(value);
+        else if (std::strcmp(option, "--json") == 0) json = value;
+        else if (std::strcmp(option, "--precision") == 0) precisionName = value;
+        else {
+            std::cerr << "Unknown option " << option << "\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Physics::Precision> precisions;
+    Physics::Precision precision;
+    if (precisionName == "all") precisions = { Physics::Precision::Single, Physics::Precision::Double, Physics::Precision::Mixed };
+    else if (Physics::findPrecision(precisionName, precision)) precisions.push_back(precision);
+    else {
+        std::cerr << "Unknown precision " << precisionName << "\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Parallel::ThreadPool pool(threads);
+    std::vector<ForceEntry> forces = makeForces();
+    std::vector<Result> results;
+
+    // the table moves to the standard error when the JSON takes the standard output
+    FILE* table = json == "-" ? stderr : stdout;
+    std::fprintf(table, "threads: %u, supported SIMD: %s\n", pool.getThreadCount(), Physics::getSimdLevelName(Physics::getSupportedSimdLevel()));
+    std::fprintf(table, "%-12s %-9s %-20s %10s %-9s %8s %16s\n", "integrator", "precision", "force", "N", "mode", "threads", "ns/particle-step");
+
+    const float deltaTime = 1e-4f;
+    for (size_t count = 1; count <= maxParticles; count *= 10) {
+        for (const ForceEntry& force : forces) {
+            for (const IntegratorEntry& integrator : INTEGRATORS) {
+                for (Physics::Precision precision : precisions) {
+                    // the serial overloads are the single-threaded mode, a pool of one thread would still dispatch tasks
+                    for (int parallel = 0; parallel < 2; parallel++) {
+                        Physics::ParticleSystem system;
+                        fillSystem(system, count);
+                        system.appliedForces.addForce(*force.force);
+
+                        // single precision runs the ParticleSystem methods, the other precisions a stepper over its own state
+                        std::unique_ptr<Propagation::PrecisionStepper> stepper;
+                        if (precision != Physics::Precision::Single) stepper = Propagation::createPrecisionStepper(precision, integrator.name, system);
+
+                        double time = 0.0;
+                        unsigned long long steps = 0;
+                        double seconds = measure([&]() {
+                            if (stepper) stepper->step(time, deltaTime, parallel ? &pool : nullptr);
+                            else if (parallel) integrator.parallel(system, (float)time, deltaTime, pool);
+                            else integrator.serial(system, (float)time, deltaTime);
+                            time += deltaTime;
+                        }, minimumTime, steps);
+
+                        Result result = { integrator.name, Physics::getPrecisionName(precision), force.name, count, parallel != 0, parallel ? pool.getThreadCount() : 1u, steps, seconds * 1e9 / count };
+                        results.push_back(result);
+                        std::fprintf(table, "%-12s %-9s %-20s %10zu %-9s %8u %16.3f\n", result.integrator, result.precision, result.force, result.particles,
+                            result.parallel ? "parallel" : "serial", result.threads, result.nanosecondsPerParticleStep);
+                    }
+                }
+            }
+        }
+    }
+
+    if (json == "-") writeJson(std::cout, pool.getThreadCount(), minimumTime, results);
+    else if (!json.empty()) {
+        std::ofstream out(json.c_str());
+        if (!out) {
+            std::cerr << "Failed to open " << json << "\n";
+            return 1;
+        }
+        writeJson(out, pool.getThreadCount(), minimumTime, results);
+    }
+
+    return 0;
+}
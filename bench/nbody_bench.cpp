@@ -0,0 +1,125 @@
+// Throughput benchmark of the N-body kernels, in pairwise interactions per second
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "morton.hpp"
+#include "nbody.hpp"
+#include "threadpool.hpp"
+
+namespace {
+    struct Bodies {
+        std::vector<glm::vec3> positions;
+        std::vector<float> masses;
+        std::vector<float> charges;
+        std::vector<glm::vec3> forces;
+    };
+
+    Bodies makeBodies(size_t count) {
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+
+        Bodies bodies;
+        for (size_t i = 0; i < count; i++) {
+            bodies.positions.push_back(glm::vec3(coordinate(generator), coordinate(generator), coordinate(generator)));
+            bodies.masses.push_back(1.0e9f);
+            bodies.charges.push_back(i % 2 ? 1.0e-6f : -1.0e-6f);
+        }
+        bodies.forces.assign(count, glm::vec3(0.0f));
+
+        return bodies;
+    }
+
+    /// @brief Copy of the bodies sorted along the Morton curve, the random ones being in no spatial order
+    Bodies sortBodies(const Bodies& bodies) {
+        const size_t count = bodies.positions.size();
+        std::vector<uint64_t> keys(count);
+        std::vector<uint32_t> order(count);
+        Physics::computeMortonKeys(bodies.positions.data(), count, glm::vec3(-100.0f), glm::vec3(100.0f), keys.data());
+        Physics::sortMortonKeys(keys.data(), count, order.data());
+
+        Bodies sorted;
+        for (uint32_t index : order) {
+            sorted.positions.push_back(bodies.positions[index]);
+            sorted.masses.push_back(bodies.masses[index]);
+            sorted.charges.push_back(bodies.charges[index]);
+        }
+        sorted.forces.assign(count, glm::vec3(0.0f));
+
+        return sorted;
+    }
+
+    /// @brief Run a kernel until at least minimumTime has elapsed, returning the seconds per run
+    template<typename Kernel>
+    double measure(Kernel kernel, double minimumTime = 0.5) {
+        kernel(); // warm-up
+
+        int runs = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double elapsed = 0.0;
+        do {
+            kernel();
+            runs++;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < minimumTime);
+
+        return elapsed / runs;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned threads = argc > 1 ? (unsigned)std::atoi(argv[1]) : 1;
+    Parallel::ThreadPool pool(threads);
+
+    std::printf("threads: %u, supported SIMD: %s\n", pool.getThreadCount(), Physics::getSimdLevelName(Physics::getSupportedSimdLevel()));
+    std::printf("%-10s %-12s %12s %18s\n", "N", "kernel", "ms/eval", "interactions/s");
+
+    const size_t counts[] = { 1024, 4096, 16384, 65536 };
+    const Physics::SimdLevel levels[] = { Physics::SimdLevel::Scalar, Physics::SimdLevel::AVX2, Physics::SimdLevel::AVX512 };
+
+    for (size_t count : counts) {
+        Bodies bodies = makeBodies(count);
+        const double interactions = (double)count * (double)count;
+
+        for (Physics::SimdLevel level : levels) {
+            if (level > Physics::getSupportedSimdLevel()) continue;
+
+            double seconds = measure([&]() {
+                Physics::computeDirectForces(
+                    bodies.positions.data(), bodies.masses.data(), bodies.charges.data(), count,
+                    bodies.positions.data(), bodies.masses.data(), bodies.charges.data(), count,
+                    0.01f, bodies.forces.data(), &pool, level
+                );
+            });
+            std::printf("%-10zu %-12s %12.3f %18.3e\n", count, Physics::getSimdLevelName(level), seconds * 1e3, interactions / seconds);
+        }
+
+        // effective rate of the octree, counting the N^2 pairs it approximates
+        Physics::NBodyInteraction tree(Physics::NBodyInteraction::Gravitational | Physics::NBodyInteraction::Electric, Physics::NBodyInteraction::BarnesHut, 0.5f, 0.01f);
+        double seconds = measure([&]() {
+            tree.computeForces(
+                bodies.positions.data(), bodies.masses.data(), bodies.charges.data(), count,
+                bodies.positions.data(), bodies.masses.data(), bodies.charges.data(), count,
+                bodies.forces.data(), &pool
+            );
+        });
+        std::printf("%-10zu %-12s %12.3f %18.3e\n", count, "barnes-hut", seconds * 1e3, interactions / seconds);
+
+        // same bodies in Morton order, as after Physics::reorderByMortonKey
+        Bodies sorted = sortBodies(bodies);
+        seconds = measure([&]() {
+            tree.computeForces(
+                sorted.positions.data(), sorted.masses.data(), sorted.charges.data(), count,
+                sorted.positions.data(), sorted.masses.data(), sorted.charges.data(), count,
+                sorted.forces.data(), &pool
+            );
+        });
+        std::printf("%-10zu %-12s %12.3f %18.3e\n", count, "bh-morton", seconds * 1e3, interactions / seconds);
+    }
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Check of the C interface (include/dynamicssim.h): builds a small N-body cluster through the dsim_ functions,
+ * advances it in the background, cancels an advance, saves and reloads it as a scenario and destroys a running system.
+ * Prints every check and returns a nonzero status if one fails.
+ *
+ *     DynamicsSim_capi_check [scenario file written and read back, default capi_check.scenario]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dynamicssim.h"
+
+static int failures = 0;
+
+static void check(int condition, const char* what, const dsim_system* system) {
+    if (condition) {
+        printf("ok    %s\n", what);
+    } else {
+        printf("FAIL  %s (%s)\n", what, system ? dsim_get_error(system) : "");
+        failures++;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "capi_check.scenario";
+    const size_t count = 2000;
+    float* masses = malloc(count * sizeof(float));
+    float* positions = malloc(3 * count * sizeof(float));
+    dsim_diagnostics before, after;
+    dsim_system* system;
+    dsim_system* loaded;
+    float parameter = 0.5f;
+    float x0;
+    size_t i;
+    int status;
+
+    check(dsim_version() == 1, "interface version 1", NULL);
+
+    system = dsim_create(2);
+    check(system != NULL, "create a system", NULL);
+    if (!system || !masses || !positions) return 1;
+
+    srand(1);
+    for (i = 0; i < count; i++) {
+        masses[i] = 1.0e9f;
+        positions[3 * i] = (float)(rand() % 200) - 100.0f;
+        positions[3 * i + 1] = (float)(rand() % 200) - 100.0f;
+        positions[3 * i + 2] = (float)(rand() % 200) - 100.0f;
+    }
+    check(dsim_add_particles(system, count, masses, positions, NULL, NULL, NULL) == DSIM_OK, "add particles", system);
+    check(dsim_size(system) == count, "count the particles", system);
+    check(dsim_add_particles(system, 1, NULL, NULL, NULL, NULL, NULL) == DSIM_INVALID_ARGUMENT, "reject null masses", NULL);
+    check(dsim_add_interaction(system, "nbody", NULL, 0) == DSIM_OK, "add an nbody interaction", system);
+    check(dsim_add_force(system, "no_such_force", &parameter, 1) == DSIM_INVALID_ARGUMENT, "reject an unknown force", NULL);
+    check(dsim_set_integrator(system, "verlet") == DSIM_OK, "select the verlet method", system);
+    check(dsim_get_integrator(system)[0] == 'v', "read the method back", system);
+
+    check(dsim_compute_diagnostics(system, &before) == DSIM_OK, "compute the diagnostics", system);
+    check(dsim_advance(system, 200, 0.001f) == DSIM_OK, "start an advance", system);
+    check(dsim_add_force(system, "air_resistance", NULL, 0) == DSIM_BUSY || !dsim_is_running(system),
+        "refuse changes while advancing", NULL);
+    check(dsim_wait(system) == DSIM_OK, "wait for the advance", system);
+    check(dsim_get_step(system) == 200, "take every step", system);
+    check(fabs(dsim_get_time(system) - 0.2) < 1.0e-6, "sum the time steps", system);
+    dsim_compute_diagnostics(system, &after);
+    check(fabs(after.total_energy - before.total_energy) <= 1.0e-3 * fabs(before.total_energy), "conserve the energy", system);
+
+    check(dsim_advance(system, 1000000, 0.001f) == DSIM_OK, "start a long advance", system);
+    dsim_cancel(system);
+    status = dsim_wait(system);
+    check(status == DSIM_CANCELLED, "cancel it", NULL);
+    check(dsim_get_step(system) < 1000200, "stop before its last step", system);
+
+    x0 = dsim_positions(system)[0];
+    check(dsim_save_scenario(system, path) == DSIM_OK, "save a scenario", system);
+    loaded = dsim_create(1);
+    check(loaded && dsim_load_scenario(loaded, path) == DSIM_OK, "load it into another system", loaded);
+    if (loaded) {
+        check(dsim_size(loaded) == count, "load every particle", loaded);
+        check(dsim_size(loaded) && fabsf(dsim_positions(loaded)[0] - x0) <= 1.0e-4f * fabsf(x0) + 1.0e-4f, "load their positions", loaded);
+        check(dsim_get_integrator(loaded)[0] == 'v', "load the method", loaded);
+        check(dsim_load_scenario(loaded, "no/such/file.scenario") == DSIM_IO_ERROR, "report a missing file", NULL);
+
+        /* destroying a system cancels and joins its advance */
+        dsim_advance(loaded, 1000000, 0.001f);
+        dsim_destroy(loaded);
+        check(1, "destroy a running system", NULL);
+    }
+
+    check(dsim_clear_particles(system) == DSIM_OK && dsim_size(system) == 0, "clear the particles", system);
+    check(dsim_positions(system) == NULL, "null arrays without particles", system);
+    dsim_destroy(system);
+    remove(path);
+    free(masses);
+    free(positions);
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "field.hpp"
+#include "interaction.hpp"
+#include "mappedfile.hpp"
+#include "physics.hpp"
+
+namespace Storage {
+
+    /**
+     * Checkpoint file layout, in the byte order of the machine which wrote it:
+     *   CheckpointHeader
+     *   sectionCount sections, each one a CheckpointSectionHeader followed by size bytes of payload, padded to 8 bytes:
+     *     CHECKPOINT_CLOCK      CheckpointClock
+     *     CHECKPOINT_SYSTEM     CheckpointSystemRecord, the positions, velocities and accelerations (3 floats per particle),
+     *                           the masses, charges, radii and step sizes (1 float per particle), padding to 8 bytes,
+     *                           then forceCount CheckpointForceRecord, interactionCount ForceDescriptor and fieldCount ForceDescriptor,
+     *                           then with CHECKPOINT_IDS the id of every particle (1 uint32_t per particle)
+     *     CHECKPOINT_PARTICLE   CheckpointParticleRecord followed by forceCount CheckpointForceRecord
+     *
+     * The applied forces are stored depth-first: a composite record is followed by the records of its childCount components.
+     * Restarts are expected on the same kind of machine, so the arrays are stored exactly as they are in memory.
+     */
+    const char CHECKPOINT_MAGIC[8] = { 'D', 'S', 'C', 'H', 'K', 'P', 'T', '\0' };
+    const uint32_t CHECKPOINT_VERSION = 2;
+
+    const uint32_t CHECKPOINT_CLOCK = 1;
+    const uint32_t CHECKPOINT_SYSTEM = 2;
+    const uint32_t CHECKPOINT_PARTICLE = 3;
+
+    // the cached accelerations of the Verlet methods are valid
+    const uint32_t CHECKPOINT_ACCELERATIONS = 1;
+    // the system was reordered, the ids of the particles follow the descriptors
+    const uint32_t CHECKPOINT_IDS = 2;
+
+    struct CheckpointHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t sectionCount;
+    };
+
+    struct CheckpointSectionHeader {
+        uint32_t type;
+        uint32_t reserved;
+        uint64_t size;
+    };
+
+    struct CheckpointClock {
+        double time;
+        uint64_t step;
+    };
+
+    struct CheckpointSystemRecord {
+        uint64_t particleCount;
+        uint32_t flags;
+        uint32_t forceCount;
+        uint32_t interactionCount;
+        uint32_t fieldCount;
+    };
+
+    struct CheckpointParticleRecord {
+        float position[3];
+        float velocity[3];
+        float acceleration[3];
+        float mass;
+        float stepSize;
+        uint32_t flags;
+        uint32_t forceCount;
+        uint32_t reserved;
+    };
+
+    struct CheckpointForceRecord {
+        Physics::ForceDescriptor descriptor;
+        uint32_t childCount;
+    };
+
+    /**
+     * @class CheckpointWriter
+     * @brief Writes the state of a simulation to a checkpoint file, one section at a time
+     *
+     * Every section is streamed to a temporary file as soon as it is written, straight from the arrays of the system.
+     * commit makes the checkpoint durable and moves it over the destination, so a preemption during the write
+     * leaves the previous checkpoint untouched.
+     *
+     * @note Only the forces and interactions whose describe method returns a known type can be saved
+     */
+    class CheckpointWriter {
+        public:
+            CheckpointWriter();
+
+            /// @brief Discards the checkpoint if it was not committed
+            ~CheckpointWriter();
+
+            CheckpointWriter(const CheckpointWriter&) = delete;
+            CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+            /// @brief Start a new checkpoint, which replaces path when it is committed
+            bool open(const std::string& path);
+
+            /// @brief Save the simulation time and the number of steps taken so far
+            bool writeClock(double time, unsigned long long step);
+
+            /// @brief Save the state arrays, the cached accelerations, the applied forces and the interactions of a system
+            bool writeSystem(const Physics::ParticleSystem& system);
+
+            /// @brief Save the state, the cached acceleration and the applied forces of a particle
+            bool writeParticle(Physics::Particle& particle);
+
+            /// @brief Flush the checkpoint to disk and move it over the destination
+            /// @return false if any section failed to be written, in which case the destination is left untouched
+            bool commit();
+
+            /// @brief Drop the checkpoint being written
+            void discard();
+
+            bool isOpen() const;
+
+        private:
+            std::FILE* file;
+            std::string path;
+            std::string temporaryPath;
+            uint32_t sectionCount;
+            bool failed;
+
+            bool writeBytes(const void* data, size_t size);
+            bool writeSection(uint32_t type, uint64_t size);
+            bool writePadding(uint64_t size);
+    };
+
+    /// @brief Forces, interactions and fields built by a restore, which must outlive the systems and particles using them
+    class CheckpointObjects {
+        public:
+            std::vector<std::unique_ptr<Physics::Force>> forces;
+            std::vector<std::unique_ptr<Physics::Interaction>> interactions;
+            std::vector<std::unique_ptr<Physics::Field>> fields;
+    };
+
+    /**
+     * @class Checkpoint
+     * @brief Checkpoint file mapped in memory, from which the saved state is restored
+     *
+     * The whole file is mapped once when it is opened, and the sections are located without copying them.
+     */
+    class Checkpoint {
+        public:
+            Checkpoint();
+
+            /// @return false if the file cannot be mapped or is not a valid checkpoint
+            bool open(const std::string& path);
+            void close();
+
+            bool isOpen() const;
+
+            /// @brief Whether a clock was saved, getTime and getStep return 0 otherwise
+            bool hasClock() const;
+            double getTime() const;
+            unsigned long long getStep() const;
+
+            /// @brief Number of saved systems and particles, in the order they were written
+            size_t getSystemCount() const;
+            size_t getParticleCount() const;
+
+            /**
+             * @brief Replace the content of a system with a saved one
+             *
+             * The applied forces and interactions of the system are replaced by new objects, stored in objects.
+             * @return false if the section is corrupted or contains forces which cannot be built
+             */
+            bool restoreSystem(size_t index, Physics::ParticleSystem& system, CheckpointObjects& objects) const;
+
+            /// @brief Replace the state and the applied forces of a particle with saved ones
+            bool restoreParticle(size_t index, Physics::Particle& particle, CheckpointObjects& objects) const;
+
+        private:
+            struct Section {
+                const unsigned char* payload;
+                uint64_t size;
+            };
+
+            MappedFile file;
+            std::vector<Section> systems;
+            std::vector<Section> particles;
+            CheckpointClock clock;
+            bool clockPresent;
+    };
+}
+
+#endif
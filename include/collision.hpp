@@ -0,0 +1,80 @@
+#ifndef COLLISION_HPP
+#define COLLISION_HPP
+
+#include <cstddef>
+#include <vector>
+#include "physics.hpp"
+#include "spatialhash.hpp"
+
+namespace Parallel {
+    class ThreadPool;
+}
+
+namespace Physics {
+
+    /**
+     * @class CollisionSolver
+     * @brief Detects and resolves the contacts between the spheres of a particle system
+     *
+     * Every particle with a positive radius is a sphere. A resolution runs in three phases:
+     * - broad phase: the particles are sorted in a SpatialHash with cells as large as the biggest sphere,
+     *   and every particle tests the neighbours in the cells around it, in parallel
+     * - islands: the touching pairs are grouped with a union-find into islands which share no particle
+     * - narrow phase: the islands are solved in parallel, each one with a few passes of sequential impulses
+     *   along the normal of every contact, followed by a correction pushing the spheres apart
+     *
+     * The restitution scales the normal velocity after the impact: 1 for elastic collisions, 0 for perfectly inelastic ones.
+     * Particles with a mass of 0 are treated as immovable. The contacts are listed in a fixed order,
+     * so the result does not depend on the number of threads.
+     *
+     * Intended usage:
+     * Call resolve after every propagation step. A dense pile in contact forms a single island, which is solved by one thread.
+     */
+    class CollisionSolver {
+        public:
+            struct Contact {
+                unsigned first;
+                unsigned second;
+            };
+
+        private:
+            float restitution;
+            unsigned iterations;
+
+            SpatialHash hash;
+            std::vector<std::vector<Contact> > blockContacts; // contacts found by each block of particles
+            std::vector<Contact> contacts;                    // grouped by island
+            std::vector<unsigned> parents;                    // union-find forest over the particles
+            std::vector<unsigned> islandStarts;               // first contact of each island, islandCount + 1 elements
+            std::vector<unsigned> islandOfRoot;               // island of each root particle
+
+            unsigned findRoot(unsigned particle);
+
+        public:
+            /**
+             * @brief Constructor for CollisionSolver
+             *
+             * @param restitution coefficient of restitution, between 0 and 1
+             * @param iterations passes over the contacts of each island
+             */
+            explicit CollisionSolver(float restitution = 1.0f, unsigned iterations = 4);
+
+            float getRestitution() const;
+            unsigned getIterations() const;
+
+            void setRestitution(float e);
+            void setIterations(unsigned count);
+
+            /**
+             * @brief Resolve the contacts between the particles of a system, changing their positions and velocities
+             *
+             * @return number of touching pairs found
+             */
+            size_t resolve(ParticleSystem& system, Parallel::ThreadPool* pool = nullptr);
+
+            /// @brief Number of islands of the last resolution
+            size_t getIslandCount() const;
+    };
+}
+
+#endif
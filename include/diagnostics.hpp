@@ -0,0 +1,81 @@
+#ifndef DIAGNOSTICS_HPP
+#define DIAGNOSTICS_HPP
+
+#include <glm/glm.hpp>
+#include "physics.hpp"
+
+namespace Parallel {
+    class ThreadPool;
+}
+
+namespace Physics {
+
+    /// @brief Conserved quantities of a particle system, accumulated in double precision
+    class SystemDiagnostics {
+        public:
+            double time;
+            double kineticEnergy;
+            double potentialEnergy;   // applied forces and fields, summed over the particles
+            double interactionEnergy; // mutual interactions, each pair counted once
+            glm::dvec3 momentum;
+            glm::dvec3 angularMomentum; // about the origin
+
+            SystemDiagnostics();
+
+            double totalEnergy() const;
+    };
+
+    /**
+     * @brief Compute the energy, momentum and angular momentum of a system in its current state
+     *
+     * The particles are reduced in fixed blocks whose partial sums are combined by a pairwise tree in block order,
+     * so the result does not depend on the number of threads or on the scheduling.
+     * The potential energy uses Force::computeEnergy and Field::computeEnergy, the interaction energy Interaction::computeEnergy.
+     *
+     * @param system particle system
+     * @param time time of the state, passed to the energies of time-dependent forces
+     * @param pool optional thread pool to split the work on
+     */
+    SystemDiagnostics computeDiagnostics(const ParticleSystem& system, float time, Parallel::ThreadPool* pool = nullptr);
+
+    /**
+     * @class DiagnosticsMonitor
+     * @brief Computes the diagnostics of a system on a decimated schedule and tracks their drift from the first sample
+     *
+     * Intended usage:
+     * Call update after every step; the diagnostics are only computed every interval steps, so monitoring a run
+     * costs a fraction of a force evaluation per step.
+     */
+    class DiagnosticsMonitor {
+        private:
+            unsigned long long interval;
+            bool sampled;
+            SystemDiagnostics initial;
+            SystemDiagnostics latest;
+
+        public:
+            /// @param interval number of steps between two samples, 0 is treated as 1
+            explicit DiagnosticsMonitor(unsigned long long interval = 100);
+
+            /**
+             * @brief Sample the system if step is a multiple of the interval
+             *
+             * @return true if a new sample was taken
+             */
+            bool update(unsigned long long step, double time, const ParticleSystem& system, Parallel::ThreadPool* pool = nullptr);
+
+            /// @brief Sample the system regardless of the schedule, e.g. at the end of a run
+            void sample(double time, const ParticleSystem& system, Parallel::ThreadPool* pool = nullptr);
+            void reset();
+
+            unsigned long long getInterval() const;
+            bool hasSample() const;
+            const SystemDiagnostics& getInitial() const;
+            const SystemDiagnostics& getLatest() const;
+
+            /// @brief (E - E0) / |E0| between the latest and the first sample, 0 when E0 is 0
+            double getRelativeEnergyDrift() const;
+    };
+}
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef DISTRIBUTED_HPP
+#define DISTRIBUTED_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <mpi.h>
+#include <glm/glm.hpp>
+#include "diagnostics.hpp"
+#include "nbody.hpp"
+
+namespace Parallel {
+
+    /// @brief Axis-aligned box bounding the particles of a rank, lower > upper when the rank has none
+    struct Bounds {
+        glm::vec3 lower;
+        glm::vec3 upper;
+
+        Bounds();
+
+        bool isEmpty() const;
+    };
+
+    /**
+     * @class DomainDecomposition
+     * @brief Spatial partition of the particles of a simulation across the ranks of an MPI communicator
+     *
+     * Every rank holds the particles of its domain in its own ParticleSystem, together with their global ids.
+     * The domains are contiguous ranges of the Morton curve (see include/morton.hpp) over the bounding box of all the particles,
+     * split so that every rank gets the same number of particles: rebalance recomputes them and migrates the particles
+     * which moved out of their domain. Between two rebalances the domains drift with the particles; the forces stay exact,
+     * since the interactions see the current bounds of every rank, only the balance and the locality degrade.
+     *
+     * Intended usage:
+     * Fill the same system on every rank, call scatter and rebalance, replace the NBodyInteraction of the system with a
+     * DistributedNBodyInteraction, then step every rank with the same fixed step method and call rebalance every few
+     * hundred steps. Every method is collective: all the ranks must call it in the same order.
+     *
+     * @note Only MPI calls from the thread which initialized MPI are made, MPI_THREAD_FUNNELED is enough.
+     */
+    class DomainDecomposition {
+        private:
+            MPI_Comm communicator;
+            int rank;
+            int size;
+            size_t lastMigrated;
+
+        public:
+            explicit DomainDecomposition(MPI_Comm communicator = MPI_COMM_WORLD);
+
+            MPI_Comm getCommunicator() const;
+            int getRank() const;
+            int getSize() const;
+
+            /**
+             * @brief Keep the share of the rank of a system filled identically on every rank
+             *
+             * @param ids output, global index of every particle kept
+             */
+            void scatter(Physics::ParticleSystem& system, std::vector<uint64_t>& ids) const;
+
+            /**
+             * @brief Partition the particles along the Morton curve and migrate them to the rank of their domain
+             *
+             * The particles of every rank end up sorted by key, which also improves the locality of the force evaluation.
+             * The cached accelerations of the system are dropped.
+             *
+             * @param ids global ids of the particles, migrated with them
+             * @return number of particles which left the rank
+             */
+            size_t rebalance(Physics::ParticleSystem& system, std::vector<uint64_t>& ids, Parallel::ThreadPool* pool = nullptr);
+
+            /// @brief Particles sent away by the last rebalance, summed over the ranks
+            size_t getLastMigrated() const;
+
+            /// @brief Bounds of the given positions on every rank, indexed by rank
+            std::vector<Bounds> exchangeBounds(const glm::vec3* positions, size_t count) const;
+
+            /**
+             * @brief Collect the particles of every rank on root, in the order of their ids
+             *
+             * @param global output, filled on root only: the particle with id i is at index i
+             */
+            void gather(const Physics::ParticleSystem& system, const std::vector<uint64_t>& ids, Physics::ParticleSystem& global, int root = 0) const;
+
+            /// @brief Sum of a count over the ranks
+            uint64_t sum(uint64_t value) const;
+
+            /// @brief Diagnostics of the whole simulation from the diagnostics of the share of every rank, see DistributedNBodyInteraction::computeEnergy
+            Physics::SystemDiagnostics reduce(const Physics::SystemDiagnostics& local) const;
+    };
+}
+
+namespace Physics {
+
+    /**
+     * @class DistributedNBodyInteraction
+     * @brief NBodyInteraction between the particles of all the ranks of a DomainDecomposition
+     *
+     * Every evaluation exchanges locally essential trees: each rank builds an octree over its own particles and sends to
+     * every other rank the part a target in that rank's bounds needs, the cells far enough from the bounds as pseudo-particles
+     * (with the opening angle of the interaction) and the sources of the leaves too close to be approximated.
+     * The exchange is nonblocking and overlaps with the forces among the particles of the rank, evaluated on the same octree
+     * in blocks of targets between which the transfers are tested, so that they progress without an asynchronous progress
+     * thread in the MPI library; the imported sources are added once they arrive. A Direct interaction exports every particle
+     * without building the tree, giving the exact sum.
+     *
+     * Intended usage:
+     * Add it to the system of every rank in place of the wrapped interaction; the propagation methods evaluate it
+     * collectively, so every rank must take the same steps. The adaptive methods are not supported, since the ranks
+     * would choose different steps.
+     *
+     * @note The wrapped interaction and the decomposition must outlive it.
+     */
+    class DistributedNBodyInteraction : public Interaction {
+        private:
+            const NBodyInteraction& interaction;
+            const Parallel::DomainDecomposition& decomposition;
+            mutable size_t lastImported;
+
+            /**
+             * @brief Send the locally essential trees and receive the sources imported from the other ranks, running local meanwhile
+             *
+             * local(tree, begin, end) evaluates the own sources on the own targets in [begin, end), on tree when the method
+             * of the wrapped interaction resolves to Barnes-Hut and with the direct sum when tree is nullptr.
+             */
+            template <typename Local>
+            void exchange(const ParticleSystem& system, const glm::vec3* positions, std::vector<Octree::Source>& imported, Local local, Parallel::ThreadPool* pool) const;
+
+        public:
+            DistributedNBodyInteraction(const NBodyInteraction& interaction, const Parallel::DomainDecomposition& decomposition);
+
+            const NBodyInteraction& getInteraction() const;
+
+            /// @brief Sources imported by the last evaluation, particles and pseudo-particles
+            size_t getLastImported() const;
+
+            void computeForces(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, glm::vec3* forces, Parallel::ThreadPool* pool = nullptr) const override;
+
+            /**
+             * @brief Share of the interaction energy of the rank: its own pairs, and half of the pairs with the particles of the other ranks
+             *
+             * The energy of the whole simulation is the sum of the shares, see DomainDecomposition::reduce.
+             */
+            float computeEnergy(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, Parallel::ThreadPool* pool = nullptr) const override;
+
+            /// @brief Described as the wrapped interaction, so a gathered system saves as an ordinary N-body system
+            ForceDescriptor describe() const override;
+    };
+}
+
+#endif
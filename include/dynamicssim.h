@@ -0,0 +1,157 @@
+#ifndef DYNAMICSSIM_H
+#define DYNAMICSSIM_H
+
+/**
+ * C interface of the physics library, for embedding the simulator in other languages (see python/dynamicssim.py)
+ *
+ * A dsim_system owns a particle system, the forces, fields and interactions added to it and a pool of worker threads.
+ * dsim_advance steps it on a background thread and returns at once; dsim_wait blocks until the steps are done.
+ * The state arrays are exposed in place: dsim_positions and dsim_velocities point into the system, 3 floats per particle,
+ * so a caller can wrap them (e.g. as NumPy arrays) without copying.
+ *
+ * Intended usage:
+ * Create a system, add its particles, forces, fields and interactions (or load a scenario), then alternate dsim_advance
+ * and dsim_wait, reading or writing the arrays in between. While a system is advancing, the functions changing it fail
+ * with DSIM_BUSY and its arrays are being written: read them only after dsim_wait. The pointers to the arrays stay valid
+ * until the number of particles changes. Distinct systems are independent and can be used from different threads;
+ * the functions of one system must be called from one thread at a time, except dsim_is_running, dsim_cancel,
+ * dsim_get_step and dsim_get_time.
+ *
+ * Every function returning int returns DSIM_OK on success and a negative dsim_status on failure,
+ * with a description of the failure in dsim_get_error.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+    #if defined(DYNAMICSSIM_C_API_BUILD)
+        #define DSIM_API __declspec(dllexport)
+    #else
+        #define DSIM_API __declspec(dllimport)
+    #endif
+#else
+    #define DSIM_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct dsim_system dsim_system;
+
+typedef enum dsim_status {
+    DSIM_OK = 0,
+    DSIM_INVALID_ARGUMENT = -1, /* unknown name, bad parameters or null array */
+    DSIM_BUSY = -2,             /* the system is advancing */
+    DSIM_IO_ERROR = -3,         /* a file cannot be read or written */
+    DSIM_CANCELLED = -4         /* the last advance was cancelled before its last step */
+} dsim_status;
+
+/** Energy, momentum and angular momentum of a system, see Physics::SystemDiagnostics */
+typedef struct dsim_diagnostics {
+    double time;
+    double kinetic_energy;
+    double potential_energy;
+    double interaction_energy;
+    double total_energy;
+    double momentum[3];
+    double angular_momentum[3];
+} dsim_diagnostics;
+
+/** Version of this interface, increased when a function changes */
+DSIM_API int dsim_version(void);
+
+/**
+ * Create an empty system, stepped with the rk4 method
+ *
+ * threads: number of threads stepping it, the background thread included; 0 for one per hardware thread
+ * Returns null if the system cannot be created.
+ */
+DSIM_API dsim_system* dsim_create(unsigned threads);
+
+/** Destroy a system, cancelling and waiting for its advance */
+DSIM_API void dsim_destroy(dsim_system* system);
+
+/** Description of the last failure on a system, empty after a success; valid until the next call on the system */
+DSIM_API const char* dsim_get_error(const dsim_system* system);
+
+/**
+ * Replace the particles, forces, fields and interactions of a system with the ones of a scenario file,
+ * also taking its integrator; see include/scenario.hpp for the format
+ */
+DSIM_API int dsim_load_scenario(dsim_system* system, const char* path);
+
+/** Save a system as a scenario file */
+DSIM_API int dsim_save_scenario(const dsim_system* system, const char* path);
+
+/**
+ * Append particles to a system
+ *
+ * masses: count floats; positions, velocities: 3 * count floats; charges, radii: count floats.
+ * The arrays other than masses can be null, giving zeros.
+ */
+DSIM_API int dsim_add_particles(dsim_system* system, size_t count, const float* masses, const float* positions,
+    const float* velocities, const float* charges, const float* radii);
+
+/** Remove every particle of a system */
+DSIM_API int dsim_clear_particles(dsim_system* system);
+
+/**
+ * Add a force applied to every particle, a field or a mutual interaction
+ *
+ * type: name of the type as in a scenario file, e.g. "earth_gravitational", "uniform_gravity" or "nbody"
+ * parameters: parameterCount parameters of the type in scenario order, the ones omitted keep their defaults
+ */
+DSIM_API int dsim_add_force(dsim_system* system, const char* type, const float* parameters, size_t parameterCount);
+DSIM_API int dsim_add_field(dsim_system* system, const char* type, const float* parameters, size_t parameterCount);
+DSIM_API int dsim_add_interaction(dsim_system* system, const char* type, const float* parameters, size_t parameterCount);
+
+/** Select the propagation method: euler, symplectic, rk4, verlet, yoshida4 or dp45 */
+DSIM_API int dsim_set_integrator(dsim_system* system, const char* name);
+
+/** Name of the propagation method of a system */
+DSIM_API const char* dsim_get_integrator(const dsim_system* system);
+
+/**
+ * Start advancing a system by steps steps of deltaTime seconds on its threads, returning at once
+ *
+ * The time of the system is the sum of the steps taken, see dsim_get_time.
+ */
+DSIM_API int dsim_advance(dsim_system* system, uint64_t steps, float deltaTime);
+
+/** Block until the advance of a system is over, returning its status: DSIM_OK or DSIM_CANCELLED */
+DSIM_API int dsim_wait(dsim_system* system);
+
+/** Whether a system is advancing */
+DSIM_API int dsim_is_running(const dsim_system* system);
+
+/** Stop the advance of a system after the step being taken, without waiting for it */
+DSIM_API void dsim_cancel(dsim_system* system);
+
+/** Steps taken and time simulated since the creation of a system, or since a scenario was loaded */
+DSIM_API uint64_t dsim_get_step(const dsim_system* system);
+DSIM_API double dsim_get_time(const dsim_system* system);
+
+/** Number of particles of a system */
+DSIM_API size_t dsim_size(const dsim_system* system);
+
+/**
+ * State arrays of a system, 3 floats per particle for the positions and velocities, 1 for the masses and charges
+ *
+ * They can be written between two advances: every advance starts from the arrays as they are, dropping the accelerations
+ * cached by the Verlet methods. Null when the system has no particles.
+ */
+DSIM_API float* dsim_positions(dsim_system* system);
+DSIM_API float* dsim_velocities(dsim_system* system);
+DSIM_API float* dsim_masses(dsim_system* system);
+DSIM_API float* dsim_charges(dsim_system* system);
+
+/** Energy, momentum and angular momentum of a system in its current state */
+DSIM_API int dsim_compute_diagnostics(dsim_system* system, dsim_diagnostics* diagnostics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
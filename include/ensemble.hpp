@@ -0,0 +1,186 @@
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "physics.hpp"
+
+namespace Parallel {
+    class ThreadPool;
+}
+
+namespace Physics {
+
+    /// @brief Force, field or interaction of an ensemble, with the parameters of its ForceDescriptor for every member
+    class EnsembleForce {
+        public:
+            uint32_t type; // ForceDescriptor::Type
+            std::vector<float> parameters[ForceDescriptor::MAX_PARAMETERS]; // parameters[k][member]
+    };
+
+    /**
+     * @class Ensemble
+     * @brief Independent copies of a small particle system, differing in their initial state and force parameters
+     *
+     * Every member has the same number of particles and the same forces, fields and interactions,
+     * while the state, masses and charges of the particles and the parameters of the forces are kept per member.
+     * The state is transposed to separate coordinate arrays with the member as the fastest index:
+     * particle p of member m is element p * getMemberCount() + m, so the kernels advance all the members in lockstep
+     * with loops over contiguous members, which the compiler vectorizes across them.
+     *
+     * Supported are the built-in forces and fields and the NBody interaction, which is summed directly within each member.
+     *
+     * Intended usage:
+     * Build the ensemble from a prototype system with assign, vary the initial state and setForceParameter per member,
+     * then advance it with Propagation::advance. Thousands of members of a few particles each keep every thread busy,
+     * where as many separate systems would mostly pay for the dispatch.
+     */
+    class Ensemble {
+        private:
+            size_t memberCount;
+            size_t particleCount;
+            std::vector<float> positions[3];
+            std::vector<float> velocities[3];
+            std::vector<float> accelerations[3];
+            std::vector<float> masses;
+            std::vector<float> charges;
+            bool accelerationsValid;
+            std::vector<EnsembleForce> forces;
+        public:
+            Ensemble();
+
+            /// @brief Whether a ForceDescriptor type can be added to an ensemble
+            static bool isSupported(uint32_t type);
+
+            /**
+             * @brief Replace the members with copies of a prototype system: its particles, applied forces, fields and interactions
+             *
+             * @return false if the prototype uses a force, field or interaction which is not supported, leaving the ensemble empty
+             */
+            bool assign(const ParticleSystem& prototype, size_t count);
+
+            /// @brief Remove every member and force
+            void clear();
+
+            /// @brief Add a force, field or interaction with the same parameters in every member, false if its type is not supported
+            bool addForce(const ForceDescriptor& descriptor);
+
+            size_t getMemberCount() const;
+            size_t getParticleCount() const;
+            size_t getForceCount() const;
+            const EnsembleForce& getForce(size_t force) const;
+
+            float getForceParameter(size_t force, size_t member, int parameter) const;
+            void setForceParameter(size_t force, size_t member, int parameter, float value);
+
+            /// @brief Index of a particle of a member in the state arrays
+            size_t index(size_t member, size_t particle) const;
+
+            glm::vec3 getPosition(size_t member, size_t particle) const;
+            glm::vec3 getVelocity(size_t member, size_t particle) const;
+            float getMass(size_t member, size_t particle) const;
+            float getCharge(size_t member, size_t particle) const;
+
+            void setPosition(size_t member, size_t particle, const glm::vec3& pos);
+            void setVelocity(size_t member, size_t particle, const glm::vec3& vel);
+            void setMass(size_t member, size_t particle, float m);
+            void setCharge(size_t member, size_t particle, float q);
+
+            /// @brief Direct access to a coordinate (0, 1 or 2) of the state arrays, getMemberCount() * getParticleCount() elements each
+            float* getPositions(int axis);
+            float* getVelocities(int axis);
+            const float* getPositions(int axis) const;
+            const float* getVelocities(int axis) const;
+            float* getMasses();
+            float* getCharges();
+            const float* getMasses() const;
+            const float* getCharges() const;
+
+            /**
+             * @brief Accelerations cached by the Verlet method at the end of the last propagation
+             *
+             * The cache is dropped by the setters and by the other methods.
+             * Call invalidateAccelerations after writing to the state arrays directly.
+             */
+            bool hasAccelerations() const;
+            float* getAccelerations(int axis);
+            const float* getAccelerations(int axis) const;
+            void validateAccelerations();
+            void invalidateAccelerations();
+    };
+
+    /**
+     * @brief Compute the kinetic and potential energy of every member of an ensemble
+     *
+     * The potential energy includes the forces, the fields and the interactions, each pair counted once.
+     *
+     * @param kinetic output array of getMemberCount() elements
+     * @param potential output array of getMemberCount() elements
+     */
+    void computeEnsembleEnergies(const Ensemble& ensemble, float time, double* kinetic, double* potential, Parallel::ThreadPool* pool = nullptr);
+
+    /// @brief Distribution of a quantity over the members of an ensemble
+    class EnsembleSummary {
+        public:
+            size_t count;
+            double mean;
+            double standardDeviation;
+            double minimum;
+            double lowerQuantile; // 5%
+            double median;
+            double upperQuantile; // 95%
+            double maximum;
+
+            EnsembleSummary();
+    };
+
+    /// @brief Summarize count values, one per member
+    EnsembleSummary summarize(const double* values, size_t count);
+}
+
+namespace Propagation {
+
+    /// @brief Propagation methods available for ensembles
+    enum class EnsembleMethod { ExplicitEuler, SymplecticEuler, VelocityVerlet, RungeKutta4 };
+
+    /// @brief Method named euler, symplectic, verlet or rk4, false for other names
+    bool findEnsembleMethod(const std::string& name, EnsembleMethod& method);
+
+    /**
+     * @class EnsembleWorkspace
+     * @brief Scratch memory of the ensemble propagation, laid out like the state arrays of the ensemble
+     *
+     * Must not be shared by concurrent calls, see RK4Workspace.
+     */
+    class EnsembleWorkspace {
+        public:
+            std::vector<float> forces[3];
+            std::vector<float> stagePositions[3];
+            std::vector<float> stageVelocities[3];
+            std::vector<float> sumKx[3];
+            std::vector<float> sumKv[3];
+
+            /// @brief Resize the buffers to hold the given number of elements, never releasing memory
+            void resize(size_t count);
+    };
+
+    /**
+     * @brief Advance every member of an ensemble by a number of fixed steps
+     *
+     * The members are split in blocks small enough to stay in the L1/L2 cache. Since the members are independent,
+     * a block takes all the steps before the next one starts, and the pool synchronizes once per call instead of once per step.
+     *
+     * @param currentTime time at the beginning of the first step, the time of each step is computed from the step count
+     * @param steps number of steps of deltaTime
+     *
+     * @note The overload without workspace uses a per-thread workspace
+     */
+    void advance(Physics::Ensemble& ensemble, EnsembleMethod method, double currentTime, float deltaTime, unsigned long long steps,
+        EnsembleWorkspace& workspace, Parallel::ThreadPool* pool = nullptr);
+    void advance(Physics::Ensemble& ensemble, EnsembleMethod method, double currentTime, float deltaTime, unsigned long long steps,
+        Parallel::ThreadPool* pool = nullptr);
+}
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef FIELD_HPP
+#define FIELD_HPP
+
+#include <cstddef>
+#include <memory>
+#include <glm/glm.hpp>
+#include "physics.hpp"
+
+namespace Physics {
+
+    /**
+     * @class Field
+     * @brief Base class for fields acting on every particle according to its own mass and charge
+     *
+     * A Force bakes the properties of the particle it acts on into its parameters (e.g. the mass of the particle in
+     * GravitationalForce), so every particle with a different mass needs its own force object.
+     * A field receives the mass and charge of the particle at evaluation time instead, so a single field object
+     * describes the action on a whole group of particles.
+     *
+     * Intended usage:
+     * Add the field to a ParticleSystem with addField, the batch propagation methods evaluate it alongside the applied forces.
+     * To apply a field to a single Particle, add a FieldForce to its applied forces.
+     */
+    class Field {
+        public:
+            virtual ~Field() = default;
+
+            /// @brief Compute the force acting on a particle with the given mass and charge
+            virtual glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const = 0;
+
+            /// @brief Compute the potential energy of a particle with the given mass and charge
+            virtual float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const = 0;
+
+            /**
+             * @brief Compute the force acting on a batch of particles
+             *
+             * @param forces output array, the force acting on each particle is added to its current value
+             * @note The default implementation calls computeForce for every particle, derived classes override it with a non-virtual loop
+             */
+            virtual void computeForces(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, const float* charges,
+                size_t count, float time, glm::vec3* forces) const;
+
+            /**
+             * @brief Compute the force acting on a particle in double precision, used by the double precision propagation
+             *
+             * @note The default implementation rounds the state to float and calls computeForce, the built-in fields override it
+             */
+            virtual glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double mass, double charge, double time) const;
+
+            /// @brief Batch counterpart of computeForceDouble, adding the force acting on each particle to its current value
+            virtual void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, const float* masses, const float* charges,
+                size_t count, double time, glm::dvec3* forces) const;
+
+            /// @brief Type and parameters of the field, Unknown for fields which cannot be saved
+            virtual ForceDescriptor describe() const;
+    };
+
+    /// @brief Build a field from its description, nullptr for Unknown or other types
+    std::unique_ptr<Field> createField(const ForceDescriptor& descriptor);
+
+    /// @brief Uniform gravitational field, Earth's surface gravity by default
+    class UniformGravityField : public Field {
+        private:
+            glm::vec3 acceleration;
+        public:
+            explicit UniformGravityField(const glm::vec3& acceleration = glm::vec3(0.0f, -g, 0.0f));
+
+            glm::vec3 getAcceleration() const;
+            void setAcceleration(const glm::vec3& a);
+
+            glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const override;
+            float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, const float* charges,
+                size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double mass, double charge, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, const float* masses, const float* charges,
+                size_t count, double time, glm::dvec3* forces) const override;
+            ForceDescriptor describe() const override;
+    };
+
+    /// @brief Gravitational field of a point mass
+    class PointGravityField : public Field {
+        private:
+            float sourceMass;
+            glm::vec3 anchorPoint;
+        public:
+            PointGravityField(float mass, const glm::vec3& anchor = glm::vec3(0.0f));
+
+            float getSourceMass() const;
+            void setSourceMass(float mass);
+            void setAnchorPoint(const glm::vec3& anchor);
+
+            glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const override;
+            float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, const float* charges,
+                size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double mass, double charge, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, const float* masses, const float* charges,
+                size_t count, double time, glm::dvec3* forces) const override;
+            ForceDescriptor describe() const override;
+    };
+
+    /// @brief Uniform electric field
+    class UniformElectricField : public Field {
+        private:
+            glm::vec3 field;
+        public:
+            explicit UniformElectricField(const glm::vec3& field);
+
+            glm::vec3 getField() const;
+            void setField(const glm::vec3& e);
+
+            glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const override;
+            float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, const float* charges,
+                size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double mass, double charge, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, const float* masses, const float* charges,
+                size_t count, double time, glm::dvec3* forces) const override;
+            ForceDescriptor describe() const override;
+    };
+
+    /// @brief Coulomb field of a point charge, repelling the charges of the same sign
+    class PointChargeField : public Field {
+        private:
+            float sourceCharge;
+            glm::vec3 anchorPoint;
+        public:
+            PointChargeField(float charge, const glm::vec3& anchor = glm::vec3(0.0f));
+
+            float getSourceCharge() const;
+            void setSourceCharge(float charge);
+            void setAnchorPoint(const glm::vec3& anchor);
+
+            glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const override;
+            float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, const float* charges,
+                size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double mass, double charge, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, const float* masses, const float* charges,
+                size_t count, double time, glm::dvec3* forces) const override;
+            ForceDescriptor describe() const override;
+    };
+
+    /**
+     * @class FieldForce
+     * @brief Force exerted by a field on a particle with a given mass and charge
+     *
+     * Adapter for the methods working with forces, such as the propagation of a single Particle.
+     * The field is referenced, so it must outlive the force.
+     */
+    class FieldForce : public Force {
+        private:
+            const Field& field;
+            float mass;
+            float charge;
+        public:
+            FieldForce(const Field& field, float mass, float charge = 0.0f);
+
+            glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+            float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const override;
+    };
+}
+
+#endif
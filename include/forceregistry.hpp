@@ -0,0 +1,116 @@
+#ifndef FORCEREGISTRY_HPP
+#define FORCEREGISTRY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "physics.hpp"
+
+namespace Physics {
+
+    /**
+     * @class ForceRegistry
+     * @brief Owner of a set of forces stored by value, grouped by type in contiguous arrays
+     *
+     * Every force added to the registry is copied into the array of its type and identified by a handle.
+     * Adding and removing are O(1): a removed force is replaced by the last one of its array and its handle is retired,
+     * so dangling handles are detected instead of reaching another force.
+     * Being itself a Force, the registry sums the forces array by array with non-virtual calls, without chasing pointers.
+     *
+     * Intended usage:
+     * Keep the registry alive as long as the systems using it, add the forces to it and add the registry to appliedForces.
+     * The sum follows the order of the arrays, not the order of insertion.
+     *
+     * @note Pointers returned by get are invalidated by the next add or remove, keep the handles instead.
+     */
+    class ForceRegistry : public Force {
+        public:
+            /// @brief Identifier of a force in the registry
+            struct Handle {
+                uint32_t slot;
+                uint32_t generation;
+
+                Handle();
+                Handle(uint32_t s, uint32_t g);
+
+                /// @brief Whether the handle was returned by a successful add, it may still have been removed since
+                bool isValid() const;
+            };
+
+        private:
+            template <typename T>
+            struct Pool {
+                std::vector<T> forces;
+                std::vector<uint32_t> slots; // slot of each force, to update it when the force is moved
+            };
+
+            struct Slot {
+                uint32_t type;       // ForceDescriptor type, Unknown when free
+                uint32_t position;   // position in the array of the type
+                uint32_t generation; // incremented when the force is removed
+            };
+
+            Pool<ElectricForce> electricForces;
+            Pool<GravitationalForce> gravitationalForces;
+            Pool<EarthGravitationalForce> earthGravitationalForces;
+            Pool<HookeForce> hookeForces;
+            Pool<AirResistanceForce> airResistanceForces;
+
+            std::vector<Slot> slots;
+            std::vector<uint32_t> freeSlots;
+
+            template <typename T>
+            Handle insert(Pool<T>& pool, uint32_t type, const T& force);
+
+            template <typename T>
+            void erase(Pool<T>& pool, uint32_t position);
+
+            const Slot* find(const Handle& handle) const;
+
+        public:
+            ForceRegistry();
+
+            ForceRegistry(const ForceRegistry&) = delete;
+            ForceRegistry& operator=(const ForceRegistry&) = delete;
+
+            /// @brief Copy a force into the registry
+            Handle add(const ElectricForce& force);
+            Handle add(const GravitationalForce& force);
+            Handle add(const EarthGravitationalForce& force);
+            Handle add(const HookeForce& force);
+            Handle add(const AirResistanceForce& force);
+
+            /// @brief Create a force from its description, an invalid handle for types the registry cannot store
+            Handle add(const ForceDescriptor& descriptor);
+
+            /// @brief Remove a force, false if the handle does not refer to a force of the registry anymore
+            bool remove(const Handle& handle);
+
+            bool contains(const Handle& handle) const;
+
+            /// @brief Force referred to by a handle, nullptr if it was removed
+            const Force* get(const Handle& handle) const;
+
+            /// @brief Remove every force, the handles returned so far are all retired
+            void clear();
+
+            size_t size() const;
+
+            glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+            float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+
+            /// @brief Accumulate the forces on a batch of particles, the uniform EarthGravitationalForce array being summed once per batch
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const override;
+
+            /// @brief Union of the dependencies of the non-empty arrays
+            unsigned getDependencies() const override;
+
+            /// @brief Described as Composite, the forces are its components in the order of the arrays
+            ForceDescriptor describe() const override;
+            size_t getComponentCount() const override;
+            const Force& getComponent(size_t index) const override;
+    };
+}
+
+#endif
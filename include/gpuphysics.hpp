@@ -0,0 +1,90 @@
+#ifndef GPUPHYSICS_HPP
+#define GPUPHYSICS_HPP
+
+#include <cstddef>
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "physics.hpp"
+
+namespace Physics {
+
+    /**
+     * @class GpuParticleSystem
+     * @brief Copy of a particle system propagated by compute shaders, with its state living in GPU buffers
+     *
+     * The state is split in shader storage buffers: positions (xyz, mass), velocities, accelerations and charges.
+     * Every step is a velocity Verlet step made of two dispatches: kick and drift of every particle, then the evaluation
+     * of the forces at the new positions followed by the second kick. The applied forces are uploaded as ForceDescriptors,
+     * the N-body interaction is evaluated as a direct sum tiled through shared memory.
+     *
+     * Intended usage:
+     * Upload a system once, step it every frame and draw the position buffer directly, e.g. with SphereRenderer::drawBuffer,
+     * so no state crosses the bus while the simulation runs. Download it only when the CPU needs the state back.
+     * The viewer does so when started with --gpu.
+     *
+     * @note Needs a current OpenGL 4.3 context. Only the built-in forces and the direct N-body sum are supported:
+     * Barnes-Hut settings of an NBodyInteraction are ignored.
+     */
+    class GpuParticleSystem {
+        private:
+            unsigned int program;
+            unsigned int positionBuffer;
+            unsigned int velocityBuffer;
+            unsigned int accelerationBuffer;
+            unsigned int chargeBuffer;
+            unsigned int forceBuffer;
+
+            int particleCountLocation;
+            int forceCountLocation;
+            int deltaTimeLocation;
+            int stageLocation;
+            int nbodyKindsLocation;
+            int softeningLocation;
+
+            size_t particleCount;
+            unsigned forceCount;
+            unsigned nbodyKinds;
+            float softening;
+
+            void dispatch(unsigned stage, float deltaTime);
+
+        public:
+            GpuParticleSystem();
+            ~GpuParticleSystem();
+
+            GpuParticleSystem(const GpuParticleSystem&) = delete;
+            GpuParticleSystem& operator=(const GpuParticleSystem&) = delete;
+
+            /// @brief Whether the compute shader compiled, the other methods do nothing otherwise
+            bool isValid() const;
+
+            /**
+             * @brief Replace the GPU state with the one of a system, including its applied forces and interactions
+             *
+             * @return false if the system has forces or interactions without a GPU implementation
+             */
+            bool upload(const ParticleSystem& system);
+
+            /// @brief Propagate the uploaded state by a number of velocity Verlet steps
+            void step(float deltaTime, unsigned steps = 1);
+
+            /**
+             * @brief Copy the positions, velocities and accelerations back into the uploaded system
+             *
+             * @return false if the system does not have the same number of particles
+             */
+            bool download(ParticleSystem& system) const;
+
+            size_t size() const;
+
+            /**
+             * @brief Buffer of the positions, one vec4 (xyz, mass) per particle
+             *
+             * The w component is the mass, not a radius: draw it with SphereRenderer::drawBuffer and a positive radius.
+             */
+            unsigned int getPositionBuffer() const;
+            unsigned int getVelocityBuffer() const;
+    };
+}
+
+#endif
@@ -3,6 +3,8 @@
 
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <cstddef>
+#include <vector>
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 
@@ -13,7 +15,129 @@ namespace Graphics {
     void initGraphics(float axis_length = 200.0f);
     void deleteGraphics();
     void drawAxis();
+
+    /// @brief Draw a sphere in immediate style, the geometry of each resolution is generated once and cached in a buffer
     void drawSphere(float radius, glm::vec3 position, int slices = 20, int stacks = 20);
+
+    /**
+     * @class TrajectoryBuffer
+     * @brief Ring buffer of trajectory points living in a persistently mapped vertex buffer
+     *
+     * New points are written straight into GPU-visible memory, overwriting the oldest ones once the buffer is full,
+     * so nothing is re-submitted when the trajectory is drawn. The ring has slack slots beyond the capacity, so the points
+     * pushed while the GPU still reads the last frames go to slots those frames do not draw and the writes do not wait.
+     * The point stored in the first slot is mirrored after the last one, which lets the wrapped ring be drawn as two
+     * line strips without a gap.
+     *
+     * Without OpenGL 4.4 or ARB_buffer_storage, the points are uploaded one by one with glBufferSubData instead.
+     *
+     * Intended usage:
+     * Create it after the OpenGL context, push the position of the particle after every step and draw it once per frame.
+     */
+    class TrajectoryBuffer {
+        private:
+            static const int FRAME_COUNT = 3;
+
+            unsigned int buffer;
+            glm::vec3* points;  // persistently mapped, slots + 1 slots; null without buffer storage
+            size_t capacity;
+            size_t slots;       // capacity and the slack
+            size_t head;        // slot of the next point
+            size_t count;
+            glm::vec3 last;
+            int frame;                       // index of the next draw among the tracked ones
+            GLsync fences[FRAME_COUNT];      // last draws reading the buffer
+            size_t drawnOldest[FRAME_COUNT]; // slots read by each of them
+            size_t drawnCount[FRAME_COUNT];
+
+        public:
+            explicit TrajectoryBuffer(size_t capacity = 10000);
+            ~TrajectoryBuffer();
+
+            TrajectoryBuffer(const TrajectoryBuffer&) = delete;
+            TrajectoryBuffer& operator=(const TrajectoryBuffer&) = delete;
+
+            /// @brief Append a point, replacing the oldest one when the buffer is full
+            void push(const glm::vec3& point);
+            void clear();
+
+            size_t size() const;
+            size_t getCapacity() const;
+            bool empty() const;
+
+            /// @brief Most recent point
+            glm::vec3 back() const;
+
+            /// @brief Draw the points from the oldest to the newest as a line strip, with the current color
+            void draw();
+    };
+
+    /**
+     * @class SphereRenderer
+     * @brief Draws many spheres of the same resolution with a single instanced draw call
+     *
+     * The sphere mesh is generated once, while the center and radius of every instance are streamed every frame
+     * through a persistently mapped buffer split in three regions, so the CPU writes one region while the GPU reads the others.
+     * Without OpenGL 4.4 or ARB_buffer_storage, they are uploaded every frame into an orphaned buffer instead.
+     * The shaders use the fixed-function matrices of the compatibility profile, so the spheres follow the camera
+     * like the rest of the scene.
+     */
+    class SphereRenderer {
+        private:
+            static const int REGION_COUNT = 3;
+
+            unsigned int program;
+            unsigned int vertexArray;
+            unsigned int meshBuffer;
+            unsigned int indexBuffer;
+            unsigned int instanceBuffer;
+            int colorLocation;
+            int radiusLocation;
+            size_t indexCount;
+
+            glm::vec4* instances; // persistently mapped, REGION_COUNT * capacity instances; null without buffer storage
+            std::vector<glm::vec4> staging; // instances of the frame without buffer storage
+            size_t capacity;
+            int region;
+            GLsync fences[REGION_COUNT];
+
+            void reserve(size_t count);
+            void releaseInstances();
+            void drawInstances(unsigned int buffer, size_t offset, size_t count, float radius, const glm::vec3& color);
+
+        public:
+            /// @param capacity initial number of instances per frame, the buffer grows when needed
+            SphereRenderer(int slices = 20, int stacks = 20, size_t capacity = 1024);
+            ~SphereRenderer();
+
+            SphereRenderer(const SphereRenderer&) = delete;
+            SphereRenderer& operator=(const SphereRenderer&) = delete;
+
+            /// @brief Whether the shaders compiled, draw does nothing otherwise
+            bool isValid() const;
+
+            /**
+             * @brief Draw one sphere for each position
+             *
+             * @param positions centers of the spheres
+             * @param radii radius of each sphere, nullptr to use radius for all of them
+             * @param count number of spheres
+             * @param radius radius used when radii is nullptr
+             * @param color color of the spheres
+             */
+            void draw(const glm::vec3* positions, const float* radii, size_t count, float radius, const glm::vec3& color);
+
+            /**
+             * @brief Draw one sphere for each vec4 of a buffer already on the GPU, without copying it
+             *
+             * @param buffer vertex buffer of count vec4, the xyz components are the centers of the spheres
+             * @param count number of spheres
+             * @param radius radius of all the spheres, negative to read it from the w component of the buffer;
+             * give a positive one for the position buffer of a GpuParticleSystem, whose w is the mass
+             * @param color color of the spheres
+             */
+            void drawBuffer(unsigned int buffer, size_t count, float radius, const glm::vec3& color);
+    };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,52 @@
+#ifndef INTERACTION_HPP
+#define INTERACTION_HPP
+
+#include <glm/glm.hpp>
+#include "physics.hpp"
+
+namespace Parallel {
+    class ThreadPool;
+}
+
+namespace Physics {
+
+    /**
+     * @class Interaction
+     * @brief Base class for mutual interactions between the particles of a system
+     *
+     * A Force acts on each particle independently of the others, while an interaction depends on the state of
+     * the whole system (e.g. N-body gravity), so it is always evaluated over all the particles at once.
+     * The state is passed explicitly because the propagation methods evaluate it at intermediate stages,
+     * while masses and charges are read from the system.
+     *
+     * Intended usage:
+     * Add the interaction to a ParticleSystem with addInteraction, the batch propagation methods evaluate it alongside the applied forces.
+     */
+    class Interaction {
+        public:
+            virtual ~Interaction() = default;
+
+            /**
+             * @brief Compute the interaction forces acting on the particles of a system
+             *
+             * @param system particle system, providing masses and charges
+             * @param positions positions of the particles, system.size() elements
+             * @param velocities velocities of the particles, system.size() elements
+             * @param time current time
+             * @param forces output array, the force acting on each particle is added to its current value
+             * @param pool optional thread pool to split the work on
+             */
+            virtual void computeForces(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, glm::vec3* forces, Parallel::ThreadPool* pool = nullptr) const = 0;
+
+            /// @brief Compute the total potential energy of the interaction
+            virtual float computeEnergy(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, Parallel::ThreadPool* pool = nullptr) const = 0;
+
+            /// @brief Type and parameters of the interaction, Unknown for interactions which cannot be saved
+            virtual ForceDescriptor describe() const;
+    };
+
+    /// @brief Build an interaction from its description, nullptr for Unknown or force types
+    std::unique_ptr<Interaction> createInteraction(const ForceDescriptor& descriptor);
+}
+
+#endif
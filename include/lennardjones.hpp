@@ -0,0 +1,54 @@
+#ifndef LENNARDJONES_HPP
+#define LENNARDJONES_HPP
+
+#include <glm/glm.hpp>
+#include "interaction.hpp"
+
+namespace Physics {
+
+    /**
+     * @class LennardJonesInteraction
+     * @brief Short-range Lennard-Jones interaction between all the particles of a system
+     *
+     * The potential of a pair is V(r) = 4 * epsilon * ( (sigma / r)^12 - (sigma / r)^6 ), repulsive below 2^(1/6) * sigma
+     * and weakly attractive beyond. Pairs farther than the cutoff are ignored and the potential is shifted
+     * so that it vanishes at the cutoff, keeping the energy continuous.
+     *
+     * The neighbours of every particle are found through a SpatialHash with cells as large as the cutoff,
+     * so an evaluation costs O(N) for a bounded density instead of O(N^2).
+     *
+     * @note The hash is rebuilt at every evaluation in a per-thread cache, so the interaction can be shared by concurrent systems.
+     */
+    class LennardJonesInteraction : public Interaction {
+        private:
+            float epsilon;
+            float sigma;
+            float cutoff;
+
+        public:
+            /**
+             * @brief Constructor for LennardJonesInteraction
+             *
+             * @param epsilon depth of the potential well
+             * @param sigma distance at which the potential is zero
+             * @param cutoff distance beyond which pairs do not interact, 0 selects 2.5 * sigma
+             */
+            LennardJonesInteraction(float epsilon = 1.0f, float sigma = 1.0f, float cutoff = 0.0f);
+
+            float getEpsilon() const;
+            float getSigma() const;
+            float getCutoff() const;
+
+            void setEpsilon(float e);
+            void setSigma(float s);
+
+            /// @brief Set the cutoff distance, 0 selects 2.5 * sigma
+            void setCutoff(float distance);
+
+            void computeForces(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, glm::vec3* forces, Parallel::ThreadPool* pool = nullptr) const override;
+            float computeEnergy(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, Parallel::ThreadPool* pool = nullptr) const override;
+            ForceDescriptor describe() const override;
+    };
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace Storage {
+
+    /**
+     * @class MappedFile
+     * @brief Read-only memory mapping of a whole file
+     *
+     * The operating system loads the pages on first access, so opening a large file is cheap
+     * and only the parts which are actually read are brought into memory.
+     * The mapping stays valid until the object is closed or destroyed.
+     */
+    class MappedFile {
+        private:
+            const unsigned char* address;
+            size_t length;
+            bool opened;
+
+        public:
+            MappedFile();
+            ~MappedFile();
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            /// @brief Map a file, closing the previous one
+            /// @return false if the file cannot be opened or mapped
+            bool open(const std::string& path);
+            void close();
+
+            bool isOpen() const;
+
+            /// @brief First byte of the file, nullptr for empty files
+            const unsigned char* data() const;
+            size_t size() const;
+    };
+}
+
+#endif
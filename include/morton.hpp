@@ -0,0 +1,48 @@
+#ifndef MORTON_HPP
+#define MORTON_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace Parallel {
+    class ThreadPool;
+}
+
+namespace Physics {
+    class ParticleSystem;
+
+    /**
+     * Morton (Z-order) keys: the box is divided in a grid of 2^21 cells along every axis and the key of a point
+     * interleaves the bits of the coordinates of its cell, x in the highest bit of every triple.
+     * Sorting the points by key follows a space-filling curve, so points close in the order are close in space
+     * and every contiguous range of keys covers a compact region; the top 3 * n bits of a key are the octree cell of level n.
+     */
+    const unsigned MORTON_BITS = 21;
+
+    /// @brief Morton key of a point in the box [lower, upper], points outside the box are clamped to it
+    uint64_t computeMortonKey(const glm::vec3& point, const glm::vec3& lower, const glm::vec3& upper);
+
+    /// @brief Morton keys of a set of points in the box [lower, upper]
+    void computeMortonKeys(const glm::vec3* points, size_t count, const glm::vec3& lower, const glm::vec3& upper, uint64_t* keys, Parallel::ThreadPool* pool = nullptr);
+
+    /**
+     * @brief Stable order of a set of keys, by a parallel least significant digit radix sort
+     *
+     * The keys are sorted one byte at a time, the bytes equal in every key are skipped.
+     *
+     * @param order output, count indices: keys[order[i]] is the i-th smallest key, equal keys keep their relative order
+     */
+    void sortMortonKeys(const uint64_t* keys, size_t count, uint32_t* order, Parallel::ThreadPool* pool = nullptr);
+
+    /**
+     * @brief Reorder the particles of a system along the Morton curve over their bounding box
+     *
+     * Particles close in space end up close in memory, so the forces gathered from the neighbours of a particle
+     * (the leaves of the octree, the cells of the spatial hash) hit the cache. The ids of the particles follow them,
+     * see ParticleSystem::reorder. Worth repeating every few hundred steps, as the particles drift away from the curve.
+     */
+    void reorderByMortonKey(ParticleSystem& system, Parallel::ThreadPool* pool = nullptr);
+}
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef NBODY_HPP
+#define NBODY_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "interaction.hpp"
+
+namespace Physics {
+
+    /**
+     * @brief Field generated by a set of sources at a point
+     *
+     * The sums do not include the physical constants nor the mass and charge of the particle sitting in the point,
+     * so that gravity and Coulomb interactions share a single traversal of the sources.
+     */
+    struct FieldSample {
+        glm::vec3 gravity;         // sum of m_j * (x_j - x) / r^3
+        glm::vec3 electric;        // sum of q_j * (x - x_j) / r^3
+        float gravityPotential;    // sum of m_j / r
+        float electricPotential;   // sum of q_j / r
+
+        FieldSample();
+    };
+
+    /**
+     * @class Octree
+     * @brief Barnes-Hut octree over a set of point masses and charges
+     *
+     * Every node stores the total mass and charge of the sources it contains, together with their centers,
+     * so that far away groups of sources are approximated by a single pseudo-particle.
+     * A node is opened when its size is larger than openingAngle times its distance from the point:
+     * smaller angles are more accurate and slower, 0 makes the traversal equivalent to a direct sum.
+     *
+     * The sources are copied into the tree in tree order, so the tree stays valid when the input arrays change.
+     */
+    class Octree {
+        public:
+            struct Source {
+                glm::vec3 position;
+                float mass;
+                float charge;
+            };
+
+            struct Node {
+                glm::vec3 center;          // geometric center of the cubic cell
+                float halfSize;            // half of the edge of the cell
+                glm::vec3 massCenter;
+                float mass;
+                glm::vec3 chargeCenter;    // center of the charge magnitudes
+                float charge;
+                float absCharge;
+                unsigned firstChild;       // children are stored contiguously
+                unsigned childCount;       // 0 for leaves
+                unsigned firstSource;      // sources are stored contiguously in tree order
+                unsigned sourceCount;
+            };
+
+            /// @param leafSize maximum number of sources in a leaf
+            explicit Octree(unsigned leafSize = 8);
+
+            /**
+             * @brief Build the tree over a set of sources, replacing the previous content
+             *
+             * @param positions positions of the sources
+             * @param masses masses of the sources, nullptr when they are all zero
+             * @param charges charges of the sources, nullptr when they are all zero
+             * @param count number of sources
+             */
+            void build(const glm::vec3* positions, const float* masses, const float* charges, size_t count);
+
+            /// @brief Add the field generated by the sources at a point to sample
+            void computeField(const glm::vec3& point, float openingAngle, float softening, FieldSample& sample) const;
+
+            void setLeafSize(unsigned size);
+            unsigned getLeafSize() const;
+
+            const std::vector<Node>& getNodes() const;
+            const std::vector<Source>& getSources() const;
+
+        private:
+            unsigned leafSize;
+            std::vector<Node> nodes;
+            std::vector<Source> sources;
+
+            void buildNode(unsigned index, size_t begin, size_t end, const glm::vec3& center, float halfSize, unsigned depth);
+    };
+
+    /// @brief Add the field generated by every source at a point to sample, without approximations
+    void computeDirectField(const glm::vec3& point, const glm::vec3* positions, const float* masses, const float* charges, size_t count, float softening, FieldSample& sample);
+
+    /// @brief Instruction sets of the vectorized direct-sum kernel
+    enum class SimdLevel { Scalar, AVX2, AVX512 };
+
+    /// @brief Best instruction set supported by the running processor
+    SimdLevel getSupportedSimdLevel();
+
+    const char* getSimdLevelName(SimdLevel level);
+
+    /**
+     * @brief Vectorized direct-sum kernel computing the forces exerted by a set of sources on a set of targets
+     *
+     * Sources and targets are transposed to separate coordinate arrays, then every SIMD lane accumulates the force on one target
+     * over tiles of sources which fit in the cache. Inverse distances use the approximate reciprocal square root of the
+     * instruction set refined by one Newton iteration, pairs in the same position are masked out.
+     *
+     * @param level instruction set to use, lowered to the supported one if needed
+     * @note Masses and charges may be nullptr to disable gravity or Coulomb interaction. The force on each target is added to forces.
+     */
+    void computeDirectForces(const glm::vec3* sourcePositions, const float* sourceMasses, const float* sourceCharges, size_t sourceCount,
+        const glm::vec3* targetPositions, const float* targetMasses, const float* targetCharges, size_t targetCount,
+        float softening, glm::vec3* forces, Parallel::ThreadPool* pool = nullptr, SimdLevel level = getSupportedSimdLevel());
+
+    /**
+     * @class NBodyInteraction
+     * @brief Mutual gravitational and Coulomb interaction between all the particles of a system
+     *
+     * Forces are evaluated either with a direct O(N^2) sum or with a Barnes-Hut octree in O(N log N).
+     * The automatic method picks the direct sum below the direct threshold, where it is faster than building the tree.
+     * The softening length is added to the distance of every pair ( r^2 + softening^2 ), avoiding singular close encounters.
+     *
+     * @note The tree is rebuilt at every evaluation in a per-thread cache, so the interaction can be shared by concurrent systems.
+     */
+    class NBodyInteraction : public Interaction {
+        public:
+            enum Kind { Gravitational = 1, Electric = 2 };
+            enum Method { Direct, BarnesHut, Automatic };
+
+        private:
+            unsigned kinds;
+            Method method;
+            float openingAngle;
+            float softening;
+            size_t directThreshold;
+            unsigned leafSize;
+            SimdLevel simdLevel;
+
+        public:
+            /**
+             * @brief Constructor for NBodyInteraction
+             *
+             * @param kinds combination of Kind flags selecting the interactions to compute
+             * @param method evaluation method
+             * @param openingAngle Barnes-Hut opening angle
+             * @param softening softening length
+             */
+            NBodyInteraction(unsigned kinds = Gravitational, Method method = Automatic, float openingAngle = 0.5f, float softening = 0.0f);
+
+            unsigned getKinds() const;
+            Method getMethod() const;
+            float getOpeningAngle() const;
+            float getSoftening() const;
+            size_t getDirectThreshold() const;
+
+            void setKinds(unsigned k);
+            void setMethod(Method m);
+            void setOpeningAngle(float angle);
+            void setSoftening(float length);
+
+            /// @brief Set the number of sources below which the automatic method uses the direct sum
+            void setDirectThreshold(size_t count);
+
+            /// @brief Set the maximum number of sources in a leaf of the octree
+            void setLeafSize(unsigned size);
+            unsigned getLeafSize() const;
+
+            /// @brief Set the instruction set of the direct-sum kernel, lowered to the supported one if needed
+            void setSimdLevel(SimdLevel level);
+            SimdLevel getSimdLevel() const;
+
+            /// @brief Method actually used for a given number of sources
+            Method resolveMethod(size_t sourceCount) const;
+
+            void computeForces(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, glm::vec3* forces, Parallel::ThreadPool* pool = nullptr) const override;
+            float computeEnergy(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, Parallel::ThreadPool* pool = nullptr) const override;
+            ForceDescriptor describe() const override;
+
+            /**
+             * @brief Compute the forces exerted by a set of sources on a set of targets
+             *
+             * Sources and targets may be the same arrays: a source does not act on a target in the same position.
+             * Masses and charges may be nullptr when they are all zero.
+             * The force acting on each target is added to forces.
+             */
+            void computeForces(const glm::vec3* sourcePositions, const float* sourceMasses, const float* sourceCharges, size_t sourceCount,
+                const glm::vec3* targetPositions, const float* targetMasses, const float* targetCharges, size_t targetCount,
+                glm::vec3* forces, Parallel::ThreadPool* pool = nullptr) const;
+
+            /**
+             * @brief Compute the forces exerted by the sources of a tree on a set of targets, with the opening angle of the interaction
+             *
+             * Lets a caller which already built the tree over the sources, e.g. to export parts of it, evaluate it without a second build.
+             * The force acting on each target is added to forces.
+             */
+            void computeForces(const Octree& tree, const glm::vec3* targetPositions, const float* targetMasses, const float* targetCharges, size_t targetCount,
+                glm::vec3* forces, Parallel::ThreadPool* pool = nullptr) const;
+    };
+}
+
+#endif
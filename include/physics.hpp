@@ -4,10 +4,22 @@
 #define _USE_MATH_DEFINES
 
 #include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 #include <glm/glm.hpp>
 
+namespace Parallel {
+    class ThreadPool;
+}
+
 namespace Physics {
+    class Field;
+    class Interaction;
+
     // Physical constants
     static const float g = 9.806f; // Earth gravitational acceleration in m/s^2
     static const float G = 6.67430e-11f; // Gravitational constant in m^3/kg/s^2
@@ -16,6 +28,42 @@ namespace Physics {
     static const float mu_0 = 1.256637061e-6f; // Vacuum permeability in H/m
     static const float k_m = mu_0 / (4.0f * M_PI); // Magnetic constant in N/A²
 
+    // Physical constants in double precision, used by the double precision force evaluation
+    static const double g_double = 9.806;
+    static const double G_double = 6.67430e-11;
+    static const double k_e_double = 1.0 / (4.0 * M_PI * 8.854187817e-12);
+
+    /**
+     * @brief Type and parameters of a force, used to save it and to build it again with createForce
+     *
+     * The meaning of the parameters depends on the type.
+     */
+    struct ForceDescriptor {
+        enum Type {
+            Unknown = 0,            // cannot be saved
+            Composite = 1,          // no parameters, the components are described on their own
+            Electric = 2,           // q1, q2, anchor x, y, z
+            Gravitational = 3,      // m1, m2, anchor x, y, z
+            EarthGravitational = 4, // m
+            Hooke = 5,              // k, anchor x, y, z
+            AirResistance = 6,      // drag coefficient
+            Driving = 7,            // direction x, y, z, amplitude, angular frequency, phase, offset
+            UniformGravityField = 32,  // field: acceleration x, y, z
+            PointGravityField = 33,    // field: source mass, anchor x, y, z
+            UniformElectricField = 34, // field: electric field x, y, z
+            PointChargeField = 35,     // field: source charge, anchor x, y, z
+            NBody = 64,             // interaction: kinds, method, opening angle, softening, direct threshold, leaf size, SIMD level
+            LennardJones = 65       // interaction: epsilon, sigma, cutoff
+        };
+
+        static const int MAX_PARAMETERS = 8;
+
+        uint32_t type;
+        float parameters[MAX_PARAMETERS];
+
+        explicit ForceDescriptor(uint32_t t = Unknown);
+    };
+
     /**
      * @class Force
      * @brief Base class for different types of forces
@@ -30,6 +78,12 @@ namespace Physics {
      * 
      * - computeEnergy: to calculate the potential energy associated with a particle
      * 
+     * computeForces is the batch counterpart of computeForce: it evaluates the force over a whole array of particles,
+     * so that the virtual dispatch happens once per batch instead of once per particle.
+     *
+     * getDependencies tells which arguments the force reads. A force reading neither the position nor the velocity is uniform:
+     * it is the same on every particle, so CompositeForce evaluates it once per batch and the Runge-Kutta methods once per stage time.
+     * 
      * Intended usage:
      * Every particle in the simulation should be associated with forces acting on it, that can be reused among different particles.
      * To represent multiple forces acting on a single particle, use the CompositeForce class.
@@ -37,6 +91,14 @@ namespace Physics {
     */
     class Force {
         public:
+            /// @brief Arguments a force depends on, combined in the value returned by getDependencies
+            enum Dependency {
+                DependsOnPosition = 1,
+                DependsOnVelocity = 2,
+                DependsOnTime = 4,
+                DependsOnAll = DependsOnPosition | DependsOnVelocity | DependsOnTime
+            };
+
             virtual ~Force() = default;
 
             /// @brief Compute the force acting on a particle
@@ -44,6 +106,46 @@ namespace Physics {
 
             /// @brief Compute the potential energy associated with a particle
             virtual float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const = 0;
+
+            /**
+             * @brief Compute the force acting on a batch of particles
+             * 
+             * @param positions positions of the particles
+             * @param velocities velocities of the particles
+             * @param count number of particles in the batch
+             * @param time current time
+             * @param forces output array, the force acting on each particle is added to its current value
+             * 
+             * @note The default implementation calls computeForce for every particle, derived classes override it with a non-virtual loop
+             */
+            virtual void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const;
+
+            /**
+             * @brief Compute the force acting on a particle in double precision, used by the double precision propagation
+             *
+             * @note The default implementation rounds the state to float and calls computeForce, the built-in forces override it
+             */
+            virtual glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const;
+
+            /// @brief Batch counterpart of computeForceDouble, adding the force acting on each particle to its current value
+            virtual void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const;
+
+            /**
+             * @brief Arguments the force depends on, a combination of the Dependency flags
+             *
+             * @note The default implementation returns DependsOnAll, which is always correct; the built-in forces return the exact set
+             */
+            virtual unsigned getDependencies() const;
+
+            /// @brief Whether the force depends neither on the position nor on the velocity, so it is the same on every particle
+            bool isUniform() const;
+
+            /// @brief Type and parameters of the force, Unknown for forces which cannot be saved
+            virtual ForceDescriptor describe() const;
+
+            /// @brief Forces summed by an aggregation described as Composite, none for the other forces
+            virtual size_t getComponentCount() const;
+            virtual const Force& getComponent(size_t index) const;
     };
 
     /// @brief Aggregation of multiple forces
@@ -58,11 +160,41 @@ namespace Physics {
             /// @brief Remove a force from the composite force
             void removeForce(const Force& force);
 
+            /// @brief Remove every force from the composite force
+            void clear();
+
             /// @brief Compute the total force acting on a particle by summing all individual forces
             glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
 
             /// @brief Compute the total potential energy associated with a particle by summing all individual energies
             float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+
+            /// @brief Accumulate the forces acting on a batch of particles, dispatching once per force and evaluating the uniform forces once per batch
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const override;
+
+            /// @brief Union of the dependencies of the components, none for an empty composite
+            unsigned getDependencies() const override;
+
+            /**
+             * @brief Sum of the uniform components at a given time, see Force::isUniform
+             *
+             * computeForces is the sum of computeUniformForce and computeVaryingForces, so a caller evaluating the same batch
+             * at several states with equal times, such as the stages of a Runge-Kutta step, can evaluate the uniform part once.
+             */
+            glm::vec3 computeUniformForce(float time) const;
+
+            /// @brief Accumulate the components which are not uniform on a batch of particles
+            void computeVaryingForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const;
+
+            ForceDescriptor describe() const override;
+            size_t getComponentCount() const override;
+            const Force& getComponent(size_t index) const override;
+
+            /// @brief Access to the component forces, in the order they were added
+            size_t getForceCount() const;
+            const Force& getForce(size_t index) const;
     };
 
     // Specific force declaration -----------------------------------------------------
@@ -86,6 +218,11 @@ namespace Physics {
 
             glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
             float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const override;
+            unsigned getDependencies() const override;
+            ForceDescriptor describe() const override;
     };
 
     /// @brief Gravitational force between two masses
@@ -105,6 +242,11 @@ namespace Physics {
 
             glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
             float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const override;
+            unsigned getDependencies() const override;
+            ForceDescriptor describe() const override;
     };
 
     /// @brief Gravitational force near Earth's surface
@@ -116,6 +258,11 @@ namespace Physics {
 
             glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
             float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const override;
+            unsigned getDependencies() const override;
+            ForceDescriptor describe() const override;
     };
 
     /// @brief Spring force using Hooke's law
@@ -130,6 +277,11 @@ namespace Physics {
 
             glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
             float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const override;
+            unsigned getDependencies() const override;
+            ForceDescriptor describe() const override;
     };
 
     /// @brief Generic air resistance force (drag)
@@ -141,14 +293,146 @@ namespace Physics {
 
             glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
             float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const override;
+            unsigned getDependencies() const override;
+            ForceDescriptor describe() const override;
+    };
+
+    /**
+     * @class StaticCompositeForce
+     * @brief Aggregation of a fixed set of forces, composed at compile time
+     * 
+     * Unlike CompositeForce, the component forces are stored by value and their types are known at compile time,
+     * so each component is called without virtual dispatch and the compiler can fuse and inline their bodies in a single loop.
+     * Being itself a Force, it can be used with every Propagation method or added to a CompositeForce.
+     * 
+     * Intended usage:
+     * Use it when the set of forces is fixed for the whole run, e.g.
+     * StaticCompositeForce<EarthGravitationalForce, AirResistanceForce, HookeForce> f(EarthGravitationalForce(m), AirResistanceForce(drag), HookeForce(k));
+     * Use CompositeForce when forces have to be added or removed at runtime.
+     */
+    template<typename... Forces>
+    class StaticCompositeForce : public Force {
+        private:
+            typedef std::tuple<Forces...> ForceTuple;
+            typedef std::integral_constant<size_t, sizeof...(Forces)> End;
+
+            ForceTuple forces;
+
+            glm::vec3 sumForces(const glm::vec3& position, const glm::vec3& velocity, float time, End) const {
+                return glm::vec3(0.0f);
+            }
+
+            template<size_t I>
+            glm::vec3 sumForces(const glm::vec3& position, const glm::vec3& velocity, float time, std::integral_constant<size_t, I>) const {
+                typedef typename std::tuple_element<I, ForceTuple>::type Component;
+                return std::get<I>(forces).Component::computeForce(position, velocity, time)
+                    + sumForces(position, velocity, time, std::integral_constant<size_t, I + 1>());
+            }
+
+            glm::dvec3 sumForcesDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time, End) const {
+                return glm::dvec3(0.0);
+            }
+
+            template<size_t I>
+            glm::dvec3 sumForcesDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time, std::integral_constant<size_t, I>) const {
+                typedef typename std::tuple_element<I, ForceTuple>::type Component;
+                return std::get<I>(forces).Component::computeForceDouble(position, velocity, time)
+                    + sumForcesDouble(position, velocity, time, std::integral_constant<size_t, I + 1>());
+            }
+
+            unsigned collectDependencies(End) const {
+                return 0;
+            }
+
+            template<size_t I>
+            unsigned collectDependencies(std::integral_constant<size_t, I>) const {
+                typedef typename std::tuple_element<I, ForceTuple>::type Component;
+                return std::get<I>(forces).Component::getDependencies() | collectDependencies(std::integral_constant<size_t, I + 1>());
+            }
+
+            float sumEnergies(const glm::vec3& position, const glm::vec3& velocity, float time, End) const {
+                return 0.0f;
+            }
+
+            template<size_t I>
+            float sumEnergies(const glm::vec3& position, const glm::vec3& velocity, float time, std::integral_constant<size_t, I>) const {
+                typedef typename std::tuple_element<I, ForceTuple>::type Component;
+                return std::get<I>(forces).Component::computeEnergy(position, velocity, time)
+                    + sumEnergies(position, velocity, time, std::integral_constant<size_t, I + 1>());
+            }
+
+        public:
+            explicit StaticCompositeForce(const Forces&... components) : forces(components...) {}
+
+            /// @brief Access to the I-th component force, e.g. to update its parameters
+            template<size_t I>
+            typename std::tuple_element<I, ForceTuple>::type& getForce() {
+                return std::get<I>(forces);
+            }
+
+            template<size_t I>
+            const typename std::tuple_element<I, ForceTuple>::type& getForce() const {
+                return std::get<I>(forces);
+            }
+
+            /// @brief Compute the total force acting on a particle by summing all the components
+            glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override {
+                return sumForces(position, velocity, time, std::integral_constant<size_t, 0>());
+            }
+
+            /// @brief Compute the total potential energy associated with a particle by summing all the components
+            float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override {
+                return sumEnergies(position, velocity, time, std::integral_constant<size_t, 0>());
+            }
+
+            /// @brief Accumulate the forces acting on a batch of particles in one fused loop over all the components
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const override {
+                for (size_t i = 0; i < count; i++) {
+                    forces[i] += sumForces(positions[i], velocities[i], time, std::integral_constant<size_t, 0>());
+                }
+            }
+
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const override {
+                return sumForcesDouble(position, velocity, time, std::integral_constant<size_t, 0>());
+            }
+
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const override {
+                for (size_t i = 0; i < count; i++) {
+                    forces[i] += sumForcesDouble(positions[i], velocities[i], time, std::integral_constant<size_t, 0>());
+                }
+            }
+
+            /// @brief Union of the dependencies of the components
+            unsigned getDependencies() const override {
+                return collectDependencies(std::integral_constant<size_t, 0>());
+            }
     };
 
+    /**
+     * @brief Build a force from its description
+     *
+     * @return nullptr for Unknown or interaction types. Composite returns an empty CompositeForce, the caller adds the components.
+     */
+    std::unique_ptr<Force> createForce(const ForceDescriptor& descriptor);
+
+    /// @brief Build a StaticCompositeForce deducing the component types from the arguments
+    template<typename... Forces>
+    StaticCompositeForce<Forces...> makeStaticCompositeForce(const Forces&... components) {
+        return StaticCompositeForce<Forces...>(components...);
+    }
+
     // Particle class representing a physical particle in the simulation
     class Particle {
         private:
             glm::vec3 position;
             glm::vec3 velocity;
             float mass;
+            float stepSize;
+            glm::vec3 acceleration;
+            bool accelerationValid;
         public:
             CompositeForce appliedForces;
 
@@ -158,9 +442,170 @@ namespace Physics {
             glm::vec3 getVelocity();
             float getMass();
 
+            /// @brief Step size suggested by the last adaptive propagation, 0 if none happened yet
+            float getStepSize();
+
             void setPosition(const glm::vec3& pos);
             void setVelocity(const glm::vec3& vel);
             void setMass(float m);
+            void setStepSize(float step);
+
+            /**
+             * @brief Acceleration cached by the Verlet methods at the end of the last propagation
+             *
+             * The cache is dropped whenever the state or the mass are changed through the setters.
+             * Call invalidateAcceleration after changing appliedForces.
+             */
+            bool hasAcceleration();
+            glm::vec3 getAcceleration();
+            void setAcceleration(const glm::vec3& acc);
+            void invalidateAcceleration();
+    };
+
+    /**
+     * @class ParticleSystem
+     * @brief Collection of particles stored as a structure of arrays
+     * 
+     * Positions, velocities, masses, charges and radii are kept in separate contiguous arrays, indexed by particle,
+     * so that the batch propagation methods can sweep through the whole system in a single call
+     * instead of copying the state of every particle in and out of a Particle object.
+     * 
+     * Intended usage:
+     * The forces in appliedForces act on every particle of the system, so a system should group particles
+     * which are subject to the same forces.
+     * Mutual forces between the particles (e.g. N-body gravity) are modelled by the interactions added with addInteraction.
+     * Fields added with addField act on every particle according to its own mass and charge,
+     * so particles with different properties can share them.
+     *
+     * Every particle also has an id, its index when it was added. reorder permutes the arrays (e.g. along the Morton curve,
+     * see reorderByMortonKey) while the ids follow the particles, so the outputs written in id order and the handles kept
+     * by the user stay valid: getIndex finds the current index of an id.
+     */
+    class ParticleSystem {
+        private:
+            std::vector<glm::vec3> positions;
+            std::vector<glm::vec3> velocities;
+            std::vector<float> masses;
+            std::vector<float> charges;
+            std::vector<float> radii;
+            std::vector<float> stepSizes;
+            std::vector<glm::vec3> accelerations;
+            bool accelerationsValid;
+            std::vector<uint32_t> ids;     // id of the particle at every index
+            std::vector<uint32_t> indices; // index of the particle with every id
+            bool identityOrder;
+            std::vector<const Interaction*> interactions;
+            std::vector<const Field*> fields;
+        public:
+            CompositeForce appliedForces;
+
+            ParticleSystem();
+
+            /// @brief Add a particle to the system, a radius of 0 makes it a point which never collides
+            /// @return index of the new particle
+            size_t addParticle(float m, const glm::vec3& pos = glm::vec3(0.0f), const glm::vec3& vel = glm::vec3(0.0f), float q = 0.0f, float r = 0.0f);
+
+            /// @brief Reserve memory for a given number of particles
+            void reserve(size_t count);
+
+            /// @brief Remove all the particles from the system
+            void clear();
+
+            /**
+             * @brief Change the number of particles, the new ones have a zeroed state, mass, charge and radius
+             *
+             * The new particles get the next ids. When shrinking, the ids of the particles kept are renumbered
+             * in the same relative order, so the ids are always the numbers from 0 to size() - 1.
+             */
+            void resize(size_t count);
+
+            size_t size() const;
+
+            glm::vec3 getPosition(size_t index) const;
+            glm::vec3 getVelocity(size_t index) const;
+            float getMass(size_t index) const;
+            float getCharge(size_t index) const;
+            float getRadius(size_t index) const;
+
+            void setPosition(size_t index, const glm::vec3& pos);
+            void setVelocity(size_t index, const glm::vec3& vel);
+            void setMass(size_t index, float m);
+            void setCharge(size_t index, float q);
+            void setRadius(size_t index, float r);
+
+            /// @brief Direct access to the contiguous state arrays, size() elements each
+            glm::vec3* getPositions();
+            glm::vec3* getVelocities();
+            float* getMasses();
+            float* getCharges();
+            const glm::vec3* getPositions() const;
+            const glm::vec3* getVelocities() const;
+            const float* getMasses() const;
+            const float* getCharges() const;
+
+            /// @brief Radii of the particles, only used by the collisions
+            float* getRadii();
+            const float* getRadii() const;
+
+            /// @brief Step sizes suggested by the last adaptive propagation of each particle, 0 if none happened yet
+            float* getStepSizes();
+            const float* getStepSizes() const;
+
+            /// @brief Id of the particle at an index, and index of the particle with an id
+            uint32_t getId(size_t index) const;
+            size_t getIndex(uint32_t id) const;
+
+            /// @brief Ids of the particles in index order, and indices of the particles in id order, size() elements each
+            const uint32_t* getIds() const;
+            const uint32_t* getIndices() const;
+
+            /// @brief Whether every particle is at the index of its id, so that the arrays are already in id order
+            bool hasIdentityOrder() const;
+
+            /**
+             * @brief Move the particles to a new order, their ids follow them
+             *
+             * The cached accelerations are permuted too, so the Verlet methods keep them.
+             *
+             * @param order size() distinct indices: the particle at index order[i] moves to index i
+             */
+            void reorder(const uint32_t* order);
+
+            /**
+             * @brief Assign the ids of the particles, e.g. to restore those of a saved system
+             *
+             * @param particleIds id of the particle at every index, size() elements
+             * @return false, leaving the ids unchanged, if particleIds is not a permutation of 0 to size() - 1
+             */
+            bool assignIds(const uint32_t* particleIds);
+
+            /**
+             * @brief Accelerations cached by the Verlet methods at the end of the last propagation
+             *
+             * The cache is dropped by the setters, by the changes to the particles or the interactions and by the other
+             * propagation methods. Call invalidateAccelerations after changing appliedForces or writing to the state arrays directly.
+             */
+            bool hasAccelerations() const;
+            glm::vec3* getAccelerations();
+            const glm::vec3* getAccelerations() const;
+            void validateAccelerations();
+            void invalidateAccelerations();
+
+            /// @brief Add a mutual interaction between the particles of the system
+            void addInteraction(const Interaction& interaction);
+
+            /// @brief Remove a mutual interaction from the system
+            void removeInteraction(const Interaction& interaction);
+
+            const std::vector<const Interaction*>& getInteractions() const;
+
+            /// @brief Add a field acting on every particle according to its mass and charge
+            void addField(const Field& field);
+
+            /// @brief Remove a field from the system
+            void removeField(const Field& field);
+
+            const std::vector<const Field*>& getFields() const;
     };
 }
 
@@ -186,6 +631,8 @@ namespace Propagation {
      */
     generalizedVector explicitEuler(Physics::Force* f, const generalizedVector& state, const float mass, const float currentTime, const float deltaTime);
     void explicitEuler(Physics::Particle& particle, const float currentTime, const float deltaTime);
+    void explicitEuler(Physics::ParticleSystem& system, const float currentTime, const float deltaTime);
+    void explicitEuler(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool);
     
     /**
      * @brief Propagates the state of a particle using the 4th-order Runge-Kutta method.
@@ -199,6 +646,43 @@ namespace Propagation {
      */
     generalizedVector rungeKutta4(Physics::Force* f, const generalizedVector& state, const float mass, const float currentTime, const float deltaTime);
     void rungeKutta4(Physics::Particle& particle, const float currentTime, const float deltaTime);
+
+    /**
+     * @class RK4Workspace
+     * @brief Scratch memory for the batch Runge-Kutta 4 method
+     * 
+     * Holds the intermediate stage state of every particle of a system.
+     * A workspace can be reused across steps to avoid reallocating it, but it must not be shared by concurrent calls:
+     * use one workspace per thread.
+     */
+    class RK4Workspace {
+        public:
+            std::vector<glm::vec3> stagePositions;
+            std::vector<glm::vec3> stageVelocities;
+            std::vector<glm::vec3> forces;
+            std::vector<glm::vec3> sumKx;
+            std::vector<glm::vec3> sumKv;
+
+            /// @brief Resize the buffers to hold the given number of particles, never releasing memory
+            void resize(size_t count);
+    };
+
+    /**
+     * @brief Propagates the state of a particle system using the 4th-order Runge-Kutta method.
+     * 
+     * @param system particle system to propagate
+     * @param currentTime current time
+     * @param deltaTime time step for propagation
+     * @param workspace scratch memory for the intermediate stages
+     * 
+     * @note The overloads without workspace use a per-thread workspace, so they are safe to call concurrently on different systems
+     * @note The overloads taking a pool split the particles across its threads
+     */
+    void rungeKutta4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, RK4Workspace& workspace);
+    void rungeKutta4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime);
+    void rungeKutta4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, RK4Workspace& workspace, Parallel::ThreadPool& pool);
+    void rungeKutta4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool);
+
     /**
      * @brief Propagates the state of a particle using the symplectic Euler method.
      * 
@@ -211,6 +695,130 @@ namespace Propagation {
      */
     generalizedVector simplecticEuler(Physics::Force* f, const generalizedVector& state, const float mass, const float currentTime, const float deltaTime);
     void simplecticEuler(Physics::Particle& particle, const float currentTime, const float deltaTime);
+    void simplecticEuler(Physics::ParticleSystem& system, const float currentTime, const float deltaTime);
+    void simplecticEuler(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool);
+
+    /**
+     * @brief Propagates the state of a particle using the velocity Verlet method.
+     * 
+     * Second order and symplectic, it needs a single force evaluation per step because the acceleration
+     * at the end of a step is the one at the beginning of the next. The force is evaluated with the half step velocity,
+     * so velocity dependent forces are only approximated to first order.
+     * 
+     * @param f force acting on the particle
+     * @param state current state of the particle
+     * @param acceleration acceleration in the current state, replaced with the one in the new state
+     * @param mass mass of the particle
+     * @param currentTime current time
+     * @param deltaTime time step for propagation
+     * @return generalizedVector new state of the particle after propagation
+     * 
+     * @note The Particle and ParticleSystem overloads cache the acceleration, computing it only on their first call
+     */
+    generalizedVector velocityVerlet(Physics::Force* f, const generalizedVector& state, glm::vec3& acceleration, const float mass, const float currentTime, const float deltaTime);
+    void velocityVerlet(Physics::Particle& particle, const float currentTime, const float deltaTime);
+    void velocityVerlet(Physics::ParticleSystem& system, const float currentTime, const float deltaTime);
+    void velocityVerlet(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool);
+
+    /**
+     * @brief Propagates the state of a particle using the 4th-order Yoshida method.
+     * 
+     * Composition of three velocity Verlet steps with weights w1, w0, w1 (w0 negative), which cancels the 3rd order error
+     * while staying symplectic: the energy error stays bounded over long runs.
+     * A step costs 3 force evaluations, reusing the cached acceleration like velocityVerlet.
+     * 
+     * @param f force acting on the particle
+     * @param state current state of the particle
+     * @param acceleration acceleration in the current state, replaced with the one in the new state
+     * @param mass mass of the particle
+     * @param currentTime current time
+     * @param deltaTime time step for propagation
+     * @return generalizedVector new state of the particle after propagation
+     */
+    generalizedVector yoshida4(Physics::Force* f, const generalizedVector& state, glm::vec3& acceleration, const float mass, const float currentTime, const float deltaTime);
+    void yoshida4(Physics::Particle& particle, const float currentTime, const float deltaTime);
+    void yoshida4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime);
+    void yoshida4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool);
+
+    /// @brief Error control parameters of the adaptive methods
+    class AdaptiveOptions {
+        public:
+            float absoluteTolerance;
+            float relativeTolerance;
+            float minStep; // steps are never shortened below this size, even if the error is too large
+            float maxStep; // 0 means bounded only by the propagation interval
+            float safety;  // factor applied to the optimal step size
+
+            AdaptiveOptions(float absTol = 1e-6f, float relTol = 1e-6f, float minStepSize = 1e-7f, float maxStepSize = 0.0f, float safetyFactor = 0.9f);
+    };
+
+    /// @brief Counters of the work done by the adaptive methods, accumulated across calls
+    class AdaptiveStatistics {
+        public:
+            unsigned long long acceptedSteps;
+            unsigned long long rejectedSteps;
+            unsigned long long forceEvaluations;
+
+            AdaptiveStatistics();
+    };
+
+    /**
+     * @brief Propagates the state of a particle over an interval using the adaptive Dormand-Prince 5(4) method.
+     * 
+     * The interval is covered by as many substeps as the error control requires: the difference between the embedded
+     * 4th and 5th order solutions is kept within absoluteTolerance + relativeTolerance * |state| for each component.
+     * The last stage of an accepted step is reused as the first one of the next step, so a step costs 6 force evaluations.
+     * 
+     * @param f force acting on the particle
+     * @param state current state of the particle
+     * @param mass mass of the particle
+     * @param currentTime current time
+     * @param deltaTime length of the interval to propagate over
+     * @param stepSize initial substep size, updated with the size suggested for the next call (0 starts from deltaTime)
+     * @param options error control parameters
+     * @param statistics optional counters of the work done
+     * @return generalizedVector new state of the particle at currentTime + deltaTime
+     */
+    generalizedVector dormandPrince45(Physics::Force* f, const generalizedVector& state, const float mass, const float currentTime, const float deltaTime,
+        float& stepSize, const AdaptiveOptions& options = AdaptiveOptions(), AdaptiveStatistics* statistics = nullptr);
+    void dormandPrince45(Physics::Particle& particle, const float currentTime, const float deltaTime, const AdaptiveOptions& options = AdaptiveOptions(), AdaptiveStatistics* statistics = nullptr);
+
+    /**
+     * @brief Scratch memory for the batch Dormand-Prince method of coupled systems
+     * 
+     * Only needed by systems with interactions, see dormandPrince45.
+     */
+    class DormandPrinceWorkspace {
+        public:
+            std::vector<glm::vec3> kx[7];
+            std::vector<glm::vec3> kv[7];
+            std::vector<glm::vec3> stagePositions;
+            std::vector<glm::vec3> stageVelocities;
+            std::vector<float> errors;
+
+            /// @brief Resize the buffers to hold the given number of particles, never releasing memory
+            void resize(size_t count);
+    };
+
+    /**
+     * @brief Propagates the state of a particle system over an interval using the adaptive Dormand-Prince 5(4) method.
+     * 
+     * Without interactions every particle is propagated with its own step size, stored in the system,
+     * so slow particles take few large steps regardless of the fast ones.
+     * With interactions the particles are coupled and share a single step size, controlled by the largest error.
+     * 
+     * @note The overloads without workspace use a per-thread workspace
+     */
+    void dormandPrince45(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, DormandPrinceWorkspace& workspace,
+        const AdaptiveOptions& options = AdaptiveOptions(), AdaptiveStatistics* statistics = nullptr, Parallel::ThreadPool* pool = nullptr);
+    void dormandPrince45(Physics::ParticleSystem& system, const float currentTime, const float deltaTime,
+        const AdaptiveOptions& options = AdaptiveOptions(), AdaptiveStatistics* statistics = nullptr, Parallel::ThreadPool* pool = nullptr);
+
+    /// @brief Propagation method of a particle system, selected by name on the command line and in scenario files
+    typedef void (*SystemIntegrator)(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool);
+
+    /// @brief Method named euler, symplectic, rk4, verlet, yoshida4 or dp45 (default adaptive options), nullptr for other names
+    SystemIntegrator findSystemIntegrator(const std::string& name);
 }
 
 #endif
\ No newline at end of file
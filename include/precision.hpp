@@ -0,0 +1,169 @@
+#ifndef PRECISION_HPP
+#define PRECISION_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "physics.hpp"
+
+namespace Parallel {
+    class ThreadPool;
+}
+
+namespace Physics {
+
+    /**
+     * Precision policies of a PrecisionSystem
+     *
+     * State is the scalar of the positions, velocities and accelerations, Accumulator the scalar the forces are evaluated and summed in.
+     * A float accumulator evaluates the forces with their batch computeForces methods, on the state rounded to float,
+     * a double one with computeForcesDouble.
+     */
+    struct SinglePrecision {
+        typedef float State;
+        typedef float Accumulator;
+    };
+
+    struct DoublePrecision {
+        typedef double State;
+        typedef double Accumulator;
+    };
+
+    /// @brief Double precision state with single precision forces: the small increments of long runs are not lost, the forces keep their float speed
+    struct MixedPrecision {
+        typedef double State;
+        typedef float Accumulator;
+    };
+
+    /// @brief Precision selected at runtime
+    enum class Precision { Single, Double, Mixed };
+
+    /// @brief Precision named single, double or mixed, false for other names
+    bool findPrecision(const std::string& name, Precision& precision);
+
+    const char* getPrecisionName(Precision precision);
+
+    /**
+     * @class PrecisionSystem
+     * @brief State of a ParticleSystem kept in the precision of a policy
+     *
+     * The masses, charges, applied forces, fields and interactions are read from the system, the positions and velocities
+     * are copied in the State scalar, so the system can be propagated in double precision and rounded back with store
+     * whenever its float state is needed (output, diagnostics, drawing).
+     *
+     * The interactions are evaluated in double precision only by a DoublePrecision system, for an NBodyInteraction whose method resolves
+     * to the direct sum (Direct, or Automatic below its direct threshold); the others, Barnes-Hut included, are evaluated
+     * on the state rounded to float.
+     *
+     * Intended usage:
+     * Build it from a filled system, propagate it with the Propagation methods taking a PrecisionSystem
+     * and call store before reading the system. Call load after changing the system, e.g. after resolving collisions.
+     */
+    template <typename Policy>
+    class PrecisionSystem {
+        public:
+            typedef typename Policy::State Real;
+            typedef glm::vec<3, Real> Vector;
+
+        private:
+            ParticleSystem* system;
+            std::vector<Vector> positions;
+            std::vector<Vector> velocities;
+            std::vector<Vector> accelerations;
+            bool accelerationsValid;
+
+        public:
+            /// @brief Copy the state of a system, which must outlive the precision system
+            explicit PrecisionSystem(ParticleSystem& system);
+
+            ParticleSystem& getSystem() const;
+            size_t size() const;
+
+            /// @brief Copy the state of the system again, e.g. after it was changed
+            void load();
+
+            /// @brief Round the state into the system
+            void store() const;
+
+            Vector getPosition(size_t index) const;
+            Vector getVelocity(size_t index) const;
+            void setPosition(size_t index, const Vector& pos);
+            void setVelocity(size_t index, const Vector& vel);
+
+            /// @brief Direct access to the contiguous state arrays, size() elements each
+            Vector* getPositions();
+            Vector* getVelocities();
+            const Vector* getPositions() const;
+            const Vector* getVelocities() const;
+
+            /// @brief Accelerations cached by the Verlet methods, see ParticleSystem::hasAccelerations
+            bool hasAccelerations() const;
+            Vector* getAccelerations();
+            void validateAccelerations();
+            void invalidateAccelerations();
+    };
+
+    /**
+     * @brief Evaluate the applied forces, the fields and the interactions acting on every particle of a PrecisionSystem in the given state
+     *
+     * @param forces output array of size() elements, overwritten
+     */
+    template <typename Policy>
+    void evaluatePrecisionForces(const PrecisionSystem<Policy>& system, const typename PrecisionSystem<Policy>::Vector* positions,
+        const typename PrecisionSystem<Policy>::Vector* velocities, double time, glm::vec<3, typename Policy::Accumulator>* forces, Parallel::ThreadPool* pool = nullptr);
+}
+
+namespace Propagation {
+
+    /**
+     * Fixed step methods of a PrecisionSystem, with the same schemes as the ParticleSystem methods of the same names.
+     * The time and the time step are in double precision; every intermediate value is in the State scalar of the policy.
+     * They are instantiated for SinglePrecision, DoublePrecision and MixedPrecision.
+     */
+    template <typename Policy>
+    void explicitEuler(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool = nullptr);
+
+    template <typename Policy>
+    void simplecticEuler(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool = nullptr);
+
+    template <typename Policy>
+    void velocityVerlet(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool = nullptr);
+
+    template <typename Policy>
+    void yoshida4(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool = nullptr);
+
+    /// @note Uses a per-thread workspace
+    template <typename Policy>
+    void rungeKutta4(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool = nullptr);
+
+    /**
+     * @class PrecisionStepper
+     * @brief Propagation of a ParticleSystem in a precision and with a method selected at runtime, for the runners
+     */
+    class PrecisionStepper {
+        public:
+            virtual ~PrecisionStepper() = default;
+
+            virtual Physics::Precision getPrecision() const = 0;
+
+            /// @brief Take a step of the state held by the stepper
+            virtual void step(double currentTime, double deltaTime, Parallel::ThreadPool* pool = nullptr) = 0;
+
+            /// @brief Copy the state of the system into the stepper, see PrecisionSystem::load
+            virtual void load() = 0;
+
+            /// @brief Round the state of the stepper into the system
+            virtual void store() const = 0;
+    };
+
+    /**
+     * @brief Stepper propagating a system with the method named euler, symplectic, verlet, yoshida4 or rk4
+     *
+     * @return nullptr for other names
+     */
+    std::unique_ptr<PrecisionStepper> createPrecisionStepper(Physics::Precision precision, const std::string& integrator, Physics::ParticleSystem& system);
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * Instrumentation macros, compiled out unless DYNAMICSSIM_PROFILE is defined (CMake option DYNAMICSSIM_ENABLE_PROFILER)
+ *
+ * DSIM_PROFILE_SCOPE(name)          time the enclosing scope
+ * DSIM_PROFILE_COUNT(name, value)   add value to a counter of the calling thread
+ * DSIM_PROFILE_SAMPLE(name)         record the counter of the calling thread and reset it, e.g. once per step
+ * DSIM_PROFILE_COUNTER(name, value) record a value directly
+ * DSIM_PROFILE_THREAD_NAME(name)    name the calling thread in the trace
+ *
+ * The names must be string literals, or strings outliving the profiler.
+ * When disabled the macros expand to nothing and their arguments are not evaluated.
+ */
+#ifdef DYNAMICSSIM_PROFILE
+#define DSIM_PROFILE_CONCAT_(a, b) a##b
+#define DSIM_PROFILE_CONCAT(a, b) DSIM_PROFILE_CONCAT_(a, b)
+#define DSIM_PROFILE_SCOPE(name) ::Profiling::ScopedTimer DSIM_PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define DSIM_PROFILE_COUNT(name, value) ::Profiling::addCount(name, (double)(value))
+#define DSIM_PROFILE_SAMPLE(name) ::Profiling::sampleCount(name)
+#define DSIM_PROFILE_COUNTER(name, value) ::Profiling::recordCounter(name, (double)(value))
+#define DSIM_PROFILE_THREAD_NAME(name) ::Profiling::setThreadName(name)
+#else
+#define DSIM_PROFILE_SCOPE(name) ((void)0)
+#define DSIM_PROFILE_COUNT(name, value) ((void)0)
+#define DSIM_PROFILE_SAMPLE(name) ((void)0)
+#define DSIM_PROFILE_COUNTER(name, value) ((void)0)
+#define DSIM_PROFILE_THREAD_NAME(name) ((void)0)
+#endif
+
+namespace Profiling {
+
+    /// @brief Whether the instrumentation was compiled in
+    bool isEnabled();
+
+    /// @brief Nanoseconds since the start of the profiler, on a monotonic clock
+    uint64_t now();
+
+    /**
+     * @class ScopedTimer
+     * @brief Records the time between its construction and its destruction as an event of the calling thread
+     *
+     * Every thread records into its own log, so the threads never wait for each other;
+     * the log also keeps the total time of each name, which stays exact after the event buffer is full.
+     */
+    class ScopedTimer {
+        private:
+            const char* name;
+            uint64_t start;
+        public:
+            explicit ScopedTimer(const char* name);
+            ~ScopedTimer();
+
+            ScopedTimer(const ScopedTimer&) = delete;
+            ScopedTimer& operator=(const ScopedTimer&) = delete;
+    };
+
+    void addCount(const char* name, double value);
+    void sampleCount(const char* name);
+    void recordCounter(const char* name, double value);
+    void setThreadName(const std::string& name);
+
+    /**
+     * @brief Write the events of every thread in the Chrome trace event format, for chrome://tracing or Perfetto
+     *
+     * @note Call it while no instrumented code is running, e.g. after the worker threads are idle
+     * @return false if the file could not be written
+     */
+    bool writeChromeTrace(const std::string& path);
+
+    /// @brief Write the number of calls, total and mean time of every scope, per thread
+    void writeSummary(std::ostream& out);
+
+    /// @brief Drop the recorded events, totals and counters of every thread
+    void reset();
+}
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef SCENARIO_HPP
+#define SCENARIO_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "field.hpp"
+#include "interaction.hpp"
+#include "physics.hpp"
+
+/**
+ * Scenario file layout
+ *
+ * A UTF-8 text part, one statement per line, '#' starting a comment:
+ *
+ *   dynamicssim-scenario 1                      first line, format version
+ *   integrator <name>                           e.g. rk4 or verlet, see the headless runner
+ *   precision <name>                            single, double or mixed, see include/precision.hpp
+ *   dt <seconds>
+ *   duration <seconds>
+ *   force <type> <parameters...>                applied to every particle
+ *   field <type> <parameters...>                acting on every particle according to its mass and charge
+ *   interaction <type> <parameters...>          mutual interaction between the particles
+ *   particle <m> <x> <y> <z> <vx> <vy> <vz> [q] [r]
+ *   bulk <count>                                last statement, followed by the binary bulk section
+ *
+ * The types are named in SCENARIO_TYPES and take the parameters of their ForceDescriptor in the same order;
+ * trailing parameters can be omitted and keep the defaults of the constructor.
+ *
+ * The binary bulk section starts at the first multiple of SCENARIO_BULK_ALIGNMENT after the newline ending the bulk statement
+ * and holds count particles as arrays in native byte order (little-endian on every supported platform):
+ * positions (vec3), velocities (vec3), masses (float), charges (float), radii (float).
+ * It is mapped in memory and copied into the system without parsing, after the particles of the text part.
+ */
+
+namespace Storage {
+
+    static const uint32_t SCENARIO_VERSION = 1;
+    static const uint64_t SCENARIO_BULK_ALIGNMENT = 64;
+
+    /// @brief Name used in scenario files for each force, field and interaction type
+    struct ScenarioType {
+        enum Category { Force, Field, Interaction };
+
+        const char* name;
+        Category category;
+        uint32_t type; // ForceDescriptor::Type
+    };
+
+    extern const ScenarioType SCENARIO_TYPES[];
+    extern const size_t SCENARIO_TYPE_COUNT;
+
+    /// @brief Type of a category with a given name, null if there is none
+    const ScenarioType* findScenarioType(const std::string& name, ScenarioType::Category category);
+
+    /// @brief Descriptor of a type holding the defaults of its constructor, for the parameters a statement omits; 0 for the arguments without a default
+    Physics::ForceDescriptor getDefaultDescriptor(uint32_t type);
+
+    /// @brief Run settings of a scenario, empty or 0 when the file does not set them
+    class ScenarioSettings {
+        public:
+            std::string integrator;
+            std::string precision;
+            float deltaTime;
+            double duration;
+
+            ScenarioSettings();
+    };
+
+    /**
+     * @class Scenario
+     * @brief Initial conditions loaded from a scenario file, owning the forces, fields and interactions they use
+     *
+     * Intended usage:
+     * Keep the scenario alive while the system it was loaded into is simulated, the system refers to its objects.
+     */
+    class Scenario {
+        public:
+            ScenarioSettings settings;
+            std::vector<std::unique_ptr<Physics::Force>> forces;
+            std::vector<std::unique_ptr<Physics::Field>> fields;
+            std::vector<std::unique_ptr<Physics::Interaction>> interactions;
+
+            /**
+             * @brief Replace the particles, applied forces, fields and interactions of a system with the ones of a file
+             *
+             * @return false if the file cannot be read or is malformed, leaving the system unchanged; see getError
+             */
+            bool load(const std::string& path, Physics::ParticleSystem& system);
+
+            /// @brief Description of the last failure of load, with the line it happened on
+            const std::string& getError() const;
+
+        private:
+            std::string error;
+    };
+
+    /**
+     * @brief Write a system and its settings as a scenario, the particles going to the binary bulk section
+     *
+     * @return false if the file cannot be written or a force, field or interaction cannot be described
+     */
+    bool saveScenario(const std::string& path, const ScenarioSettings& settings, const Physics::ParticleSystem& system);
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef SPATIALHASH_HPP
+#define SPATIALHASH_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace Physics {
+
+    /**
+     * @class SpatialHash
+     * @brief Uniform grid of cells for finding the neighbours of a point in O(1)
+     *
+     * The points are sorted by cell with a counting sort, so a rebuild is O(N) and reuses the arrays of the previous one:
+     * rebuilding at every step of a simulation does not allocate once the number of points is stable.
+     * The sort is stable, so the neighbours are always visited in the same order for the same input.
+     *
+     * When the bounding box of the points holds a few cells per point, every cell gets its own bucket in row order,
+     * so the three cells of a row around a point are a single contiguous range. Sparse or far-flung sets hash the cells
+     * into about two buckets per point instead, and every point remembers its cell to tell apart the cells sharing a bucket.
+     *
+     * Intended usage:
+     * Build the grid with a cell size at least as large as the interaction cutoff, then visit the candidates around a point
+     * with forEachNeighbour and keep the ones within the cutoff.
+     */
+    class SpatialHash {
+        private:
+            float cellSize;
+            float inverseCellSize;
+
+            bool dense;           // one bucket per cell of the bounding box
+            int minimum[3];       // first cell of the bounding box
+            int extent[3];        // cells of the bounding box along each axis
+            size_t bucketMask;    // hashed buckets only
+
+            std::vector<unsigned> bucketStarts;    // first entry of each bucket, bucketCount + 1 elements
+            std::vector<unsigned> cursors;
+            std::vector<unsigned> particleBuckets; // bucket of each point
+            std::vector<unsigned> indices;         // points sorted by bucket
+            std::vector<glm::vec3> positions;      // sorted like indices
+            std::vector<uint64_t> cells;           // key of the cell of each point, sorted like indices, hashed buckets only
+
+            int cell(float coordinate) const {
+                return (int)std::floor(coordinate * inverseCellSize);
+            }
+
+            size_t hashBucket(int x, int y, int z) const {
+                // large primes spread the neighbouring cells over the table
+                unsigned hash = ((unsigned)x * 73856093u) ^ ((unsigned)y * 19349663u) ^ ((unsigned)z * 83492791u);
+                return hash & bucketMask;
+            }
+
+            size_t denseBucket(int x, int y, int z) const {
+                return (size_t)(x - minimum[0]) + (size_t)extent[0] * ((size_t)(y - minimum[1]) + (size_t)extent[1] * (size_t)(z - minimum[2]));
+            }
+
+            static uint64_t key(int x, int y, int z) {
+                // 21 bits per coordinate, cells farther than a million cells apart may alias
+                const uint64_t mask = (1u << 21) - 1;
+                return ((uint64_t)((unsigned)x & mask) << 42) | ((uint64_t)((unsigned)y & mask) << 21) | (uint64_t)((unsigned)z & mask);
+            }
+
+            template <typename Visitor>
+            void visitRange(unsigned begin, unsigned end, Visitor& visit) const {
+                for (unsigned entry = begin; entry < end; entry++) visit(indices[entry], positions[entry]);
+            }
+
+        public:
+            SpatialHash();
+
+            /**
+             * @brief Sort a set of points in the grid, replacing the previous content
+             *
+             * @param points positions of the points
+             * @param count number of points
+             * @param size edge of a cell
+             */
+            void build(const glm::vec3* points, size_t count, float size);
+
+            /**
+             * @brief Visit the points in the 27 cells around a point: all the ones within the cell size, and some farther ones
+             *
+             * @param point center of the search
+             * @param visit called as visit(index, position) for every candidate, index being the position in the input of build
+             */
+            template <typename Visitor>
+            void forEachNeighbour(const glm::vec3& point, Visitor visit) const {
+                if (indices.empty()) return;
+                const int x = cell(point.x), y = cell(point.y), z = cell(point.z);
+
+                if (dense) {
+                    const int first = std::max(x - 1, minimum[0]), last = std::min(x + 1, minimum[0] + extent[0] - 1);
+                    if (first > last) return;
+
+                    for (int cz = std::max(z - 1, minimum[2]); cz <= std::min(z + 1, minimum[2] + extent[2] - 1); cz++) {
+                        for (int cy = std::max(y - 1, minimum[1]); cy <= std::min(y + 1, minimum[1] + extent[1] - 1); cy++) {
+                            // the cells of a row are consecutive buckets
+                            visitRange(bucketStarts[denseBucket(first, cy, cz)], bucketStarts[denseBucket(last, cy, cz) + 1], visit);
+                        }
+                    }
+                    return;
+                }
+
+                for (int dz = -1; dz <= 1; dz++) {
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            const size_t b = hashBucket(x + dx, y + dy, z + dz);
+                            const uint64_t target = key(x + dx, y + dy, z + dz);
+
+                            // the bucket may also hold other cells, which are visited on their own turn
+                            for (unsigned entry = bucketStarts[b]; entry < bucketStarts[b + 1]; entry++) {
+                                if (cells[entry] == target) visit(indices[entry], positions[entry]);
+                            }
+                        }
+                    }
+                }
+            }
+
+            float getCellSize() const;
+            size_t size() const;
+
+            /// @brief Indices of the points sorted by bucket, iterating in this order keeps the neighbours close in memory
+            const std::vector<unsigned>& getIndices() const;
+    };
+}
+
+#endif
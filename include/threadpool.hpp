@@ -0,0 +1,92 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+
+    /**
+     * @class ThreadPool
+     * @brief Persistent pool of worker threads executing parallel loops
+     *
+     * The workers are created once and reused by every parallelFor call, so that the fixed-timestep loop
+     * does not pay for thread creation at each substep.
+     * Each call acts as a barrier: it returns only when the whole range has been processed.
+     *
+     * Scheduling:
+     * The range is split in one contiguous slice per thread, which every thread consumes in chunks of grainSize elements.
+     * A thread that runs out of work steals chunks from the slices of the others, which balances uneven force costs.
+     * Idle workers spin for a short while before going to sleep, keeping the dispatch latency between substeps low.
+     *
+     * Intended usage:
+     * The pool is not reentrant: tasks must not call parallelFor on the pool that is running them.
+     */
+    class ThreadPool {
+        public:
+            /// @brief Task processing the elements in [begin, end)
+            typedef std::function<void(size_t begin, size_t end)> RangeTask;
+
+            /**
+             * @brief Constructor for ThreadPool
+             *
+             * @param threadCount total number of threads taking part in the loops, including the calling thread.
+             * 0 selects the number of hardware threads.
+             */
+            explicit ThreadPool(unsigned threadCount = 0);
+            ~ThreadPool();
+
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            /// @brief Number of threads taking part in the loops, including the calling thread
+            unsigned getThreadCount() const;
+
+            /**
+             * @brief Run task over [0, count) split across the pool, blocking until every element is processed
+             *
+             * @param count number of elements
+             * @param grainSize number of elements claimed at once by a thread
+             * @param task function processing a sub-range
+             */
+            void parallelFor(size_t count, size_t grainSize, const RangeTask& task);
+
+        private:
+            // Slice of the range owned by a thread, padded to avoid false sharing between threads
+            struct Slice {
+                std::atomic<size_t> next;
+                size_t end;
+                char padding[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+            };
+
+            std::vector<std::thread> workers;
+            std::unique_ptr<Slice[]> slices;
+            unsigned threadCount;
+
+            const RangeTask* task;
+            size_t grainSize;
+
+            std::atomic<unsigned> generation;
+            std::atomic<unsigned> pending;
+            std::atomic<unsigned> sleeping;
+            std::atomic<bool> stopping;
+
+            std::mutex wakeMutex;
+            std::condition_variable wakeUp;
+            std::mutex dispatchMutex;
+
+            void workerLoop(unsigned index);
+            void runChunks(unsigned index);
+    };
+
+    /// @brief Run task over [0, count) on the pool, or on the calling thread when pool is null
+    void parallelFor(ThreadPool* pool, size_t count, size_t grainSize, const ThreadPool::RangeTask& task);
+}
+
+#endif
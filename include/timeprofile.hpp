@@ -0,0 +1,131 @@
+#ifndef TIMEPROFILE_HPP
+#define TIMEPROFILE_HPP
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "physics.hpp"
+
+namespace Physics {
+
+    /**
+     * @class TimeProfile
+     * @brief Scalar function of time, either sinusoidal or tabulated
+     *
+     * A tabulated profile interpolates linearly between samples, so an expensive function of time can be
+     * sampled once with tabulate and looked up in constant time afterwards. Outside the table the profile
+     * holds its first and last values, or repeats the table if it is periodic.
+     *
+     * Intended usage:
+     * Time dependent forces evaluate their profile once per batch in computeForces, so the time dependence costs
+     * a lookup per integrator stage and batch instead of one per particle.
+     */
+    class TimeProfile {
+        public:
+            enum Type { Sinusoidal, Tabulated };
+
+        private:
+            Type type;
+            float amplitude;
+            float angularFrequency;
+            float phase;
+            float offset;
+            std::vector<float> times;   // increasing sample times, empty when evenly spaced
+            std::vector<float> values;
+            float start;
+            float interval;             // spacing of evenly spaced samples
+            bool periodic;
+
+        public:
+            /// @brief Constant profile
+            explicit TimeProfile(float value = 1.0f);
+
+            /// @brief offset + amplitude * sin(angularFrequency * t + phase)
+            static TimeProfile sinusoidal(float amplitude, float angularFrequency, float phase = 0.0f, float offset = 0.0f);
+
+            /**
+             * @brief Evenly spaced samples, values[i] being the value at start + i * interval
+             *
+             * @param periodic repeat the table with period values.size() * interval, the last sample interpolating towards the first
+             */
+            static TimeProfile tabulated(const std::vector<float>& values, float start, float interval, bool periodic = false);
+
+            /// @brief Piecewise linear profile through the points (times[i], values[i]), times increasing
+            static TimeProfile piecewiseLinear(const std::vector<float>& times, const std::vector<float>& values, bool periodic = false);
+
+            /// @brief Sample a function of time at count evenly spaced times in [start, end]
+            template <typename Function>
+            static TimeProfile tabulate(Function function, float start, float end, size_t count, bool periodic = false) {
+                std::vector<float> samples(count);
+                const float interval = count > 1 ? (end - start) / (float)(count - 1) : 0.0f;
+                for (size_t i = 0; i < count; i++) samples[i] = (float)function(start + i * interval);
+                return tabulated(samples, start, interval, periodic);
+            }
+
+            /// @brief Value of the profile at a given time, taken in double precision so that late times keep their resolution
+            float evaluate(double time) const;
+
+            Type getType() const;
+
+            /// @brief Parameters of a sinusoidal profile (a constant one has a zero amplitude)
+            float getAmplitude() const;
+            float getAngularFrequency() const;
+            float getPhase() const;
+            float getOffset() const;
+    };
+
+    /**
+     * @brief Uniform force along a direction, driven by a time profile: F(t) = profile(t) * direction
+     *
+     * Models e.g. a sinusoidally driven oscillator together with a HookeForce.
+     * Only the forces with a sinusoidal or constant profile can be described and saved.
+     */
+    class DrivingForce : public Force {
+        private:
+            glm::vec3 direction;
+            TimeProfile profile;
+        public:
+            DrivingForce(const glm::vec3& direction, const TimeProfile& profile);
+
+            const TimeProfile& getProfile() const;
+            void setProfile(const TimeProfile& p);
+
+            glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+
+            /// @brief Potential of the uniform force at the given time, -F(t) . position
+            float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const override;
+            unsigned getDependencies() const override;
+            ForceDescriptor describe() const override;
+    };
+
+    /**
+     * @brief Another force scaled by a time profile: F(x, v, t) = profile(t) * base(x, v, t)
+     *
+     * Turns any force into a time-varying one, e.g. a spring whose stiffness is modulated or a field switched on gradually.
+     * It refers to the base force, which must outlive it, and cannot be saved.
+     */
+    class ModulatedForce : public Force {
+        private:
+            const Force& base;
+            TimeProfile profile;
+        public:
+            ModulatedForce(const Force& base, const TimeProfile& profile);
+
+            const TimeProfile& getProfile() const;
+            void setProfile(const TimeProfile& p);
+
+            glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+            float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override;
+            void computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const override;
+            glm::dvec3 computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const override;
+            void computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const override;
+
+            /// @brief Dependencies of the base force, and the time
+            unsigned getDependencies() const override;
+    };
+}
+
+#endif
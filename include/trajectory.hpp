@@ -0,0 +1,178 @@
+#ifndef TRAJECTORY_HPP
+#define TRAJECTORY_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "mappedfile.hpp"
+#include "physics.hpp"
+
+namespace Storage {
+
+    /**
+     * Trajectory file layout, in the byte order of the machine which wrote it:
+     *   TrajectoryHeader
+     *   frameCount frames, each one made of a TrajectoryFrameHeader followed by the positions of the particles
+     *   and, when TRAJECTORY_VELOCITIES is set, by their velocities (3 floats per particle)
+     *
+     * Every frame has the same size, so a frame is located without scanning the file. The frame count is written
+     * when the file is closed: a file left unfinished by a crash has a frame count of 0, and its complete frames are still readable.
+     */
+    const char TRAJECTORY_MAGIC[8] = { 'D', 'S', 'T', 'R', 'A', 'J', '\0', '\0' };
+    const uint32_t TRAJECTORY_VERSION = 1;
+    const uint32_t TRAJECTORY_FRAME_MAGIC = 0x4D415246; // "FRAM"
+    const uint32_t TRAJECTORY_VELOCITIES = 1;
+
+    struct TrajectoryHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint64_t particleCount;
+        uint64_t frameCount;
+    };
+
+    struct TrajectoryFrameHeader {
+        uint32_t magic;
+        uint32_t flags;
+        uint64_t step;
+        double time;
+        uint64_t particleCount;
+    };
+
+    /**
+     * @class TrajectoryWriter
+     * @brief Streams the states of a particle system to a trajectory file from a background thread
+     *
+     * Recorded frames are copied into a chunk buffer, and full chunks are handed over to an I/O thread which writes them
+     * while the next chunk is being filled. The propagation loop only waits for the disk when every buffer is queued,
+     * which happens when the frames are produced faster than the disk can write them on average.
+     *
+     * Intended usage:
+     * Call record after every step of the propagation loop, the decimation selects the steps which are actually stored.
+     */
+    class TrajectoryWriter {
+        public:
+            TrajectoryWriter();
+            ~TrajectoryWriter();
+
+            TrajectoryWriter(const TrajectoryWriter&) = delete;
+            TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+            /**
+             * @brief Create a trajectory file, closing the previous one
+             *
+             * @param path file to create, replaced if it exists
+             * @param particleCount number of particles of every frame
+             * @param velocities whether to store the velocities alongside the positions
+             * @param decimation only the steps multiple of decimation are recorded
+             * @param chunkSize bytes of frames collected before handing them to the I/O thread, at least one frame
+             * @param bufferCount number of chunk buffers, 2 for double buffering
+             * @return false if the file cannot be created
+             */
+            bool open(const std::string& path, size_t particleCount, bool velocities = true, unsigned long long decimation = 1,
+                size_t chunkSize = 4 << 20, unsigned bufferCount = 2);
+
+            /**
+             * @brief Record the state of the particles after a step, if the step is selected by the decimation
+             *
+             * @param velocities ignored when the file does not store velocities
+             * @return false if the writer is not open or a write failed
+             */
+            bool record(unsigned long long step, double time, const glm::vec3* positions, const glm::vec3* velocities);
+
+            /// @brief Record the state of a system, in the order of the particle ids if the system was reordered
+            bool record(unsigned long long step, double time, const Physics::ParticleSystem& system);
+
+            /// @brief Write the pending frames and close the file
+            /// @return false if any write failed
+            bool close();
+
+            bool isOpen() const;
+            bool hasFailed() const;
+
+            /// @brief Number of frames recorded since the file was opened
+            unsigned long long getFrameCount() const;
+
+            /// @brief Seconds spent by record waiting for a free buffer
+            double getStallTime() const;
+
+        private:
+            struct Buffer {
+                std::vector<unsigned char> data;
+                size_t used;
+            };
+
+            std::FILE* file;
+            TrajectoryHeader header;
+            size_t frameSize;
+            unsigned long long decimation;
+            unsigned long long frameCount;
+            double stallTime;
+
+            std::vector<Buffer> buffers;
+            int current; // buffer being filled by record, -1 if none
+            std::deque<unsigned> freeBuffers;
+            std::deque<unsigned> pendingBuffers;
+
+            std::thread ioThread;
+            mutable std::mutex mutex;
+            std::condition_variable bufferFree;
+            std::condition_variable bufferPending;
+            bool stopping;
+            bool failed;
+
+            void ioLoop();
+            void submitCurrent();
+
+            /// @brief Claim a buffer, waiting for one if needed, and write the header of a frame: returns where its arrays go
+            unsigned char* beginFrame(unsigned long long step, double time);
+            void endFrame();
+    };
+
+    /**
+     * @class TrajectoryReader
+     * @brief Random access to the frames of a trajectory file through a memory mapping
+     *
+     * The state arrays point directly into the mapping, so no frame is copied
+     * and only the frames which are accessed are read from disk.
+     */
+    class TrajectoryReader {
+        public:
+            TrajectoryReader();
+
+            /// @return false if the file cannot be mapped or is not a valid trajectory
+            bool open(const std::string& path);
+            void close();
+
+            bool isOpen() const;
+            size_t getParticleCount() const;
+            size_t getFrameCount() const;
+            bool hasVelocities() const;
+
+            unsigned long long getStep(size_t frame) const;
+            double getTime(size_t frame) const;
+
+            /// @brief State arrays of a frame, getParticleCount() elements each, valid while the reader is open
+            const glm::vec3* getPositions(size_t frame) const;
+            /// @return nullptr if the file does not store velocities
+            const glm::vec3* getVelocities(size_t frame) const;
+
+        private:
+            MappedFile file;
+            size_t particleCount;
+            size_t frameCount;
+            size_t frameSize;
+            bool velocities;
+
+            const TrajectoryFrameHeader* frameHeader(size_t frame) const;
+    };
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef TRIPLEBUFFER_HPP
+#define TRIPLEBUFFER_HPP
+
+#include <atomic>
+
+namespace Parallel {
+
+    /**
+     * @class TripleBuffer
+     * @brief Lock-free exchange of the latest value between one writer thread and one reader thread
+     *
+     * The writer fills its own slot and publishes it, the reader picks up the most recent published slot.
+     * The third slot sits in between, so neither side ever waits for the other: a value published while the reader
+     * is still using the previous one simply replaces the unread one, and the reader skips to the newest state.
+     *
+     * Intended usage:
+     * The writer calls getWriteBuffer, fills the value and calls publish. The reader calls update,
+     * then reads getReadBuffer until the next update. Every slot is written in full before being published,
+     * since a slot coming back to the writer holds an older value.
+     */
+    template <typename T>
+    class TripleBuffer {
+        private:
+            static const unsigned INDEX_MASK = 3;
+            static const unsigned FRESH = 4; // set on the middle slot when it holds a value not read yet
+
+            // each slot in its own cache line, so the two threads do not share lines
+            struct alignas(64) Slot {
+                T value;
+            };
+
+            Slot slots[3];
+            std::atomic<unsigned> middle;
+            unsigned back;  // owned by the writer
+            unsigned front; // owned by the reader
+
+        public:
+            TripleBuffer() : middle(1), back(0), front(2) {}
+
+            TripleBuffer(const TripleBuffer&) = delete;
+            TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+            /// @brief Slot the writer is filling
+            T& getWriteBuffer() {
+                return slots[back].value;
+            }
+
+            /// @brief Make the written slot the latest value, the writer continues with a different slot
+            void publish() {
+                back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+            }
+
+            /**
+             * @brief Switch the reader to the latest published value
+             *
+             * @return false if nothing was published since the last update, the read slot is unchanged then
+             */
+            bool update() {
+                if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+                front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+                return true;
+            }
+
+            /// @brief Slot the reader is using
+            const T& getReadBuffer() const {
+                return slots[front].value;
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,382 @@
+#include "dynamicssim.h"
+#include "diagnostics.hpp"
+#include "field.hpp"
+#include "interaction.hpp"
+#include "physics.hpp"
+#include "scenario.hpp"
+#include "threadpool.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    const int DSIM_VERSION = 1;
+
+    // the arrays are handed out as 3 floats per particle
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "glm::vec3 must be packed");
+}
+
+/**
+ * @brief System behind a dsim_system handle, with the objects it refers to and the thread advancing it
+ *
+ * The driver thread sleeps until dsim_advance hands it a run of steps, then steps the system on the pool,
+ * taking part in the loops as the calling thread of the pool.
+ */
+struct dsim_system {
+    Physics::ParticleSystem system;
+    Storage::Scenario scenario;
+    std::vector<std::unique_ptr<Physics::Force>> forces;
+    std::vector<std::unique_ptr<Physics::Field>> fields;
+    std::vector<std::unique_ptr<Physics::Interaction>> interactions;
+    std::string integratorName;
+    Propagation::SystemIntegrator integrator;
+    mutable std::string error;
+
+    std::atomic<uint64_t> step;
+    std::atomic<double> time;
+
+    Parallel::ThreadPool pool;
+    std::thread driver;
+    mutable std::mutex mutex;
+    std::condition_variable runRequested;
+    std::condition_variable runFinished;
+    bool running;
+    bool stopping;
+    std::atomic<bool> cancelled;
+    uint64_t requestedSteps;
+    float requestedDeltaTime;
+    int status;
+
+    explicit dsim_system(unsigned threads)
+        : integratorName("rk4"), integrator(Propagation::findSystemIntegrator("rk4")), step(0), time(0.0), pool(threads),
+        running(false), stopping(false), cancelled(false), requestedSteps(0), requestedDeltaTime(0.0f), status(DSIM_OK) {
+        driver = std::thread(&dsim_system::driverLoop, this);
+    }
+
+    ~dsim_system() {
+        cancelled = true;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        runRequested.notify_one();
+        driver.join();
+    }
+
+    bool isRunning() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return running;
+    }
+
+    int fail(int failure, const std::string& message) const {
+        error = message;
+        return failure;
+    }
+
+    int succeed() const {
+        error.clear();
+        return DSIM_OK;
+    }
+
+    /// @brief Failure of the functions changing the system while it advances
+    int failBusy() const {
+        return fail(DSIM_BUSY, "the system is advancing, call dsim_wait first");
+    }
+
+    void driverLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            runRequested.wait(lock, [this]() { return running || stopping; });
+            if (stopping) return;
+
+            const uint64_t steps = requestedSteps;
+            const float deltaTime = requestedDeltaTime;
+            lock.unlock();
+
+            // the time of every step is computed from the start of the run, so it does not accumulate rounding errors
+            const double start = time;
+            uint64_t taken = 0;
+            while (taken < steps && !cancelled) {
+                integrator(system, (float)(start + taken * (double)deltaTime), deltaTime, pool);
+                taken++;
+                step++;
+                time = start + taken * (double)deltaTime;
+            }
+
+            lock.lock();
+            status = taken < steps ? DSIM_CANCELLED : DSIM_OK;
+            running = false;
+            runFinished.notify_all();
+        }
+    }
+};
+
+namespace {
+    /// @brief Add a force, field or interaction of a type named as in the scenario files
+    int addObject(dsim_system* handle, Storage::ScenarioType::Category category, const char* type, const float* parameters, size_t parameterCount) {
+        if (!handle) return DSIM_INVALID_ARGUMENT;
+        if (handle->isRunning()) return handle->failBusy();
+        if (!type) return handle->fail(DSIM_INVALID_ARGUMENT, "null type");
+
+        const Storage::ScenarioType* scenarioType = Storage::findScenarioType(type, category);
+        if (!scenarioType) return handle->fail(DSIM_INVALID_ARGUMENT, std::string("unknown type ") + type);
+        if (parameterCount > (size_t)Physics::ForceDescriptor::MAX_PARAMETERS || (parameterCount > 0 && !parameters)) {
+            return handle->fail(DSIM_INVALID_ARGUMENT, std::string("invalid parameters of ") + type);
+        }
+
+        Physics::ForceDescriptor descriptor = Storage::getDefaultDescriptor(scenarioType->type);
+        for (size_t i = 0; i < parameterCount; i++) descriptor.parameters[i] = parameters[i];
+
+        Physics::ParticleSystem& system = handle->system;
+        if (category == Storage::ScenarioType::Force) {
+            std::unique_ptr<Physics::Force> force = Physics::createForce(descriptor);
+            if (!force) return handle->fail(DSIM_INVALID_ARGUMENT, std::string("cannot create ") + type);
+            system.appliedForces.addForce(*force);
+            system.invalidateAccelerations();
+            handle->forces.push_back(std::move(force));
+        }
+        else if (category == Storage::ScenarioType::Field) {
+            std::unique_ptr<Physics::Field> field = Physics::createField(descriptor);
+            if (!field) return handle->fail(DSIM_INVALID_ARGUMENT, std::string("cannot create ") + type);
+            system.addField(*field);
+            handle->fields.push_back(std::move(field));
+        }
+        else {
+            std::unique_ptr<Physics::Interaction> interaction = Physics::createInteraction(descriptor);
+            if (!interaction) return handle->fail(DSIM_INVALID_ARGUMENT, std::string("cannot create ") + type);
+            system.addInteraction(*interaction);
+            handle->interactions.push_back(std::move(interaction));
+        }
+
+        return handle->succeed();
+    }
+
+    /// @brief Array of a system handed out in place, null while it has no particles
+    float* exposeArray(const dsim_system* handle, void* values) {
+        if (!handle || handle->system.size() == 0) return nullptr;
+        return static_cast<float*>(values);
+    }
+}
+
+// C interface implementations
+extern "C" {
+
+int dsim_version(void) {
+    return DSIM_VERSION;
+}
+
+dsim_system* dsim_create(unsigned threads) {
+    // no exception crosses the C interface, a system which cannot be created is null
+    try {
+        return new dsim_system(threads);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void dsim_destroy(dsim_system* system) {
+    delete system;
+}
+
+const char* dsim_get_error(const dsim_system* system) {
+    return system ? system->error.c_str() : "null system";
+}
+
+int dsim_load_scenario(dsim_system* system, const char* path) {
+    if (!system) return DSIM_INVALID_ARGUMENT;
+    if (system->isRunning()) return system->failBusy();
+    if (!path) return system->fail(DSIM_INVALID_ARGUMENT, "null path");
+
+    if (!system->scenario.load(path, system->system)) return system->fail(DSIM_IO_ERROR, system->scenario.getError());
+
+    // the system now refers to the objects of the scenario only
+    system->forces.clear();
+    system->fields.clear();
+    system->interactions.clear();
+    system->step = 0;
+    system->time = 0.0;
+
+    const std::string& integratorName = system->scenario.settings.integrator;
+    if (!integratorName.empty()) {
+        Propagation::SystemIntegrator integrator = Propagation::findSystemIntegrator(integratorName);
+        if (!integrator) return system->fail(DSIM_INVALID_ARGUMENT, "loaded, but the integrator " + integratorName + " is unknown");
+        system->integratorName = integratorName;
+        system->integrator = integrator;
+    }
+
+    return system->succeed();
+}
+
+int dsim_save_scenario(const dsim_system* system, const char* path) {
+    if (!system) return DSIM_INVALID_ARGUMENT;
+    if (system->isRunning()) return system->failBusy();
+    if (!path) return system->fail(DSIM_INVALID_ARGUMENT, "null path");
+
+    Storage::ScenarioSettings settings;
+    settings.integrator = system->integratorName;
+    if (!Storage::saveScenario(path, settings, system->system)) {
+        return system->fail(DSIM_IO_ERROR, std::string("cannot write ") + path + " or describe the forces of the system");
+    }
+
+    return system->succeed();
+}
+
+int dsim_add_particles(dsim_system* system, size_t count, const float* masses, const float* positions,
+    const float* velocities, const float* charges, const float* radii) {
+    if (!system) return DSIM_INVALID_ARGUMENT;
+    if (system->isRunning()) return system->failBusy();
+    if (count > 0 && !masses) return system->fail(DSIM_INVALID_ARGUMENT, "null masses");
+
+    Physics::ParticleSystem& particles = system->system;
+    const size_t first = particles.size();
+    try {
+        particles.resize(first + count);
+    }
+    catch (const std::bad_alloc&) {
+        particles.resize(first);
+        return system->fail(DSIM_INVALID_ARGUMENT, "not enough memory for " + std::to_string(count) + " particles");
+    }
+
+    // the new particles are zeroed by resize, only the given arrays are copied
+    std::memcpy(particles.getMasses() + first, masses, count * sizeof(float));
+    if (positions) std::memcpy(particles.getPositions() + first, positions, count * sizeof(glm::vec3));
+    if (velocities) std::memcpy(particles.getVelocities() + first, velocities, count * sizeof(glm::vec3));
+    if (charges) std::memcpy(particles.getCharges() + first, charges, count * sizeof(float));
+    if (radii) std::memcpy(particles.getRadii() + first, radii, count * sizeof(float));
+
+    return system->succeed();
+}
+
+int dsim_clear_particles(dsim_system* system) {
+    if (!system) return DSIM_INVALID_ARGUMENT;
+    if (system->isRunning()) return system->failBusy();
+
+    system->system.clear();
+    return system->succeed();
+}
+
+int dsim_add_force(dsim_system* system, const char* type, const float* parameters, size_t parameterCount) {
+    return addObject(system, Storage::ScenarioType::Force, type, parameters, parameterCount);
+}
+
+int dsim_add_field(dsim_system* system, const char* type, const float* parameters, size_t parameterCount) {
+    return addObject(system, Storage::ScenarioType::Field, type, parameters, parameterCount);
+}
+
+int dsim_add_interaction(dsim_system* system, const char* type, const float* parameters, size_t parameterCount) {
+    return addObject(system, Storage::ScenarioType::Interaction, type, parameters, parameterCount);
+}
+
+int dsim_set_integrator(dsim_system* system, const char* name) {
+    if (!system) return DSIM_INVALID_ARGUMENT;
+    if (system->isRunning()) return system->failBusy();
+    if (!name) return system->fail(DSIM_INVALID_ARGUMENT, "null integrator");
+
+    Propagation::SystemIntegrator integrator = Propagation::findSystemIntegrator(name);
+    if (!integrator) return system->fail(DSIM_INVALID_ARGUMENT, std::string("unknown integrator ") + name);
+
+    system->integratorName = name;
+    system->integrator = integrator;
+    return system->succeed();
+}
+
+const char* dsim_get_integrator(const dsim_system* system) {
+    return system ? system->integratorName.c_str() : "";
+}
+
+int dsim_advance(dsim_system* system, uint64_t steps, float deltaTime) {
+    if (!system) return DSIM_INVALID_ARGUMENT;
+    if (!(deltaTime > 0.0f)) return system->fail(DSIM_INVALID_ARGUMENT, "the time step must be positive");
+
+    {
+        std::lock_guard<std::mutex> lock(system->mutex);
+        if (system->running) return system->failBusy();
+
+        // the caller may have written to the arrays since the last advance
+        system->system.invalidateAccelerations();
+        system->cancelled = false;
+        system->status = DSIM_OK;
+        if (steps == 0) return system->succeed();
+
+        system->requestedSteps = steps;
+        system->requestedDeltaTime = deltaTime;
+        system->running = true;
+    }
+    system->runRequested.notify_one();
+
+    return system->succeed();
+}
+
+int dsim_wait(dsim_system* system) {
+    if (!system) return DSIM_INVALID_ARGUMENT;
+
+    std::unique_lock<std::mutex> lock(system->mutex);
+    system->runFinished.wait(lock, [system]() { return !system->running; });
+    if (system->status == DSIM_CANCELLED) return system->fail(DSIM_CANCELLED, "the advance was cancelled at step " + std::to_string(system->step));
+    return system->succeed();
+}
+
+int dsim_is_running(const dsim_system* system) {
+    return system && system->isRunning() ? 1 : 0;
+}
+
+void dsim_cancel(dsim_system* system) {
+    if (system) system->cancelled = true;
+}
+
+uint64_t dsim_get_step(const dsim_system* system) {
+    return system ? system->step.load() : 0;
+}
+
+double dsim_get_time(const dsim_system* system) {
+    return system ? system->time.load() : 0.0;
+}
+
+size_t dsim_size(const dsim_system* system) {
+    return system ? system->system.size() : 0;
+}
+
+float* dsim_positions(dsim_system* system) {
+    return exposeArray(system, system ? system->system.getPositions() : nullptr);
+}
+
+float* dsim_velocities(dsim_system* system) {
+    return exposeArray(system, system ? system->system.getVelocities() : nullptr);
+}
+
+float* dsim_masses(dsim_system* system) {
+    return exposeArray(system, system ? system->system.getMasses() : nullptr);
+}
+
+float* dsim_charges(dsim_system* system) {
+    return exposeArray(system, system ? system->system.getCharges() : nullptr);
+}
+
+int dsim_compute_diagnostics(dsim_system* system, dsim_diagnostics* diagnostics) {
+    if (!system) return DSIM_INVALID_ARGUMENT;
+    if (system->isRunning()) return system->failBusy();
+    if (!diagnostics) return system->fail(DSIM_INVALID_ARGUMENT, "null diagnostics");
+
+    const Physics::SystemDiagnostics computed = Physics::computeDiagnostics(system->system, (float)system->time.load(), &system->pool);
+    diagnostics->time = system->time;
+    diagnostics->kinetic_energy = computed.kineticEnergy;
+    diagnostics->potential_energy = computed.potentialEnergy;
+    diagnostics->interaction_energy = computed.interactionEnergy;
+    diagnostics->total_energy = computed.totalEnergy();
+    for (int axis = 0; axis < 3; axis++) {
+        diagnostics->momentum[axis] = computed.momentum[axis];
+        diagnostics->angular_momentum[axis] = computed.angularMomentum[axis];
+    }
+
+    return system->succeed();
+}
+
+}
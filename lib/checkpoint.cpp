@@ -0,0 +1,484 @@
+#include "checkpoint.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Storage {
+
+    namespace {
+        const unsigned char PADDING[8] = { 0 };
+
+        uint64_t paddedSize(uint64_t size) {
+            return (size + 7) & ~(uint64_t)7;
+        }
+
+        /// @brief Whether every number from 0 to ids.size() - 1 appears exactly once
+        bool isPermutation(const std::vector<uint32_t>& ids) {
+            std::vector<bool> seen(ids.size(), false);
+            for (uint32_t id : ids) {
+                if (id >= ids.size() || seen[id]) return false;
+                seen[id] = true;
+            }
+            return true;
+        }
+
+        /// @brief Append the records of a force and of its components in depth-first order
+        bool collectForces(const Physics::Force& force, std::vector<CheckpointForceRecord>& records) {
+            CheckpointForceRecord record;
+            record.descriptor = force.describe();
+            record.childCount = 0;
+            if (record.descriptor.type == Physics::ForceDescriptor::Unknown) return false;
+
+            if (record.descriptor.type == Physics::ForceDescriptor::Composite) record.childCount = (uint32_t)force.getComponentCount();
+
+            records.push_back(record);
+            for (uint32_t i = 0; i < record.childCount; i++) {
+                if (!collectForces(force.getComponent(i), records)) return false;
+            }
+            return true;
+        }
+
+        /// @brief Records of the components of a root composite force, such as the applied forces of a particle
+        bool collectComponents(const Physics::CompositeForce& root, std::vector<CheckpointForceRecord>& records) {
+            for (size_t i = 0; i < root.getForceCount(); i++) {
+                if (!collectForces(root.getForce(i), records)) return false;
+            }
+            return true;
+        }
+
+        /// @brief Build the force starting at records[next] with its components, adding it to parent
+        bool buildForce(const CheckpointForceRecord* records, size_t count, size_t& next, Physics::CompositeForce& parent, CheckpointObjects& objects) {
+            if (next >= count) return false;
+            CheckpointForceRecord record;
+            std::memcpy(&record, records + next++, sizeof(record));
+
+            std::unique_ptr<Physics::Force> force = Physics::createForce(record.descriptor);
+            if (!force) return false;
+
+            if (record.descriptor.type == Physics::ForceDescriptor::Composite) {
+                Physics::CompositeForce& composite = static_cast<Physics::CompositeForce&>(*force);
+                for (uint32_t i = 0; i < record.childCount; i++) {
+                    if (!buildForce(records, count, next, composite, objects)) return false;
+                }
+            }
+
+            parent.addForce(*force);
+            objects.forces.push_back(std::move(force));
+            return true;
+        }
+
+        bool buildComponents(const unsigned char* data, size_t count, Physics::CompositeForce& root, CheckpointObjects& objects) {
+            const CheckpointForceRecord* records = reinterpret_cast<const CheckpointForceRecord*>(data);
+            size_t next = 0;
+            while (next < count) {
+                if (!buildForce(records, count, next, root, objects)) return false;
+            }
+            return true;
+        }
+
+        /// @brief Make the written data durable before the file is moved into place
+        bool syncFile(std::FILE* file) {
+            if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+            return _commit(_fileno(file)) == 0;
+#else
+            return fsync(fileno(file)) == 0;
+#endif
+        }
+
+        bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+            return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+            return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+        }
+    }
+
+    // CheckpointWriter implementations
+    CheckpointWriter::CheckpointWriter() : file(nullptr), sectionCount(0), failed(false) {}
+
+    CheckpointWriter::~CheckpointWriter() {
+        discard();
+    }
+
+    bool CheckpointWriter::open(const std::string& path) {
+        discard();
+
+        this->path = path;
+        temporaryPath = path + ".tmp";
+        file = std::fopen(temporaryPath.c_str(), "wb");
+        if (!file) return false;
+
+        sectionCount = 0;
+        failed = false;
+
+        // the section count is updated on commit
+        CheckpointHeader header;
+        std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+        header.version = CHECKPOINT_VERSION;
+        header.sectionCount = 0;
+        return writeBytes(&header, sizeof(header));
+    }
+
+    bool CheckpointWriter::writeClock(double time, unsigned long long step) {
+        CheckpointClock clock;
+        clock.time = time;
+        clock.step = step;
+
+        return writeSection(CHECKPOINT_CLOCK, sizeof(clock)) && writeBytes(&clock, sizeof(clock));
+    }
+
+    bool CheckpointWriter::writeSystem(const Physics::ParticleSystem& system) {
+        std::vector<CheckpointForceRecord> forces;
+        std::vector<Physics::ForceDescriptor> interactions;
+        std::vector<Physics::ForceDescriptor> fields;
+
+        bool describable = collectComponents(system.appliedForces, forces);
+        for (const Physics::Interaction* interaction : system.getInteractions()) {
+            interactions.push_back(interaction->describe());
+            if (interactions.back().type == Physics::ForceDescriptor::Unknown) describable = false;
+        }
+        for (const Physics::Field* field : system.getFields()) {
+            fields.push_back(field->describe());
+            if (fields.back().type == Physics::ForceDescriptor::Unknown) describable = false;
+        }
+        if (!describable) {
+            failed = true;
+            return false;
+        }
+
+        const size_t count = system.size();
+        const uint64_t vectorSize = count * sizeof(glm::vec3);
+        const uint64_t scalarSize = count * sizeof(float);
+        const uint64_t arraysSize = sizeof(CheckpointSystemRecord) + 3 * vectorSize + 4 * scalarSize;
+
+        CheckpointSystemRecord record;
+        record.particleCount = count;
+        record.flags = system.hasAccelerations() ? CHECKPOINT_ACCELERATIONS : 0;
+        if (!system.hasIdentityOrder()) record.flags |= CHECKPOINT_IDS;
+        record.forceCount = (uint32_t)forces.size();
+        record.interactionCount = (uint32_t)interactions.size();
+        record.fieldCount = (uint32_t)fields.size();
+
+        // the order of a reordered system is kept, so that the restart sums the forces in the same order
+        const uint64_t idsSize = (record.flags & CHECKPOINT_IDS) ? count * sizeof(uint32_t) : 0;
+        const uint64_t size = paddedSize(arraysSize) + forces.size() * sizeof(CheckpointForceRecord) + (interactions.size() + fields.size()) * sizeof(Physics::ForceDescriptor) + idsSize;
+
+        // the arrays are written straight from the system, without an intermediate copy
+        return writeSection(CHECKPOINT_SYSTEM, size)
+            && writeBytes(&record, sizeof(record))
+            && writeBytes(system.getPositions(), vectorSize)
+            && writeBytes(system.getVelocities(), vectorSize)
+            && writeBytes(system.getAccelerations(), vectorSize)
+            && writeBytes(system.getMasses(), scalarSize)
+            && writeBytes(system.getCharges(), scalarSize)
+            && writeBytes(system.getRadii(), scalarSize)
+            && writeBytes(system.getStepSizes(), scalarSize)
+            && writePadding(arraysSize)
+            && writeBytes(forces.data(), forces.size() * sizeof(CheckpointForceRecord))
+            && writeBytes(interactions.data(), interactions.size() * sizeof(Physics::ForceDescriptor))
+            && writeBytes(fields.data(), fields.size() * sizeof(Physics::ForceDescriptor))
+            && writeBytes(system.getIds(), idsSize)
+            && writePadding(size);
+    }
+
+    bool CheckpointWriter::writeParticle(Physics::Particle& particle) {
+        std::vector<CheckpointForceRecord> forces;
+        if (!collectComponents(particle.appliedForces, forces)) {
+            failed = true;
+            return false;
+        }
+
+        glm::vec3 position = particle.getPosition();
+        glm::vec3 velocity = particle.getVelocity();
+        glm::vec3 acceleration = particle.getAcceleration();
+
+        CheckpointParticleRecord record;
+        for (int c = 0; c < 3; c++) {
+            record.position[c] = position[c];
+            record.velocity[c] = velocity[c];
+            record.acceleration[c] = acceleration[c];
+        }
+        record.mass = particle.getMass();
+        record.stepSize = particle.getStepSize();
+        record.flags = particle.hasAcceleration() ? CHECKPOINT_ACCELERATIONS : 0;
+        record.forceCount = (uint32_t)forces.size();
+        record.reserved = 0;
+
+        const uint64_t size = sizeof(record) + forces.size() * sizeof(CheckpointForceRecord);
+
+        return writeSection(CHECKPOINT_PARTICLE, size)
+            && writeBytes(&record, sizeof(record))
+            && writeBytes(forces.data(), forces.size() * sizeof(CheckpointForceRecord))
+            && writePadding(size);
+    }
+
+    bool CheckpointWriter::commit() {
+        if (!file) return false;
+
+        if (!failed) {
+            failed = std::fseek(file, (long)offsetof(CheckpointHeader, sectionCount), SEEK_SET) != 0
+                || std::fwrite(&sectionCount, sizeof(sectionCount), 1, file) != 1
+                || !syncFile(file);
+        }
+        if (std::fclose(file) != 0) failed = true;
+        file = nullptr;
+
+        if (failed || !replaceFile(temporaryPath, path)) {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void CheckpointWriter::discard() {
+        if (!file) return;
+
+        std::fclose(file);
+        file = nullptr;
+        std::remove(temporaryPath.c_str());
+    }
+
+    bool CheckpointWriter::isOpen() const {
+        return file != nullptr;
+    }
+
+    bool CheckpointWriter::writeBytes(const void* data, size_t size) {
+        if (!file || failed) return false;
+        if (size > 0 && std::fwrite(data, 1, size, file) != size) failed = true;
+        return !failed;
+    }
+
+    bool CheckpointWriter::writeSection(uint32_t type, uint64_t size) {
+        CheckpointSectionHeader header;
+        header.type = type;
+        header.reserved = 0;
+        header.size = size;
+
+        sectionCount++;
+        return writeBytes(&header, sizeof(header));
+    }
+
+    bool CheckpointWriter::writePadding(uint64_t size) {
+        return writeBytes(PADDING, (size_t)(paddedSize(size) - size));
+    }
+
+    // Checkpoint implementations
+    Checkpoint::Checkpoint() : clockPresent(false) {
+        clock.time = 0.0;
+        clock.step = 0;
+    }
+
+    bool Checkpoint::open(const std::string& path) {
+        close();
+        if (!file.open(path)) return false;
+
+        const unsigned char* data = file.data();
+        const uint64_t size = file.size();
+
+        CheckpointHeader header;
+        if (size < sizeof(header)) {
+            close();
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 || header.version != CHECKPOINT_VERSION) {
+            close();
+            return false;
+        }
+
+        uint64_t offset = sizeof(header);
+        for (uint32_t i = 0; i < header.sectionCount; i++) {
+            CheckpointSectionHeader section;
+            if (size - offset < sizeof(section)) {
+                close();
+                return false;
+            }
+            std::memcpy(&section, data + offset, sizeof(section));
+            offset += sizeof(section);
+
+            if (size - offset < paddedSize(section.size)) {
+                close();
+                return false;
+            }
+            Section entry = { data + offset, section.size };
+            offset += paddedSize(section.size);
+
+            if (section.type == CHECKPOINT_CLOCK && section.size >= sizeof(clock)) {
+                std::memcpy(&clock, entry.payload, sizeof(clock));
+                clockPresent = true;
+            }
+            else if (section.type == CHECKPOINT_SYSTEM) systems.push_back(entry);
+            else if (section.type == CHECKPOINT_PARTICLE) particles.push_back(entry);
+            // unknown sections are skipped, so newer writers stay readable
+        }
+
+        return true;
+    }
+
+    void Checkpoint::close() {
+        file.close();
+        systems.clear();
+        particles.clear();
+        clock.time = 0.0;
+        clock.step = 0;
+        clockPresent = false;
+    }
+
+    bool Checkpoint::isOpen() const {
+        return file.isOpen();
+    }
+
+    bool Checkpoint::hasClock() const {
+        return clockPresent;
+    }
+
+    double Checkpoint::getTime() const {
+        return clock.time;
+    }
+
+    unsigned long long Checkpoint::getStep() const {
+        return clock.step;
+    }
+
+    size_t Checkpoint::getSystemCount() const {
+        return systems.size();
+    }
+
+    size_t Checkpoint::getParticleCount() const {
+        return particles.size();
+    }
+
+    bool Checkpoint::restoreSystem(size_t index, Physics::ParticleSystem& system, CheckpointObjects& objects) const {
+        if (index >= systems.size()) return false;
+        const Section& section = systems[index];
+
+        CheckpointSystemRecord record;
+        if (section.size < sizeof(record)) return false;
+        std::memcpy(&record, section.payload, sizeof(record));
+
+        // the counts come from the file: bound them by the payload before any size is computed, so that none can wrap
+        const uint64_t particleSize = 3 * sizeof(glm::vec3) + 4 * sizeof(float) + ((record.flags & CHECKPOINT_IDS) ? sizeof(uint32_t) : 0);
+        uint64_t remaining = section.size - sizeof(record);
+        if (record.particleCount > remaining / particleSize) return false;
+
+        const size_t count = (size_t)record.particleCount;
+        const uint64_t vectorSize = (uint64_t)count * sizeof(glm::vec3);
+        const uint64_t scalarSize = (uint64_t)count * sizeof(float);
+        const uint64_t arraysSize = sizeof(record) + 3 * vectorSize + 4 * scalarSize;
+        const uint64_t idsSize = (record.flags & CHECKPOINT_IDS) ? (uint64_t)count * sizeof(uint32_t) : 0;
+        if (section.size < paddedSize(arraysSize) + idsSize) return false;
+
+        remaining = section.size - paddedSize(arraysSize) - idsSize;
+        if (record.forceCount > remaining / sizeof(CheckpointForceRecord)) return false;
+        const uint64_t forcesSize = (uint64_t)record.forceCount * sizeof(CheckpointForceRecord);
+
+        remaining -= forcesSize;
+        if ((uint64_t)record.interactionCount + record.fieldCount > remaining / sizeof(Physics::ForceDescriptor)) return false;
+
+        // build the forces before touching the system, so a failed restore leaves it unchanged
+        Physics::CompositeForce appliedForces;
+        CheckpointObjects restored;
+        const unsigned char* forces = section.payload + paddedSize(arraysSize);
+        if (!buildComponents(forces, record.forceCount, appliedForces, restored)) return false;
+
+        const unsigned char* interactions = forces + forcesSize;
+        for (uint32_t i = 0; i < record.interactionCount; i++) {
+            Physics::ForceDescriptor descriptor;
+            std::memcpy(&descriptor, interactions + i * sizeof(descriptor), sizeof(descriptor));
+
+            std::unique_ptr<Physics::Interaction> interaction = Physics::createInteraction(descriptor);
+            if (!interaction) return false;
+            restored.interactions.push_back(std::move(interaction));
+        }
+
+        const unsigned char* fields = interactions + record.interactionCount * sizeof(Physics::ForceDescriptor);
+        for (uint32_t i = 0; i < record.fieldCount; i++) {
+            Physics::ForceDescriptor descriptor;
+            std::memcpy(&descriptor, fields + i * sizeof(descriptor), sizeof(descriptor));
+
+            std::unique_ptr<Physics::Field> field = Physics::createField(descriptor);
+            if (!field) return false;
+            restored.fields.push_back(std::move(field));
+        }
+
+        // the ids are checked before touching the system too
+        std::vector<uint32_t> ids;
+        if (record.flags & CHECKPOINT_IDS) {
+            ids.resize(count);
+            std::memcpy(ids.data(), fields + record.fieldCount * sizeof(Physics::ForceDescriptor), idsSize);
+            if (!isPermutation(ids)) return false;
+        }
+
+        // the ids of the target system do not describe the particles restored, a checkpoint without ids restores them in id order
+        system.clear();
+        system.resize(count);
+        const unsigned char* arrays = section.payload + sizeof(record);
+        std::memcpy(system.getPositions(), arrays, vectorSize);
+        std::memcpy(system.getVelocities(), arrays + vectorSize, vectorSize);
+        std::memcpy(system.getAccelerations(), arrays + 2 * vectorSize, vectorSize);
+        std::memcpy(system.getMasses(), arrays + 3 * vectorSize, scalarSize);
+        std::memcpy(system.getCharges(), arrays + 3 * vectorSize + scalarSize, scalarSize);
+        std::memcpy(system.getRadii(), arrays + 3 * vectorSize + 2 * scalarSize, scalarSize);
+        std::memcpy(system.getStepSizes(), arrays + 3 * vectorSize + 3 * scalarSize, scalarSize);
+        if (record.flags & CHECKPOINT_IDS) system.assignIds(ids.data());
+
+        system.appliedForces.clear();
+        for (size_t i = 0; i < appliedForces.getForceCount(); i++) system.appliedForces.addForce(appliedForces.getForce(i));
+
+        const std::vector<const Physics::Interaction*> previous = system.getInteractions();
+        for (const Physics::Interaction* interaction : previous) system.removeInteraction(*interaction);
+        for (const std::unique_ptr<Physics::Interaction>& interaction : restored.interactions) system.addInteraction(*interaction);
+
+        const std::vector<const Physics::Field*> previousFields = system.getFields();
+        for (const Physics::Field* field : previousFields) system.removeField(*field);
+        for (const std::unique_ptr<Physics::Field>& field : restored.fields) system.addField(*field);
+
+        // the cache is restored last, the changes above drop it
+        if (record.flags & CHECKPOINT_ACCELERATIONS) system.validateAccelerations();
+        else system.invalidateAccelerations();
+
+        for (std::unique_ptr<Physics::Force>& force : restored.forces) objects.forces.push_back(std::move(force));
+        for (std::unique_ptr<Physics::Interaction>& interaction : restored.interactions) objects.interactions.push_back(std::move(interaction));
+        for (std::unique_ptr<Physics::Field>& field : restored.fields) objects.fields.push_back(std::move(field));
+        return true;
+    }
+
+    bool Checkpoint::restoreParticle(size_t index, Physics::Particle& particle, CheckpointObjects& objects) const {
+        if (index >= particles.size()) return false;
+        const Section& section = particles[index];
+
+        CheckpointParticleRecord record;
+        if (section.size < sizeof(record)) return false;
+        std::memcpy(&record, section.payload, sizeof(record));
+        if (record.forceCount > (section.size - sizeof(record)) / sizeof(CheckpointForceRecord)) return false;
+
+        Physics::CompositeForce appliedForces;
+        CheckpointObjects restored;
+        if (!buildComponents(section.payload + sizeof(record), record.forceCount, appliedForces, restored)) return false;
+
+        particle.setPosition(glm::vec3(record.position[0], record.position[1], record.position[2]));
+        particle.setVelocity(glm::vec3(record.velocity[0], record.velocity[1], record.velocity[2]));
+        particle.setMass(record.mass);
+        particle.setStepSize(record.stepSize);
+
+        particle.appliedForces.clear();
+        for (size_t i = 0; i < appliedForces.getForceCount(); i++) particle.appliedForces.addForce(appliedForces.getForce(i));
+
+        if (record.flags & CHECKPOINT_ACCELERATIONS) particle.setAcceleration(glm::vec3(record.acceleration[0], record.acceleration[1], record.acceleration[2]));
+        else particle.invalidateAcceleration();
+
+        for (std::unique_ptr<Physics::Force>& force : restored.forces) objects.forces.push_back(std::move(force));
+        return true;
+    }
+}
@@ -0,0 +1,190 @@
+#include "collision.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include "profiler.hpp"
+#include "threadpool.hpp"
+
+namespace Physics {
+
+    namespace {
+        // Particles searched for contacts by each block, fixed so the contacts are listed in the same order for any number of threads
+        const size_t CONTACT_BLOCK = 1024;
+
+        // Islands claimed at once by a thread
+        const size_t ISLAND_GRAIN = 16;
+
+        // Fraction of the overlap removed by the position correction, and overlap left alone to avoid jitter
+        const float CORRECTION_FRACTION = 0.8f;
+        const float CORRECTION_SLOP = 0.01f; // relative to the sum of the radii
+
+        float inverseMass(float mass) {
+            return mass > 0.0f ? 1.0f / mass : 0.0f;
+        }
+    }
+
+    CollisionSolver::CollisionSolver(float e, unsigned count) : restitution(e), iterations(count) {}
+
+    float CollisionSolver::getRestitution() const {
+        return restitution;
+    }
+
+    unsigned CollisionSolver::getIterations() const {
+        return iterations;
+    }
+
+    void CollisionSolver::setRestitution(float e) {
+        restitution = e;
+    }
+
+    void CollisionSolver::setIterations(unsigned count) {
+        iterations = count;
+    }
+
+    size_t CollisionSolver::getIslandCount() const {
+        return islandStarts.empty() ? 0 : islandStarts.size() - 1;
+    }
+
+    unsigned CollisionSolver::findRoot(unsigned particle) {
+        while (parents[particle] != particle) {
+            parents[particle] = parents[parents[particle]]; // path halving
+            particle = parents[particle];
+        }
+        return particle;
+    }
+
+    size_t CollisionSolver::resolve(ParticleSystem& system, Parallel::ThreadPool* pool) {
+        DSIM_PROFILE_SCOPE("CollisionSolver::resolve");
+        const size_t count = system.size();
+        glm::vec3* positions = system.getPositions();
+        glm::vec3* velocities = system.getVelocities();
+        const float* masses = system.getMasses();
+        const float* radii = system.getRadii();
+
+        contacts.clear();
+        islandStarts.clear();
+
+        float maxRadius = 0.0f;
+        for (size_t i = 0; i < count; i++) maxRadius = std::max(maxRadius, radii[i]);
+        if (count < 2 || maxRadius <= 0.0f) return 0;
+
+        // broad phase: two spheres can only touch when their centers are closer than twice the largest radius
+        hash.build(positions, count, 2.0f * maxRadius);
+        const std::vector<unsigned>& order = hash.getIndices();
+
+        const size_t blockCount = (count + CONTACT_BLOCK - 1) / CONTACT_BLOCK;
+        if (blockContacts.size() < blockCount) blockContacts.resize(blockCount);
+
+        Parallel::parallelFor(pool, blockCount, 1, [&](size_t firstBlock, size_t lastBlock) {
+            for (size_t block = firstBlock; block < lastBlock; block++) {
+                std::vector<Contact>& found = blockContacts[block];
+                found.clear();
+
+                // the particles are visited in grid order, so consecutive ones share most of their neighbours
+                for (size_t k = block * CONTACT_BLOCK; k < std::min(count, (block + 1) * CONTACT_BLOCK); k++) {
+                    const unsigned i = order[k];
+                    if (radii[i] <= 0.0f) continue;
+                    const glm::vec3 position = positions[i];
+
+                    hash.forEachNeighbour(position, [&](unsigned j, const glm::vec3& neighbour) {
+                        // every pair is tested from its first particle only
+                        if (j <= i || radii[j] <= 0.0f) return;
+
+                        glm::vec3 separation = neighbour - position;
+                        float reach = radii[i] + radii[j];
+                        if (glm::dot(separation, separation) < reach * reach) {
+                            Contact contact = { i, j };
+                            found.push_back(contact);
+                        }
+                    });
+                }
+            }
+        });
+
+        // islands: particles connected by a chain of contacts
+        parents.resize(count);
+        for (size_t i = 0; i < count; i++) parents[i] = (unsigned)i;
+
+        size_t contactCount = 0;
+        for (size_t block = 0; block < blockCount; block++) {
+            for (const Contact& contact : blockContacts[block]) {
+                unsigned first = findRoot(contact.first), second = findRoot(contact.second);
+                if (first != second) parents[std::max(first, second)] = std::min(first, second);
+            }
+            contactCount += blockContacts[block].size();
+        }
+        if (contactCount == 0) return 0;
+
+        // counting sort of the contacts by island, numbering the islands by their root
+        islandOfRoot.assign(count, ~0u);
+        unsigned islandCount = 0;
+        for (size_t block = 0; block < blockCount; block++) {
+            for (const Contact& contact : blockContacts[block]) {
+                unsigned root = findRoot(contact.first);
+                if (islandOfRoot[root] == ~0u) islandOfRoot[root] = islandCount++;
+            }
+        }
+
+        islandStarts.assign(islandCount + 1, 0);
+        for (size_t block = 0; block < blockCount; block++) {
+            for (const Contact& contact : blockContacts[block]) islandStarts[islandOfRoot[findRoot(contact.first)] + 1]++;
+        }
+        for (unsigned island = 0; island < islandCount; island++) islandStarts[island + 1] += islandStarts[island];
+
+        contacts.resize(contactCount);
+        std::vector<unsigned> cursors(islandStarts.begin(), islandStarts.end() - 1);
+        for (size_t block = 0; block < blockCount; block++) {
+            for (const Contact& contact : blockContacts[block]) contacts[cursors[islandOfRoot[findRoot(contact.first)]]++] = contact;
+        }
+
+        // narrow phase: the islands share no particle, so they are solved concurrently
+        const float e = restitution;
+        const unsigned passes = std::max(iterations, 1u);
+
+        Parallel::parallelFor(pool, islandCount, ISLAND_GRAIN, [&](size_t firstIsland, size_t lastIsland) {
+            for (size_t island = firstIsland; island < lastIsland; island++) {
+                const unsigned begin = islandStarts[island], end = islandStarts[island + 1];
+
+                for (unsigned pass = 0; pass < passes; pass++) {
+                    for (unsigned c = begin; c < end; c++) {
+                        const unsigned i = contacts[c].first, j = contacts[c].second;
+                        const float wi = inverseMass(masses[i]), wj = inverseMass(masses[j]);
+                        if (wi + wj <= 0.0f) continue;
+
+                        glm::vec3 separation = positions[j] - positions[i];
+                        float distance = std::sqrt(glm::dot(separation, separation));
+                        if (distance <= 0.0f || distance >= radii[i] + radii[j]) continue;
+                        glm::vec3 normal = separation / distance;
+
+                        // impulse only while the spheres approach each other
+                        float approach = glm::dot(velocities[j] - velocities[i], normal);
+                        if (approach < 0.0f) {
+                            float impulse = -(1.0f + e) * approach / (wi + wj);
+                            velocities[i] -= (impulse * wi) * normal;
+                            velocities[j] += (impulse * wj) * normal;
+                        }
+                    }
+                }
+
+                for (unsigned c = begin; c < end; c++) {
+                    const unsigned i = contacts[c].first, j = contacts[c].second;
+                    const float wi = inverseMass(masses[i]), wj = inverseMass(masses[j]);
+                    if (wi + wj <= 0.0f) continue;
+
+                    glm::vec3 separation = positions[j] - positions[i];
+                    float distance = std::sqrt(glm::dot(separation, separation));
+                    float reach = radii[i] + radii[j];
+                    float overlap = reach - distance - CORRECTION_SLOP * reach;
+                    if (distance <= 0.0f || overlap <= 0.0f) continue;
+
+                    glm::vec3 correction = (CORRECTION_FRACTION * overlap / (wi + wj) / distance) * separation;
+                    positions[i] -= wi * correction;
+                    positions[j] += wj * correction;
+                }
+            }
+        });
+
+        system.invalidateAccelerations();
+        return contactCount;
+    }
+}
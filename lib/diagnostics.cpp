@@ -0,0 +1,137 @@
+#include "diagnostics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "field.hpp"
+#include "interaction.hpp"
+#include "profiler.hpp"
+#include "threadpool.hpp"
+
+namespace Physics {
+
+    namespace {
+        // Number of particles in a block of the reduction, the partial sums of the blocks are combined in a fixed order
+        const size_t DIAGNOSTICS_BLOCK = 1024;
+
+        struct PartialSums {
+            double kineticEnergy;
+            double potentialEnergy;
+            glm::dvec3 momentum;
+            glm::dvec3 angularMomentum;
+        };
+
+        void combine(PartialSums& target, const PartialSums& source) {
+            target.kineticEnergy += source.kineticEnergy;
+            target.potentialEnergy += source.potentialEnergy;
+            target.momentum = target.momentum + source.momentum;
+            target.angularMomentum = target.angularMomentum + source.angularMomentum;
+        }
+    }
+
+    // SystemDiagnostics implementations
+    SystemDiagnostics::SystemDiagnostics()
+        : time(0.0), kineticEnergy(0.0), potentialEnergy(0.0), interactionEnergy(0.0), momentum(0.0), angularMomentum(0.0) {}
+
+    double SystemDiagnostics::totalEnergy() const {
+        return kineticEnergy + potentialEnergy + interactionEnergy;
+    }
+
+    SystemDiagnostics computeDiagnostics(const ParticleSystem& system, float time, Parallel::ThreadPool* pool) {
+        DSIM_PROFILE_SCOPE("computeDiagnostics");
+
+        const size_t count = system.size();
+        const glm::vec3* positions = system.getPositions();
+        const glm::vec3* velocities = system.getVelocities();
+        const float* masses = system.getMasses();
+        const float* charges = system.getCharges();
+        const std::vector<const Field*>& fields = system.getFields();
+
+        const size_t blockCount = (count + DIAGNOSTICS_BLOCK - 1) / DIAGNOSTICS_BLOCK;
+        std::vector<PartialSums> blocks(std::max<size_t>(blockCount, 1));
+
+        Parallel::parallelFor(pool, blockCount, 1, [&](size_t firstBlock, size_t lastBlock) {
+            for (size_t block = firstBlock; block < lastBlock; block++) {
+                PartialSums sums = { 0.0, 0.0, glm::dvec3(0.0), glm::dvec3(0.0) };
+
+                for (size_t i = block * DIAGNOSTICS_BLOCK; i < std::min(count, (block + 1) * DIAGNOSTICS_BLOCK); i++) {
+                    const glm::dvec3 position(positions[i]);
+                    const glm::dvec3 momentum = (double)masses[i] * glm::dvec3(velocities[i]);
+
+                    sums.kineticEnergy += 0.5 * glm::dot(momentum, glm::dvec3(velocities[i]));
+                    sums.momentum = sums.momentum + momentum;
+                    sums.angularMomentum = sums.angularMomentum + glm::cross(position, momentum);
+
+                    sums.potentialEnergy += system.appliedForces.computeEnergy(positions[i], velocities[i], time);
+                    for (const Field* field : fields) sums.potentialEnergy += field->computeEnergy(positions[i], velocities[i], masses[i], charges[i], time);
+                }
+
+                blocks[block] = sums;
+            }
+        });
+
+        // pairwise tree over the blocks, its shape depends only on the number of blocks
+        for (size_t stride = 1; stride < blockCount; stride *= 2) {
+            for (size_t block = 0; block + stride < blockCount; block += 2 * stride) combine(blocks[block], blocks[block + stride]);
+        }
+
+        SystemDiagnostics diagnostics;
+        diagnostics.time = time;
+        if (blockCount > 0) {
+            diagnostics.kineticEnergy = blocks[0].kineticEnergy;
+            diagnostics.potentialEnergy = blocks[0].potentialEnergy;
+            diagnostics.momentum = blocks[0].momentum;
+            diagnostics.angularMomentum = blocks[0].angularMomentum;
+        }
+
+        for (const Interaction* interaction : system.getInteractions()) {
+            diagnostics.interactionEnergy += interaction->computeEnergy(system, positions, velocities, time, pool);
+        }
+
+        return diagnostics;
+    }
+
+    // DiagnosticsMonitor implementations
+    DiagnosticsMonitor::DiagnosticsMonitor(unsigned long long interval) : interval(std::max(interval, 1ull)), sampled(false) {}
+
+    bool DiagnosticsMonitor::update(unsigned long long step, double time, const ParticleSystem& system, Parallel::ThreadPool* pool) {
+        if (step % interval != 0) return false;
+        sample(time, system, pool);
+        return true;
+    }
+
+    void DiagnosticsMonitor::sample(double time, const ParticleSystem& system, Parallel::ThreadPool* pool) {
+        latest = computeDiagnostics(system, (float)time, pool);
+        latest.time = time;
+
+        if (!sampled) initial = latest;
+        sampled = true;
+    }
+
+    void DiagnosticsMonitor::reset() {
+        sampled = false;
+        initial = latest = SystemDiagnostics();
+    }
+
+    unsigned long long DiagnosticsMonitor::getInterval() const {
+        return interval;
+    }
+
+    bool DiagnosticsMonitor::hasSample() const {
+        return sampled;
+    }
+
+    const SystemDiagnostics& DiagnosticsMonitor::getInitial() const {
+        return initial;
+    }
+
+    const SystemDiagnostics& DiagnosticsMonitor::getLatest() const {
+        return latest;
+    }
+
+    double DiagnosticsMonitor::getRelativeEnergyDrift() const {
+        const double reference = initial.totalEnergy();
+        if (reference == 0.0) return 0.0;
+        return (latest.totalEnergy() - reference) / std::abs(reference);
+    }
+}
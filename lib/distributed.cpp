@@ -0,0 +1,531 @@
+#include "distributed.hpp"
+#include "morton.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace {
+    const int SOURCE_TAG = 1;
+
+    /// @brief MPI datatype of a plain structure, sent as raw bytes between ranks of the same build
+    class RecordType {
+        private:
+            MPI_Datatype type;
+        public:
+            explicit RecordType(size_t bytes) {
+                MPI_Type_contiguous((int)bytes, MPI_BYTE, &type);
+                MPI_Type_commit(&type);
+            }
+
+            ~RecordType() {
+                MPI_Type_free(&type);
+            }
+
+            RecordType(const RecordType&) = delete;
+            RecordType& operator=(const RecordType&) = delete;
+
+            operator MPI_Datatype() const {
+                return type;
+            }
+    };
+}
+
+namespace Parallel {
+
+    namespace {
+        // Bits of the Morton keys counted by the histogram splitting the curve, the octree cells of level 6
+        const unsigned HISTOGRAM_BITS = 18;
+
+        /// @brief State of a particle migrated to another rank
+        struct ParticleRecord {
+            uint64_t key;
+            uint64_t id;
+            glm::vec3 position;
+            glm::vec3 velocity;
+            float mass;
+            float charge;
+            float radius;
+        };
+
+        Bounds computeBounds(const glm::vec3* positions, size_t count) {
+            Bounds bounds;
+            for (size_t i = 0; i < count; i++) {
+                bounds.lower = glm::min(bounds.lower, positions[i]);
+                bounds.upper = glm::max(bounds.upper, positions[i]);
+            }
+            return bounds;
+        }
+
+        /// @brief Offsets of the blocks of the given sizes laid out one after the other, returning the total
+        size_t computeDisplacements(const std::vector<int>& counts, std::vector<int>& displacements) {
+            displacements.resize(counts.size());
+            size_t total = 0;
+            for (size_t i = 0; i < counts.size(); i++) {
+                displacements[i] = (int)total;
+                total += counts[i];
+            }
+            return total;
+        }
+
+        ParticleRecord makeRecord(const Physics::ParticleSystem& system, size_t index, uint64_t id, uint64_t key) {
+            ParticleRecord record;
+            record.key = key;
+            record.id = id;
+            record.position = system.getPositions()[index];
+            record.velocity = system.getVelocities()[index];
+            record.mass = system.getMasses()[index];
+            record.charge = system.getCharges()[index];
+            record.radius = system.getRadii()[index];
+            return record;
+        }
+
+        /// @brief Replace the particles of a system with the records, keeping its forces, fields and interactions
+        void loadRecords(Physics::ParticleSystem& system, const std::vector<ParticleRecord>& records, std::vector<uint64_t>* ids) {
+            system.resize(records.size());
+            if (ids) ids->resize(records.size());
+
+            for (size_t i = 0; i < records.size(); i++) {
+                const ParticleRecord& record = records[i];
+                system.getPositions()[i] = record.position;
+                system.getVelocities()[i] = record.velocity;
+                system.getMasses()[i] = record.mass;
+                system.getCharges()[i] = record.charge;
+                system.getRadii()[i] = record.radius;
+                if (ids) (*ids)[i] = record.id;
+            }
+            system.invalidateAccelerations();
+        }
+    }
+
+    // Bounds implementations
+    Bounds::Bounds() : lower(FLT_MAX), upper(-FLT_MAX) {}
+
+    bool Bounds::isEmpty() const {
+        return lower.x > upper.x;
+    }
+
+    // DomainDecomposition implementations
+    DomainDecomposition::DomainDecomposition(MPI_Comm communicator) : communicator(communicator), rank(0), size(1), lastMigrated(0) {
+        MPI_Comm_rank(communicator, &rank);
+        MPI_Comm_size(communicator, &size);
+    }
+
+    MPI_Comm DomainDecomposition::getCommunicator() const {
+        return communicator;
+    }
+
+    int DomainDecomposition::getRank() const {
+        return rank;
+    }
+
+    int DomainDecomposition::getSize() const {
+        return size;
+    }
+
+    size_t DomainDecomposition::getLastMigrated() const {
+        return lastMigrated;
+    }
+
+    void DomainDecomposition::scatter(Physics::ParticleSystem& system, std::vector<uint64_t>& ids) const {
+        // contiguous blocks keep the locality of the input order until the first rebalance
+        const size_t count = system.size();
+        const size_t begin = count * rank / size;
+        const size_t end = count * (rank + 1) / size;
+
+        std::vector<ParticleRecord> records;
+        records.reserve(end - begin);
+        for (size_t i = begin; i < end; i++) records.push_back(makeRecord(system, i, i, 0));
+
+        loadRecords(system, records, &ids);
+    }
+
+    size_t DomainDecomposition::rebalance(Physics::ParticleSystem& system, std::vector<uint64_t>& ids, Parallel::ThreadPool* pool) {
+        const size_t count = system.size();
+
+        Bounds bounds = computeBounds(system.getPositions(), count);
+        MPI_Allreduce(MPI_IN_PLACE, &bounds.lower[0], 3, MPI_FLOAT, MPI_MIN, communicator);
+        MPI_Allreduce(MPI_IN_PLACE, &bounds.upper[0], 3, MPI_FLOAT, MPI_MAX, communicator);
+        if (bounds.isEmpty()) {
+            lastMigrated = 0;
+            return 0;
+        }
+
+        std::vector<uint64_t> keys(count);
+        Physics::computeMortonKeys(system.getPositions(), count, bounds.lower, bounds.upper, keys.data(), pool);
+
+        // global histogram of the coarse cells along the curve, every rank gets a contiguous range of cells with the same share of the particles
+        const unsigned shift = 3 * Physics::MORTON_BITS - HISTOGRAM_BITS;
+        std::vector<uint64_t> histogram((size_t)1 << HISTOGRAM_BITS, 0);
+        for (uint64_t key : keys) histogram[key >> shift]++;
+        MPI_Allreduce(MPI_IN_PLACE, histogram.data(), (int)histogram.size(), MPI_UINT64_T, MPI_SUM, communicator);
+
+        uint64_t total = 0;
+        for (uint64_t cellCount : histogram) total += cellCount;
+
+        std::vector<int> owners(histogram.size());
+        uint64_t preceding = 0;
+        for (size_t cell = 0; cell < histogram.size(); cell++) {
+            owners[cell] = (int)std::min<uint64_t>(size - 1, preceding * size / total);
+            preceding += histogram[cell];
+        }
+
+        // records grouped by destination with a counting sort
+        std::vector<int> sendCounts(size, 0), receiveCounts(size);
+        for (uint64_t key : keys) sendCounts[owners[key >> shift]]++;
+
+        std::vector<int> sendDisplacements, receiveDisplacements;
+        computeDisplacements(sendCounts, sendDisplacements);
+
+        std::vector<ParticleRecord> sent(count);
+        std::vector<int> cursors = sendDisplacements;
+        for (size_t i = 0; i < count; i++) {
+            sent[cursors[owners[keys[i] >> shift]]++] = makeRecord(system, i, ids[i], keys[i]);
+        }
+
+        MPI_Alltoall(sendCounts.data(), 1, MPI_INT, receiveCounts.data(), 1, MPI_INT, communicator);
+        std::vector<ParticleRecord> received(computeDisplacements(receiveCounts, receiveDisplacements));
+
+        RecordType recordType(sizeof(ParticleRecord));
+        MPI_Alltoallv(sent.data(), sendCounts.data(), sendDisplacements.data(), recordType,
+            received.data(), receiveCounts.data(), receiveDisplacements.data(), recordType, communicator);
+
+        // the ids break the ties, so the order does not depend on the order of arrival
+        std::sort(received.begin(), received.end(), [](const ParticleRecord& a, const ParticleRecord& b) {
+            return a.key != b.key ? a.key < b.key : a.id < b.id;
+        });
+        loadRecords(system, received, &ids);
+
+        const size_t migrated = count - sendCounts[rank];
+        lastMigrated = (size_t)sum(migrated);
+        return migrated;
+    }
+
+    std::vector<Bounds> DomainDecomposition::exchangeBounds(const glm::vec3* positions, size_t count) const {
+        const Bounds local = computeBounds(positions, count);
+        const float corners[6] = { local.lower.x, local.lower.y, local.lower.z, local.upper.x, local.upper.y, local.upper.z };
+
+        std::vector<float> gathered(6 * size);
+        MPI_Allgather(corners, 6, MPI_FLOAT, gathered.data(), 6, MPI_FLOAT, communicator);
+
+        std::vector<Bounds> bounds(size);
+        for (int r = 0; r < size; r++) {
+            bounds[r].lower = glm::vec3(gathered[6 * r], gathered[6 * r + 1], gathered[6 * r + 2]);
+            bounds[r].upper = glm::vec3(gathered[6 * r + 3], gathered[6 * r + 4], gathered[6 * r + 5]);
+        }
+        return bounds;
+    }
+
+    void DomainDecomposition::gather(const Physics::ParticleSystem& system, const std::vector<uint64_t>& ids, Physics::ParticleSystem& global, int root) const {
+        std::vector<ParticleRecord> sent(system.size());
+        for (size_t i = 0; i < system.size(); i++) sent[i] = makeRecord(system, i, ids[i], 0);
+
+        const int count = (int)sent.size();
+        std::vector<int> receiveCounts(rank == root ? size : 0), receiveDisplacements;
+        MPI_Gather(&count, 1, MPI_INT, receiveCounts.data(), 1, MPI_INT, root, communicator);
+
+        std::vector<ParticleRecord> received(rank == root ? computeDisplacements(receiveCounts, receiveDisplacements) : 0);
+        RecordType recordType(sizeof(ParticleRecord));
+        MPI_Gatherv(sent.data(), count, recordType, received.data(), receiveCounts.data(), receiveDisplacements.data(), recordType, root, communicator);
+        if (rank != root) return;
+
+        std::sort(received.begin(), received.end(), [](const ParticleRecord& a, const ParticleRecord& b) {
+            return a.id < b.id;
+        });
+        loadRecords(global, received, nullptr);
+    }
+
+    uint64_t DomainDecomposition::sum(uint64_t value) const {
+        uint64_t total = 0;
+        MPI_Allreduce(&value, &total, 1, MPI_UINT64_T, MPI_SUM, communicator);
+        return total;
+    }
+
+    Physics::SystemDiagnostics DomainDecomposition::reduce(const Physics::SystemDiagnostics& local) const {
+        double values[9] = {
+            local.kineticEnergy, local.potentialEnergy, local.interactionEnergy,
+            local.momentum.x, local.momentum.y, local.momentum.z,
+            local.angularMomentum.x, local.angularMomentum.y, local.angularMomentum.z
+        };
+        MPI_Allreduce(MPI_IN_PLACE, values, 9, MPI_DOUBLE, MPI_SUM, communicator);
+
+        Physics::SystemDiagnostics total;
+        total.time = local.time;
+        total.kineticEnergy = values[0];
+        total.potentialEnergy = values[1];
+        total.interactionEnergy = values[2];
+        total.momentum = glm::dvec3(values[3], values[4], values[5]);
+        total.angularMomentum = glm::dvec3(values[6], values[7], values[8]);
+        return total;
+    }
+}
+
+namespace Physics {
+
+    namespace {
+        // Number of targets in a block of the energy reduction, fixed so that the sum does not depend on the thread count
+        const size_t ENERGY_BLOCK = 1024;
+
+        // Number of own targets evaluated between two tests of the transfers of the exchange, a multiple of ENERGY_BLOCK
+        const size_t PROGRESS_BLOCK = 4 * ENERGY_BLOCK;
+
+        float distanceSquaredToBounds(const glm::vec3& point, const Parallel::Bounds& bounds) {
+            glm::vec3 outside = glm::max(glm::max(bounds.lower - point, point - bounds.upper), glm::vec3(0.0f));
+            return glm::dot(outside, outside);
+        }
+
+        /**
+         * @brief Sources of a tree needed by the targets in the given bounds
+         *
+         * The opening test of Octree::computeField is applied with the distance from the bounds, the smallest distance
+         * from any target in them, so a cell exported as pseudo-particles would not have been opened by any of the targets.
+         */
+        void exportSources(const Octree& tree, const Parallel::Bounds& bounds, float openingAngle, std::vector<Octree::Source>& exported) {
+            const std::vector<Octree::Node>& nodes = tree.getNodes();
+            const std::vector<Octree::Source>& sources = tree.getSources();
+            if (nodes.empty()) return;
+
+            const float openingAngleSquared = openingAngle * openingAngle;
+            std::vector<unsigned> stack(1, 0);
+
+            while (!stack.empty()) {
+                const Octree::Node& node = nodes[stack.back()];
+                stack.pop_back();
+
+                if (node.childCount == 0) {
+                    exported.insert(exported.end(), sources.begin() + node.firstSource, sources.begin() + node.firstSource + node.sourceCount);
+                    continue;
+                }
+
+                const float sizeSquared = 4.0f * node.halfSize * node.halfSize;
+                bool far = true;
+                if (node.mass != 0.0f) far = sizeSquared < openingAngleSquared * distanceSquaredToBounds(node.massCenter, bounds);
+                if (far && node.absCharge != 0.0f) far = sizeSquared < openingAngleSquared * distanceSquaredToBounds(node.chargeCenter, bounds);
+
+                if (far) {
+                    // the same two pseudo-particles as in the traversal, one carrying the mass and one carrying the charge
+                    if (node.mass != 0.0f) {
+                        Octree::Source source = { node.massCenter, node.mass, 0.0f };
+                        exported.push_back(source);
+                    }
+                    if (node.charge != 0.0f) {
+                        Octree::Source source = { node.chargeCenter, 0.0f, node.charge };
+                        exported.push_back(source);
+                    }
+                }
+                else {
+                    for (unsigned c = node.firstChild; c < node.firstChild + node.childCount; c++) stack.push_back(c);
+                }
+            }
+        }
+
+        /**
+         * @brief Half of the potential energy of the targets in [begin, end) in the field of a set of sources
+         *
+         * Evaluated on the tree over the sources when given, with the direct sum otherwise. begin is a multiple of
+         * ENERGY_BLOCK, so the blocks and the sum do not depend on how the targets are split.
+         */
+        double computeHalfEnergy(const NBodyInteraction& interaction, const Octree* tree,
+            const glm::vec3* sourcePositions, const float* sourceMasses, const float* sourceCharges, size_t sourceCount,
+            const glm::vec3* positions, const float* masses, const float* charges, size_t begin, size_t end, Parallel::ThreadPool* pool) {
+
+            const size_t blockCount = (end - begin + ENERGY_BLOCK - 1) / ENERGY_BLOCK;
+            std::vector<double> blockEnergies(blockCount, 0.0);
+
+            Parallel::parallelFor(pool, blockCount, 1, [&](size_t firstBlock, size_t lastBlock) {
+                for (size_t block = firstBlock; block < lastBlock; block++) {
+                    double energy = 0.0;
+
+                    for (size_t i = begin + block * ENERGY_BLOCK; i < std::min(end, begin + (block + 1) * ENERGY_BLOCK); i++) {
+                        FieldSample sample;
+                        if (tree) tree->computeField(positions[i], interaction.getOpeningAngle(), interaction.getSoftening(), sample);
+                        else computeDirectField(positions[i], sourcePositions, sourceMasses, sourceCharges, sourceCount, interaction.getSoftening(), sample);
+
+                        if (masses) energy -= (double)G * masses[i] * sample.gravityPotential;
+                        if (charges) energy += (double)k_e * charges[i] * sample.electricPotential;
+                    }
+
+                    blockEnergies[block] = 0.5 * energy;
+                }
+            });
+
+            double totalEnergy = 0.0;
+            for (double energy : blockEnergies) totalEnergy += energy;
+            return totalEnergy;
+        }
+
+        /// @brief Imported sources as the separate arrays of the N-body kernels
+        struct SourceArrays {
+            std::vector<glm::vec3> positions;
+            std::vector<float> masses;
+            std::vector<float> charges;
+
+            void assign(const std::vector<Octree::Source>& sources) {
+                positions.resize(sources.size());
+                masses.resize(sources.size());
+                charges.resize(sources.size());
+                for (size_t i = 0; i < sources.size(); i++) {
+                    positions[i] = sources[i].position;
+                    masses[i] = sources[i].mass;
+                    charges[i] = sources[i].charge;
+                }
+            }
+        };
+    }
+
+    // DistributedNBodyInteraction implementations
+    DistributedNBodyInteraction::DistributedNBodyInteraction(const NBodyInteraction& interaction, const Parallel::DomainDecomposition& decomposition)
+        : interaction(interaction), decomposition(decomposition), lastImported(0) {}
+
+    const NBodyInteraction& DistributedNBodyInteraction::getInteraction() const {
+        return interaction;
+    }
+
+    size_t DistributedNBodyInteraction::getLastImported() const {
+        return lastImported;
+    }
+
+    ForceDescriptor DistributedNBodyInteraction::describe() const {
+        return interaction.describe();
+    }
+
+    template <typename Local>
+    void DistributedNBodyInteraction::exchange(const ParticleSystem& system, const glm::vec3* positions, std::vector<Octree::Source>& imported, Local local, Parallel::ThreadPool* pool) const {
+        const MPI_Comm communicator = decomposition.getCommunicator();
+        const int rank = decomposition.getRank();
+        const int size = decomposition.getSize();
+        const size_t count = system.size();
+
+        const float* masses = (interaction.getKinds() & NBodyInteraction::Gravitational) ? system.getMasses() : nullptr;
+        const float* charges = (interaction.getKinds() & NBodyInteraction::Electric) ? system.getCharges() : nullptr;
+        const size_t sourceCount = (masses || charges) ? count : 0;
+        const std::vector<Parallel::Bounds> bounds = decomposition.exchangeBounds(positions, count);
+
+        static thread_local Octree cachedTree;
+        static thread_local std::vector<std::vector<Octree::Source> > cachedExports;
+        const Octree& tree = cachedTree; // the workers must read the buffers of the calling thread
+        std::vector<std::vector<Octree::Source> >& exports = cachedExports;
+        exports.resize(size);
+
+        // a direct sum never approximates, so every source is exported, in the slot of the own rank, without a tree
+        const bool direct = interaction.getMethod() == NBodyInteraction::Direct;
+        if (direct) {
+            std::vector<Octree::Source>& sources = exports[rank];
+            sources.resize(sourceCount);
+            for (size_t i = 0; i < sourceCount; i++) {
+                sources[i].position = positions[i];
+                sources[i].mass = masses ? masses[i] : 0.0f;
+                sources[i].charge = charges ? charges[i] : 0.0f;
+            }
+        }
+        else {
+            cachedTree.setLeafSize(interaction.getLeafSize());
+            cachedTree.build(positions, masses, charges, sourceCount);
+
+            Parallel::parallelFor(pool, size, 1, [&](size_t begin, size_t end) {
+                for (size_t r = begin; r < end; r++) {
+                    exports[r].clear();
+                    if ((int)r != rank && !bounds[r].isEmpty()) exportSources(tree, bounds[r], interaction.getOpeningAngle(), exports[r]);
+                }
+            });
+        }
+
+        std::vector<int> sendCounts(size), receiveCounts(size);
+        for (int r = 0; r < size; r++) {
+            if (r == rank) sendCounts[r] = 0;
+            else if (direct) sendCounts[r] = bounds[r].isEmpty() ? 0 : (int)exports[rank].size();
+            else sendCounts[r] = (int)exports[r].size();
+        }
+        MPI_Alltoall(sendCounts.data(), 1, MPI_INT, receiveCounts.data(), 1, MPI_INT, communicator);
+
+        size_t total = 0;
+        for (int r = 0; r < size; r++) total += receiveCounts[r];
+        imported.resize(total);
+
+        RecordType sourceType(sizeof(Octree::Source));
+        std::vector<MPI_Request> requests;
+        requests.reserve(2 * size);
+        size_t offset = 0;
+        for (int r = 0; r < size; r++) {
+            if (receiveCounts[r] == 0) continue;
+            requests.push_back(MPI_REQUEST_NULL);
+            MPI_Irecv(imported.data() + offset, receiveCounts[r], sourceType, r, SOURCE_TAG, communicator, &requests.back());
+            offset += receiveCounts[r];
+        }
+        for (int r = 0; r < size; r++) {
+            if (sendCounts[r] == 0) continue;
+            requests.push_back(MPI_REQUEST_NULL);
+            MPI_Isend(exports[direct ? rank : r].data(), sendCounts[r], sourceType, r, SOURCE_TAG, communicator, &requests.back());
+        }
+
+        // the own sources are evaluated while the trees of the other ranks are in flight, on the tree built for the export when
+        // the wrapped interaction would build the same one; testing the requests between the blocks lets the transfers progress
+        // in MPI libraries without an asynchronous progress thread
+        const Octree* localTree = (!direct && interaction.resolveMethod(sourceCount) == NBodyInteraction::BarnesHut) ? &tree : nullptr;
+        int complete = requests.empty();
+        for (size_t begin = 0; begin < count; begin += PROGRESS_BLOCK) {
+            local(localTree, begin, std::min(count, begin + PROGRESS_BLOCK));
+            if (!complete) MPI_Testall((int)requests.size(), requests.data(), &complete, MPI_STATUSES_IGNORE);
+        }
+
+        MPI_Waitall((int)requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+        lastImported = imported.size();
+    }
+
+    void DistributedNBodyInteraction::computeForces(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, glm::vec3* forces, Parallel::ThreadPool* pool) const {
+        static thread_local std::vector<Octree::Source> imported;
+        static thread_local SourceArrays arrays;
+
+        const size_t count = system.size();
+        const float* masses = system.getMasses();
+        const float* charges = system.getCharges();
+
+        exchange(system, positions, imported, [&](const Octree* tree, size_t begin, size_t end) {
+            if (tree) interaction.computeForces(*tree, positions + begin, masses + begin, charges + begin, end - begin, forces + begin, pool);
+            else interaction.computeForces(positions, masses, charges, count, positions + begin, masses + begin, charges + begin, end - begin, forces + begin, pool);
+        }, pool);
+
+        if (imported.empty()) return;
+        arrays.assign(imported);
+        interaction.computeForces(
+            arrays.positions.data(), arrays.masses.data(), arrays.charges.data(), arrays.positions.size(),
+            positions, masses, charges, count,
+            forces, pool
+        );
+    }
+
+    float DistributedNBodyInteraction::computeEnergy(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, Parallel::ThreadPool* pool) const {
+        static thread_local std::vector<Octree::Source> imported;
+        static thread_local SourceArrays cachedArrays;
+        const SourceArrays& arrays = cachedArrays; // the workers must read the buffers of the calling thread
+
+        const size_t count = system.size();
+        const float* masses = (interaction.getKinds() & NBodyInteraction::Gravitational) ? system.getMasses() : nullptr;
+        const float* charges = (interaction.getKinds() & NBodyInteraction::Electric) ? system.getCharges() : nullptr;
+
+        // every pair of own particles is counted twice, once from each side
+        double localEnergy = 0.0;
+        exchange(system, positions, imported, [&](const Octree* tree, size_t begin, size_t end) {
+            if (masses || charges) localEnergy += computeHalfEnergy(interaction, tree, positions, masses, charges, count, positions, masses, charges, begin, end, pool);
+        }, pool);
+
+        if (imported.empty() || count == 0) return (float)localEnergy;
+
+        cachedArrays.assign(imported);
+        const size_t importedCount = arrays.positions.size();
+        const bool useTree = interaction.resolveMethod(importedCount) == NBodyInteraction::BarnesHut;
+
+        static thread_local Octree cachedTree;
+        if (useTree) {
+            cachedTree.setLeafSize(interaction.getLeafSize());
+            cachedTree.build(arrays.positions.data(), arrays.masses.data(), arrays.charges.data(), importedCount);
+        }
+
+        // every pair with a particle of another rank is counted by both ranks
+        const double crossEnergy = computeHalfEnergy(interaction, useTree ? &cachedTree : nullptr,
+            arrays.positions.data(), arrays.masses.data(), arrays.charges.data(), importedCount,
+            positions, masses, charges, 0, count, pool);
+
+        return (float)(localEnergy + crossEnergy);
+    }
+}
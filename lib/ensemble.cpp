@@ -0,0 +1,776 @@
+#include "ensemble.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include "field.hpp"
+#include "interaction.hpp"
+#include "nbody.hpp"
+#include "profiler.hpp"
+#include "threadpool.hpp"
+
+// The row kernels of the propagation promise the compiler that their arrays do not overlap
+#if defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)
+#define ENSEMBLE_RESTRICT __restrict
+#else
+#define ENSEMBLE_RESTRICT
+#endif
+
+namespace Physics {
+
+    namespace {
+        // Number of members advanced together, sized so that the state and scratch arrays of a block of a few particles stay in the L1/L2 cache
+        const size_t ENSEMBLE_BLOCK = 256;
+
+        /// @brief Append the leaves of a force, false if one of them is not supported by the ensembles
+        bool collectForces(const Force& force, std::vector<ForceDescriptor>& descriptors) {
+            ForceDescriptor descriptor = force.describe();
+
+            if (descriptor.type == ForceDescriptor::Composite) {
+                for (size_t i = 0; i < force.getComponentCount(); i++) {
+                    if (!collectForces(force.getComponent(i), descriptors)) return false;
+                }
+                return true;
+            }
+
+            descriptors.push_back(descriptor);
+            return Ensemble::isSupported(descriptor.type);
+        }
+
+        /// @brief Potential energy of a particle of a member due to a force or field, 0 for the interactions
+        double particleEnergy(const Ensemble& ensemble, const EnsembleForce& force, size_t member, size_t particle, float time) {
+            const size_t i = ensemble.index(member, particle);
+            const glm::vec3 position = ensemble.getPosition(member, particle);
+            const float mass = ensemble.getMasses()[i];
+            const float charge = ensemble.getCharges()[i];
+
+            float p[ForceDescriptor::MAX_PARAMETERS];
+            for (int k = 0; k < ForceDescriptor::MAX_PARAMETERS; k++) p[k] = force.parameters[k][member];
+
+            switch (force.type) {
+                case ForceDescriptor::Electric:
+                    return -k_e * p[0] * p[1] / glm::length(position - glm::vec3(p[2], p[3], p[4]));
+                case ForceDescriptor::Gravitational:
+                    return -G * p[0] * p[1] / glm::length(position - glm::vec3(p[2], p[3], p[4]));
+                case ForceDescriptor::EarthGravitational:
+                    return p[0] * g * position.y;
+                case ForceDescriptor::Hooke: {
+                    const glm::vec3 distance = position - glm::vec3(p[1], p[2], p[3]);
+                    return 0.5f * p[0] * glm::dot(distance, distance);
+                }
+                case ForceDescriptor::AirResistance: {
+                    const glm::vec3 velocity = ensemble.getVelocity(member, particle);
+                    return 0.5f * p[0] * glm::dot(velocity, velocity);
+                }
+                case ForceDescriptor::Driving:
+                    return -(p[6] + p[3] * std::sin(p[4] * time + p[5])) * glm::dot(glm::vec3(p[0], p[1], p[2]), position);
+                case ForceDescriptor::UniformGravityField:
+                    return -mass * glm::dot(glm::vec3(p[0], p[1], p[2]), position);
+                case ForceDescriptor::PointGravityField:
+                    return -G * p[0] * mass / glm::length(position - glm::vec3(p[1], p[2], p[3]));
+                case ForceDescriptor::UniformElectricField:
+                    return -charge * glm::dot(glm::vec3(p[0], p[1], p[2]), position);
+                case ForceDescriptor::PointChargeField:
+                    return k_e * p[0] * charge / glm::length(position - glm::vec3(p[1], p[2], p[3]));
+                default:
+                    return 0.0;
+            }
+        }
+
+        /// @brief Potential energy of the pairs of particles of a member, each pair counted once
+        double interactionEnergy(const Ensemble& ensemble, const EnsembleForce& force, size_t member) {
+            const unsigned kinds = (unsigned)force.parameters[0][member];
+            const float softeningSquared = force.parameters[3][member] * force.parameters[3][member];
+
+            double energy = 0.0;
+            for (size_t a = 0; a < ensemble.getParticleCount(); a++) {
+                for (size_t b = a + 1; b < ensemble.getParticleCount(); b++) {
+                    const glm::vec3 distance = ensemble.getPosition(member, b) - ensemble.getPosition(member, a);
+                    const float distanceSquared = glm::dot(distance, distance);
+                    if (distanceSquared == 0.0f) continue;
+
+                    const double inverseDistance = 1.0 / std::sqrt(distanceSquared + softeningSquared);
+                    if (kinds & NBodyInteraction::Gravitational) energy -= (double)G * ensemble.getMass(member, a) * ensemble.getMass(member, b) * inverseDistance;
+                    if (kinds & NBodyInteraction::Electric) energy += (double)k_e * ensemble.getCharge(member, a) * ensemble.getCharge(member, b) * inverseDistance;
+                }
+            }
+            return energy;
+        }
+    }
+
+    // Ensemble implementations
+    Ensemble::Ensemble() : memberCount(0), particleCount(0), accelerationsValid(false) {}
+
+    bool Ensemble::isSupported(uint32_t type) {
+        switch (type) {
+            case ForceDescriptor::Electric:
+            case ForceDescriptor::Gravitational:
+            case ForceDescriptor::EarthGravitational:
+            case ForceDescriptor::Hooke:
+            case ForceDescriptor::AirResistance:
+            case ForceDescriptor::Driving:
+            case ForceDescriptor::UniformGravityField:
+            case ForceDescriptor::PointGravityField:
+            case ForceDescriptor::UniformElectricField:
+            case ForceDescriptor::PointChargeField:
+            case ForceDescriptor::NBody:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool Ensemble::assign(const ParticleSystem& prototype, size_t count) {
+        clear();
+
+        std::vector<ForceDescriptor> descriptors;
+        bool supported = collectForces(prototype.appliedForces, descriptors);
+        for (const Field* field : prototype.getFields()) {
+            descriptors.push_back(field->describe());
+            supported = supported && isSupported(descriptors.back().type);
+        }
+        for (const Interaction* interaction : prototype.getInteractions()) {
+            descriptors.push_back(interaction->describe());
+            supported = supported && isSupported(descriptors.back().type);
+        }
+        if (!supported) return false;
+
+        memberCount = count;
+        particleCount = prototype.size();
+
+        const size_t elements = memberCount * particleCount;
+        for (int axis = 0; axis < 3; axis++) {
+            positions[axis].resize(elements);
+            velocities[axis].resize(elements);
+            accelerations[axis].resize(elements);
+        }
+        masses.resize(elements);
+        charges.resize(elements);
+
+        for (size_t particle = 0; particle < particleCount; particle++) {
+            const glm::vec3 position = prototype.getPosition(particle);
+            const glm::vec3 velocity = prototype.getVelocity(particle);
+
+            const size_t row = particle * memberCount;
+            for (int axis = 0; axis < 3; axis++) {
+                std::fill(positions[axis].begin() + row, positions[axis].begin() + row + memberCount, position[axis]);
+                std::fill(velocities[axis].begin() + row, velocities[axis].begin() + row + memberCount, velocity[axis]);
+            }
+            std::fill(masses.begin() + row, masses.begin() + row + memberCount, prototype.getMass(particle));
+            std::fill(charges.begin() + row, charges.begin() + row + memberCount, prototype.getCharge(particle));
+        }
+
+        for (const ForceDescriptor& descriptor : descriptors) addForce(descriptor);
+        return true;
+    }
+
+    void Ensemble::clear() {
+        memberCount = particleCount = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            positions[axis].clear();
+            velocities[axis].clear();
+            accelerations[axis].clear();
+        }
+        masses.clear();
+        charges.clear();
+        forces.clear();
+        accelerationsValid = false;
+    }
+
+    bool Ensemble::addForce(const ForceDescriptor& descriptor) {
+        if (!isSupported(descriptor.type)) return false;
+
+        EnsembleForce force;
+        force.type = descriptor.type;
+        for (int k = 0; k < ForceDescriptor::MAX_PARAMETERS; k++) force.parameters[k].assign(memberCount, descriptor.parameters[k]);
+
+        forces.push_back(force);
+        accelerationsValid = false;
+        return true;
+    }
+
+    size_t Ensemble::getMemberCount() const {
+        return memberCount;
+    }
+
+    size_t Ensemble::getParticleCount() const {
+        return particleCount;
+    }
+
+    size_t Ensemble::getForceCount() const {
+        return forces.size();
+    }
+
+    const EnsembleForce& Ensemble::getForce(size_t force) const {
+        return forces[force];
+    }
+
+    float Ensemble::getForceParameter(size_t force, size_t member, int parameter) const {
+        return forces[force].parameters[parameter][member];
+    }
+
+    void Ensemble::setForceParameter(size_t force, size_t member, int parameter, float value) {
+        forces[force].parameters[parameter][member] = value;
+        accelerationsValid = false;
+    }
+
+    size_t Ensemble::index(size_t member, size_t particle) const {
+        return particle * memberCount + member;
+    }
+
+    glm::vec3 Ensemble::getPosition(size_t member, size_t particle) const {
+        const size_t i = index(member, particle);
+        return glm::vec3(positions[0][i], positions[1][i], positions[2][i]);
+    }
+
+    glm::vec3 Ensemble::getVelocity(size_t member, size_t particle) const {
+        const size_t i = index(member, particle);
+        return glm::vec3(velocities[0][i], velocities[1][i], velocities[2][i]);
+    }
+
+    float Ensemble::getMass(size_t member, size_t particle) const {
+        return masses[index(member, particle)];
+    }
+
+    float Ensemble::getCharge(size_t member, size_t particle) const {
+        return charges[index(member, particle)];
+    }
+
+    void Ensemble::setPosition(size_t member, size_t particle, const glm::vec3& pos) {
+        const size_t i = index(member, particle);
+        for (int axis = 0; axis < 3; axis++) positions[axis][i] = pos[axis];
+        accelerationsValid = false;
+    }
+
+    void Ensemble::setVelocity(size_t member, size_t particle, const glm::vec3& vel) {
+        const size_t i = index(member, particle);
+        for (int axis = 0; axis < 3; axis++) velocities[axis][i] = vel[axis];
+        accelerationsValid = false;
+    }
+
+    void Ensemble::setMass(size_t member, size_t particle, float m) {
+        masses[index(member, particle)] = m;
+        accelerationsValid = false;
+    }
+
+    void Ensemble::setCharge(size_t member, size_t particle, float q) {
+        charges[index(member, particle)] = q;
+        accelerationsValid = false;
+    }
+
+    float* Ensemble::getPositions(int axis) {
+        return positions[axis].data();
+    }
+
+    float* Ensemble::getVelocities(int axis) {
+        return velocities[axis].data();
+    }
+
+    const float* Ensemble::getPositions(int axis) const {
+        return positions[axis].data();
+    }
+
+    const float* Ensemble::getVelocities(int axis) const {
+        return velocities[axis].data();
+    }
+
+    float* Ensemble::getMasses() {
+        return masses.data();
+    }
+
+    float* Ensemble::getCharges() {
+        return charges.data();
+    }
+
+    const float* Ensemble::getMasses() const {
+        return masses.data();
+    }
+
+    const float* Ensemble::getCharges() const {
+        return charges.data();
+    }
+
+    bool Ensemble::hasAccelerations() const {
+        return accelerationsValid;
+    }
+
+    float* Ensemble::getAccelerations(int axis) {
+        return accelerations[axis].data();
+    }
+
+    const float* Ensemble::getAccelerations(int axis) const {
+        return accelerations[axis].data();
+    }
+
+    void Ensemble::validateAccelerations() {
+        accelerationsValid = true;
+    }
+
+    void Ensemble::invalidateAccelerations() {
+        accelerationsValid = false;
+    }
+
+    void computeEnsembleEnergies(const Ensemble& ensemble, float time, double* kinetic, double* potential, Parallel::ThreadPool* pool) {
+        DSIM_PROFILE_SCOPE("computeEnsembleEnergies");
+
+        Parallel::parallelFor(pool, ensemble.getMemberCount(), ENSEMBLE_BLOCK, [&](size_t memberBegin, size_t memberEnd) {
+            for (size_t member = memberBegin; member < memberEnd; member++) {
+                double kineticEnergy = 0.0;
+                double potentialEnergy = 0.0;
+
+                for (size_t particle = 0; particle < ensemble.getParticleCount(); particle++) {
+                    const glm::vec3 velocity = ensemble.getVelocity(member, particle);
+                    kineticEnergy += 0.5 * ensemble.getMass(member, particle) * glm::dot(velocity, velocity);
+                }
+
+                for (size_t force = 0; force < ensemble.getForceCount(); force++) {
+                    const EnsembleForce& ensembleForce = ensemble.getForce(force);
+                    if (ensembleForce.type == ForceDescriptor::NBody) {
+                        potentialEnergy += interactionEnergy(ensemble, ensembleForce, member);
+                        continue;
+                    }
+                    for (size_t particle = 0; particle < ensemble.getParticleCount(); particle++) {
+                        potentialEnergy += particleEnergy(ensemble, ensembleForce, member, particle, time);
+                    }
+                }
+
+                kinetic[member] = kineticEnergy;
+                potential[member] = potentialEnergy;
+            }
+        });
+    }
+
+    // EnsembleSummary implementations
+    EnsembleSummary::EnsembleSummary()
+        : count(0), mean(0.0), standardDeviation(0.0), minimum(0.0), lowerQuantile(0.0), median(0.0), upperQuantile(0.0), maximum(0.0) {}
+
+    EnsembleSummary summarize(const double* values, size_t count) {
+        EnsembleSummary summary;
+        summary.count = count;
+        if (count == 0) return summary;
+
+        std::vector<double> sorted(values, values + count);
+        std::sort(sorted.begin(), sorted.end());
+
+        double sum = 0.0;
+        for (double value : sorted) sum += value;
+        summary.mean = sum / count;
+
+        double squares = 0.0;
+        for (double value : sorted) squares += (value - summary.mean) * (value - summary.mean);
+        summary.standardDeviation = count > 1 ? std::sqrt(squares / (count - 1)) : 0.0;
+
+        // linear interpolation between the closest ranks
+        auto quantile = [&](double fraction) {
+            const double rank = fraction * (count - 1);
+            const size_t below = (size_t)rank;
+            const size_t above = std::min(below + 1, count - 1);
+            return sorted[below] + (rank - below) * (sorted[above] - sorted[below]);
+        };
+
+        summary.minimum = sorted.front();
+        summary.lowerQuantile = quantile(0.05);
+        summary.median = quantile(0.5);
+        summary.upperQuantile = quantile(0.95);
+        summary.maximum = sorted.back();
+        return summary;
+    }
+}
+
+namespace Propagation {
+
+    namespace {
+        const float ENSEMBLE_RK4_STAGE_STEPS[3] = { 0.5f, 0.5f, 1.0f };
+        const float ENSEMBLE_RK4_STAGE_WEIGHTS[4] = { 1.0f, 2.0f, 2.0f, 1.0f };
+
+        /// @brief Coordinate arrays of a state, indexed like the state arrays of the ensemble
+        struct StateArrays {
+            const float* position[3];
+            const float* velocity[3];
+        };
+
+        /// @brief Block of members [memberBegin, memberEnd) of an ensemble, the kernels loop over its members innermost
+        struct MemberBlock {
+            const Physics::Ensemble& ensemble;
+            size_t memberBegin;
+            size_t memberEnd;
+        };
+
+        /*
+         * Row kernels: loops over count consecutive members of one particle, the innermost loops of the propagation.
+         * The arrays of a call never overlap, which lets the compiler vectorize them without checking for aliasing at run time.
+         */
+
+        /// @brief Inverse-square force towards an anchor, coefficients[j] * scales[j] / r^2 (scales are the masses or charges, or nullptr for 1)
+        template<bool Scaled>
+        void centralRow(size_t count, const float* ENSEMBLE_RESTRICT x, const float* ENSEMBLE_RESTRICT y, const float* ENSEMBLE_RESTRICT z,
+            const float* ENSEMBLE_RESTRICT anchorX, const float* ENSEMBLE_RESTRICT anchorY, const float* ENSEMBLE_RESTRICT anchorZ,
+            const float* ENSEMBLE_RESTRICT coefficients, const float* ENSEMBLE_RESTRICT scales,
+            float* ENSEMBLE_RESTRICT forceX, float* ENSEMBLE_RESTRICT forceY, float* ENSEMBLE_RESTRICT forceZ) {
+
+            for (size_t j = 0; j < count; j++) {
+                const float dx = x[j] - anchorX[j];
+                const float dy = y[j] - anchorY[j];
+                const float dz = z[j] - anchorZ[j];
+                const float distanceSquared = dx * dx + dy * dy + dz * dz;
+
+                const float weight = (Scaled ? coefficients[j] * scales[j] : coefficients[j]) / (distanceSquared * std::sqrt(distanceSquared));
+                forceX[j] += weight * dx;
+                forceY[j] += weight * dy;
+                forceZ[j] += weight * dz;
+            }
+        }
+
+        /// @brief Uniform force along one axis, vector[j] * scales[j]
+        void uniformRow(size_t count, const float* ENSEMBLE_RESTRICT vector, const float* ENSEMBLE_RESTRICT scales, float* ENSEMBLE_RESTRICT force) {
+            for (size_t j = 0; j < count; j++) force[j] += scales[j] * vector[j];
+        }
+
+        /// @brief NBody interaction between particles a and b, with the gravitational and Coulomb constants of each member (0 when disabled)
+        void pairRow(size_t count, const float* ENSEMBLE_RESTRICT gravity, const float* ENSEMBLE_RESTRICT electric, const float* ENSEMBLE_RESTRICT softeningSquared,
+            const float* ENSEMBLE_RESTRICT xa, const float* ENSEMBLE_RESTRICT ya, const float* ENSEMBLE_RESTRICT za,
+            const float* ENSEMBLE_RESTRICT xb, const float* ENSEMBLE_RESTRICT yb, const float* ENSEMBLE_RESTRICT zb,
+            const float* ENSEMBLE_RESTRICT massA, const float* ENSEMBLE_RESTRICT massB, const float* ENSEMBLE_RESTRICT chargeA, const float* ENSEMBLE_RESTRICT chargeB,
+            float* ENSEMBLE_RESTRICT forceXa, float* ENSEMBLE_RESTRICT forceYa, float* ENSEMBLE_RESTRICT forceZa,
+            float* ENSEMBLE_RESTRICT forceXb, float* ENSEMBLE_RESTRICT forceYb, float* ENSEMBLE_RESTRICT forceZb) {
+
+            for (size_t j = 0; j < count; j++) {
+                const float dx = xb[j] - xa[j];
+                const float dy = yb[j] - ya[j];
+                const float dz = zb[j] - za[j];
+                const float distanceSquared = dx * dx + dy * dy + dz * dz;
+
+                const float inverseDistance = distanceSquared > 0.0f ? 1.0f / std::sqrt(distanceSquared + softeningSquared[j]) : 0.0f;
+                const float weight = (gravity[j] * massA[j] * massB[j] - electric[j] * chargeA[j] * chargeB[j]) * inverseDistance * inverseDistance * inverseDistance;
+
+                forceXa[j] += weight * dx; forceYa[j] += weight * dy; forceZa[j] += weight * dz;
+                forceXb[j] -= weight * dx; forceYb[j] -= weight * dy; forceZb[j] -= weight * dz;
+            }
+        }
+
+        void explicitEulerRow(size_t count, float* ENSEMBLE_RESTRICT x, float* ENSEMBLE_RESTRICT v, const float* ENSEMBLE_RESTRICT f, const float* ENSEMBLE_RESTRICT m, float deltaTime) {
+            for (size_t j = 0; j < count; j++) {
+                x[j] += v[j] * deltaTime;
+                v[j] += (f[j] / m[j]) * deltaTime;
+            }
+        }
+
+        void simplecticEulerRow(size_t count, float* ENSEMBLE_RESTRICT x, float* ENSEMBLE_RESTRICT v, const float* ENSEMBLE_RESTRICT f, const float* ENSEMBLE_RESTRICT m, float deltaTime) {
+            for (size_t j = 0; j < count; j++) {
+                v[j] += (f[j] / m[j]) * deltaTime;
+                x[j] += v[j] * deltaTime;
+            }
+        }
+
+        /// @brief First half of a Verlet step: half kick and drift
+        void verletDriftRow(size_t count, float* ENSEMBLE_RESTRICT x, float* ENSEMBLE_RESTRICT v, const float* ENSEMBLE_RESTRICT a, float deltaTime) {
+            for (size_t j = 0; j < count; j++) {
+                v[j] += 0.5f * deltaTime * a[j];
+                x[j] += deltaTime * v[j];
+            }
+        }
+
+        /// @brief Second half of a Verlet step: new acceleration and half kick
+        void verletKickRow(size_t count, float* ENSEMBLE_RESTRICT v, float* ENSEMBLE_RESTRICT a, const float* ENSEMBLE_RESTRICT f, const float* ENSEMBLE_RESTRICT m, float deltaTime) {
+            for (size_t j = 0; j < count; j++) {
+                a[j] = f[j] / m[j];
+                v[j] += 0.5f * deltaTime * a[j];
+            }
+        }
+
+        /// @brief First Runge-Kutta stage, starting the sums and the state of the second stage
+        void rungeKutta4FirstRow(size_t count, const float* ENSEMBLE_RESTRICT x, const float* ENSEMBLE_RESTRICT v, const float* ENSEMBLE_RESTRICT f, const float* ENSEMBLE_RESTRICT m,
+            float stageStep, float* ENSEMBLE_RESTRICT stageX, float* ENSEMBLE_RESTRICT stageV, float* ENSEMBLE_RESTRICT sumKx, float* ENSEMBLE_RESTRICT sumKv) {
+
+            for (size_t j = 0; j < count; j++) {
+                const float dv = f[j] / m[j];
+                sumKx[j] = v[j];
+                sumKv[j] = dv;
+                stageX[j] = x[j] + stageStep * v[j];
+                stageV[j] = v[j] + stageStep * dv;
+            }
+        }
+
+        /// @brief Second and third Runge-Kutta stages, the stage velocity is replaced with the one of the next stage
+        void rungeKutta4MiddleRow(size_t count, const float* ENSEMBLE_RESTRICT x, const float* ENSEMBLE_RESTRICT v, const float* ENSEMBLE_RESTRICT f, const float* ENSEMBLE_RESTRICT m,
+            float weight, float stageStep, float* ENSEMBLE_RESTRICT stageX, float* ENSEMBLE_RESTRICT stageV, float* ENSEMBLE_RESTRICT sumKx, float* ENSEMBLE_RESTRICT sumKv) {
+
+            for (size_t j = 0; j < count; j++) {
+                const float dx = stageV[j];
+                const float dv = f[j] / m[j];
+                sumKx[j] += weight * dx;
+                sumKv[j] += weight * dv;
+                stageX[j] = x[j] + stageStep * dx;
+                stageV[j] = v[j] + stageStep * dv;
+            }
+        }
+
+        /// @brief Last Runge-Kutta stage, completing the step
+        void rungeKutta4LastRow(size_t count, float* ENSEMBLE_RESTRICT x, float* ENSEMBLE_RESTRICT v, const float* ENSEMBLE_RESTRICT stageV, const float* ENSEMBLE_RESTRICT f, const float* ENSEMBLE_RESTRICT m,
+            float deltaTime, const float* ENSEMBLE_RESTRICT sumKx, const float* ENSEMBLE_RESTRICT sumKv) {
+
+            const float sixth = deltaTime / 6.0f;
+            for (size_t j = 0; j < count; j++) {
+                x[j] += sixth * (sumKx[j] + stageV[j]);
+                v[j] += sixth * (sumKv[j] + f[j] / m[j]);
+            }
+        }
+
+        /// @brief Evaluate every force, field and interaction acting on the particles of a block in the given state, overwriting forces
+        void evaluateEnsembleForces(const MemberBlock& block, const StateArrays& state, float time, float* const forces[3]) {
+            const Physics::Ensemble& ensemble = block.ensemble;
+            const size_t memberCount = ensemble.getMemberCount();
+            const size_t particleCount = ensemble.getParticleCount();
+            const size_t first = block.memberBegin;
+            const size_t width = block.memberEnd - block.memberBegin;
+            const float* masses = ensemble.getMasses();
+            const float* charges = ensemble.getCharges();
+
+            for (size_t particle = 0; particle < particleCount; particle++) {
+                const size_t row = particle * memberCount + first;
+                for (int axis = 0; axis < 3; axis++) std::fill(forces[axis] + row, forces[axis] + row + width, 0.0f);
+            }
+
+            float coefficients[Physics::ENSEMBLE_BLOCK], electric[Physics::ENSEMBLE_BLOCK], softeningSquared[Physics::ENSEMBLE_BLOCK];
+            for (size_t f = 0; f < ensemble.getForceCount(); f++) {
+                const Physics::EnsembleForce& force = ensemble.getForce(f);
+
+                // parameters of the first member of the block
+                const float* p[Physics::ForceDescriptor::MAX_PARAMETERS];
+                for (int k = 0; k < Physics::ForceDescriptor::MAX_PARAMETERS; k++) p[k] = force.parameters[k].data() + first;
+
+                switch (force.type) {
+                    case Physics::ForceDescriptor::Electric:
+                    case Physics::ForceDescriptor::Gravitational: {
+                        const float constant = force.type == Physics::ForceDescriptor::Electric ? -Physics::k_e : -Physics::G;
+                        for (size_t j = 0; j < width; j++) coefficients[j] = constant * p[0][j] * p[1][j];
+
+                        for (size_t particle = 0; particle < particleCount; particle++) {
+                            const size_t row = particle * memberCount + first;
+                            centralRow<false>(width, state.position[0] + row, state.position[1] + row, state.position[2] + row, p[2], p[3], p[4],
+                                coefficients, nullptr, forces[0] + row, forces[1] + row, forces[2] + row);
+                        }
+                        break;
+                    }
+                    case Physics::ForceDescriptor::PointGravityField:
+                    case Physics::ForceDescriptor::PointChargeField: {
+                        const bool gravity = force.type == Physics::ForceDescriptor::PointGravityField;
+                        const float constant = gravity ? -Physics::G : Physics::k_e;
+                        for (size_t j = 0; j < width; j++) coefficients[j] = constant * p[0][j];
+
+                        for (size_t particle = 0; particle < particleCount; particle++) {
+                            const size_t row = particle * memberCount + first;
+                            centralRow<true>(width, state.position[0] + row, state.position[1] + row, state.position[2] + row, p[1], p[2], p[3],
+                                coefficients, (gravity ? masses : charges) + row, forces[0] + row, forces[1] + row, forces[2] + row);
+                        }
+                        break;
+                    }
+                    case Physics::ForceDescriptor::UniformGravityField:
+                    case Physics::ForceDescriptor::UniformElectricField: {
+                        const float* scales = force.type == Physics::ForceDescriptor::UniformGravityField ? masses : charges;
+                        for (size_t particle = 0; particle < particleCount; particle++) {
+                            const size_t row = particle * memberCount + first;
+                            for (int axis = 0; axis < 3; axis++) uniformRow(width, p[axis], scales + row, forces[axis] + row);
+                        }
+                        break;
+                    }
+                    case Physics::ForceDescriptor::EarthGravitational:
+                        for (size_t particle = 0; particle < particleCount; particle++) {
+                            float* forceY = forces[1] + particle * memberCount + first;
+                            for (size_t j = 0; j < width; j++) forceY[j] -= p[0][j] * Physics::g;
+                        }
+                        break;
+                    case Physics::ForceDescriptor::Hooke:
+                        for (size_t particle = 0; particle < particleCount; particle++) {
+                            const size_t row = particle * memberCount + first;
+                            for (int axis = 0; axis < 3; axis++) {
+                                const float* x = state.position[axis] + row;
+                                float* forceAxis = forces[axis] + row;
+                                for (size_t j = 0; j < width; j++) forceAxis[j] -= p[0][j] * (x[j] - p[1 + axis][j]);
+                            }
+                        }
+                        break;
+                    case Physics::ForceDescriptor::AirResistance:
+                        for (size_t particle = 0; particle < particleCount; particle++) {
+                            const size_t row = particle * memberCount + first;
+                            for (int axis = 0; axis < 3; axis++) {
+                                const float* v = state.velocity[axis] + row;
+                                float* forceAxis = forces[axis] + row;
+                                for (size_t j = 0; j < width; j++) forceAxis[j] -= p[0][j] * v[j];
+                            }
+                        }
+                        break;
+                    case Physics::ForceDescriptor::Driving:
+                        // the profile depends on the member and the time only: evaluated once per member and stage, shared by the particles
+                        for (size_t j = 0; j < width; j++) coefficients[j] = p[6][j] + p[3][j] * std::sin(p[4][j] * time + p[5][j]);
+
+                        for (size_t particle = 0; particle < particleCount; particle++) {
+                            const size_t row = particle * memberCount + first;
+                            for (int axis = 0; axis < 3; axis++) uniformRow(width, p[axis], coefficients, forces[axis] + row);
+                        }
+                        break;
+                    case Physics::ForceDescriptor::NBody:
+                        for (size_t j = 0; j < width; j++) {
+                            const unsigned kinds = (unsigned)p[0][j];
+                            coefficients[j] = (kinds & Physics::NBodyInteraction::Gravitational) ? Physics::G : 0.0f;
+                            electric[j] = (kinds & Physics::NBodyInteraction::Electric) ? Physics::k_e : 0.0f;
+                            softeningSquared[j] = p[3][j] * p[3][j];
+                        }
+
+                        for (size_t a = 0; a < particleCount; a++) {
+                            for (size_t b = a + 1; b < particleCount; b++) {
+                                const size_t rowA = a * memberCount + first, rowB = b * memberCount + first;
+                                pairRow(width, coefficients, electric, softeningSquared,
+                                    state.position[0] + rowA, state.position[1] + rowA, state.position[2] + rowA,
+                                    state.position[0] + rowB, state.position[1] + rowB, state.position[2] + rowB,
+                                    masses + rowA, masses + rowB, charges + rowA, charges + rowB,
+                                    forces[0] + rowA, forces[1] + rowA, forces[2] + rowA, forces[0] + rowB, forces[1] + rowB, forces[2] + rowB);
+                            }
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+
+        /// @brief Take every step of a block of members, see advance
+        void advanceBlock(Physics::Ensemble& ensemble, EnsembleMethod method, EnsembleWorkspace& workspace, double currentTime, float deltaTime,
+            unsigned long long steps, bool computeAccelerations, size_t memberBegin, size_t memberEnd) {
+
+            const MemberBlock block = { ensemble, memberBegin, memberEnd };
+            const size_t memberCount = ensemble.getMemberCount();
+            const size_t particleCount = ensemble.getParticleCount();
+            const size_t width = memberEnd - memberBegin;
+            const float* masses = ensemble.getMasses();
+
+            float* positions[3], * velocities[3], * accelerations[3], * forces[3];
+            float* stagePositions[3], * stageVelocities[3], * sumKx[3], * sumKv[3];
+            for (int axis = 0; axis < 3; axis++) {
+                positions[axis] = ensemble.getPositions(axis);
+                velocities[axis] = ensemble.getVelocities(axis);
+                accelerations[axis] = ensemble.getAccelerations(axis);
+                forces[axis] = workspace.forces[axis].data();
+                stagePositions[axis] = workspace.stagePositions[axis].data();
+                stageVelocities[axis] = workspace.stageVelocities[axis].data();
+                sumKx[axis] = workspace.sumKx[axis].data();
+                sumKv[axis] = workspace.sumKv[axis].data();
+            }
+
+            const StateArrays current = { { positions[0], positions[1], positions[2] }, { velocities[0], velocities[1], velocities[2] } };
+            const StateArrays stage = { { stagePositions[0], stagePositions[1], stagePositions[2] }, { stageVelocities[0], stageVelocities[1], stageVelocities[2] } };
+
+            if (method == EnsembleMethod::VelocityVerlet && computeAccelerations) {
+                evaluateEnsembleForces(block, current, (float)currentTime, forces);
+                for (size_t particle = 0; particle < particleCount; particle++) {
+                    for (size_t i = particle * memberCount + memberBegin; i < particle * memberCount + memberEnd; i++) {
+                        for (int axis = 0; axis < 3; axis++) accelerations[axis][i] = forces[axis][i] / masses[i];
+                    }
+                }
+            }
+
+            for (unsigned long long step = 0; step < steps; step++) {
+                // the time is computed from the step count, so it does not accumulate rounding errors
+                const float time = (float)(currentTime + step * (double)deltaTime);
+
+                switch (method) {
+                    case EnsembleMethod::ExplicitEuler:
+                    case EnsembleMethod::SymplecticEuler:
+                        evaluateEnsembleForces(block, current, time, forces);
+                        for (size_t particle = 0; particle < particleCount; particle++) {
+                            const size_t row = particle * memberCount + memberBegin;
+                            for (int axis = 0; axis < 3; axis++) {
+                                if (method == EnsembleMethod::ExplicitEuler) explicitEulerRow(width, positions[axis] + row, velocities[axis] + row, forces[axis] + row, masses + row, deltaTime);
+                                else simplecticEulerRow(width, positions[axis] + row, velocities[axis] + row, forces[axis] + row, masses + row, deltaTime);
+                            }
+                        }
+                        break;
+
+                    case EnsembleMethod::VelocityVerlet:
+                        for (size_t particle = 0; particle < particleCount; particle++) {
+                            const size_t row = particle * memberCount + memberBegin;
+                            for (int axis = 0; axis < 3; axis++) verletDriftRow(width, positions[axis] + row, velocities[axis] + row, accelerations[axis] + row, deltaTime);
+                        }
+
+                        evaluateEnsembleForces(block, current, time + deltaTime, forces);
+                        for (size_t particle = 0; particle < particleCount; particle++) {
+                            const size_t row = particle * memberCount + memberBegin;
+                            for (int axis = 0; axis < 3; axis++) verletKickRow(width, velocities[axis] + row, accelerations[axis] + row, forces[axis] + row, masses + row, deltaTime);
+                        }
+                        break;
+
+                    case EnsembleMethod::RungeKutta4:
+                        for (int k = 0; k < 4; k++) {
+                            evaluateEnsembleForces(block, k == 0 ? current : stage, k == 0 ? time : time + ENSEMBLE_RK4_STAGE_STEPS[k - 1] * deltaTime, forces);
+
+                            for (size_t particle = 0; particle < particleCount; particle++) {
+                                const size_t row = particle * memberCount + memberBegin;
+
+                                for (int axis = 0; axis < 3; axis++) {
+                                    float* x = positions[axis] + row;
+                                    float* v = velocities[axis] + row;
+                                    const float* f = forces[axis] + row;
+                                    const float* m = masses + row;
+
+                                    if (k == 0) {
+                                        rungeKutta4FirstRow(width, x, v, f, m, ENSEMBLE_RK4_STAGE_STEPS[0] * deltaTime,
+                                            stagePositions[axis] + row, stageVelocities[axis] + row, sumKx[axis] + row, sumKv[axis] + row);
+                                    } else if (k < 3) {
+                                        rungeKutta4MiddleRow(width, x, v, f, m, ENSEMBLE_RK4_STAGE_WEIGHTS[k], ENSEMBLE_RK4_STAGE_STEPS[k] * deltaTime,
+                                            stagePositions[axis] + row, stageVelocities[axis] + row, sumKx[axis] + row, sumKv[axis] + row);
+                                    } else {
+                                        rungeKutta4LastRow(width, x, v, stageVelocities[axis] + row, f, m, deltaTime, sumKx[axis] + row, sumKv[axis] + row);
+                                    }
+                                }
+                            }
+                        }
+                        break;
+                }
+            }
+        }
+    }
+
+    bool findEnsembleMethod(const std::string& name, EnsembleMethod& method) {
+        if (name == "euler") method = EnsembleMethod::ExplicitEuler;
+        else if (name == "symplectic") method = EnsembleMethod::SymplecticEuler;
+        else if (name == "verlet") method = EnsembleMethod::VelocityVerlet;
+        else if (name == "rk4") method = EnsembleMethod::RungeKutta4;
+        else return false;
+        return true;
+    }
+
+    // EnsembleWorkspace implementations
+    void EnsembleWorkspace::resize(size_t count) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (forces[axis].size() < count) forces[axis].resize(count);
+            if (stagePositions[axis].size() < count) stagePositions[axis].resize(count);
+            if (stageVelocities[axis].size() < count) stageVelocities[axis].resize(count);
+            if (sumKx[axis].size() < count) sumKx[axis].resize(count);
+            if (sumKv[axis].size() < count) sumKv[axis].resize(count);
+        }
+    }
+
+    void advance(Physics::Ensemble& ensemble, EnsembleMethod method, double currentTime, float deltaTime, unsigned long long steps,
+        EnsembleWorkspace& workspace, Parallel::ThreadPool* pool) {
+
+        DSIM_PROFILE_SCOPE("advanceEnsemble");
+        DSIM_PROFILE_COUNT("force evaluations", ensemble.getMemberCount() * ensemble.getParticleCount() * steps * (method == EnsembleMethod::RungeKutta4 ? 4 : 1));
+
+        workspace.resize(ensemble.getMemberCount() * ensemble.getParticleCount());
+        const bool computeAccelerations = !ensemble.hasAccelerations();
+
+        Parallel::parallelFor(pool, ensemble.getMemberCount(), Physics::ENSEMBLE_BLOCK, [&](size_t begin, size_t end) {
+            for (size_t block = begin; block < end; block += Physics::ENSEMBLE_BLOCK) {
+                advanceBlock(ensemble, method, workspace, currentTime, deltaTime, steps, computeAccelerations, block, std::min(end, block + Physics::ENSEMBLE_BLOCK));
+            }
+        });
+
+        if (method == EnsembleMethod::VelocityVerlet) ensemble.validateAccelerations();
+        else ensemble.invalidateAccelerations();
+    }
+
+    void advance(Physics::Ensemble& ensemble, EnsembleMethod method, double currentTime, float deltaTime, unsigned long long steps, Parallel::ThreadPool* pool) {
+        static thread_local EnsembleWorkspace cachedWorkspace;
+        EnsembleWorkspace& workspace = cachedWorkspace; // the workers must use the workspace of the calling thread
+        advance(ensemble, method, currentTime, deltaTime, steps, workspace, pool);
+    }
+}
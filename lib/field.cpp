@@ -0,0 +1,267 @@
+#include "field.hpp"
+
+namespace Physics {
+
+    // Field implementations
+    void Field::computeForces(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, const float* charges,
+        size_t count, float time, glm::vec3* forces) const {
+
+        for (size_t i = 0; i < count; i++) {
+            forces[i] += computeForce(positions[i], velocities[i], masses[i], charges[i], time);
+        }
+    }
+
+    glm::dvec3 Field::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double mass, double charge, double time) const {
+        return glm::dvec3(computeForce(glm::vec3(position), glm::vec3(velocity), (float)mass, (float)charge, (float)time));
+    }
+
+    void Field::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, const float* masses, const float* charges,
+        size_t count, double time, glm::dvec3* forces) const {
+
+        for (size_t i = 0; i < count; i++) {
+            forces[i] += computeForceDouble(positions[i], velocities[i], masses[i], charges[i], time);
+        }
+    }
+
+    ForceDescriptor Field::describe() const {
+        return ForceDescriptor();
+    }
+
+    std::unique_ptr<Field> createField(const ForceDescriptor& descriptor) {
+        const float* p = descriptor.parameters;
+
+        switch (descriptor.type) {
+            case ForceDescriptor::UniformGravityField:
+                return std::unique_ptr<Field>(new UniformGravityField(glm::vec3(p[0], p[1], p[2])));
+            case ForceDescriptor::PointGravityField:
+                return std::unique_ptr<Field>(new PointGravityField(p[0], glm::vec3(p[1], p[2], p[3])));
+            case ForceDescriptor::UniformElectricField:
+                return std::unique_ptr<Field>(new UniformElectricField(glm::vec3(p[0], p[1], p[2])));
+            case ForceDescriptor::PointChargeField:
+                return std::unique_ptr<Field>(new PointChargeField(p[0], glm::vec3(p[1], p[2], p[3])));
+            default:
+                return std::unique_ptr<Field>();
+        }
+    }
+
+    // UniformGravityField implementations
+    UniformGravityField::UniformGravityField(const glm::vec3& a) : acceleration(a) {}
+
+    glm::vec3 UniformGravityField::getAcceleration() const {
+        return acceleration;
+    }
+
+    void UniformGravityField::setAcceleration(const glm::vec3& a) {
+        acceleration = a;
+    }
+
+    glm::vec3 UniformGravityField::computeForce(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const {
+        return mass * acceleration;
+    }
+
+    float UniformGravityField::computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const {
+        return -mass * glm::dot(acceleration, position);
+    }
+
+    void UniformGravityField::computeForces(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, const float* charges,
+        size_t count, float time, glm::vec3* forces) const {
+
+        for (size_t i = 0; i < count; i++) forces[i] += masses[i] * acceleration;
+    }
+
+    glm::dvec3 UniformGravityField::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double mass, double charge, double time) const {
+        return mass * glm::dvec3(acceleration);
+    }
+
+    void UniformGravityField::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, const float* masses, const float* charges,
+        size_t count, double time, glm::dvec3* forces) const {
+
+        for (size_t i = 0; i < count; i++) forces[i] += UniformGravityField::computeForceDouble(positions[i], velocities[i], masses[i], charges[i], time);
+    }
+
+    ForceDescriptor UniformGravityField::describe() const {
+        ForceDescriptor descriptor(ForceDescriptor::UniformGravityField);
+        descriptor.parameters[0] = acceleration.x;
+        descriptor.parameters[1] = acceleration.y;
+        descriptor.parameters[2] = acceleration.z;
+        return descriptor;
+    }
+
+    // PointGravityField implementations
+    PointGravityField::PointGravityField(float mass, const glm::vec3& anchor) : sourceMass(mass), anchorPoint(anchor) {}
+
+    float PointGravityField::getSourceMass() const {
+        return sourceMass;
+    }
+
+    void PointGravityField::setSourceMass(float mass) {
+        sourceMass = mass;
+    }
+
+    void PointGravityField::setAnchorPoint(const glm::vec3& anchor) {
+        anchorPoint = anchor;
+    }
+
+    glm::vec3 PointGravityField::computeForce(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const {
+        glm::vec3 distance = position - anchorPoint;
+        float distanceSquared = glm::dot(distance, distance);
+        return (-G * sourceMass * mass / (distanceSquared * std::sqrt(distanceSquared))) * distance;
+    }
+
+    float PointGravityField::computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const {
+        return -G * sourceMass * mass / glm::length(position - anchorPoint);
+    }
+
+    void PointGravityField::computeForces(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, const float* charges,
+        size_t count, float time, glm::vec3* forces) const {
+
+        const float coefficient = -G * sourceMass;
+
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 distance = positions[i] - anchorPoint;
+            float distanceSquared = glm::dot(distance, distance);
+            forces[i] += (coefficient * masses[i] / (distanceSquared * std::sqrt(distanceSquared))) * distance;
+        }
+    }
+
+    glm::dvec3 PointGravityField::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double mass, double charge, double time) const {
+        const glm::dvec3 distance = position - glm::dvec3(anchorPoint);
+        const double distanceSquared = glm::dot(distance, distance);
+        return (-G_double * sourceMass * mass / (distanceSquared * std::sqrt(distanceSquared))) * distance;
+    }
+
+    void PointGravityField::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, const float* masses, const float* charges,
+        size_t count, double time, glm::dvec3* forces) const {
+
+        for (size_t i = 0; i < count; i++) forces[i] += PointGravityField::computeForceDouble(positions[i], velocities[i], masses[i], charges[i], time);
+    }
+
+    ForceDescriptor PointGravityField::describe() const {
+        ForceDescriptor descriptor(ForceDescriptor::PointGravityField);
+        descriptor.parameters[0] = sourceMass;
+        descriptor.parameters[1] = anchorPoint.x;
+        descriptor.parameters[2] = anchorPoint.y;
+        descriptor.parameters[3] = anchorPoint.z;
+        return descriptor;
+    }
+
+    // UniformElectricField implementations
+    UniformElectricField::UniformElectricField(const glm::vec3& e) : field(e) {}
+
+    glm::vec3 UniformElectricField::getField() const {
+        return field;
+    }
+
+    void UniformElectricField::setField(const glm::vec3& e) {
+        field = e;
+    }
+
+    glm::vec3 UniformElectricField::computeForce(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const {
+        return charge * field;
+    }
+
+    float UniformElectricField::computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const {
+        return -charge * glm::dot(field, position);
+    }
+
+    void UniformElectricField::computeForces(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, const float* charges,
+        size_t count, float time, glm::vec3* forces) const {
+
+        for (size_t i = 0; i < count; i++) forces[i] += charges[i] * field;
+    }
+
+    glm::dvec3 UniformElectricField::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double mass, double charge, double time) const {
+        return charge * glm::dvec3(field);
+    }
+
+    void UniformElectricField::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, const float* masses, const float* charges,
+        size_t count, double time, glm::dvec3* forces) const {
+
+        for (size_t i = 0; i < count; i++) forces[i] += UniformElectricField::computeForceDouble(positions[i], velocities[i], masses[i], charges[i], time);
+    }
+
+    ForceDescriptor UniformElectricField::describe() const {
+        ForceDescriptor descriptor(ForceDescriptor::UniformElectricField);
+        descriptor.parameters[0] = field.x;
+        descriptor.parameters[1] = field.y;
+        descriptor.parameters[2] = field.z;
+        return descriptor;
+    }
+
+    // PointChargeField implementations
+    PointChargeField::PointChargeField(float charge, const glm::vec3& anchor) : sourceCharge(charge), anchorPoint(anchor) {}
+
+    float PointChargeField::getSourceCharge() const {
+        return sourceCharge;
+    }
+
+    void PointChargeField::setSourceCharge(float charge) {
+        sourceCharge = charge;
+    }
+
+    void PointChargeField::setAnchorPoint(const glm::vec3& anchor) {
+        anchorPoint = anchor;
+    }
+
+    glm::vec3 PointChargeField::computeForce(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const {
+        glm::vec3 distance = position - anchorPoint;
+        float distanceSquared = glm::dot(distance, distance);
+        return (k_e * sourceCharge * charge / (distanceSquared * std::sqrt(distanceSquared))) * distance;
+    }
+
+    float PointChargeField::computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float mass, float charge, float time) const {
+        return k_e * sourceCharge * charge / glm::length(position - anchorPoint);
+    }
+
+    void PointChargeField::computeForces(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, const float* charges,
+        size_t count, float time, glm::vec3* forces) const {
+
+        const float coefficient = k_e * sourceCharge;
+
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 distance = positions[i] - anchorPoint;
+            float distanceSquared = glm::dot(distance, distance);
+            forces[i] += (coefficient * charges[i] / (distanceSquared * std::sqrt(distanceSquared))) * distance;
+        }
+    }
+
+    glm::dvec3 PointChargeField::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double mass, double charge, double time) const {
+        const glm::dvec3 distance = position - glm::dvec3(anchorPoint);
+        const double distanceSquared = glm::dot(distance, distance);
+        return (k_e_double * sourceCharge * charge / (distanceSquared * std::sqrt(distanceSquared))) * distance;
+    }
+
+    void PointChargeField::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, const float* masses, const float* charges,
+        size_t count, double time, glm::dvec3* forces) const {
+
+        for (size_t i = 0; i < count; i++) forces[i] += PointChargeField::computeForceDouble(positions[i], velocities[i], masses[i], charges[i], time);
+    }
+
+    ForceDescriptor PointChargeField::describe() const {
+        ForceDescriptor descriptor(ForceDescriptor::PointChargeField);
+        descriptor.parameters[0] = sourceCharge;
+        descriptor.parameters[1] = anchorPoint.x;
+        descriptor.parameters[2] = anchorPoint.y;
+        descriptor.parameters[3] = anchorPoint.z;
+        return descriptor;
+    }
+
+    // FieldForce implementations
+    FieldForce::FieldForce(const Field& f, float m, float q) : field(f), mass(m), charge(q) {}
+
+    glm::vec3 FieldForce::computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const {
+        return field.computeForce(position, velocity, mass, charge, time);
+    }
+
+    float FieldForce::computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const {
+        return field.computeEnergy(position, velocity, mass, charge, time);
+    }
+
+    void FieldForce::computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        for (size_t i = 0; i < count; i++) forces[i] += field.computeForce(positions[i], velocities[i], mass, charge, time);
+    }
+
+    glm::dvec3 FieldForce::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const {
+        return field.computeForceDouble(position, velocity, mass, charge, time);
+    }
+}
@@ -0,0 +1,233 @@
+#include "forceregistry.hpp"
+
+#include <memory>
+
+namespace Physics {
+
+    namespace {
+        const uint32_t NO_SLOT = ~(uint32_t)0;
+
+        // The calls are qualified, so the compiler calls and inlines the exact type without virtual dispatch
+        template <typename T>
+        glm::vec3 sumForces(const std::vector<T>& forces, const glm::vec3& position, const glm::vec3& velocity, float time) {
+            glm::vec3 total(0.0f);
+            for (const T& force : forces) total += force.T::computeForce(position, velocity, time);
+            return total;
+        }
+
+        template <typename T>
+        float sumEnergies(const std::vector<T>& forces, const glm::vec3& position, const glm::vec3& velocity, float time) {
+            float total = 0.0f;
+            for (const T& force : forces) total += force.T::computeEnergy(position, velocity, time);
+            return total;
+        }
+
+        template <typename T>
+        void accumulateForces(const std::vector<T>& forces, const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* out) {
+            for (const T& force : forces) force.T::computeForces(positions, velocities, count, time, out);
+        }
+    }
+
+    // Handle implementations
+    ForceRegistry::Handle::Handle() : slot(NO_SLOT), generation(0) {}
+
+    ForceRegistry::Handle::Handle(uint32_t s, uint32_t g) : slot(s), generation(g) {}
+
+    bool ForceRegistry::Handle::isValid() const {
+        return slot != NO_SLOT;
+    }
+
+    // ForceRegistry implementations
+    ForceRegistry::ForceRegistry() {}
+
+    template <typename T>
+    ForceRegistry::Handle ForceRegistry::insert(Pool<T>& pool, uint32_t type, const T& force) {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            slot = (uint32_t)slots.size();
+            Slot empty = { ForceDescriptor::Unknown, 0, 0 };
+            slots.push_back(empty);
+        }
+
+        slots[slot].type = type;
+        slots[slot].position = (uint32_t)pool.forces.size();
+        pool.forces.push_back(force);
+        pool.slots.push_back(slot);
+
+        return Handle(slot, slots[slot].generation);
+    }
+
+    template <typename T>
+    void ForceRegistry::erase(Pool<T>& pool, uint32_t position) {
+        // the last force takes the place of the removed one
+        const uint32_t last = (uint32_t)pool.forces.size() - 1;
+        if (position != last) {
+            pool.forces[position] = pool.forces[last];
+            pool.slots[position] = pool.slots[last];
+            slots[pool.slots[position]].position = position;
+        }
+        pool.forces.pop_back();
+        pool.slots.pop_back();
+    }
+
+    ForceRegistry::Handle ForceRegistry::add(const ElectricForce& force) {
+        return insert(electricForces, ForceDescriptor::Electric, force);
+    }
+
+    ForceRegistry::Handle ForceRegistry::add(const GravitationalForce& force) {
+        return insert(gravitationalForces, ForceDescriptor::Gravitational, force);
+    }
+
+    ForceRegistry::Handle ForceRegistry::add(const EarthGravitationalForce& force) {
+        return insert(earthGravitationalForces, ForceDescriptor::EarthGravitational, force);
+    }
+
+    ForceRegistry::Handle ForceRegistry::add(const HookeForce& force) {
+        return insert(hookeForces, ForceDescriptor::Hooke, force);
+    }
+
+    ForceRegistry::Handle ForceRegistry::add(const AirResistanceForce& force) {
+        return insert(airResistanceForces, ForceDescriptor::AirResistance, force);
+    }
+
+    ForceRegistry::Handle ForceRegistry::add(const ForceDescriptor& descriptor) {
+        std::unique_ptr<Force> force = createForce(descriptor);
+        if (!force) return Handle();
+
+        switch (descriptor.type) {
+            case ForceDescriptor::Electric: return add(static_cast<const ElectricForce&>(*force));
+            case ForceDescriptor::Gravitational: return add(static_cast<const GravitationalForce&>(*force));
+            case ForceDescriptor::EarthGravitational: return add(static_cast<const EarthGravitationalForce&>(*force));
+            case ForceDescriptor::Hooke: return add(static_cast<const HookeForce&>(*force));
+            case ForceDescriptor::AirResistance: return add(static_cast<const AirResistanceForce&>(*force));
+            default: return Handle();
+        }
+    }
+
+    const ForceRegistry::Slot* ForceRegistry::find(const Handle& handle) const {
+        if (handle.slot >= slots.size()) return nullptr;
+        const Slot& slot = slots[handle.slot];
+        if (slot.type == ForceDescriptor::Unknown || slot.generation != handle.generation) return nullptr;
+        return &slot;
+    }
+
+    bool ForceRegistry::remove(const Handle& handle) {
+        const Slot* found = find(handle);
+        if (!found) return false;
+
+        switch (found->type) {
+            case ForceDescriptor::Electric: erase(electricForces, found->position); break;
+            case ForceDescriptor::Gravitational: erase(gravitationalForces, found->position); break;
+            case ForceDescriptor::EarthGravitational: erase(earthGravitationalForces, found->position); break;
+            case ForceDescriptor::Hooke: erase(hookeForces, found->position); break;
+            case ForceDescriptor::AirResistance: erase(airResistanceForces, found->position); break;
+        }
+
+        Slot& slot = slots[handle.slot];
+        slot.type = ForceDescriptor::Unknown;
+        slot.generation++;
+        freeSlots.push_back(handle.slot);
+        return true;
+    }
+
+    bool ForceRegistry::contains(const Handle& handle) const {
+        return find(handle) != nullptr;
+    }
+
+    const Force* ForceRegistry::get(const Handle& handle) const {
+        const Slot* found = find(handle);
+        if (!found) return nullptr;
+
+        switch (found->type) {
+            case ForceDescriptor::Electric: return &electricForces.forces[found->position];
+            case ForceDescriptor::Gravitational: return &gravitationalForces.forces[found->position];
+            case ForceDescriptor::EarthGravitational: return &earthGravitationalForces.forces[found->position];
+            case ForceDescriptor::Hooke: return &hookeForces.forces[found->position];
+            case ForceDescriptor::AirResistance: return &airResistanceForces.forces[found->position];
+            default: return nullptr;
+        }
+    }
+
+    void ForceRegistry::clear() {
+        electricForces = Pool<ElectricForce>();
+        gravitationalForces = Pool<GravitationalForce>();
+        earthGravitationalForces = Pool<EarthGravitationalForce>();
+        hookeForces = Pool<HookeForce>();
+        airResistanceForces = Pool<AirResistanceForce>();
+
+        freeSlots.clear();
+        for (uint32_t i = 0; i < slots.size(); i++) {
+            if (slots[i].type != ForceDescriptor::Unknown) {
+                slots[i].type = ForceDescriptor::Unknown;
+                slots[i].generation++;
+            }
+            freeSlots.push_back(i);
+        }
+    }
+
+    size_t ForceRegistry::size() const {
+        return slots.size() - freeSlots.size();
+    }
+
+    glm::vec3 ForceRegistry::computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const {
+        return sumForces(electricForces.forces, position, velocity, time)
+            + sumForces(gravitationalForces.forces, position, velocity, time)
+            + sumForces(earthGravitationalForces.forces, position, velocity, time)
+            + sumForces(hookeForces.forces, position, velocity, time)
+            + sumForces(airResistanceForces.forces, position, velocity, time);
+    }
+
+    float ForceRegistry::computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const {
+        return sumEnergies(electricForces.forces, position, velocity, time)
+            + sumEnergies(gravitationalForces.forces, position, velocity, time)
+            + sumEnergies(earthGravitationalForces.forces, position, velocity, time)
+            + sumEnergies(hookeForces.forces, position, velocity, time)
+            + sumEnergies(airResistanceForces.forces, position, velocity, time);
+    }
+
+    void ForceRegistry::computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        accumulateForces(electricForces.forces, positions, velocities, count, time, forces);
+        accumulateForces(gravitationalForces.forces, positions, velocities, count, time, forces);
+        accumulateForces(hookeForces.forces, positions, velocities, count, time, forces);
+        accumulateForces(airResistanceForces.forces, positions, velocities, count, time, forces);
+
+        if (!earthGravitationalForces.forces.empty()) {
+            const glm::vec3 uniformForce = sumForces(earthGravitationalForces.forces, glm::vec3(0.0f), glm::vec3(0.0f), time);
+            for (size_t i = 0; i < count; i++) forces[i] += uniformForce;
+        }
+    }
+
+    unsigned ForceRegistry::getDependencies() const {
+        unsigned dependencies = 0;
+        if (!electricForces.forces.empty()) dependencies |= electricForces.forces[0].ElectricForce::getDependencies();
+        if (!gravitationalForces.forces.empty()) dependencies |= gravitationalForces.forces[0].GravitationalForce::getDependencies();
+        if (!earthGravitationalForces.forces.empty()) dependencies |= earthGravitationalForces.forces[0].EarthGravitationalForce::getDependencies();
+        if (!hookeForces.forces.empty()) dependencies |= hookeForces.forces[0].HookeForce::getDependencies();
+        if (!airResistanceForces.forces.empty()) dependencies |= airResistanceForces.forces[0].AirResistanceForce::getDependencies();
+        return dependencies;
+    }
+
+    ForceDescriptor ForceRegistry::describe() const {
+        return ForceDescriptor(ForceDescriptor::Composite);
+    }
+
+    size_t ForceRegistry::getComponentCount() const {
+        return size();
+    }
+
+    const Force& ForceRegistry::getComponent(size_t index) const {
+        if (index < electricForces.forces.size()) return electricForces.forces[index];
+        index -= electricForces.forces.size();
+        if (index < gravitationalForces.forces.size()) return gravitationalForces.forces[index];
+        index -= gravitationalForces.forces.size();
+        if (index < earthGravitationalForces.forces.size()) return earthGravitationalForces.forces[index];
+        index -= earthGravitationalForces.forces.size();
+        if (index < hookeForces.forces.size()) return hookeForces.forces[index];
+        index -= hookeForces.forces.size();
+        return airResistanceForces.forces[index];
+    }
+}
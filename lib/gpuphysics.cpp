@@ -0,0 +1,407 @@
+#include "gpuphysics.hpp"
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "field.hpp"
+#include "nbody.hpp"
+
+namespace Physics {
+
+    namespace {
+        const unsigned WORKGROUP_SIZE = 256;
+
+        // Stages of the compute shader
+        const unsigned STAGE_DRIFT = 0;        // first kick and drift
+        const unsigned STAGE_KICK = 1;         // forces at the new positions and second kick
+        const unsigned STAGE_ACCELERATION = 2; // forces only, to start the integration
+
+        const char* PHYSICS_COMPUTE_SHADER = R"(
+            layout(local_size_x = WORKGROUP_SIZE) in;
+
+            struct AppliedForce {
+                vec4 parameters; // see ForceDescriptor
+                vec4 anchor;
+                uvec4 type;
+            };
+
+            layout(std430, binding = 0) buffer Positions { vec4 positions[]; }; // position, mass
+            layout(std430, binding = 1) buffer Velocities { vec4 velocities[]; };
+            layout(std430, binding = 2) buffer Accelerations { vec4 accelerations[]; };
+            layout(std430, binding = 3) readonly buffer Charges { float charges[]; };
+            layout(std430, binding = 4) readonly buffer Forces { AppliedForce forces[]; };
+
+            uniform uint particleCount;
+            uniform uint forceCount;
+            uniform float deltaTime;
+            uniform uint stage;
+            uniform uint nbodyKinds; // NBodyInteraction kinds, 0 without interaction
+            uniform float softening;
+
+            shared vec4 tilePositions[WORKGROUP_SIZE];
+            shared float tileCharges[WORKGROUP_SIZE];
+
+            vec3 appliedForce(vec3 position, vec3 velocity, float mass, float charge) {
+                vec3 force = vec3(0.0);
+                for (uint i = 0; i < forceCount; i++) {
+                    vec4 p = forces[i].parameters;
+                    vec3 r = position - forces[i].anchor.xyz;
+
+                    switch (forces[i].type.x) {
+                        case TYPE_ELECTRIC: force -= (K_E * p.x * p.y / pow(length(r), 3.0)) * r; break;
+                        case TYPE_GRAVITATIONAL: force -= (G * p.x * p.y / pow(length(r), 3.0)) * r; break;
+                        case TYPE_EARTH_GRAVITATIONAL: force.y -= p.x * EARTH_G; break;
+                        case TYPE_HOOKE: force -= p.x * r; break;
+                        case TYPE_AIR_RESISTANCE: force -= p.x * velocity; break;
+                        case TYPE_UNIFORM_GRAVITY_FIELD: force += mass * p.xyz; break;
+                        case TYPE_POINT_GRAVITY_FIELD: force -= (G * p.x * mass / pow(length(r), 3.0)) * r; break;
+                        case TYPE_UNIFORM_ELECTRIC_FIELD: force += charge * p.xyz; break;
+                        case TYPE_POINT_CHARGE_FIELD: force += (K_E * p.x * charge / pow(length(r), 3.0)) * r; break;
+                    }
+                }
+                return force;
+            }
+
+            void main() {
+                uint i = gl_GlobalInvocationID.x;
+                bool active = i < particleCount;
+
+                if (stage == STAGE_DRIFT) {
+                    if (!active) return;
+                    vec3 velocity = velocities[i].xyz + (0.5 * deltaTime) * accelerations[i].xyz;
+                    velocities[i].xyz = velocity;
+                    positions[i].xyz += deltaTime * velocity;
+                    return;
+                }
+
+                // every invocation takes part in loading the tiles, so none returns before the sum
+                vec4 particle = active ? positions[i] : vec4(0.0);
+                vec3 velocity = active ? velocities[i].xyz : vec3(0.0);
+                vec3 force = active ? appliedForce(particle.xyz, velocity, particle.w, charges[i]) : vec3(0.0);
+
+                if (nbodyKinds != 0u) {
+                    vec3 gravity = vec3(0.0);
+                    vec3 electric = vec3(0.0);
+                    float softeningSquared = softening * softening;
+
+                    for (uint tile = 0; tile < particleCount; tile += WORKGROUP_SIZE) {
+                        uint j = tile + gl_LocalInvocationID.x;
+                        tilePositions[gl_LocalInvocationID.x] = j < particleCount ? positions[j] : vec4(0.0);
+                        tileCharges[gl_LocalInvocationID.x] = j < particleCount ? charges[j] : 0.0;
+                        barrier();
+
+                        uint tileCount = min(WORKGROUP_SIZE, particleCount - tile);
+                        for (uint k = 0; k < tileCount; k++) {
+                            vec3 separation = tilePositions[k].xyz - particle.xyz;
+                            float distanceSquared = dot(separation, separation);
+                            if (distanceSquared > 0.0) {
+                                float inverseDistance = inversesqrt(distanceSquared + softeningSquared);
+                                float inverseDistanceCubed = inverseDistance * inverseDistance * inverseDistance;
+                                gravity += (tilePositions[k].w * inverseDistanceCubed) * separation;
+                                electric -= (tileCharges[k] * inverseDistanceCubed) * separation;
+                            }
+                        }
+                        barrier();
+                    }
+
+                    if ((nbodyKinds & KIND_GRAVITATIONAL) != 0u) force += (G * particle.w) * gravity;
+                    if ((nbodyKinds & KIND_ELECTRIC) != 0u && active) force += (K_E * charges[i]) * electric;
+                }
+
+                if (!active) return;
+                vec3 acceleration = force / particle.w;
+                accelerations[i] = vec4(acceleration, 0.0);
+                if (stage == STAGE_KICK) velocities[i].xyz = velocity + (0.5 * deltaTime) * acceleration;
+            }
+        )";
+
+        /// @brief Layout of an AppliedForce in the shader
+        struct GpuForce {
+            float parameters[4];
+            float anchor[4];
+            uint32_t type[4];
+        };
+
+        /// @brief Append a force or a field, false if it has no GPU implementation
+        bool collectDescriptor(const ForceDescriptor& descriptor, std::vector<GpuForce>& forces) {
+            GpuForce gpuForce = {};
+            gpuForce.type[0] = descriptor.type;
+            const float* p = descriptor.parameters;
+
+            switch (descriptor.type) {
+                case ForceDescriptor::Electric:
+                case ForceDescriptor::Gravitational:
+                    gpuForce.parameters[0] = p[0];
+                    gpuForce.parameters[1] = p[1];
+                    gpuForce.anchor[0] = p[2]; gpuForce.anchor[1] = p[3]; gpuForce.anchor[2] = p[4];
+                    break;
+                case ForceDescriptor::Hooke:
+                    gpuForce.parameters[0] = p[0];
+                    gpuForce.anchor[0] = p[1]; gpuForce.anchor[1] = p[2]; gpuForce.anchor[2] = p[3];
+                    break;
+                case ForceDescriptor::EarthGravitational:
+                case ForceDescriptor::AirResistance:
+                    gpuForce.parameters[0] = p[0];
+                    break;
+                case ForceDescriptor::UniformGravityField:
+                case ForceDescriptor::UniformElectricField:
+                    gpuForce.parameters[0] = p[0]; gpuForce.parameters[1] = p[1]; gpuForce.parameters[2] = p[2];
+                    break;
+                case ForceDescriptor::PointGravityField:
+                case ForceDescriptor::PointChargeField:
+                    gpuForce.parameters[0] = p[0];
+                    gpuForce.anchor[0] = p[1]; gpuForce.anchor[1] = p[2]; gpuForce.anchor[2] = p[3];
+                    break;
+                default:
+                    return false;
+            }
+
+            forces.push_back(gpuForce);
+            return true;
+        }
+
+        /// @brief Flatten the composite forces, false if a force has no GPU implementation
+        bool collectForces(const Force& force, std::vector<GpuForce>& forces) {
+            ForceDescriptor descriptor = force.describe();
+
+            if (descriptor.type == ForceDescriptor::Composite) {
+                for (size_t i = 0; i < force.getComponentCount(); i++) {
+                    if (!collectForces(force.getComponent(i), forces)) return false;
+                }
+                return true;
+            }
+            return collectDescriptor(descriptor, forces);
+        }
+
+        std::string shaderSource() {
+            std::ostringstream source;
+            source << std::setprecision(9)
+                << "#version 430\n"
+                << "#define WORKGROUP_SIZE " << WORKGROUP_SIZE << "u\n"
+                << "#define STAGE_DRIFT " << STAGE_DRIFT << "u\n"
+                << "#define STAGE_KICK " << STAGE_KICK << "u\n"
+                << "#define TYPE_ELECTRIC " << ForceDescriptor::Electric << "u\n"
+                << "#define TYPE_GRAVITATIONAL " << ForceDescriptor::Gravitational << "u\n"
+                << "#define TYPE_EARTH_GRAVITATIONAL " << ForceDescriptor::EarthGravitational << "u\n"
+                << "#define TYPE_HOOKE " << ForceDescriptor::Hooke << "u\n"
+                << "#define TYPE_AIR_RESISTANCE " << ForceDescriptor::AirResistance << "u\n"
+                << "#define TYPE_UNIFORM_GRAVITY_FIELD " << ForceDescriptor::UniformGravityField << "u\n"
+                << "#define TYPE_POINT_GRAVITY_FIELD " << ForceDescriptor::PointGravityField << "u\n"
+                << "#define TYPE_UNIFORM_ELECTRIC_FIELD " << ForceDescriptor::UniformElectricField << "u\n"
+                << "#define TYPE_POINT_CHARGE_FIELD " << ForceDescriptor::PointChargeField << "u\n"
+                << "#define KIND_GRAVITATIONAL " << NBodyInteraction::Gravitational << "u\n"
+                << "#define KIND_ELECTRIC " << NBodyInteraction::Electric << "u\n"
+                << "const float G = " << std::scientific << G << ";\n"
+                << "const float K_E = " << k_e << ";\n"
+                << "const float EARTH_G = " << g << ";\n"
+                << PHYSICS_COMPUTE_SHADER;
+            return source.str();
+        }
+
+        unsigned int linkComputeProgram(const std::string& source) {
+            const char* text = source.c_str();
+            unsigned int shader = glCreateShader(GL_COMPUTE_SHADER);
+            glShaderSource(shader, 1, &text, nullptr);
+            glCompileShader(shader);
+
+            int compiled = 0;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+            if (!compiled) {
+                char log[1024];
+                glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+                std::cerr << "Failed to compile compute shader:\n" << log << "\n";
+                glDeleteShader(shader);
+                return 0;
+            }
+
+            unsigned int program = glCreateProgram();
+            glAttachShader(program, shader);
+            glLinkProgram(program);
+            glDeleteShader(shader);
+
+            int linked = 0;
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            if (!linked) {
+                char log[1024];
+                glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+                std::cerr << "Failed to link compute program:\n" << log << "\n";
+                glDeleteProgram(program);
+                return 0;
+            }
+            return program;
+        }
+
+        void uploadBuffer(unsigned int buffer, size_t size, const void* data) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            // never empty, so the buffer can always be bound
+            glBufferData(GL_SHADER_STORAGE_BUFFER, size ? size : 16, data, GL_DYNAMIC_COPY);
+        }
+    }
+
+    // GpuParticleSystem implementations
+    GpuParticleSystem::GpuParticleSystem()
+        : program(0), positionBuffer(0), velocityBuffer(0), accelerationBuffer(0), chargeBuffer(0), forceBuffer(0),
+          particleCountLocation(-1), forceCountLocation(-1), deltaTimeLocation(-1), stageLocation(-1), nbodyKindsLocation(-1), softeningLocation(-1),
+          particleCount(0), forceCount(0), nbodyKinds(0), softening(0.0f) {
+
+        program = linkComputeProgram(shaderSource());
+        if (!program) return;
+
+        particleCountLocation = glGetUniformLocation(program, "particleCount");
+        forceCountLocation = glGetUniformLocation(program, "forceCount");
+        deltaTimeLocation = glGetUniformLocation(program, "deltaTime");
+        stageLocation = glGetUniformLocation(program, "stage");
+        nbodyKindsLocation = glGetUniformLocation(program, "nbodyKinds");
+        softeningLocation = glGetUniformLocation(program, "softening");
+
+        unsigned int buffers[5];
+        glGenBuffers(5, buffers);
+        positionBuffer = buffers[0];
+        velocityBuffer = buffers[1];
+        accelerationBuffer = buffers[2];
+        chargeBuffer = buffers[3];
+        forceBuffer = buffers[4];
+    }
+
+    GpuParticleSystem::~GpuParticleSystem() {
+        unsigned int buffers[5] = { positionBuffer, velocityBuffer, accelerationBuffer, chargeBuffer, forceBuffer };
+        glDeleteBuffers(5, buffers);
+        glDeleteProgram(program);
+    }
+
+    bool GpuParticleSystem::isValid() const {
+        return program != 0;
+    }
+
+    bool GpuParticleSystem::upload(const ParticleSystem& system) {
+        if (!program) return false;
+
+        std::vector<GpuForce> forces;
+        if (!collectForces(system.appliedForces, forces)) return false;
+        // the fields share the force table, they read the mass and the charge of each particle
+        for (const Field* field : system.getFields()) {
+            if (!collectDescriptor(field->describe(), forces)) return false;
+        }
+
+        unsigned kinds = 0;
+        float interactionSoftening = 0.0f;
+        const std::vector<const Interaction*>& interactions = system.getInteractions();
+        for (size_t i = 0; i < interactions.size(); i++) {
+            ForceDescriptor descriptor = interactions[i]->describe();
+            // a single direct sum is evaluated, so only one N-body interaction is supported
+            if (descriptor.type != ForceDescriptor::NBody || i > 0) return false;
+            kinds = (unsigned)descriptor.parameters[0];
+            interactionSoftening = descriptor.parameters[3];
+        }
+
+        const size_t count = system.size();
+        const glm::vec3* positions = system.getPositions();
+        const glm::vec3* velocities = system.getVelocities();
+        const float* masses = system.getMasses();
+
+        std::vector<glm::vec4> packed(count);
+        for (size_t i = 0; i < count; i++) packed[i] = glm::vec4(positions[i], masses[i]);
+        uploadBuffer(positionBuffer, count * sizeof(glm::vec4), packed.data());
+
+        for (size_t i = 0; i < count; i++) packed[i] = glm::vec4(velocities[i], 0.0f);
+        uploadBuffer(velocityBuffer, count * sizeof(glm::vec4), packed.data());
+
+        const bool cached = system.hasAccelerations();
+        if (cached) {
+            const glm::vec3* accelerations = system.getAccelerations();
+            for (size_t i = 0; i < count; i++) packed[i] = glm::vec4(accelerations[i], 0.0f);
+        }
+        uploadBuffer(accelerationBuffer, count * sizeof(glm::vec4), cached ? packed.data() : nullptr);
+
+        uploadBuffer(chargeBuffer, count * sizeof(float), system.getCharges());
+        uploadBuffer(forceBuffer, forces.size() * sizeof(GpuForce), forces.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        particleCount = count;
+        forceCount = (unsigned)forces.size();
+        nbodyKinds = kinds;
+        softening = interactionSoftening;
+
+        // the first kick needs the accelerations at the initial positions
+        if (!cached) {
+            dispatch(STAGE_ACCELERATION, 0.0f);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        return true;
+    }
+
+    void GpuParticleSystem::dispatch(unsigned stage, float deltaTime) {
+        glUseProgram(program);
+        glUniform1ui(particleCountLocation, (GLuint)particleCount);
+        glUniform1ui(forceCountLocation, forceCount);
+        glUniform1f(deltaTimeLocation, deltaTime);
+        glUniform1ui(stageLocation, stage);
+        glUniform1ui(nbodyKindsLocation, nbodyKinds);
+        glUniform1f(softeningLocation, softening);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velocityBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, accelerationBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, chargeBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, forceBuffer);
+
+        glDispatchCompute((GLuint)((particleCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE), 1, 1);
+        glUseProgram(0);
+    }
+
+    void GpuParticleSystem::step(float deltaTime, unsigned steps) {
+        if (!program || particleCount == 0) return;
+
+        for (unsigned i = 0; i < steps; i++) {
+            dispatch(STAGE_DRIFT, deltaTime);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            dispatch(STAGE_KICK, deltaTime);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+
+        // the buffers are read next as vertex attributes or by a download
+        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+
+    bool GpuParticleSystem::download(ParticleSystem& system) const {
+        if (!program || system.size() != particleCount) return false;
+        if (particleCount == 0) return true;
+
+        std::vector<glm::vec4> packed(particleCount);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, positionBuffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleCount * sizeof(glm::vec4), packed.data());
+        glm::vec3* positions = system.getPositions();
+        for (size_t i = 0; i < particleCount; i++) positions[i] = glm::vec3(packed[i]);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, velocityBuffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleCount * sizeof(glm::vec4), packed.data());
+        glm::vec3* velocities = system.getVelocities();
+        for (size_t i = 0; i < particleCount; i++) velocities[i] = glm::vec3(packed[i]);
+
+        // the accelerations match the downloaded positions, so a CPU velocity Verlet step can reuse them
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, accelerationBuffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleCount * sizeof(glm::vec4), packed.data());
+        glm::vec3* accelerations = system.getAccelerations();
+        for (size_t i = 0; i < particleCount; i++) accelerations[i] = glm::vec3(packed[i]);
+        system.validateAccelerations();
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return true;
+    }
+
+    size_t GpuParticleSystem::size() const {
+        return particleCount;
+    }
+
+    unsigned int GpuParticleSystem::getPositionBuffer() const {
+        return positionBuffer;
+    }
+
+    unsigned int GpuParticleSystem::getVelocityBuffer() const {
+        return velocityBuffer;
+    }
+}
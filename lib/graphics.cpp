@@ -1,17 +1,188 @@
 #include "graphics.hpp"
 
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+
 namespace Graphics {
 
     unsigned int axis = 0;
 
+    namespace {
+        const GLbitfield PERSISTENT_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        // Timeout of a single wait on a fence, in nanoseconds
+        const GLuint64 FENCE_TIMEOUT = 1000000;
+
+        // Slots of a TrajectoryBuffer beyond its capacity, more than the points the viewer pushes in the frames in flight
+        const size_t TRAJECTORY_SLACK = 1024;
+
+        const char* SPHERE_VERTEX_SHADER = R"(
+            #version 430 compatibility
+            layout(location = 0) in vec3 vertexPosition;
+            layout(location = 1) in vec4 instance; // center, radius
+            uniform float radius;                  // used instead of instance.w when not negative
+
+            out vec3 normal;
+
+            void main() {
+                float instanceRadius = radius < 0.0 ? instance.w : radius;
+                normal = gl_NormalMatrix * vertexPosition;
+                gl_Position = gl_ModelViewProjectionMatrix * vec4(instance.xyz + instanceRadius * vertexPosition, 1.0);
+            }
+        )";
+
+        const char* SPHERE_FRAGMENT_SHADER = R"(
+            #version 430 compatibility
+            in vec3 normal;
+            uniform vec3 color;
+
+            out vec4 fragmentColor;
+
+            void main() {
+                // headlight shading, so the spheres keep their volume from every camera angle
+                float diffuse = abs(normalize(normal).z);
+                fragmentColor = vec4(color * (0.3 + 0.7 * diffuse), 1.0);
+            }
+        )";
+
+        /// @brief Unit sphere as indexed triangles, the positions double as normals
+        struct SphereMesh {
+            unsigned int vertexBuffer;
+            unsigned int indexBuffer;
+            size_t indexCount;
+        };
+
+        std::map<std::pair<int, int>, SphereMesh> sphereMeshes;
+
+        void buildSphere(int slices, int stacks, std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices) {
+            for (int i = 0; i <= stacks; ++i) {
+                float lat = M_PI * (-0.5 + (float)i / stacks);
+                float z = sinf(lat), zr = cosf(lat);
+
+                for (int j = 0; j <= slices; ++j) {
+                    float lng = 2 * M_PI * (float)j / slices;
+                    vertices.push_back(glm::vec3(cosf(lng) * zr, sinf(lng) * zr, z));
+                }
+            }
+
+            for (int i = 0; i < stacks; ++i) {
+                for (int j = 0; j < slices; ++j) {
+                    unsigned int first = i * (slices + 1) + j;
+                    unsigned int above = first + slices + 1;
+
+                    indices.push_back(first);
+                    indices.push_back(first + 1);
+                    indices.push_back(above);
+
+                    indices.push_back(above);
+                    indices.push_back(first + 1);
+                    indices.push_back(above + 1);
+                }
+            }
+        }
+
+        const SphereMesh& cachedSphere(int slices, int stacks) {
+            std::map<std::pair<int, int>, SphereMesh>::iterator it = sphereMeshes.find(std::make_pair(slices, stacks));
+            if (it != sphereMeshes.end()) return it->second;
+
+            std::vector<glm::vec3> vertices;
+            std::vector<unsigned int> indices;
+            buildSphere(slices, stacks, vertices, indices);
+
+            SphereMesh mesh;
+            glGenBuffers(1, &mesh.vertexBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+
+            glGenBuffers(1, &mesh.indexBuffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+            mesh.indexCount = indices.size();
+            return sphereMeshes[std::make_pair(slices, stacks)] = mesh;
+        }
+
+        void deleteSphereMeshes() {
+            for (std::map<std::pair<int, int>, SphereMesh>::iterator it = sphereMeshes.begin(); it != sphereMeshes.end(); ++it) {
+                glDeleteBuffers(1, &it->second.vertexBuffer);
+                glDeleteBuffers(1, &it->second.indexBuffer);
+            }
+            sphereMeshes.clear();
+        }
+
+        /// @brief Whether buffers can be persistently mapped: OpenGL 4.4 or ARB_buffer_storage, the viewer only requests 4.3
+        bool hasBufferStorage() {
+            return GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+        }
+
+        /// @brief Block until the GPU has passed a fence, then release it
+        void waitFence(GLsync& fence) {
+            if (!fence) return;
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT) == GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        unsigned int compileShader(GLenum type, const char* source) {
+            unsigned int shader = glCreateShader(type);
+            glShaderSource(shader, 1, &source, nullptr);
+            glCompileShader(shader);
+
+            int compiled = 0;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+            if (!compiled) {
+                char log[1024];
+                glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+                std::cerr << "Failed to compile shader:\n" << log << "\n";
+                glDeleteShader(shader);
+                return 0;
+            }
+            return shader;
+        }
+
+        unsigned int linkProgram(const char* vertexSource, const char* fragmentSource) {
+            unsigned int vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+            unsigned int fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+            if (!vertexShader || !fragmentShader) {
+                glDeleteShader(vertexShader);
+                glDeleteShader(fragmentShader);
+                return 0;
+            }
+
+            unsigned int program = glCreateProgram();
+            glAttachShader(program, vertexShader);
+            glAttachShader(program, fragmentShader);
+            glLinkProgram(program);
+            glDeleteShader(vertexShader);
+            glDeleteShader(fragmentShader);
+
+            int linked = 0;
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            if (!linked) {
+                char log[1024];
+                glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+                std::cerr << "Failed to link program:\n" << log << "\n";
+                glDeleteProgram(program);
+                return 0;
+            }
+            return program;
+        }
+    }
+
     void initGraphics(float axis_length) {
         axis = glGenLists(1);
         glNewList(axis, GL_COMPILE);
         glBegin(GL_LINES);
-        
+
         // set color
         glColor3f(0.0, 0.0, 0.0);
-        
+
         // Draw the axis Line
         glVertex3f(0.0, -axis_length, 0.0);
         glVertex3f(0.0, axis_length, 0.0);
@@ -33,6 +204,7 @@ namespace Graphics {
 
     void deleteGraphics() {
         glDeleteLists(axis, 1);
+        deleteSphereMeshes();
     }
 
     void drawAxis() {
@@ -46,26 +218,275 @@ namespace Graphics {
     }
 
     void drawSphere(float radius, glm::vec3 position, int slices, int stacks) {
+        const SphereMesh& mesh = cachedSphere(slices, stacks);
+
+        glPushMatrix();
         glTranslatef(position.x, position.y, position.z);
+        glScalef(radius, radius, radius);
 
-        for (int i = 0; i < stacks; ++i) {
-            float lat0 = M_PI * (-0.5 + (float)i / stacks);
-            float z0 = sinf(lat0), zr0 = cosf(lat0);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 0, nullptr);
+        glNormalPointer(GL_FLOAT, 0, nullptr);
 
-            float lat1 = M_PI * (-0.5 + (float)(i + 1) / stacks);
-            float z1 = sinf(lat1), zr1 = cosf(lat1);
+        glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indexCount, GL_UNSIGNED_INT, nullptr);
 
-            glBegin(GL_QUAD_STRIP);
-            for (int j = 0; j <= slices; ++j) {
-                float lng = 2 * M_PI * (float)(j - 1) / slices;
-                float x = cosf(lng), y = sinf(lng);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glPopMatrix();
+    }
 
-                glNormal3f(x * zr0, y * zr0, z0);
-                glVertex3f(radius * x * zr0, radius * y * zr0, radius * z0);
-                glNormal3f(x * zr1, y * zr1, z1);
-                glVertex3f(radius * x * zr1, radius * y * zr1, radius * z1);
-            }
-            glEnd();
+    // TrajectoryBuffer implementations
+    TrajectoryBuffer::TrajectoryBuffer(size_t capacity)
+        : buffer(0), points(nullptr), capacity(std::max<size_t>(2, capacity)), slots(this->capacity + TRAJECTORY_SLACK), head(0), count(0), last(0.0f), frame(0) {
+
+        for (int i = 0; i < FRAME_COUNT; i++) {
+            fences[i] = nullptr;
+            drawnOldest[i] = 0;
+            drawnCount[i] = 0;
+        }
+
+        const GLsizeiptr size = (slots + 1) * sizeof(glm::vec3);
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (hasBufferStorage()) {
+            glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, PERSISTENT_FLAGS);
+            points = (glm::vec3*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, PERSISTENT_FLAGS);
+        }
+        else glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    TrajectoryBuffer::~TrajectoryBuffer() {
+        for (int i = 0; i < FRAME_COUNT; i++) waitFence(fences[i]);
+
+        if (points) {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    void TrajectoryBuffer::push(const glm::vec3& point) {
+        // only a slot read by a frame in flight needs to wait for the GPU, the slack keeps the writes away from them
+        for (int i = 0; i < FRAME_COUNT; i++) {
+            if (fences[i] && (head + slots - drawnOldest[i]) % slots < drawnCount[i]) waitFence(fences[i]);
+        }
+
+        if (points) {
+            points[head] = point;
+            if (head == 0) points[slots] = point;
+        }
+        else {
+            // without persistent mapping the driver orders the update after the draws reading the slot
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferSubData(GL_ARRAY_BUFFER, head * sizeof(glm::vec3), sizeof(glm::vec3), &point);
+            if (head == 0) glBufferSubData(GL_ARRAY_BUFFER, slots * sizeof(glm::vec3), sizeof(glm::vec3), &point);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        head = (head + 1) % slots;
+        count = std::min(count + 1, capacity);
+        last = point;
+    }
+
+    void TrajectoryBuffer::clear() {
+        head = 0;
+        count = 0;
+    }
+
+    size_t TrajectoryBuffer::size() const {
+        return count;
+    }
+
+    size_t TrajectoryBuffer::getCapacity() const {
+        return capacity;
+    }
+
+    bool TrajectoryBuffer::empty() const {
+        return count == 0;
+    }
+
+    glm::vec3 TrajectoryBuffer::back() const {
+        return last;
+    }
+
+    void TrajectoryBuffer::draw() {
+        if (count < 2) return;
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 0, nullptr);
+
+        const size_t oldest = (head + slots - count) % slots;
+        if (oldest + count <= slots) {
+            glDrawArrays(GL_LINE_STRIP, (GLint)oldest, (GLsizei)count);
+        }
+        else {
+            // up to the mirror of the first slot, then from the first slot to the newest point
+            glDrawArrays(GL_LINE_STRIP, (GLint)oldest, (GLsizei)(slots + 1 - oldest));
+            glDrawArrays(GL_LINE_STRIP, 0, (GLsizei)head);
+        }
+
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        if (!points) return;
+        // the draw tracked in this place is FRAME_COUNT frames old, usually long finished
+        waitFence(fences[frame]);
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        drawnOldest[frame] = oldest;
+        drawnCount[frame] = count;
+        frame = (frame + 1) % FRAME_COUNT;
+    }
+
+    // SphereRenderer implementations
+    SphereRenderer::SphereRenderer(int slices, int stacks, size_t capacity)
+        : program(0), vertexArray(0), meshBuffer(0), indexBuffer(0), instanceBuffer(0), colorLocation(-1), radiusLocation(-1), indexCount(0),
+          instances(nullptr), capacity(0), region(0) {
+
+        for (int i = 0; i < REGION_COUNT; i++) fences[i] = nullptr;
+
+        program = linkProgram(SPHERE_VERTEX_SHADER, SPHERE_FRAGMENT_SHADER);
+        if (!program) return;
+        colorLocation = glGetUniformLocation(program, "color");
+        radiusLocation = glGetUniformLocation(program, "radius");
+
+        std::vector<glm::vec3> vertices;
+        std::vector<unsigned int> indices;
+        buildSphere(slices, stacks, vertices, indices);
+        indexCount = indices.size();
+
+        glGenVertexArrays(1, &vertexArray);
+        glBindVertexArray(vertexArray);
+
+        glGenBuffers(1, &meshBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, meshBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        reserve(capacity);
+    }
+
+    SphereRenderer::~SphereRenderer() {
+        releaseInstances();
+
+        glDeleteBuffers(1, &meshBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteProgram(program);
+    }
+
+    bool SphereRenderer::isValid() const {
+        return program != 0;
+    }
+
+    void SphereRenderer::releaseInstances() {
+        for (int i = 0; i < REGION_COUNT; i++) waitFence(fences[i]);
+        if (!instanceBuffer) return;
+
+        if (instances) {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
         }
+        glDeleteBuffers(1, &instanceBuffer);
+
+        instanceBuffer = 0;
+        instances = nullptr;
+        staging.clear();
+        capacity = 0;
+    }
+
+    void SphereRenderer::reserve(size_t count) {
+        if (count <= capacity) return;
+
+        size_t newCapacity = std::max<size_t>(capacity, 64);
+        while (newCapacity < count) newCapacity *= 2;
+        releaseInstances();
+
+        glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        if (hasBufferStorage()) {
+            const GLsizeiptr size = REGION_COUNT * newCapacity * sizeof(glm::vec4);
+            glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, PERSISTENT_FLAGS);
+            instances = (glm::vec4*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, PERSISTENT_FLAGS);
+        }
+        else {
+            // a single region, orphaned by every upload
+            glBufferData(GL_ARRAY_BUFFER, newCapacity * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+            staging.resize(newCapacity);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        capacity = newCapacity;
+        region = 0;
+    }
+
+    void SphereRenderer::draw(const glm::vec3* positions, const float* radii, size_t count, float radius, const glm::vec3& color) {
+        if (!program || count == 0) return;
+        reserve(count);
+
+        if (!instances) {
+            for (size_t i = 0; i < count; i++) staging[i] = glm::vec4(positions[i], radii ? radii[i] : radius);
+
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::vec4), staging.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            drawInstances(instanceBuffer, 0, count, -1.0f, color);
+            return;
+        }
+
+        // wait for the frame which last read this region, usually long finished
+        waitFence(fences[region]);
+
+        glm::vec4* regionInstances = instances + region * capacity;
+        for (size_t i = 0; i < count; i++) {
+            regionInstances[i] = glm::vec4(positions[i], radii ? radii[i] : radius);
+        }
+
+        drawInstances(instanceBuffer, region * capacity * sizeof(glm::vec4), count, -1.0f, color);
+
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region = (region + 1) % REGION_COUNT;
+    }
+
+    void SphereRenderer::drawBuffer(unsigned int buffer, size_t count, float radius, const glm::vec3& color) {
+        if (!program || count == 0) return;
+        drawInstances(buffer, 0, count, radius, color);
+    }
+
+    void SphereRenderer::drawInstances(unsigned int buffer, size_t offset, size_t count, float radius, const glm::vec3& color) {
+        glUseProgram(program);
+        glUniform3f(colorLocation, color.x, color.y, color.z);
+        glUniform1f(radiusLocation, radius);
+
+        glBindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (const void*)offset);
+        glVertexAttribDivisor(1, 1);
+
+        glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)indexCount, GL_UNSIGNED_INT, nullptr, (GLsizei)count);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,28 @@
+#include "interaction.hpp"
+#include "lennardjones.hpp"
+#include "nbody.hpp"
+
+namespace Physics {
+
+    ForceDescriptor Interaction::describe() const {
+        return ForceDescriptor();
+    }
+
+    std::unique_ptr<Interaction> createInteraction(const ForceDescriptor& descriptor) {
+        const float* p = descriptor.parameters;
+
+        switch (descriptor.type) {
+            case ForceDescriptor::NBody: {
+                NBodyInteraction* interaction = new NBodyInteraction((unsigned)p[0], (NBodyInteraction::Method)(int)p[1], p[2], p[3]);
+                interaction->setDirectThreshold((size_t)p[4]);
+                interaction->setLeafSize((unsigned)p[5]);
+                interaction->setSimdLevel((SimdLevel)(int)p[6]);
+                return std::unique_ptr<Interaction>(interaction);
+            }
+            case ForceDescriptor::LennardJones:
+                return std::unique_ptr<Interaction>(new LennardJonesInteraction(p[0], p[1], p[2]));
+            default:
+                return std::unique_ptr<Interaction>();
+        }
+    }
+}
@@ -0,0 +1,136 @@
+#include "lennardjones.hpp"
+
+#include <algorithm>
+#include <vector>
+#include "spatialhash.hpp"
+#include "threadpool.hpp"
+
+namespace Physics {
+
+    namespace {
+        // Particles claimed at once by a thread
+        const size_t TARGET_GRAIN = 256;
+
+        // Particles summed together in the energy, fixed so the result does not depend on the thread count
+        const size_t ENERGY_BLOCK = 1024;
+
+        const float DEFAULT_CUTOFF = 2.5f; // in units of sigma
+    }
+
+    LennardJonesInteraction::LennardJonesInteraction(float e, float s, float distance) : epsilon(e), sigma(s), cutoff(0.0f) {
+        setCutoff(distance);
+    }
+
+    float LennardJonesInteraction::getEpsilon() const {
+        return epsilon;
+    }
+
+    float LennardJonesInteraction::getSigma() const {
+        return sigma;
+    }
+
+    float LennardJonesInteraction::getCutoff() const {
+        return cutoff > 0.0f ? cutoff : DEFAULT_CUTOFF * sigma;
+    }
+
+    void LennardJonesInteraction::setEpsilon(float e) {
+        epsilon = e;
+    }
+
+    void LennardJonesInteraction::setSigma(float s) {
+        sigma = s;
+    }
+
+    void LennardJonesInteraction::setCutoff(float distance) {
+        cutoff = std::max(distance, 0.0f);
+    }
+
+    ForceDescriptor LennardJonesInteraction::describe() const {
+        ForceDescriptor descriptor(ForceDescriptor::LennardJones);
+        descriptor.parameters[0] = epsilon;
+        descriptor.parameters[1] = sigma;
+        descriptor.parameters[2] = cutoff;
+        return descriptor;
+    }
+
+    void LennardJonesInteraction::computeForces(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, glm::vec3* forces, Parallel::ThreadPool* pool) const {
+        const size_t count = system.size();
+        const float range = getCutoff();
+        if (count < 2 || range <= 0.0f) return;
+
+        static thread_local SpatialHash cachedHash;
+        const SpatialHash& hash = cachedHash; // the workers must read the hash of the calling thread
+        cachedHash.build(positions, count, range);
+
+        const float rangeSquared = range * range;
+        const float sigmaSquared = sigma * sigma;
+        const std::vector<unsigned>& order = hash.getIndices();
+
+        // the particles are visited in bucket order, so consecutive ones share most of their neighbours
+        Parallel::parallelFor(pool, count, TARGET_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                const unsigned i = order[k];
+                const glm::vec3 position = positions[i];
+                glm::vec3 force(0.0f);
+
+                hash.forEachNeighbour(position, [&](unsigned j, const glm::vec3& neighbour) {
+                    glm::vec3 separation = position - neighbour;
+                    float distanceSquared = glm::dot(separation, separation);
+                    if (j == i || distanceSquared >= rangeSquared || distanceSquared <= 0.0f) return;
+
+                    float s2 = sigmaSquared / distanceSquared;
+                    float s6 = s2 * s2 * s2;
+                    force += (24.0f * epsilon * s6 * (2.0f * s6 - 1.0f) / distanceSquared) * separation;
+                });
+
+                forces[i] += force;
+            }
+        });
+    }
+
+    float LennardJonesInteraction::computeEnergy(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, Parallel::ThreadPool* pool) const {
+        const size_t count = system.size();
+        const float range = getCutoff();
+        if (count < 2 || range <= 0.0f) return 0.0f;
+
+        static thread_local SpatialHash cachedHash;
+        const SpatialHash& hash = cachedHash; // the workers must read the hash of the calling thread
+        cachedHash.build(positions, count, range);
+
+        const double rangeSquared = (double)range * range;
+        const double sigmaSquared = (double)sigma * sigma;
+        const double cutoffSix = sigmaSquared * sigmaSquared * sigmaSquared / (rangeSquared * rangeSquared * rangeSquared);
+        const double shift = 4.0 * epsilon * (cutoffSix * cutoffSix - cutoffSix);
+
+        // every pair is counted twice, once from each side
+        const size_t blockCount = (count + ENERGY_BLOCK - 1) / ENERGY_BLOCK;
+        std::vector<double> blockEnergies(blockCount, 0.0);
+
+        Parallel::parallelFor(pool, blockCount, 1, [&](size_t firstBlock, size_t lastBlock) {
+            for (size_t block = firstBlock; block < lastBlock; block++) {
+                double energy = 0.0;
+
+                for (size_t i = block * ENERGY_BLOCK; i < std::min(count, (block + 1) * ENERGY_BLOCK); i++) {
+                    const glm::vec3 position = positions[i];
+
+                    hash.forEachNeighbour(position, [&](unsigned j, const glm::vec3& neighbour) {
+                        glm::vec3 separation = position - neighbour;
+                        double distanceSquared = glm::dot(separation, separation);
+                        if (j == i || distanceSquared >= rangeSquared || distanceSquared <= 0.0) return;
+
+                        double s2 = sigmaSquared / distanceSquared;
+                        double s6 = s2 * s2 * s2;
+                        energy += 4.0 * epsilon * (s6 * s6 - s6) - shift;
+                    });
+                }
+
+                blockEnergies[block] = 0.5 * energy;
+            }
+        });
+
+        double totalEnergy = 0.0;
+        for (double energy : blockEnergies) totalEnergy += energy;
+
+        return (float)totalEnergy;
+    }
+}
@@ -0,0 +1,108 @@
+#include "mappedfile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Storage {
+
+    MappedFile::MappedFile() : address(nullptr), length(0), opened(false) {}
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+#ifdef _WIN32
+    bool MappedFile::open(const std::string& path) {
+        close();
+
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            CloseHandle(file);
+            return false;
+        }
+
+        if (fileSize.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) address = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+            // the view keeps the mapping and the file alive
+            if (mapping) CloseHandle(mapping);
+            if (!address) {
+                CloseHandle(file);
+                return false;
+            }
+        }
+        CloseHandle(file);
+
+        length = (size_t)fileSize.QuadPart;
+        opened = true;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (address) UnmapViewOfFile(address);
+        address = nullptr;
+        length = 0;
+        opened = false;
+    }
+#else
+    bool MappedFile::open(const std::string& path) {
+        close();
+
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) return false;
+
+        struct stat status;
+        if (fstat(descriptor, &status) != 0) {
+            ::close(descriptor);
+            return false;
+        }
+
+        if (status.st_size > 0) {
+            void* mapping = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(descriptor);
+                return false;
+            }
+            address = (const unsigned char*)mapping;
+        }
+
+        // the mapping keeps the file alive
+        ::close(descriptor);
+
+        length = (size_t)status.st_size;
+        opened = true;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (address) munmap((void*)address, length);
+        address = nullptr;
+        length = 0;
+        opened = false;
+    }
+#endif
+
+    bool MappedFile::isOpen() const {
+        return opened;
+    }
+
+    const unsigned char* MappedFile::data() const {
+        return address;
+    }
+
+    size_t MappedFile::size() const {
+        return length;
+    }
+}
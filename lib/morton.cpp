@@ -0,0 +1,183 @@
+#include "morton.hpp"
+#include "physics.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace Physics {
+
+    namespace {
+        // Number of points claimed at once by a thread of the pool
+        const size_t KEY_GRAIN = 4096;
+
+        // Bits sorted by every pass of the radix sort, and the least number of keys given to a thread
+        const unsigned RADIX_BITS = 8;
+        const size_t RADIX_BUCKETS = 1u << RADIX_BITS;
+        const size_t RADIX_CHUNK = 16384;
+
+        /// @brief Scratch memory of the radix sort, kept by every thread across the calls
+        struct RadixScratch {
+            std::vector<uint64_t> keys[2];
+            std::vector<uint32_t> order;
+            std::vector<size_t> histograms; // RADIX_BUCKETS counters per chunk
+            std::vector<uint64_t> sameBits; // bits set and bits cleared in every key of a chunk
+        };
+
+        struct ReorderScratch {
+            std::vector<uint64_t> keys;
+            std::vector<uint32_t> order;
+        };
+
+        /// @brief Spread the low 21 bits of value so that two zero bits follow each of them
+        inline uint64_t spreadBits(uint64_t value) {
+            value &= 0x1fffff;
+            value = (value | value << 32) & 0x1f00000000ffffull;
+            value = (value | value << 16) & 0x1f0000ff0000ffull;
+            value = (value | value << 8) & 0x100f00f00f00f00full;
+            value = (value | value << 4) & 0x10c30c30c30c30c3ull;
+            value = (value | value << 2) & 0x1249249249249249ull;
+            return value;
+        }
+
+        inline uint64_t cellCoordinate(float coordinate, float lower, float scale) {
+            const float cell = (coordinate - lower) * scale;
+            // the comparisons also map NaN to the first cell
+            if (!(cell > 0.0f)) return 0;
+            if (cell >= (float)((1u << MORTON_BITS) - 1)) return (1u << MORTON_BITS) - 1;
+            return (uint64_t)cell;
+        }
+
+        inline uint64_t mortonKey(const glm::vec3& point, const glm::vec3& lower, const glm::vec3& scale) {
+            return spreadBits(cellCoordinate(point.x, lower.x, scale.x)) << 2
+                | spreadBits(cellCoordinate(point.y, lower.y, scale.y)) << 1
+                | spreadBits(cellCoordinate(point.z, lower.z, scale.z));
+        }
+
+        /// @brief Cells per unit length along each axis, a flat axis puts every point in its first cell
+        glm::vec3 gridScale(const glm::vec3& lower, const glm::vec3& upper) {
+            const float cells = (float)(1u << MORTON_BITS);
+            glm::vec3 scale;
+            for (int axis = 0; axis < 3; axis++) {
+                const float extent = upper[axis] - lower[axis];
+                scale[axis] = extent > 0.0f ? cells / extent : 0.0f;
+            }
+            return scale;
+        }
+    }
+
+    uint64_t computeMortonKey(const glm::vec3& point, const glm::vec3& lower, const glm::vec3& upper) {
+        return mortonKey(point, lower, gridScale(lower, upper));
+    }
+
+    void computeMortonKeys(const glm::vec3* points, size_t count, const glm::vec3& lower, const glm::vec3& upper, uint64_t* keys, Parallel::ThreadPool* pool) {
+        const glm::vec3 scale = gridScale(lower, upper);
+
+        Parallel::parallelFor(pool, count, KEY_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) keys[i] = mortonKey(points[i], lower, scale);
+        });
+    }
+
+    void sortMortonKeys(const uint64_t* keys, size_t count, uint32_t* order, Parallel::ThreadPool* pool) {
+        // workers read the buffers of the calling thread, through this reference
+        static thread_local RadixScratch cachedScratch;
+        RadixScratch& scratch = cachedScratch;
+
+        // one chunk per thread, each with its own histogram; the chunks are scattered in order, so the sort is stable
+        const size_t threads = pool ? pool->getThreadCount() : 1;
+        const size_t chunks = std::max<size_t>(1, std::min(threads, count / RADIX_CHUNK));
+        scratch.keys[0].assign(keys, keys + count);
+        scratch.keys[1].resize(count);
+        scratch.order.resize(count);
+        scratch.histograms.resize(chunks * RADIX_BUCKETS);
+        scratch.sameBits.resize(2 * chunks);
+
+        auto chunkBegin = [count, chunks](size_t chunk) { return chunk * count / chunks; };
+
+        Parallel::parallelFor(pool, chunks, 1, [&](size_t begin, size_t end) {
+            for (size_t chunk = begin; chunk < end; chunk++) {
+                uint64_t set = 0, cleared = 0;
+                for (size_t i = chunkBegin(chunk); i < chunkBegin(chunk + 1); i++) {
+                    order[i] = (uint32_t)i;
+                    set |= keys[i];
+                    cleared |= ~keys[i];
+                }
+                scratch.sameBits[2 * chunk] = set;
+                scratch.sameBits[2 * chunk + 1] = cleared;
+            }
+        });
+
+        uint64_t set = 0, cleared = 0;
+        for (size_t chunk = 0; chunk < chunks; chunk++) {
+            set |= scratch.sameBits[2 * chunk];
+            cleared |= scratch.sameBits[2 * chunk + 1];
+        }
+        const uint64_t varying = set & cleared;
+
+        // the sorted keys and indices alternate between the two buffers at every pass
+        uint64_t* sourceKeys = scratch.keys[0].data();
+        uint64_t* targetKeys = scratch.keys[1].data();
+        uint32_t* sourceOrder = order;
+        uint32_t* targetOrder = scratch.order.data();
+
+        for (unsigned shift = 0; shift < 64; shift += RADIX_BITS) {
+            if (((varying >> shift) & (RADIX_BUCKETS - 1)) == 0) continue;
+
+            Parallel::parallelFor(pool, chunks, 1, [&](size_t begin, size_t end) {
+                for (size_t chunk = begin; chunk < end; chunk++) {
+                    size_t* histogram = scratch.histograms.data() + chunk * RADIX_BUCKETS;
+                    std::fill(histogram, histogram + RADIX_BUCKETS, (size_t)0);
+                    for (size_t i = chunkBegin(chunk); i < chunkBegin(chunk + 1); i++) histogram[(sourceKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                }
+            });
+
+            // first position of every digit in every chunk: by digit, then by chunk
+            size_t offset = 0;
+            for (size_t digit = 0; digit < RADIX_BUCKETS; digit++) {
+                for (size_t chunk = 0; chunk < chunks; chunk++) {
+                    size_t& counter = scratch.histograms[chunk * RADIX_BUCKETS + digit];
+                    const size_t digitCount = counter;
+                    counter = offset;
+                    offset += digitCount;
+                }
+            }
+
+            Parallel::parallelFor(pool, chunks, 1, [&](size_t begin, size_t end) {
+                for (size_t chunk = begin; chunk < end; chunk++) {
+                    size_t* positions = scratch.histograms.data() + chunk * RADIX_BUCKETS;
+                    for (size_t i = chunkBegin(chunk); i < chunkBegin(chunk + 1); i++) {
+                        const size_t target = positions[(sourceKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                        targetKeys[target] = sourceKeys[i];
+                        targetOrder[target] = sourceOrder[i];
+                    }
+                }
+            });
+
+            std::swap(sourceKeys, targetKeys);
+            std::swap(sourceOrder, targetOrder);
+        }
+
+        if (sourceOrder != order) std::copy(sourceOrder, sourceOrder + count, order);
+    }
+
+    void reorderByMortonKey(ParticleSystem& system, Parallel::ThreadPool* pool) {
+        const size_t count = system.size();
+        if (count < 2) return;
+
+        const glm::vec3* positions = system.getPositions();
+        glm::vec3 lower = positions[0], upper = positions[0];
+        for (size_t i = 1; i < count; i++) {
+            lower = glm::min(lower, positions[i]);
+            upper = glm::max(upper, positions[i]);
+        }
+
+        static thread_local ReorderScratch cachedScratch;
+        ReorderScratch& scratch = cachedScratch;
+        scratch.keys.resize(count);
+        scratch.order.resize(count);
+
+        computeMortonKeys(positions, count, lower, upper, scratch.keys.data(), pool);
+        sortMortonKeys(scratch.keys.data(), count, scratch.order.data(), pool);
+        system.reorder(scratch.order.data());
+    }
+}
@@ -0,0 +1,390 @@
+#include "nbody.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+
+namespace Physics {
+
+    namespace {
+        // Maximum depth of the octree, bounding the subdivision of coincident sources
+        const unsigned MAX_DEPTH = 32;
+
+        // Number of targets claimed at once by a thread of the pool
+        const size_t TARGET_GRAIN = 64;
+
+        // Number of targets in a block of the energy reduction, fixed so that the sum does not depend on the thread count
+        const size_t ENERGY_BLOCK = 1024;
+
+        inline void accumulateSource(const glm::vec3& point, const glm::vec3& position, float mass, float charge, float softeningSquared, FieldSample& sample) {
+            glm::vec3 distance = position - point;
+            float distanceSquared = glm::dot(distance, distance);
+            if (distanceSquared == 0.0f) return; // the target itself
+
+            float inverseDistance = 1.0f / std::sqrt(distanceSquared + softeningSquared);
+            float inverseDistanceCubed = inverseDistance * inverseDistance * inverseDistance;
+
+            sample.gravity += (mass * inverseDistanceCubed) * distance;
+            sample.electric -= (charge * inverseDistanceCubed) * distance;
+            sample.gravityPotential += mass * inverseDistance;
+            sample.electricPotential += charge * inverseDistance;
+        }
+    }
+
+    // FieldSample implementations
+    FieldSample::FieldSample()
+        : gravity(0.0f), electric(0.0f), gravityPotential(0.0f), electricPotential(0.0f) {}
+
+    // Octree implementations
+    Octree::Octree(unsigned leafSize) : leafSize(std::max(1u, leafSize)) {}
+
+    void Octree::setLeafSize(unsigned size) {
+        leafSize = std::max(1u, size);
+    }
+
+    unsigned Octree::getLeafSize() const {
+        return leafSize;
+    }
+
+    const std::vector<Octree::Node>& Octree::getNodes() const {
+        return nodes;
+    }
+
+    const std::vector<Octree::Source>& Octree::getSources() const {
+        return sources;
+    }
+
+    void Octree::build(const glm::vec3* positions, const float* masses, const float* charges, size_t count) {
+        nodes.clear();
+        sources.resize(count);
+        if (count == 0) return;
+
+        glm::vec3 lower = positions[0], upper = positions[0];
+        for (size_t i = 0; i < count; i++) {
+            sources[i].position = positions[i];
+            sources[i].mass = masses ? masses[i] : 0.0f;
+            sources[i].charge = charges ? charges[i] : 0.0f;
+
+            lower = glm::min(lower, positions[i]);
+            upper = glm::max(upper, positions[i]);
+        }
+
+        // cubic root cell, slightly enlarged so that no source lies on its boundary
+        glm::vec3 extent = upper - lower;
+        float halfSize = 0.5f * std::max(extent.x, std::max(extent.y, extent.z));
+        halfSize = halfSize * 1.001f + 1e-6f;
+
+        nodes.reserve(2 * count / leafSize + 1);
+        nodes.push_back(Node());
+        buildNode(0, 0, count, 0.5f * (lower + upper), halfSize, 0);
+    }
+
+    void Octree::buildNode(unsigned index, size_t begin, size_t end, const glm::vec3& center, float halfSize, unsigned depth) {
+        Node node;
+        node.center = center;
+        node.halfSize = halfSize;
+        node.firstChild = 0;
+        node.childCount = 0;
+        node.firstSource = (unsigned)begin;
+        node.sourceCount = (unsigned)(end - begin);
+
+        glm::vec3 massMoment(0.0f), chargeMoment(0.0f);
+        node.mass = 0.0f;
+        node.charge = 0.0f;
+        node.absCharge = 0.0f;
+
+        if (end - begin <= leafSize || depth >= MAX_DEPTH) {
+            for (size_t i = begin; i < end; i++) {
+                const Source& source = sources[i];
+                node.mass += source.mass;
+                node.charge += source.charge;
+                node.absCharge += std::abs(source.charge);
+                massMoment += source.mass * source.position;
+                chargeMoment += std::abs(source.charge) * source.position;
+            }
+        }
+        else {
+            // split the sources in octants: bit 2 of the octant selects the upper half along x, bit 1 along y, bit 0 along z
+            Source* data = sources.data();
+            size_t bounds[9];
+            bounds[0] = begin;
+            bounds[8] = end;
+
+            auto split = [&](size_t first, size_t last, int axis) {
+                return (size_t)(std::partition(data + first, data + last, [&](const Source& source) {
+                    return source.position[axis] < center[axis];
+                }) - data);
+            };
+
+            bounds[4] = split(begin, end, 0);
+            bounds[2] = split(begin, bounds[4], 1);
+            bounds[6] = split(bounds[4], end, 1);
+            bounds[1] = split(begin, bounds[2], 2);
+            bounds[3] = split(bounds[2], bounds[4], 2);
+            bounds[5] = split(bounds[4], bounds[6], 2);
+            bounds[7] = split(bounds[6], end, 2);
+
+            for (int octant = 0; octant < 8; octant++) {
+                if (bounds[octant + 1] > bounds[octant]) node.childCount++;
+            }
+
+            node.firstChild = (unsigned)nodes.size();
+            nodes.resize(nodes.size() + node.childCount);
+
+            const float childHalfSize = 0.5f * halfSize;
+            unsigned child = node.firstChild;
+            for (int octant = 0; octant < 8; octant++) {
+                if (bounds[octant + 1] == bounds[octant]) continue;
+
+                glm::vec3 childCenter(
+                    center.x + (octant & 4 ? childHalfSize : -childHalfSize),
+                    center.y + (octant & 2 ? childHalfSize : -childHalfSize),
+                    center.z + (octant & 1 ? childHalfSize : -childHalfSize)
+                );
+                buildNode(child++, bounds[octant], bounds[octant + 1], childCenter, childHalfSize, depth + 1);
+            }
+
+            for (unsigned c = node.firstChild; c < node.firstChild + node.childCount; c++) {
+                const Node& childNode = nodes[c];
+                node.mass += childNode.mass;
+                node.charge += childNode.charge;
+                node.absCharge += childNode.absCharge;
+                massMoment += childNode.mass * childNode.massCenter;
+                chargeMoment += childNode.absCharge * childNode.chargeCenter;
+            }
+        }
+
+        node.massCenter = node.mass != 0.0f ? massMoment / node.mass : center;
+        node.chargeCenter = node.absCharge != 0.0f ? chargeMoment / node.absCharge : center;
+        nodes[index] = node;
+    }
+
+    void Octree::computeField(const glm::vec3& point, float openingAngle, float softening, FieldSample& sample) const {
+        if (nodes.empty()) return;
+
+        const float openingAngleSquared = openingAngle * openingAngle;
+        const float softeningSquared = softening * softening;
+
+        // depth-first traversal, every level pushes at most 8 nodes
+        unsigned stack[8 * (MAX_DEPTH + 1)];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            const Node& node = nodes[stack[--top]];
+
+            if (node.childCount == 0) {
+                for (unsigned i = node.firstSource; i < node.firstSource + node.sourceCount; i++) {
+                    accumulateSource(point, sources[i].position, sources[i].mass, sources[i].charge, softeningSquared, sample);
+                }
+                continue;
+            }
+
+            const float sizeSquared = 4.0f * node.halfSize * node.halfSize;
+            bool far = true;
+
+            if (node.mass != 0.0f) {
+                glm::vec3 distance = node.massCenter - point;
+                far = sizeSquared < openingAngleSquared * glm::dot(distance, distance);
+            }
+            if (far && node.absCharge != 0.0f) {
+                glm::vec3 distance = node.chargeCenter - point;
+                far = sizeSquared < openingAngleSquared * glm::dot(distance, distance);
+            }
+
+            if (far) {
+                // the node acts as two pseudo-particles, one carrying the mass and one carrying the charge
+                if (node.mass != 0.0f) accumulateSource(point, node.massCenter, node.mass, 0.0f, softeningSquared, sample);
+                if (node.charge != 0.0f) accumulateSource(point, node.chargeCenter, 0.0f, node.charge, softeningSquared, sample);
+            }
+            else {
+                for (unsigned c = node.firstChild; c < node.firstChild + node.childCount; c++) {
+                    stack[top++] = c;
+                }
+            }
+        }
+    }
+
+    void computeDirectField(const glm::vec3& point, const glm::vec3* positions, const float* masses, const float* charges, size_t count, float softening, FieldSample& sample) {
+        const float softeningSquared = softening * softening;
+
+        for (size_t j = 0; j < count; j++) {
+            accumulateSource(point, positions[j], masses ? masses[j] : 0.0f, charges ? charges[j] : 0.0f, softeningSquared, sample);
+        }
+    }
+
+    // NBodyInteraction implementations
+    NBodyInteraction::NBodyInteraction(unsigned kinds, Method method, float openingAngle, float softening)
+        : kinds(kinds), method(method), openingAngle(openingAngle), softening(softening), directThreshold(0), leafSize(8), simdLevel(getSupportedSimdLevel()) {
+        // the vectorized direct sum outruns the tree up to a few tens of thousands of sources
+        directThreshold = simdLevel == SimdLevel::Scalar ? 2048 : 16384;
+    }
+
+    unsigned NBodyInteraction::getKinds() const {
+        return kinds;
+    }
+
+    NBodyInteraction::Method NBodyInteraction::getMethod() const {
+        return method;
+    }
+
+    float NBodyInteraction::getOpeningAngle() const {
+        return openingAngle;
+    }
+
+    float NBodyInteraction::getSoftening() const {
+        return softening;
+    }
+
+    size_t NBodyInteraction::getDirectThreshold() const {
+        return directThreshold;
+    }
+
+    void NBodyInteraction::setKinds(unsigned k) {
+        kinds = k;
+    }
+
+    void NBodyInteraction::setMethod(Method m) {
+        method = m;
+    }
+
+    void NBodyInteraction::setOpeningAngle(float angle) {
+        openingAngle = angle;
+    }
+
+    void NBodyInteraction::setSoftening(float length) {
+        softening = length;
+    }
+
+    void NBodyInteraction::setDirectThreshold(size_t count) {
+        directThreshold = count;
+    }
+
+    void NBodyInteraction::setLeafSize(unsigned size) {
+        leafSize = size;
+    }
+
+    unsigned NBodyInteraction::getLeafSize() const {
+        return leafSize;
+    }
+
+    void NBodyInteraction::setSimdLevel(SimdLevel level) {
+        simdLevel = std::min(level, getSupportedSimdLevel());
+    }
+
+    SimdLevel NBodyInteraction::getSimdLevel() const {
+        return simdLevel;
+    }
+
+    ForceDescriptor NBodyInteraction::describe() const {
+        ForceDescriptor descriptor(ForceDescriptor::NBody);
+        descriptor.parameters[0] = (float)kinds;
+        descriptor.parameters[1] = (float)method;
+        descriptor.parameters[2] = openingAngle;
+        descriptor.parameters[3] = softening;
+        descriptor.parameters[4] = (float)directThreshold;
+        descriptor.parameters[5] = (float)leafSize;
+        descriptor.parameters[6] = (float)simdLevel;
+        return descriptor;
+    }
+
+    NBodyInteraction::Method NBodyInteraction::resolveMethod(size_t sourceCount) const {
+        if (method != Automatic) return method;
+        return sourceCount < directThreshold ? Direct : BarnesHut;
+    }
+
+    void NBodyInteraction::computeForces(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, glm::vec3* forces, Parallel::ThreadPool* pool) const {
+        computeForces(
+            positions, system.getMasses(), system.getCharges(), system.size(),
+            positions, system.getMasses(), system.getCharges(), system.size(),
+            forces, pool
+        );
+    }
+
+    void NBodyInteraction::computeForces(const glm::vec3* sourcePositions, const float* sourceMasses, const float* sourceCharges, size_t sourceCount,
+        const glm::vec3* targetPositions, const float* targetMasses, const float* targetCharges, size_t targetCount,
+        glm::vec3* forces, Parallel::ThreadPool* pool) const {
+
+        if (sourceCount == 0 || targetCount == 0) return;
+
+        // disabled interactions are dropped from the sources, so that they cost nothing
+        const float* masses = (kinds & Gravitational) ? sourceMasses : nullptr;
+        const float* charges = (kinds & Electric) ? sourceCharges : nullptr;
+        if (!masses && !charges) return;
+
+        if (resolveMethod(sourceCount) == Direct) {
+            computeDirectForces(
+                sourcePositions, masses, charges, sourceCount,
+                targetPositions, targetMasses, targetCharges, targetCount,
+                softening, forces, pool, simdLevel
+            );
+            return;
+        }
+
+        static thread_local Octree cachedTree;
+        const Octree& tree = cachedTree; // the workers must read the tree of the calling thread
+        cachedTree.setLeafSize(leafSize);
+        cachedTree.build(sourcePositions, masses, charges, sourceCount);
+
+        computeForces(tree, targetPositions, targetMasses, targetCharges, targetCount, forces, pool);
+    }
+
+    void NBodyInteraction::computeForces(const Octree& tree, const glm::vec3* targetPositions, const float* targetMasses, const float* targetCharges, size_t targetCount,
+        glm::vec3* forces, Parallel::ThreadPool* pool) const {
+
+        if (tree.getNodes().empty() || targetCount == 0) return;
+
+        const float* masses = (kinds & Gravitational) ? targetMasses : nullptr;
+        const float* charges = (kinds & Electric) ? targetCharges : nullptr;
+
+        Parallel::parallelFor(pool, targetCount, TARGET_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                FieldSample sample;
+                tree.computeField(targetPositions[i], openingAngle, softening, sample);
+
+                if (masses) forces[i] += (G * masses[i]) * sample.gravity;
+                if (charges) forces[i] += (k_e * charges[i]) * sample.electric;
+            }
+        });
+    }
+
+    float NBodyInteraction::computeEnergy(const ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, Parallel::ThreadPool* pool) const {
+        const size_t count = system.size();
+        const float* masses = (kinds & Gravitational) ? system.getMasses() : nullptr;
+        const float* charges = (kinds & Electric) ? system.getCharges() : nullptr;
+        if (count == 0 || (!masses && !charges)) return 0.0f;
+
+        const bool useTree = resolveMethod(count) == BarnesHut;
+        static thread_local Octree cachedTree;
+        const Octree& tree = cachedTree; // the workers must read the tree of the calling thread
+        if (useTree) {
+            cachedTree.setLeafSize(leafSize);
+            cachedTree.build(positions, masses, charges, count);
+        }
+
+        // every pair is counted twice, once from each side
+        const size_t blockCount = (count + ENERGY_BLOCK - 1) / ENERGY_BLOCK;
+        std::vector<double> blockEnergies(blockCount, 0.0);
+
+        Parallel::parallelFor(pool, blockCount, 1, [&](size_t firstBlock, size_t lastBlock) {
+            for (size_t block = firstBlock; block < lastBlock; block++) {
+                double energy = 0.0;
+
+                for (size_t i = block * ENERGY_BLOCK; i < std::min(count, (block + 1) * ENERGY_BLOCK); i++) {
+                    FieldSample sample;
+                    if (useTree) tree.computeField(positions[i], openingAngle, softening, sample);
+                    else computeDirectField(positions[i], positions, masses, charges, count, softening, sample);
+
+                    if (masses) energy -= (double)G * masses[i] * sample.gravityPotential;
+                    if (charges) energy += (double)k_e * charges[i] * sample.electricPotential;
+                }
+
+                blockEnergies[block] = 0.5 * energy;
+            }
+        });
+
+        double totalEnergy = 0.0;
+        for (double energy : blockEnergies) totalEnergy += energy;
+
+        return (float)totalEnergy;
+    }
+}
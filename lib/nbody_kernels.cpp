@@ -0,0 +1,271 @@
+#include "nbody.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NBODY_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace Physics {
+
+    namespace {
+        // Number of sources of a tile, sized so that a tile of coordinates, masses and charges stays in the L1/L2 cache
+        const size_t SOURCE_TILE = 1024;
+
+        // Number of targets processed by a block, a multiple of the widest vector
+        const size_t TARGET_BLOCK = 256;
+
+        /**
+         * Sources and a block of targets transposed to separate coordinate arrays.
+         * Accumulators hold the unscaled fields, as in FieldSample.
+         */
+        struct SourceArrays {
+            std::vector<float> x, y, z, mass, charge;
+        };
+
+        struct TargetBlock {
+            float x[TARGET_BLOCK], y[TARGET_BLOCK], z[TARGET_BLOCK];
+            float gravityX[TARGET_BLOCK], gravityY[TARGET_BLOCK], gravityZ[TARGET_BLOCK];
+            float electricX[TARGET_BLOCK], electricY[TARGET_BLOCK], electricZ[TARGET_BLOCK];
+        };
+
+        typedef void (*TileKernel)(const SourceArrays& sources, size_t sourceBegin, size_t sourceEnd, TargetBlock& block, size_t targetCount, float softeningSquared);
+
+        template<bool Gravity, bool Electric>
+        void tileScalar(const SourceArrays& sources, size_t sourceBegin, size_t sourceEnd, TargetBlock& block, size_t targetCount, float softeningSquared) {
+            for (size_t t = 0; t < targetCount; t++) {
+                float gx = block.gravityX[t], gy = block.gravityY[t], gz = block.gravityZ[t];
+                float ex = block.electricX[t], ey = block.electricY[t], ez = block.electricZ[t];
+
+                for (size_t j = sourceBegin; j < sourceEnd; j++) {
+                    float dx = sources.x[j] - block.x[t];
+                    float dy = sources.y[j] - block.y[t];
+                    float dz = sources.z[j] - block.z[t];
+                    float distanceSquared = dx * dx + dy * dy + dz * dz;
+
+                    float inverseDistance = distanceSquared > 0.0f ? 1.0f / std::sqrt(distanceSquared + softeningSquared) : 0.0f;
+                    float inverseDistanceCubed = inverseDistance * inverseDistance * inverseDistance;
+
+                    if (Gravity) {
+                        float weight = sources.mass[j] * inverseDistanceCubed;
+                        gx += weight * dx; gy += weight * dy; gz += weight * dz;
+                    }
+                    if (Electric) {
+                        float weight = sources.charge[j] * inverseDistanceCubed;
+                        ex -= weight * dx; ey -= weight * dy; ez -= weight * dz;
+                    }
+                }
+
+                block.gravityX[t] = gx; block.gravityY[t] = gy; block.gravityZ[t] = gz;
+                block.electricX[t] = ex; block.electricY[t] = ey; block.electricZ[t] = ez;
+            }
+        }
+
+#ifdef NBODY_X86_KERNELS
+        template<bool Gravity, bool Electric>
+        __attribute__((target("avx2,fma")))
+        void tileAVX2(const SourceArrays& sources, size_t sourceBegin, size_t sourceEnd, TargetBlock& block, size_t targetCount, float softeningSquared) {
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 half = _mm256_set1_ps(0.5f);
+            const __m256 threeHalves = _mm256_set1_ps(1.5f);
+            const __m256 softening = _mm256_set1_ps(softeningSquared);
+
+            for (size_t t = 0; t < targetCount; t += 8) {
+                const __m256 px = _mm256_loadu_ps(block.x + t);
+                const __m256 py = _mm256_loadu_ps(block.y + t);
+                const __m256 pz = _mm256_loadu_ps(block.z + t);
+
+                __m256 gx = _mm256_loadu_ps(block.gravityX + t), gy = _mm256_loadu_ps(block.gravityY + t), gz = _mm256_loadu_ps(block.gravityZ + t);
+                __m256 ex = _mm256_loadu_ps(block.electricX + t), ey = _mm256_loadu_ps(block.electricY + t), ez = _mm256_loadu_ps(block.electricZ + t);
+
+                for (size_t j = sourceBegin; j < sourceEnd; j++) {
+                    __m256 dx = _mm256_sub_ps(_mm256_set1_ps(sources.x[j]), px);
+                    __m256 dy = _mm256_sub_ps(_mm256_set1_ps(sources.y[j]), py);
+                    __m256 dz = _mm256_sub_ps(_mm256_set1_ps(sources.z[j]), pz);
+                    __m256 distanceSquared = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+                    __m256 valid = _mm256_cmp_ps(distanceSquared, zero, _CMP_GT_OQ);
+
+                    // rsqrt estimate refined by one Newton iteration: y = y * (1.5 - 0.5 * x * y^2)
+                    __m256 softened = _mm256_add_ps(distanceSquared, softening);
+                    __m256 inverseDistance = _mm256_rsqrt_ps(softened);
+                    inverseDistance = _mm256_mul_ps(inverseDistance, _mm256_fnmadd_ps(_mm256_mul_ps(half, softened), _mm256_mul_ps(inverseDistance, inverseDistance), threeHalves));
+                    inverseDistance = _mm256_and_ps(inverseDistance, valid);
+                    __m256 inverseDistanceCubed = _mm256_mul_ps(inverseDistance, _mm256_mul_ps(inverseDistance, inverseDistance));
+
+                    if (Gravity) {
+                        __m256 weight = _mm256_mul_ps(_mm256_set1_ps(sources.mass[j]), inverseDistanceCubed);
+                        gx = _mm256_fmadd_ps(weight, dx, gx);
+                        gy = _mm256_fmadd_ps(weight, dy, gy);
+                        gz = _mm256_fmadd_ps(weight, dz, gz);
+                    }
+                    if (Electric) {
+                        __m256 weight = _mm256_mul_ps(_mm256_set1_ps(sources.charge[j]), inverseDistanceCubed);
+                        ex = _mm256_fnmadd_ps(weight, dx, ex);
+                        ey = _mm256_fnmadd_ps(weight, dy, ey);
+                        ez = _mm256_fnmadd_ps(weight, dz, ez);
+                    }
+                }
+
+                _mm256_storeu_ps(block.gravityX + t, gx); _mm256_storeu_ps(block.gravityY + t, gy); _mm256_storeu_ps(block.gravityZ + t, gz);
+                _mm256_storeu_ps(block.electricX + t, ex); _mm256_storeu_ps(block.electricY + t, ey); _mm256_storeu_ps(block.electricZ + t, ez);
+            }
+        }
+
+        template<bool Gravity, bool Electric>
+        __attribute__((target("avx512f")))
+        void tileAVX512(const SourceArrays& sources, size_t sourceBegin, size_t sourceEnd, TargetBlock& block, size_t targetCount, float softeningSquared) {
+            const __m512 zero = _mm512_setzero_ps();
+            const __m512 half = _mm512_set1_ps(0.5f);
+            const __m512 threeHalves = _mm512_set1_ps(1.5f);
+            const __m512 softening = _mm512_set1_ps(softeningSquared);
+
+            for (size_t t = 0; t < targetCount; t += 16) {
+                const __m512 px = _mm512_loadu_ps(block.x + t);
+                const __m512 py = _mm512_loadu_ps(block.y + t);
+                const __m512 pz = _mm512_loadu_ps(block.z + t);
+
+                __m512 gx = _mm512_loadu_ps(block.gravityX + t), gy = _mm512_loadu_ps(block.gravityY + t), gz = _mm512_loadu_ps(block.gravityZ + t);
+                __m512 ex = _mm512_loadu_ps(block.electricX + t), ey = _mm512_loadu_ps(block.electricY + t), ez = _mm512_loadu_ps(block.electricZ + t);
+
+                for (size_t j = sourceBegin; j < sourceEnd; j++) {
+                    __m512 dx = _mm512_sub_ps(_mm512_set1_ps(sources.x[j]), px);
+                    __m512 dy = _mm512_sub_ps(_mm512_set1_ps(sources.y[j]), py);
+                    __m512 dz = _mm512_sub_ps(_mm512_set1_ps(sources.z[j]), pz);
+                    __m512 distanceSquared = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+                    __mmask16 valid = _mm512_cmp_ps_mask(distanceSquared, zero, _CMP_GT_OQ);
+
+                    // rsqrt14 estimate refined by one Newton iteration: y = y * (1.5 - 0.5 * x * y^2)
+                    __m512 softened = _mm512_add_ps(distanceSquared, softening);
+                    __m512 inverseDistance = _mm512_rsqrt14_ps(softened);
+                    __m512 correction = _mm512_fnmadd_ps(_mm512_mul_ps(half, softened), _mm512_mul_ps(inverseDistance, inverseDistance), threeHalves);
+                    inverseDistance = _mm512_maskz_mul_ps(valid, inverseDistance, correction);
+                    __m512 inverseDistanceCubed = _mm512_mul_ps(inverseDistance, _mm512_mul_ps(inverseDistance, inverseDistance));
+
+                    if (Gravity) {
+                        __m512 weight = _mm512_mul_ps(_mm512_set1_ps(sources.mass[j]), inverseDistanceCubed);
+                        gx = _mm512_fmadd_ps(weight, dx, gx);
+                        gy = _mm512_fmadd_ps(weight, dy, gy);
+                        gz = _mm512_fmadd_ps(weight, dz, gz);
+                    }
+                    if (Electric) {
+                        __m512 weight = _mm512_mul_ps(_mm512_set1_ps(sources.charge[j]), inverseDistanceCubed);
+                        ex = _mm512_fnmadd_ps(weight, dx, ex);
+                        ey = _mm512_fnmadd_ps(weight, dy, ey);
+                        ez = _mm512_fnmadd_ps(weight, dz, ez);
+                    }
+                }
+
+                _mm512_storeu_ps(block.gravityX + t, gx); _mm512_storeu_ps(block.gravityY + t, gy); _mm512_storeu_ps(block.gravityZ + t, gz);
+                _mm512_storeu_ps(block.electricX + t, ex); _mm512_storeu_ps(block.electricY + t, ey); _mm512_storeu_ps(block.electricZ + t, ez);
+            }
+        }
+#endif
+
+        template<template<bool, bool> class Selector>
+        TileKernel selectKernel(bool gravity, bool electric) {
+            if (gravity && electric) return Selector<true, true>::kernel();
+            if (gravity) return Selector<true, false>::kernel();
+            return Selector<false, true>::kernel();
+        }
+
+        template<bool Gravity, bool Electric>
+        struct ScalarSelector {
+            static TileKernel kernel() { return tileScalar<Gravity, Electric>; }
+        };
+
+#ifdef NBODY_X86_KERNELS
+        template<bool Gravity, bool Electric>
+        struct AVX2Selector {
+            static TileKernel kernel() { return tileAVX2<Gravity, Electric>; }
+        };
+
+        template<bool Gravity, bool Electric>
+        struct AVX512Selector {
+            static TileKernel kernel() { return tileAVX512<Gravity, Electric>; }
+        };
+#endif
+    }
+
+    SimdLevel getSupportedSimdLevel() {
+#ifdef NBODY_X86_KERNELS
+        static const SimdLevel level = __builtin_cpu_supports("avx512f") ? SimdLevel::AVX512
+            : (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) ? SimdLevel::AVX2
+            : SimdLevel::Scalar;
+        return level;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+
+    const char* getSimdLevelName(SimdLevel level) {
+        switch (level) {
+            case SimdLevel::AVX512: return "avx512";
+            case SimdLevel::AVX2: return "avx2";
+            default: return "scalar";
+        }
+    }
+
+    void computeDirectForces(const glm::vec3* sourcePositions, const float* sourceMasses, const float* sourceCharges, size_t sourceCount,
+        const glm::vec3* targetPositions, const float* targetMasses, const float* targetCharges, size_t targetCount,
+        float softening, glm::vec3* forces, Parallel::ThreadPool* pool, SimdLevel level) {
+
+        const bool gravity = sourceMasses && targetMasses;
+        const bool electric = sourceCharges && targetCharges;
+        if (sourceCount == 0 || targetCount == 0 || (!gravity && !electric)) return;
+
+        level = std::min(level, getSupportedSimdLevel());
+        TileKernel kernel = selectKernel<ScalarSelector>(gravity, electric);
+        size_t width = 1;
+#ifdef NBODY_X86_KERNELS
+        if (level == SimdLevel::AVX512) { kernel = selectKernel<AVX512Selector>(gravity, electric); width = 16; }
+        else if (level == SimdLevel::AVX2) { kernel = selectKernel<AVX2Selector>(gravity, electric); width = 8; }
+#endif
+
+        SourceArrays sources;
+        sources.x.resize(sourceCount);
+        sources.y.resize(sourceCount);
+        sources.z.resize(sourceCount);
+        sources.mass.resize(sourceCount, 0.0f);
+        sources.charge.resize(sourceCount, 0.0f);
+        for (size_t j = 0; j < sourceCount; j++) {
+            sources.x[j] = sourcePositions[j].x;
+            sources.y[j] = sourcePositions[j].y;
+            sources.z[j] = sourcePositions[j].z;
+            if (gravity) sources.mass[j] = sourceMasses[j];
+            if (electric) sources.charge[j] = sourceCharges[j];
+        }
+
+        const float softeningSquared = softening * softening;
+
+        Parallel::parallelFor(pool, targetCount, TARGET_BLOCK, [&](size_t begin, size_t end) {
+            TargetBlock block;
+
+            for (size_t first = begin; first < end; first += TARGET_BLOCK) {
+                const size_t count = std::min(TARGET_BLOCK, end - first);
+                // padding lanes replicate the last target and are discarded
+                const size_t paddedCount = (count + width - 1) / width * width;
+
+                for (size_t t = 0; t < paddedCount; t++) {
+                    const glm::vec3& position = targetPositions[first + std::min(t, count - 1)];
+                    block.x[t] = position.x;
+                    block.y[t] = position.y;
+                    block.z[t] = position.z;
+                    block.gravityX[t] = block.gravityY[t] = block.gravityZ[t] = 0.0f;
+                    block.electricX[t] = block.electricY[t] = block.electricZ[t] = 0.0f;
+                }
+
+                for (size_t tile = 0; tile < sourceCount; tile += SOURCE_TILE) {
+                    kernel(sources, tile, std::min(sourceCount, tile + SOURCE_TILE), block, paddedCount, softeningSquared);
+                }
+
+                for (size_t t = 0; t < count; t++) {
+                    const size_t i = first + t;
+                    if (gravity) forces[i] += (G * targetMasses[i]) * glm::vec3(block.gravityX[t], block.gravityY[t], block.gravityZ[t]);
+                    if (electric) forces[i] += (k_e * targetCharges[i]) * glm::vec3(block.electricX[t], block.electricY[t], block.electricZ[t]);
+                }
+            }
+        });
+    }
+}
@@ -1,10 +1,18 @@
 #include "physics.hpp"
+#include "field.hpp"
+#include "interaction.hpp"
+#include "profiler.hpp"
+#include "timeprofile.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <mutex>
 
 namespace Physics {
 
     // Particle implementations
     Particle::Particle(float m, const glm::vec3& pos, const glm::vec3& vel) 
-        : mass(m), position(pos), velocity(vel) {}
+        : position(pos), velocity(vel), mass(m), stepSize(0.0f), acceleration(0.0f), accelerationValid(false) {}
 
     glm::vec3 Particle::getPosition() {
         return position;
@@ -18,16 +26,405 @@ namespace Physics {
         return mass;
     }
 
+    float Particle::getStepSize() {
+        return stepSize;
+    }
+
     void Particle::setPosition(const glm::vec3& pos) {
         position = pos;
+        accelerationValid = false;
     }
     
     void Particle::setVelocity(const glm::vec3& vel) {
         velocity = vel;
+        accelerationValid = false;
     }
     
     void Particle::setMass(float m) {
         mass = m;
+        accelerationValid = false;
+    }
+
+    void Particle::setStepSize(float step) {
+        stepSize = step;
+    }
+
+    bool Particle::hasAcceleration() {
+        return accelerationValid;
+    }
+
+    glm::vec3 Particle::getAcceleration() {
+        return acceleration;
+    }
+
+    void Particle::setAcceleration(const glm::vec3& acc) {
+        acceleration = acc;
+        accelerationValid = true;
+    }
+
+    void Particle::invalidateAcceleration() {
+        accelerationValid = false;
+    }
+
+    // ParticleSystem implementations
+    ParticleSystem::ParticleSystem() : accelerationsValid(false), identityOrder(true) {}
+
+    size_t ParticleSystem::addParticle(float m, const glm::vec3& pos, const glm::vec3& vel, float q, float r) {
+        positions.push_back(pos);
+        velocities.push_back(vel);
+        masses.push_back(m);
+        charges.push_back(q);
+        radii.push_back(r);
+        stepSizes.push_back(0.0f);
+        accelerations.push_back(glm::vec3(0.0f));
+        accelerationsValid = false;
+
+        // the new particle gets the next id, at the next index
+        ids.push_back((uint32_t)(masses.size() - 1));
+        indices.push_back((uint32_t)(masses.size() - 1));
+
+        return masses.size() - 1;
+    }
+
+    void ParticleSystem::reserve(size_t count) {
+        positions.reserve(count);
+        velocities.reserve(count);
+        masses.reserve(count);
+        charges.reserve(count);
+        radii.reserve(count);
+        stepSizes.reserve(count);
+        accelerations.reserve(count);
+        ids.reserve(count);
+        indices.reserve(count);
+    }
+
+    void ParticleSystem::clear() {
+        positions.clear();
+        velocities.clear();
+        masses.clear();
+        charges.clear();
+        radii.clear();
+        stepSizes.clear();
+        accelerations.clear();
+        accelerationsValid = false;
+        ids.clear();
+        indices.clear();
+        identityOrder = true;
+    }
+
+    void ParticleSystem::resize(size_t count) {
+        const size_t previous = masses.size();
+
+        positions.resize(count, glm::vec3(0.0f));
+        velocities.resize(count, glm::vec3(0.0f));
+        masses.resize(count, 0.0f);
+        charges.resize(count, 0.0f);
+        radii.resize(count, 0.0f);
+        stepSizes.resize(count, 0.0f);
+        accelerations.resize(count, glm::vec3(0.0f));
+        accelerationsValid = false;
+
+        if (count < previous && !identityOrder) {
+            // renumber the ids kept in increasing order, skipping those of the removed particles
+            uint32_t next = 0;
+            for (size_t id = 0; id < previous; id++) {
+                const uint32_t index = indices[id];
+                if (index < count) {
+                    ids[index] = next;
+                    indices[next++] = index;
+                }
+            }
+            ids.resize(count);
+            indices.resize(count);
+            identityOrder = std::is_sorted(indices.begin(), indices.end());
+        }
+        else {
+            ids.resize(count);
+            indices.resize(count);
+            for (size_t i = previous; i < count; i++) ids[i] = indices[i] = (uint32_t)i;
+        }
+    }
+
+    size_t ParticleSystem::size() const {
+        return masses.size();
+    }
+
+    glm::vec3 ParticleSystem::getPosition(size_t index) const {
+        return positions[index];
+    }
+
+    glm::vec3 ParticleSystem::getVelocity(size_t index) const {
+        return velocities[index];
+    }
+
+    float ParticleSystem::getMass(size_t index) const {
+        return masses[index];
+    }
+
+    float ParticleSystem::getCharge(size_t index) const {
+        return charges[index];
+    }
+
+    float ParticleSystem::getRadius(size_t index) const {
+        return radii[index];
+    }
+
+    void ParticleSystem::setPosition(size_t index, const glm::vec3& pos) {
+        positions[index] = pos;
+        accelerationsValid = false;
+    }
+
+    void ParticleSystem::setVelocity(size_t index, const glm::vec3& vel) {
+        velocities[index] = vel;
+        accelerationsValid = false;
+    }
+
+    void ParticleSystem::setMass(size_t index, float m) {
+        masses[index] = m;
+        accelerationsValid = false;
+    }
+
+    void ParticleSystem::setCharge(size_t index, float q) {
+        charges[index] = q;
+        accelerationsValid = false;
+    }
+
+    void ParticleSystem::setRadius(size_t index, float r) {
+        radii[index] = r;
+    }
+
+    glm::vec3* ParticleSystem::getPositions() {
+        return positions.data();
+    }
+
+    glm::vec3* ParticleSystem::getVelocities() {
+        return velocities.data();
+    }
+
+    float* ParticleSystem::getMasses() {
+        return masses.data();
+    }
+
+    float* ParticleSystem::getCharges() {
+        return charges.data();
+    }
+
+    const glm::vec3* ParticleSystem::getPositions() const {
+        return positions.data();
+    }
+
+    const glm::vec3* ParticleSystem::getVelocities() const {
+        return velocities.data();
+    }
+
+    const float* ParticleSystem::getMasses() const {
+        return masses.data();
+    }
+
+    const float* ParticleSystem::getCharges() const {
+        return charges.data();
+    }
+
+    float* ParticleSystem::getRadii() {
+        return radii.data();
+    }
+
+    const float* ParticleSystem::getRadii() const {
+        return radii.data();
+    }
+
+    float* ParticleSystem::getStepSizes() {
+        return stepSizes.data();
+    }
+
+    const float* ParticleSystem::getStepSizes() const {
+        return stepSizes.data();
+    }
+
+    uint32_t ParticleSystem::getId(size_t index) const {
+        return ids[index];
+    }
+
+    size_t ParticleSystem::getIndex(uint32_t id) const {
+        return indices[id];
+    }
+
+    const uint32_t* ParticleSystem::getIds() const {
+        return ids.data();
+    }
+
+    const uint32_t* ParticleSystem::getIndices() const {
+        return indices.data();
+    }
+
+    bool ParticleSystem::hasIdentityOrder() const {
+        return identityOrder;
+    }
+
+    void ParticleSystem::reorder(const uint32_t* order) {
+        const size_t count = masses.size();
+
+        // one scratch array per element type, reused by every array of that type
+        std::vector<glm::vec3> vectors(count);
+        std::vector<float> scalars(count);
+        std::vector<uint32_t> numbers(count);
+
+        for (std::vector<glm::vec3>* array : { &positions, &velocities, &accelerations }) {
+            for (size_t i = 0; i < count; i++) vectors[i] = (*array)[order[i]];
+            array->swap(vectors);
+        }
+        for (std::vector<float>* array : { &masses, &charges, &radii, &stepSizes }) {
+            for (size_t i = 0; i < count; i++) scalars[i] = (*array)[order[i]];
+            array->swap(scalars);
+        }
+        for (size_t i = 0; i < count; i++) numbers[i] = ids[order[i]];
+        ids.swap(numbers);
+
+        identityOrder = true;
+        for (size_t i = 0; i < count; i++) {
+            indices[ids[i]] = (uint32_t)i;
+            if (ids[i] != i) identityOrder = false;
+        }
+    }
+
+    bool ParticleSystem::assignIds(const uint32_t* particleIds) {
+        const size_t count = masses.size();
+        std::vector<uint32_t> assigned(count, (uint32_t)count);
+        for (size_t i = 0; i < count; i++) {
+            if (particleIds[i] >= count || assigned[particleIds[i]] != count) return false;
+            assigned[particleIds[i]] = (uint32_t)i;
+        }
+
+        ids.assign(particleIds, particleIds + count);
+        indices.swap(assigned);
+        identityOrder = true;
+        for (size_t i = 0; i < count; i++) {
+            if (ids[i] != i) identityOrder = false;
+        }
+        return true;
+    }
+
+    bool ParticleSystem::hasAccelerations() const {
+        return accelerationsValid;
+    }
+
+    glm::vec3* ParticleSystem::getAccelerations() {
+        return accelerations.data();
+    }
+
+    const glm::vec3* ParticleSystem::getAccelerations() const {
+        return accelerations.data();
+    }
+
+    void ParticleSystem::validateAccelerations() {
+        accelerationsValid = true;
+    }
+
+    void ParticleSystem::invalidateAccelerations() {
+        accelerationsValid = false;
+    }
+
+    void ParticleSystem::addInteraction(const Interaction& interaction) {
+        interactions.push_back(&interaction);
+        accelerationsValid = false;
+    }
+
+    void ParticleSystem::removeInteraction(const Interaction& interaction) {
+        for (std::vector<const Interaction*>::iterator it = interactions.begin(); it != interactions.end(); ++it) {
+            if (*it == &interaction) {
+                interactions.erase(it);
+                accelerationsValid = false;
+                break;
+            }
+        }
+    }
+
+    const std::vector<const Interaction*>& ParticleSystem::getInteractions() const {
+        return interactions;
+    }
+
+    void ParticleSystem::addField(const Field& field) {
+        fields.push_back(&field);
+        accelerationsValid = false;
+    }
+
+    void ParticleSystem::removeField(const Field& field) {
+        for (std::vector<const Field*>::iterator it = fields.begin(); it != fields.end(); ++it) {
+            if (*it == &field) {
+                fields.erase(it);
+                accelerationsValid = false;
+                break;
+            }
+        }
+    }
+
+    const std::vector<const Field*>& ParticleSystem::getFields() const {
+        return fields;
+    }
+
+    // Force implementations
+    void Force::computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        for (size_t i = 0; i < count; i++) {
+            forces[i] += computeForce(positions[i], velocities[i], time);
+        }
+    }
+
+    glm::dvec3 Force::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const {
+        return glm::dvec3(computeForce(glm::vec3(position), glm::vec3(velocity), (float)time));
+    }
+
+    void Force::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const {
+        for (size_t i = 0; i < count; i++) {
+            forces[i] += computeForceDouble(positions[i], velocities[i], time);
+        }
+    }
+
+    unsigned Force::getDependencies() const {
+        return DependsOnAll;
+    }
+
+    bool Force::isUniform() const {
+        return (getDependencies() & (DependsOnPosition | DependsOnVelocity)) == 0;
+    }
+
+    ForceDescriptor Force::describe() const {
+        return ForceDescriptor();
+    }
+
+    size_t Force::getComponentCount() const {
+        return 0;
+    }
+
+    const Force& Force::getComponent(size_t index) const {
+        return *this;
+    }
+
+    // ForceDescriptor implementations
+    ForceDescriptor::ForceDescriptor(uint32_t t) : type(t) {
+        std::fill(parameters, parameters + MAX_PARAMETERS, 0.0f);
+    }
+
+    std::unique_ptr<Force> createForce(const ForceDescriptor& descriptor) {
+        const float* p = descriptor.parameters;
+
+        switch (descriptor.type) {
+            case ForceDescriptor::Composite:
+                return std::unique_ptr<Force>(new CompositeForce());
+            case ForceDescriptor::Electric:
+                return std::unique_ptr<Force>(new ElectricForce(p[0], p[1], glm::vec3(p[2], p[3], p[4])));
+            case ForceDescriptor::Gravitational:
+                return std::unique_ptr<Force>(new GravitationalForce(p[0], p[1], glm::vec3(p[2], p[3], p[4])));
+            case ForceDescriptor::EarthGravitational:
+                return std::unique_ptr<Force>(new EarthGravitationalForce(p[0]));
+            case ForceDescriptor::Hooke:
+                return std::unique_ptr<Force>(new HookeForce(p[0], glm::vec3(p[1], p[2], p[3])));
+            case ForceDescriptor::AirResistance:
+                return std::unique_ptr<Force>(new AirResistanceForce(p[0]));
+            case ForceDescriptor::Driving:
+                return std::unique_ptr<Force>(new DrivingForce(glm::vec3(p[0], p[1], p[2]), TimeProfile::sinusoidal(p[3], p[4], p[5], p[6])));
+            default:
+                return std::unique_ptr<Force>();
+        }
     }
 
     // CompositeForce implementations
@@ -44,6 +441,10 @@ namespace Physics {
         }
     }
 
+    void CompositeForce::clear() {
+        forces.clear();
+    }
+
     glm::vec3 CompositeForce::computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const {
         glm::vec3 totalForce(0.0f);
         
@@ -64,6 +465,96 @@ namespace Physics {
         return totalEnergy;
     }
 
+    void CompositeForce::computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        glm::vec3 uniformForce(0.0f);
+        bool hasUniform = false;
+
+        for (const auto& force : this->forces) {
+            if (force->isUniform()) {
+                uniformForce += force->computeForce(glm::vec3(0.0f), glm::vec3(0.0f), time);
+                hasUniform = true;
+            }
+            else force->computeForces(positions, velocities, count, time, forces);
+        }
+
+        if (hasUniform) {
+            for (size_t i = 0; i < count; i++) forces[i] += uniformForce;
+        }
+    }
+
+    glm::dvec3 CompositeForce::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const {
+        glm::dvec3 totalForce(0.0);
+
+        for (const auto& force : forces) {
+            totalForce += force->computeForceDouble(position, velocity, time);
+        }
+
+        return totalForce;
+    }
+
+    void CompositeForce::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const {
+        glm::dvec3 uniformForce(0.0);
+        bool hasUniform = false;
+
+        for (const auto& force : this->forces) {
+            if (force->isUniform()) {
+                uniformForce += force->computeForceDouble(glm::dvec3(0.0), glm::dvec3(0.0), time);
+                hasUniform = true;
+            }
+            else force->computeForcesDouble(positions, velocities, count, time, forces);
+        }
+
+        if (hasUniform) {
+            for (size_t i = 0; i < count; i++) forces[i] += uniformForce;
+        }
+    }
+
+    unsigned CompositeForce::getDependencies() const {
+        unsigned dependencies = 0;
+
+        for (const auto& force : forces) {
+            dependencies |= force->getDependencies();
+        }
+
+        return dependencies;
+    }
+
+    glm::vec3 CompositeForce::computeUniformForce(float time) const {
+        glm::vec3 uniformForce(0.0f);
+
+        for (const auto& force : forces) {
+            if (force->isUniform()) uniformForce += force->computeForce(glm::vec3(0.0f), glm::vec3(0.0f), time);
+        }
+
+        return uniformForce;
+    }
+
+    void CompositeForce::computeVaryingForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        for (const auto& force : this->forces) {
+            if (!force->isUniform()) force->computeForces(positions, velocities, count, time, forces);
+        }
+    }
+
+    ForceDescriptor CompositeForce::describe() const {
+        return ForceDescriptor(ForceDescriptor::Composite);
+    }
+
+    size_t CompositeForce::getComponentCount() const {
+        return forces.size();
+    }
+
+    const Force& CompositeForce::getComponent(size_t index) const {
+        return *forces[index];
+    }
+
+    size_t CompositeForce::getForceCount() const {
+        return forces.size();
+    }
+
+    const Force& CompositeForce::getForce(size_t index) const {
+        return *forces[index];
+    }
+
     // ElectricForce implementations
     ElectricForce::ElectricForce(float q1, float q2, const glm::vec3& anchor) 
         : charge_1(q1), charge_2(q2), anchorPoint(anchor) {}
@@ -96,6 +587,42 @@ namespace Physics {
         return -k_e * charge_1 * charge_2 / glm::length(position - anchorPoint);
     }
 
+    void ElectricForce::computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        const float coefficient = -k_e * charge_1 * charge_2;
+
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 distance = positions[i] - anchorPoint;
+            float distanceSquared = glm::dot(distance, distance);
+            forces[i] += coefficient / (distanceSquared * std::sqrt(distanceSquared)) * distance;
+        }
+    }
+
+    glm::dvec3 ElectricForce::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const {
+        const glm::dvec3 distance = position - glm::dvec3(anchorPoint);
+        const double distanceSquared = glm::dot(distance, distance);
+        return -k_e_double * (double)charge_1 * (double)charge_2 / (distanceSquared * std::sqrt(distanceSquared)) * distance;
+    }
+
+    void ElectricForce::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const {
+        for (size_t i = 0; i < count; i++) {
+            forces[i] += ElectricForce::computeForceDouble(positions[i], velocities[i], time);
+        }
+    }
+
+    unsigned ElectricForce::getDependencies() const {
+        return DependsOnPosition;
+    }
+
+    ForceDescriptor ElectricForce::describe() const {
+        ForceDescriptor descriptor(ForceDescriptor::Electric);
+        descriptor.parameters[0] = charge_1;
+        descriptor.parameters[1] = charge_2;
+        descriptor.parameters[2] = anchorPoint.x;
+        descriptor.parameters[3] = anchorPoint.y;
+        descriptor.parameters[4] = anchorPoint.z;
+        return descriptor;
+    }
+
     // GravitationalForce implementations
     GravitationalForce::GravitationalForce(float m1, float m2, const glm::vec3& anchor) 
         : mass_1(m1), mass_2(m2), anchorPoint(anchor) {}
@@ -128,6 +655,42 @@ namespace Physics {
         return -G * mass_1 * mass_2 / glm::length(position - anchorPoint);
     }
 
+    void GravitationalForce::computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        const float coefficient = -G * mass_1 * mass_2;
+
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 distance = positions[i] - anchorPoint;
+            float distanceSquared = glm::dot(distance, distance);
+            forces[i] += coefficient / (distanceSquared * std::sqrt(distanceSquared)) * distance;
+        }
+    }
+
+    glm::dvec3 GravitationalForce::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const {
+        const glm::dvec3 distance = position - glm::dvec3(anchorPoint);
+        const double distanceSquared = glm::dot(distance, distance);
+        return -G_double * (double)mass_1 * (double)mass_2 / (distanceSquared * std::sqrt(distanceSquared)) * distance;
+    }
+
+    void GravitationalForce::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const {
+        for (size_t i = 0; i < count; i++) {
+            forces[i] += GravitationalForce::computeForceDouble(positions[i], velocities[i], time);
+        }
+    }
+
+    unsigned GravitationalForce::getDependencies() const {
+        return DependsOnPosition;
+    }
+
+    ForceDescriptor GravitationalForce::describe() const {
+        ForceDescriptor descriptor(ForceDescriptor::Gravitational);
+        descriptor.parameters[0] = mass_1;
+        descriptor.parameters[1] = mass_2;
+        descriptor.parameters[2] = anchorPoint.x;
+        descriptor.parameters[3] = anchorPoint.y;
+        descriptor.parameters[4] = anchorPoint.z;
+        return descriptor;
+    }
+
     // EarthGravitationalForce implementations
     EarthGravitationalForce::EarthGravitationalForce(float m) : mass(m) {}
 
@@ -139,6 +702,34 @@ namespace Physics {
         return mass * g * position.y;
     }
 
+    void EarthGravitationalForce::computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        const float weight = -mass * g;
+
+        for (size_t i = 0; i < count; i++) {
+            forces[i].y += weight;
+        }
+    }
+
+    glm::dvec3 EarthGravitationalForce::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const {
+        return glm::dvec3(0.0, -mass * g_double, 0.0);
+    }
+
+    void EarthGravitationalForce::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const {
+        for (size_t i = 0; i < count; i++) {
+            forces[i] += EarthGravitationalForce::computeForceDouble(positions[i], velocities[i], time);
+        }
+    }
+
+    unsigned EarthGravitationalForce::getDependencies() const {
+        return 0;
+    }
+
+    ForceDescriptor EarthGravitationalForce::describe() const {
+        ForceDescriptor descriptor(ForceDescriptor::EarthGravitational);
+        descriptor.parameters[0] = mass;
+        return descriptor;
+    }
+
     // HookeForce implementations
     HookeForce::HookeForce(float springConstant, const glm::vec3& anchor) 
         : anchorPoint(anchor), k(springConstant) {}
@@ -155,6 +746,35 @@ namespace Physics {
         return 0.5f * k * glm::dot(position - anchorPoint, position - anchorPoint);
     }
 
+    void HookeForce::computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        for (size_t i = 0; i < count; i++) {
+            forces[i] -= k * (positions[i] - anchorPoint);
+        }
+    }
+
+    glm::dvec3 HookeForce::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const {
+        return -(double)k * (position - glm::dvec3(anchorPoint));
+    }
+
+    void HookeForce::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const {
+        for (size_t i = 0; i < count; i++) {
+            forces[i] += HookeForce::computeForceDouble(positions[i], velocities[i], time);
+        }
+    }
+
+    unsigned HookeForce::getDependencies() const {
+        return DependsOnPosition;
+    }
+
+    ForceDescriptor HookeForce::describe() const {
+        ForceDescriptor descriptor(ForceDescriptor::Hooke);
+        descriptor.parameters[0] = k;
+        descriptor.parameters[1] = anchorPoint.x;
+        descriptor.parameters[2] = anchorPoint.y;
+        descriptor.parameters[3] = anchorPoint.z;
+        return descriptor;
+    }
+
     // AirResistanceForce implementations
     AirResistanceForce::AirResistanceForce(float drag) : dragCoefficient(drag) {}
 
@@ -165,10 +785,539 @@ namespace Physics {
     float AirResistanceForce::computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const {
         return 0.5f * dragCoefficient * glm::dot(velocity, velocity);
     }
+
+    void AirResistanceForce::computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        for (size_t i = 0; i < count; i++) {
+            forces[i] -= dragCoefficient * velocities[i];
+        }
+    }
+
+    glm::dvec3 AirResistanceForce::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const {
+        return -(double)dragCoefficient * velocity;
+    }
+
+    void AirResistanceForce::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const {
+        for (size_t i = 0; i < count; i++) {
+            forces[i] += AirResistanceForce::computeForceDouble(positions[i], velocities[i], time);
+        }
+    }
+
+    unsigned AirResistanceForce::getDependencies() const {
+        return DependsOnVelocity;
+    }
+
+    ForceDescriptor AirResistanceForce::describe() const {
+        ForceDescriptor descriptor(ForceDescriptor::AirResistance);
+        descriptor.parameters[0] = dragCoefficient;
+        return descriptor;
+    }
 }
 
 namespace Propagation {
 
+    namespace {
+        // Number of particles whose forces are buffered on the stack by the Euler methods
+        const size_t BATCH_SIZE = 256;
+
+        // Number of particles claimed at once by a thread of the pool
+        const size_t PARALLEL_GRAIN = 1024;
+
+        const float RK4_STAGE_STEPS[3] = { 0.5f, 0.5f, 1.0f };
+        const float RK4_STAGE_WEIGHTS[4] = { 1.0f, 2.0f, 2.0f, 1.0f };
+
+        /// @brief Evaluate the total force acting on a batch of particles into a zeroed output array
+        void evaluateForces(const Physics::Force& f, const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) {
+            std::fill(forces, forces + count, glm::vec3(0.0f));
+            f.computeForces(positions, velocities, count, time, forces);
+        }
+
+        /**
+         * @brief Evaluate the applied forces and the fields acting on the particles [first, first + count) of a system into a zeroed output array
+         *
+         * positions, velocities and forces point to the state and force of particle first
+         */
+        void evaluateParticleForces(const Physics::ParticleSystem& system, size_t first, const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) {
+            evaluateForces(system.appliedForces, positions, velocities, count, time, forces);
+
+            for (const Physics::Field* field : system.getFields()) {
+                field->computeForces(positions, velocities, system.getMasses() + first, system.getCharges() + first, count, time, forces);
+            }
+        }
+
+        /// @brief evaluateParticleForces with the uniform part of the applied forces given, see CompositeForce::computeUniformForce
+        void evaluateParticleForces(const Physics::ParticleSystem& system, size_t first, const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time,
+            const glm::vec3& uniformForce, glm::vec3* forces) {
+
+            std::fill(forces, forces + count, uniformForce);
+            system.appliedForces.computeVaryingForces(positions, velocities, count, time, forces);
+
+            for (const Physics::Field* field : system.getFields()) {
+                field->computeForces(positions, velocities, system.getMasses() + first, system.getCharges() + first, count, time, forces);
+            }
+        }
+
+        /// @brief Applied forces and fields acting on one particle of a system, for the methods propagating a single particle
+        class SystemParticleForce : public Physics::Force {
+            private:
+                const Physics::ParticleSystem& system;
+                float mass;
+                float charge;
+            public:
+                SystemParticleForce(const Physics::ParticleSystem& s, size_t index) : system(s), mass(s.getMass(index)), charge(s.getCharge(index)) {}
+
+                glm::vec3 computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const override {
+                    glm::vec3 force = system.appliedForces.computeForce(position, velocity, time);
+                    for (const Physics::Field* field : system.getFields()) force += field->computeForce(position, velocity, mass, charge, time);
+                    return force;
+                }
+
+                float computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const override {
+                    float energy = system.appliedForces.computeEnergy(position, velocity, time);
+                    for (const Physics::Field* field : system.getFields()) energy += field->computeEnergy(position, velocity, mass, charge, time);
+                    return energy;
+                }
+        };
+
+        /// @brief Evaluate the applied forces, the fields and the mutual interactions acting on every particle of a system in the given state
+        void evaluateSystemForces(const Physics::ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, glm::vec3* forces, Parallel::ThreadPool* pool) {
+            DSIM_PROFILE_SCOPE("evaluateSystemForces");
+            Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                evaluateParticleForces(system, begin, positions + begin, velocities + begin, end - begin, time, forces + begin);
+            });
+
+            for (const Physics::Interaction* interaction : system.getInteractions()) {
+                DSIM_PROFILE_SCOPE("Interaction::computeForces");
+                interaction->computeForces(system, positions, velocities, time, forces, pool);
+            }
+        }
+
+        /// @brief evaluateSystemForces with the uniform part of the applied forces given
+        void evaluateSystemForces(const Physics::ParticleSystem& system, const glm::vec3* positions, const glm::vec3* velocities, float time, const glm::vec3& uniformForce,
+            glm::vec3* forces, Parallel::ThreadPool* pool) {
+
+            DSIM_PROFILE_SCOPE("evaluateSystemForces");
+            Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                evaluateParticleForces(system, begin, positions + begin, velocities + begin, end - begin, time, uniformForce, forces + begin);
+            });
+
+            for (const Physics::Interaction* interaction : system.getInteractions()) {
+                DSIM_PROFILE_SCOPE("Interaction::computeForces");
+                interaction->computeForces(system, positions, velocities, time, forces, pool);
+            }
+        }
+
+        /// @brief Per-thread force buffer for the methods which need the forces of the whole system at once
+        glm::vec3* systemForceBuffer(size_t count) {
+            static thread_local std::vector<glm::vec3> buffer;
+            buffer.resize(count);
+            return buffer.data();
+        }
+
+        // The update functions advance the particles in [begin, end), forces[0] being the force on particle begin
+
+        void explicitEulerUpdate(Physics::ParticleSystem& system, const glm::vec3* forces, const float deltaTime, size_t begin, size_t end) {
+            glm::vec3* positions = system.getPositions();
+            glm::vec3* velocities = system.getVelocities();
+            const float* masses = system.getMasses();
+
+            for (size_t i = begin; i < end; i++) {
+                positions[i] += velocities[i] * deltaTime;
+                velocities[i] += (forces[i - begin] / masses[i]) * deltaTime;
+            }
+        }
+
+        void simplecticEulerUpdate(Physics::ParticleSystem& system, const glm::vec3* forces, const float deltaTime, size_t begin, size_t end) {
+            glm::vec3* positions = system.getPositions();
+            glm::vec3* velocities = system.getVelocities();
+            const float* masses = system.getMasses();
+
+            for (size_t i = begin; i < end; i++) {
+                velocities[i] += (forces[i - begin] / masses[i]) * deltaTime;
+                positions[i] += velocities[i] * deltaTime;
+            }
+        }
+
+        /// @brief Shared driver of the Euler methods
+        void eulerStep(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool* pool,
+            void (*update)(Physics::ParticleSystem&, const glm::vec3*, const float, size_t, size_t)) {
+
+            DSIM_PROFILE_SCOPE("eulerStep");
+            DSIM_PROFILE_COUNT("force evaluations", system.size());
+            system.invalidateAccelerations();
+
+            if (system.getInteractions().empty()) {
+                // independent particles: evaluate and advance in small batches while they are still in cache
+                Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                    glm::vec3 forces[BATCH_SIZE];
+
+                    for (size_t batch = begin; batch < end; batch += BATCH_SIZE) {
+                        const size_t count = std::min(BATCH_SIZE, end - batch);
+                        evaluateParticleForces(system, batch, system.getPositions() + batch, system.getVelocities() + batch, count, currentTime, forces);
+                        update(system, forces, deltaTime, batch, batch + count);
+                    }
+                });
+                return;
+            }
+
+            // coupled particles: every force must be known before any particle moves
+            glm::vec3* forces = systemForceBuffer(system.size());
+            evaluateSystemForces(system, system.getPositions(), system.getVelocities(), currentTime, forces, pool);
+
+            Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                update(system, forces + begin, deltaTime, begin, end);
+            });
+        }
+
+        /// @brief Copy the initial state of the particles in [begin, end) into the stage buffers of the workspace
+        void rungeKutta4Begin(Physics::ParticleSystem& system, RK4Workspace& workspace, size_t begin, size_t end) {
+            std::copy(system.getPositions() + begin, system.getPositions() + end, workspace.stagePositions.begin() + begin);
+            std::copy(system.getVelocities() + begin, system.getVelocities() + end, workspace.stageVelocities.begin() + begin);
+            std::fill(workspace.sumKx.begin() + begin, workspace.sumKx.begin() + end, glm::vec3(0.0f));
+            std::fill(workspace.sumKv.begin() + begin, workspace.sumKv.begin() + end, glm::vec3(0.0f));
+        }
+
+        /// @brief Consume the forces of a stage for the particles in [begin, end), preparing the next stage or completing the step
+        void rungeKutta4Stage(Physics::ParticleSystem& system, RK4Workspace& workspace, int stage, const float deltaTime, size_t begin, size_t end) {
+            glm::vec3* positions = system.getPositions();
+            glm::vec3* velocities = system.getVelocities();
+            const float* masses = system.getMasses();
+
+            glm::vec3* stagePositions = workspace.stagePositions.data();
+            glm::vec3* stageVelocities = workspace.stageVelocities.data();
+            const glm::vec3* forces = workspace.forces.data();
+            glm::vec3* sumKx = workspace.sumKx.data();
+            glm::vec3* sumKv = workspace.sumKv.data();
+
+            const float weight = RK4_STAGE_WEIGHTS[stage];
+
+            if (stage < 3) {
+                const float stageStep = RK4_STAGE_STEPS[stage] * deltaTime;
+
+                for (size_t i = begin; i < end; i++) {
+                    glm::vec3 kx = stageVelocities[i];
+                    glm::vec3 kv = forces[i] / masses[i];
+
+                    sumKx[i] += weight * kx;
+                    sumKv[i] += weight * kv;
+
+                    stagePositions[i] = positions[i] + kx * stageStep;
+                    stageVelocities[i] = velocities[i] + kv * stageStep;
+                }
+            }
+            else {
+                for (size_t i = begin; i < end; i++) {
+                    positions[i] += deltaTime / 6.0f * (sumKx[i] + stageVelocities[i]);
+                    velocities[i] += deltaTime / 6.0f * (sumKv[i] + forces[i] / masses[i]);
+                }
+            }
+        }
+
+        /**
+         * @brief Times of the four stages of a step and the uniform applied forces at each of them
+         *
+         * The uniform forces are evaluated once per step instead of once per batch and stage: once in total when they do not depend
+         * on the time, else once per distinct time, the two middle stages sharing theirs.
+         * They are evaluated again at every step, so changes to the forces between steps are seen.
+         */
+        void rungeKutta4StageForces(const Physics::CompositeForce& appliedForces, const float currentTime, const float deltaTime, float (&stageTimes)[4], glm::vec3 (&uniformForces)[4]) {
+            stageTimes[0] = currentTime;
+            for (int stage = 1; stage < 4; stage++) stageTimes[stage] = currentTime + RK4_STAGE_STEPS[stage - 1] * deltaTime;
+
+            const bool timeDependent = (appliedForces.getDependencies() & Physics::Force::DependsOnTime) != 0;
+            uniformForces[0] = appliedForces.computeUniformForce(stageTimes[0]);
+            for (int stage = 1; stage < 4; stage++) {
+                if (!timeDependent || stageTimes[stage] == stageTimes[stage - 1]) uniformForces[stage] = uniformForces[stage - 1];
+                else uniformForces[stage] = appliedForces.computeUniformForce(stageTimes[stage]);
+            }
+        }
+
+        void rungeKutta4Step(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, RK4Workspace& workspace, Parallel::ThreadPool* pool) {
+            DSIM_PROFILE_SCOPE("rungeKutta4Step");
+            DSIM_PROFILE_COUNT("force evaluations", 4 * system.size());
+            system.invalidateAccelerations();
+
+            // every range works on its own slice of the workspace, so a single workspace is shared by all the threads
+            workspace.resize(system.size());
+
+            float stageTimes[4];
+            glm::vec3 uniformForces[4];
+            rungeKutta4StageForces(system.appliedForces, currentTime, deltaTime, stageTimes, uniformForces);
+
+            if (system.getInteractions().empty()) {
+                // independent particles: run all the stages of a range at once while it is still in cache
+                Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                    rungeKutta4Begin(system, workspace, begin, end);
+
+                    for (int stage = 0; stage < 4; stage++) {
+                        evaluateParticleForces(system, begin, workspace.stagePositions.data() + begin, workspace.stageVelocities.data() + begin, end - begin, stageTimes[stage],
+                            uniformForces[stage], workspace.forces.data() + begin);
+                        rungeKutta4Stage(system, workspace, stage, deltaTime, begin, end);
+                    }
+                });
+                return;
+            }
+
+            // coupled particles: each stage needs the stage state of the whole system
+            Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                rungeKutta4Begin(system, workspace, begin, end);
+            });
+
+            for (int stage = 0; stage < 4; stage++) {
+                evaluateSystemForces(system, workspace.stagePositions.data(), workspace.stageVelocities.data(), stageTimes[stage], uniformForces[stage], workspace.forces.data(), pool);
+
+                Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                    rungeKutta4Stage(system, workspace, stage, deltaTime, begin, end);
+                });
+            }
+        }
+
+        // Yoshida triple jump: w1 = 1 / (2 - 2^(1/3)), w0 = 1 - 2 * w1
+        const float YOSHIDA_WEIGHTS[3] = { 1.35120719195965777f, -1.70241438391931554f, 1.35120719195965777f };
+
+        /// @brief Compute the accelerations of the particles of a system, unless they are already cached
+        void ensureAccelerations(Physics::ParticleSystem& system, const float currentTime, Parallel::ThreadPool* pool) {
+            if (system.hasAccelerations()) return;
+
+            DSIM_PROFILE_COUNT("force evaluations", system.size());
+            const Physics::ParticleSystem& state = system;
+            glm::vec3* accelerations = system.getAccelerations();
+            const float* masses = state.getMasses();
+
+            evaluateSystemForces(system, state.getPositions(), state.getVelocities(), currentTime, accelerations, pool);
+            Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) accelerations[i] /= masses[i];
+            });
+        }
+
+        /// @brief Kick-drift-kick step over the cached accelerations, leaving the ones of the new state in the cache
+        void verletStep(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool* pool) {
+            DSIM_PROFILE_COUNT("force evaluations", system.size());
+            glm::vec3* positions = system.getPositions();
+            glm::vec3* velocities = system.getVelocities();
+            const float* masses = system.getMasses();
+            glm::vec3* accelerations = system.getAccelerations();
+
+            const float halfStep = 0.5f * deltaTime;
+            const float newTime = currentTime + deltaTime;
+
+            if (system.getInteractions().empty()) {
+                // independent particles: advance in small batches while they are still in cache
+                Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                    for (size_t batch = begin; batch < end; batch += BATCH_SIZE) {
+                        const size_t batchEnd = std::min(batch + BATCH_SIZE, end);
+
+                        for (size_t i = batch; i < batchEnd; i++) {
+                            velocities[i] += accelerations[i] * halfStep;
+                            positions[i] += velocities[i] * deltaTime;
+                        }
+
+                        evaluateParticleForces(system, batch, positions + batch, velocities + batch, batchEnd - batch, newTime, accelerations + batch);
+
+                        for (size_t i = batch; i < batchEnd; i++) {
+                            accelerations[i] /= masses[i];
+                            velocities[i] += accelerations[i] * halfStep;
+                        }
+                    }
+                });
+                return;
+            }
+
+            // coupled particles: every particle must have moved before the new forces are evaluated
+            Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    velocities[i] += accelerations[i] * halfStep;
+                    positions[i] += velocities[i] * deltaTime;
+                }
+            });
+
+            evaluateSystemForces(system, positions, velocities, newTime, accelerations, pool);
+
+            Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    accelerations[i] /= masses[i];
+                    velocities[i] += accelerations[i] * halfStep;
+                }
+            });
+        }
+
+        void velocityVerletStep(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool* pool) {
+            DSIM_PROFILE_SCOPE("velocityVerletStep");
+            ensureAccelerations(system, currentTime, pool);
+            verletStep(system, currentTime, deltaTime, pool);
+            system.validateAccelerations();
+        }
+
+        void yoshida4Step(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool* pool) {
+            DSIM_PROFILE_SCOPE("yoshida4Step");
+            ensureAccelerations(system, currentTime, pool);
+
+            float time = currentTime;
+            for (int substep = 0; substep < 3; substep++) {
+                verletStep(system, time, YOSHIDA_WEIGHTS[substep] * deltaTime, pool);
+                time += YOSHIDA_WEIGHTS[substep] * deltaTime;
+            }
+            system.validateAccelerations();
+        }
+
+        // Dormand-Prince 5(4) tableau: DP_A[s] holds the coefficients of stage s, the 7th stage being the 5th order solution
+        const float DP_C[7] = { 0.0f, 1.0f / 5.0f, 3.0f / 10.0f, 4.0f / 5.0f, 8.0f / 9.0f, 1.0f, 1.0f };
+        const float DP_A[7][6] = {
+            { 0.0f },
+            { 1.0f / 5.0f },
+            { 3.0f / 40.0f, 9.0f / 40.0f },
+            { 44.0f / 45.0f, -56.0f / 15.0f, 32.0f / 9.0f },
+            { 19372.0f / 6561.0f, -25360.0f / 2187.0f, 64448.0f / 6561.0f, -212.0f / 729.0f },
+            { 9017.0f / 3168.0f, -355.0f / 33.0f, 46732.0f / 5247.0f, 49.0f / 176.0f, -5103.0f / 18656.0f },
+            { 35.0f / 384.0f, 0.0f, 500.0f / 1113.0f, 125.0f / 192.0f, -2187.0f / 6784.0f, 11.0f / 84.0f }
+        };
+
+        // difference between the 5th and the 4th order weights, estimating the local error
+        const float DP_E[7] = { 71.0f / 57600.0f, 0.0f, -71.0f / 16695.0f, 71.0f / 1920.0f, -17253.0f / 339200.0f, 22.0f / 525.0f, -1.0f / 40.0f };
+
+        // bounds of the step size change after an attempt
+        const float DP_MIN_FACTOR = 0.2f;
+        const float DP_MAX_FACTOR = 5.0f;
+
+        // Number of particles in a block of the coupled error reduction
+        const size_t DP_ERROR_BLOCK = 1024;
+
+        float clampStep(float step, const AdaptiveOptions& options) {
+            if (options.maxStep > 0.0f) step = std::min(step, options.maxStep);
+            return std::max(step, options.minStep);
+        }
+
+        /// @brief Largest ratio between the error of a component and its tolerance
+        float componentError(const glm::vec3& error, const glm::vec3& before, const glm::vec3& after, const AdaptiveOptions& options) {
+            float ratio = 0.0f;
+            for (int c = 0; c < 3; c++) {
+                float scale = options.absoluteTolerance + options.relativeTolerance * std::max(std::abs(before[c]), std::abs(after[c]));
+                ratio = std::max(ratio, std::abs(error[c]) / scale);
+            }
+            return ratio;
+        }
+
+        /// @brief Error of a step relative to the tolerances, the step is acceptable when it is at most 1
+        float dormandPrinceError(const glm::vec3& position, const glm::vec3& velocity, const glm::vec3& newPosition, const glm::vec3& newVelocity,
+            const glm::vec3* kx, const glm::vec3* kv, float step, const AdaptiveOptions& options) {
+
+            glm::vec3 positionError(0.0f), velocityError(0.0f);
+            for (int j = 0; j < 7; j++) {
+                positionError += DP_E[j] * kx[j];
+                velocityError += DP_E[j] * kv[j];
+            }
+
+            return std::max(
+                componentError(step * positionError, position, newPosition, options),
+                componentError(step * velocityError, velocity, newVelocity, options)
+            );
+        }
+
+        /// @brief Factor to apply to the step size after an attempt with the given error
+        float dormandPrinceFactor(float error, const AdaptiveOptions& options) {
+            if (error == 0.0f) return DP_MAX_FACTOR;
+            return std::min(DP_MAX_FACTOR, std::max(DP_MIN_FACTOR, options.safety * std::pow(error, -0.2f)));
+        }
+
+        /// @brief Step size to suggest after an accepted step of size taken, whose optimal size was taken * factor
+        float nextStep(float step, float taken, float factor, bool truncated) {
+            // a step truncated to the end of the interval says nothing against the previous step size
+            if (truncated) return std::max(step, taken * factor);
+            return taken * factor;
+        }
+
+        void dormandPrinceCoupled(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, DormandPrinceWorkspace& workspace,
+            const AdaptiveOptions& options, AdaptiveStatistics& statistics, Parallel::ThreadPool* pool) {
+
+            const size_t count = system.size();
+            glm::vec3* positions = system.getPositions();
+            glm::vec3* velocities = system.getVelocities();
+            const float* masses = system.getMasses();
+            float* stepSizes = system.getStepSizes();
+
+            workspace.resize(count);
+            const size_t blockCount = (count + DP_ERROR_BLOCK - 1) / DP_ERROR_BLOCK;
+            workspace.errors.resize(blockCount);
+
+            // derivative of the state, the forces being already stored in kv[stage]
+            auto finishStage = [&](int stage, const glm::vec3* stageVelocities) {
+                Parallel::parallelFor(pool, count, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) {
+                        workspace.kx[stage][i] = stageVelocities[i];
+                        workspace.kv[stage][i] /= masses[i];
+                    }
+                });
+                statistics.forceEvaluations += count;
+            };
+
+            float time = currentTime;
+            float remaining = deltaTime;
+            float step = clampStep(stepSizes[0] > 0.0f ? stepSizes[0] : deltaTime, options);
+
+            evaluateSystemForces(system, positions, velocities, time, workspace.kv[0].data(), pool);
+            finishStage(0, velocities);
+
+            while (remaining > 0.0f) {
+                const bool last = step >= remaining;
+                const float h = last ? remaining : step;
+
+                for (int stage = 1; stage < 7; stage++) {
+                    Parallel::parallelFor(pool, count, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                        for (size_t i = begin; i < end; i++) {
+                            glm::vec3 position = positions[i], velocity = velocities[i];
+                            for (int j = 0; j < stage; j++) {
+                                position += (h * DP_A[stage][j]) * workspace.kx[j][i];
+                                velocity += (h * DP_A[stage][j]) * workspace.kv[j][i];
+                            }
+                            workspace.stagePositions[i] = position;
+                            workspace.stageVelocities[i] = velocity;
+                        }
+                    });
+
+                    evaluateSystemForces(system, workspace.stagePositions.data(), workspace.stageVelocities.data(), time + DP_C[stage] * h, workspace.kv[stage].data(), pool);
+                    finishStage(stage, workspace.stageVelocities.data());
+                }
+
+                // the coupled step is controlled by the worst particle
+                Parallel::parallelFor(pool, blockCount, 1, [&](size_t firstBlock, size_t lastBlock) {
+                    glm::vec3 kx[7], kv[7];
+                    for (size_t block = firstBlock; block < lastBlock; block++) {
+                        float error = 0.0f;
+                        for (size_t i = block * DP_ERROR_BLOCK; i < std::min(count, (block + 1) * DP_ERROR_BLOCK); i++) {
+                            for (int j = 0; j < 7; j++) {
+                                kx[j] = workspace.kx[j][i];
+                                kv[j] = workspace.kv[j][i];
+                            }
+                            error = std::max(error, dormandPrinceError(positions[i], velocities[i], workspace.stagePositions[i], workspace.stageVelocities[i], kx, kv, h, options));
+                        }
+                        workspace.errors[block] = error;
+                    }
+                });
+                float error = *std::max_element(workspace.errors.begin(), workspace.errors.end());
+                float factor = dormandPrinceFactor(error, options);
+
+                if (error <= 1.0f || h <= options.minStep) {
+                    std::copy(workspace.stagePositions.begin(), workspace.stagePositions.end(), positions);
+                    std::copy(workspace.stageVelocities.begin(), workspace.stageVelocities.end(), velocities);
+
+                    // first same as last: the last stage is the first one of the next step
+                    std::swap(workspace.kx[0], workspace.kx[6]);
+                    std::swap(workspace.kv[0], workspace.kv[6]);
+
+                    time = last ? currentTime + deltaTime : time + h;
+                    remaining = last ? 0.0f : remaining - h;
+                    step = clampStep(nextStep(step, h, factor, last && h < step), options);
+                    statistics.acceptedSteps++;
+                }
+                else {
+                    step = clampStep(h * factor, options);
+                    statistics.rejectedSteps++;
+                }
+            }
+
+            std::fill(stepSizes, stepSizes + count, step);
+        }
+    }
+
     // generalizedVector implementations
     generalizedVector::generalizedVector() 
         : position(glm::vec3(0.0f)), velocity(glm::vec3(0.0f)) {}
@@ -176,6 +1325,91 @@ namespace Propagation {
     generalizedVector::generalizedVector(const glm::vec3& pos, const glm::vec3& vel) 
         : position(pos), velocity(vel) {}
 
+    generalizedVector velocityVerlet(Physics::Force* f, const generalizedVector& state, glm::vec3& acceleration, const float mass, const float currentTime, const float deltaTime) {
+        glm::vec3 halfVelocity = state.velocity + acceleration * (0.5f * deltaTime);
+        glm::vec3 newPosition = state.position + halfVelocity * deltaTime;
+
+        acceleration = f->computeForce(newPosition, halfVelocity, currentTime + deltaTime) / mass;
+
+        return generalizedVector(newPosition, halfVelocity + acceleration * (0.5f * deltaTime));
+    }
+
+    void velocityVerlet(Physics::Particle& particle, const float currentTime, const float deltaTime) {
+        DSIM_PROFILE_COUNT("force evaluations", particle.hasAcceleration() ? 1 : 2);
+        glm::vec3 acceleration = particle.hasAcceleration()
+            ? particle.getAcceleration()
+            : particle.appliedForces.computeForce(particle.getPosition(), particle.getVelocity(), currentTime) / particle.getMass();
+
+        generalizedVector newState = velocityVerlet(
+            &particle.appliedForces,
+            generalizedVector(particle.getPosition(), particle.getVelocity()),
+            acceleration,
+            particle.getMass(),
+            currentTime,
+            deltaTime
+        );
+
+        particle.setPosition(newState.position);
+        particle.setVelocity(newState.velocity);
+        particle.setAcceleration(acceleration);
+    }
+
+    void velocityVerlet(Physics::ParticleSystem& system, const float currentTime, const float deltaTime) {
+        velocityVerletStep(system, currentTime, deltaTime, nullptr);
+    }
+
+    void velocityVerlet(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool) {
+        velocityVerletStep(system, currentTime, deltaTime, &pool);
+    }
+
+    generalizedVector yoshida4(Physics::Force* f, const generalizedVector& state, glm::vec3& acceleration, const float mass, const float currentTime, const float deltaTime) {
+        generalizedVector current = state;
+        float time = currentTime;
+
+        for (int substep = 0; substep < 3; substep++) {
+            current = velocityVerlet(f, current, acceleration, mass, time, YOSHIDA_WEIGHTS[substep] * deltaTime);
+            time += YOSHIDA_WEIGHTS[substep] * deltaTime;
+        }
+
+        return current;
+    }
+
+    void yoshida4(Physics::Particle& particle, const float currentTime, const float deltaTime) {
+        DSIM_PROFILE_COUNT("force evaluations", particle.hasAcceleration() ? 3 : 4);
+        glm::vec3 acceleration = particle.hasAcceleration()
+            ? particle.getAcceleration()
+            : particle.appliedForces.computeForce(particle.getPosition(), particle.getVelocity(), currentTime) / particle.getMass();
+
+        generalizedVector newState = yoshida4(
+            &particle.appliedForces,
+            generalizedVector(particle.getPosition(), particle.getVelocity()),
+            acceleration,
+            particle.getMass(),
+            currentTime,
+            deltaTime
+        );
+
+        particle.setPosition(newState.position);
+        particle.setVelocity(newState.velocity);
+        particle.setAcceleration(acceleration);
+    }
+
+    void yoshida4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime) {
+        yoshida4Step(system, currentTime, deltaTime, nullptr);
+    }
+
+    void yoshida4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool) {
+        yoshida4Step(system, currentTime, deltaTime, &pool);
+    }
+
+    // AdaptiveOptions implementations
+    AdaptiveOptions::AdaptiveOptions(float absTol, float relTol, float minStepSize, float maxStepSize, float safetyFactor)
+        : absoluteTolerance(absTol), relativeTolerance(relTol), minStep(minStepSize), maxStep(maxStepSize), safety(safetyFactor) {}
+
+    // AdaptiveStatistics implementations
+    AdaptiveStatistics::AdaptiveStatistics()
+        : acceptedSteps(0), rejectedSteps(0), forceEvaluations(0) {}
+
     // Propagation methods
 
     generalizedVector explicitEuler(Physics::Force* f, const generalizedVector& state, const float mass, const float currentTime, const float deltaTime) {
@@ -188,6 +1422,7 @@ namespace Propagation {
     }
 
     void explicitEuler(Physics::Particle& particle, const float currentTime, const float deltaTime) {
+        DSIM_PROFILE_COUNT("force evaluations", 1);
         generalizedVector newState = explicitEuler(
             &particle.appliedForces, 
             generalizedVector(particle.getPosition(),
@@ -201,24 +1436,28 @@ namespace Propagation {
         particle.setVelocity(newState.velocity);
     }
 
+    void explicitEuler(Physics::ParticleSystem& system, const float currentTime, const float deltaTime) {
+        eulerStep(system, currentTime, deltaTime, nullptr, explicitEulerUpdate);
+    }
+
+    void explicitEuler(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool) {
+        eulerStep(system, currentTime, deltaTime, &pool, explicitEulerUpdate);
+    }
+
     generalizedVector rungeKutta4(Physics::Force* f, const generalizedVector& state, const float mass, const float currentTime, const float deltaTime) {
-        static glm::vec3 kx[4], kv[4];
+        glm::vec3 kx[4], kv[4];
 
         kx[0] = state.velocity;
-        static glm::vec3 force = f->computeForce(state.position, kx[0], currentTime);
-        kv[0] = force / mass;
+        kv[0] = f->computeForce(state.position, kx[0], currentTime) / mass;
 
         kx[1] = state.velocity + kv[0] * (deltaTime / 2.0f);
-        force = f->computeForce(state.position + kx[0] * (deltaTime / 2.0f), kx[1], currentTime + deltaTime / 2.0f);
-        kv[1] = force / mass;
+        kv[1] = f->computeForce(state.position + kx[0] * (deltaTime / 2.0f), kx[1], currentTime + deltaTime / 2.0f) / mass;
 
         kx[2] = state.velocity + kv[1] * (deltaTime / 2.0f);
-        force = f->computeForce(state.position + kx[1] * (deltaTime / 2.0f), kx[2], currentTime + deltaTime / 2.0f);
-        kv[2] = force / mass;
+        kv[2] = f->computeForce(state.position + kx[1] * (deltaTime / 2.0f), kx[2], currentTime + deltaTime / 2.0f) / mass;
 
         kx[3] = state.velocity + kv[2] * deltaTime;
-        force = f->computeForce(state.position + kx[2] * deltaTime, kx[3], currentTime + deltaTime);
-        kv[3] = force / mass;
+        kv[3] = f->computeForce(state.position + kx[2] * deltaTime, kx[3], currentTime + deltaTime) / mass;
 
         return {
             state.position + deltaTime / 6.0f * (kx[0] + 2.0f * kx[1] + 2.0f * kx[2] + kx[3]),
@@ -227,6 +1466,7 @@ namespace Propagation {
     }
 
     void rungeKutta4(Physics::Particle& particle, const float currentTime, const float deltaTime) {
+        DSIM_PROFILE_COUNT("force evaluations", 4);
         generalizedVector newState = rungeKutta4(
             &particle.appliedForces,
             generalizedVector(particle.getPosition(),
@@ -240,6 +1480,32 @@ namespace Propagation {
         particle.setVelocity(newState.velocity);
     }
 
+    void RK4Workspace::resize(size_t count) {
+        stagePositions.resize(count);
+        stageVelocities.resize(count);
+        forces.resize(count);
+        sumKx.resize(count);
+        sumKv.resize(count);
+    }
+
+    void rungeKutta4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, RK4Workspace& workspace) {
+        rungeKutta4Step(system, currentTime, deltaTime, workspace, nullptr);
+    }
+
+    void rungeKutta4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime) {
+        static thread_local RK4Workspace workspace;
+        rungeKutta4(system, currentTime, deltaTime, workspace);
+    }
+
+    void rungeKutta4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, RK4Workspace& workspace, Parallel::ThreadPool& pool) {
+        rungeKutta4Step(system, currentTime, deltaTime, workspace, &pool);
+    }
+
+    void rungeKutta4(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool) {
+        static thread_local RK4Workspace workspace;
+        rungeKutta4(system, currentTime, deltaTime, workspace, pool);
+    }
+
     generalizedVector simplecticEuler(Physics::Force* f, const generalizedVector& state, const float mass, const float currentTime, const float deltaTime) {
         glm::vec3 force = f->computeForce(state.position, state.velocity, currentTime);
         glm::vec3 newVelocity = state.velocity + (force / mass) * deltaTime;
@@ -251,6 +1517,7 @@ namespace Propagation {
     }
 
     void simplecticEuler(Physics::Particle& particle, const float currentTime, const float deltaTime) {
+        DSIM_PROFILE_COUNT("force evaluations", 1);
         generalizedVector newState = simplecticEuler(
             &particle.appliedForces, 
             generalizedVector(particle.getPosition(),
@@ -264,5 +1531,201 @@ namespace Propagation {
         particle.setVelocity(newState.velocity);
     }
 
-}
+    void simplecticEuler(Physics::ParticleSystem& system, const float currentTime, const float deltaTime) {
+        eulerStep(system, currentTime, deltaTime, nullptr, simplecticEulerUpdate);
+    }
+
+    void simplecticEuler(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool) {
+        eulerStep(system, currentTime, deltaTime, &pool, simplecticEulerUpdate);
+    }
+
+    generalizedVector dormandPrince45(Physics::Force* f, const generalizedVector& state, const float mass, const float currentTime, const float deltaTime,
+        float& stepSize, const AdaptiveOptions& options, AdaptiveStatistics* statistics) {
+
+        if (deltaTime <= 0.0f) return state;
+
+        AdaptiveStatistics counters;
+        generalizedVector current = state;
+        glm::vec3 kx[7], kv[7];
+
+        float time = currentTime;
+        float remaining = deltaTime;
+        float step = clampStep(stepSize > 0.0f ? stepSize : deltaTime, options);
+
+        kx[0] = current.velocity;
+        kv[0] = f->computeForce(current.position, current.velocity, time) / mass;
+        counters.forceEvaluations++;
+
+        while (remaining > 0.0f) {
+            const bool last = step >= remaining;
+            const float h = last ? remaining : step;
+            glm::vec3 position, velocity;
+
+            for (int stage = 1; stage < 7; stage++) {
+                position = current.position;
+                velocity = current.velocity;
+                for (int j = 0; j < stage; j++) {
+                    position += (h * DP_A[stage][j]) * kx[j];
+                    velocity += (h * DP_A[stage][j]) * kv[j];
+                }
+
+                kx[stage] = velocity;
+                kv[stage] = f->computeForce(position, velocity, time + DP_C[stage] * h) / mass;
+            }
+            counters.forceEvaluations += 6;
+
+            // the 7th stage state is the 5th order solution
+            float error = dormandPrinceError(current.position, current.velocity, position, velocity, kx, kv, h, options);
+            float factor = dormandPrinceFactor(error, options);
+
+            if (error <= 1.0f || h <= options.minStep) {
+                current = generalizedVector(position, velocity);
+                kx[0] = kx[6];
+                kv[0] = kv[6];
+
+                time = last ? currentTime + deltaTime : time + h;
+                remaining = last ? 0.0f : remaining - h;
+                step = clampStep(nextStep(step, h, factor, last && h < step), options);
+                counters.acceptedSteps++;
+            }
+            else {
+                step = clampStep(h * factor, options);
+                counters.rejectedSteps++;
+            }
+        }
+
+        stepSize = step;
+        if (statistics) {
+            statistics->acceptedSteps += counters.acceptedSteps;
+            statistics->rejectedSteps += counters.rejectedSteps;
+            statistics->forceEvaluations += counters.forceEvaluations;
+        }
+
+        return current;
+    }
+
+    void dormandPrince45(Physics::Particle& particle, const float currentTime, const float deltaTime, const AdaptiveOptions& options, AdaptiveStatistics* statistics) {
+        AdaptiveStatistics counters;
+        float stepSize = particle.getStepSize();
+        generalizedVector newState = dormandPrince45(
+            &particle.appliedForces,
+            generalizedVector(particle.getPosition(),
+            particle.getVelocity()),
+            particle.getMass(),
+            currentTime,
+            deltaTime,
+            stepSize,
+            options,
+            &counters
+        );
+
+        particle.setPosition(newState.position);
+        particle.setVelocity(newState.velocity);
+        particle.setStepSize(stepSize);
+
+        DSIM_PROFILE_COUNT("force evaluations", counters.forceEvaluations);
+        if (statistics) {
+            statistics->acceptedSteps += counters.acceptedSteps;
+            statistics->rejectedSteps += counters.rejectedSteps;
+            statistics->forceEvaluations += counters.forceEvaluations;
+        }
+    }
+
+    void DormandPrinceWorkspace::resize(size_t count) {
+        for (int stage = 0; stage < 7; stage++) {
+            kx[stage].resize(count);
+            kv[stage].resize(count);
+        }
+        stagePositions.resize(count);
+        stageVelocities.resize(count);
+    }
+
+    void dormandPrince45(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, DormandPrinceWorkspace& workspace,
+        const AdaptiveOptions& options, AdaptiveStatistics* statistics, Parallel::ThreadPool* pool) {
+
+        if (deltaTime <= 0.0f || system.size() == 0) return;
+
+        DSIM_PROFILE_SCOPE("dormandPrince45");
+        system.invalidateAccelerations();
+        AdaptiveStatistics counters;
+
+        if (!system.getInteractions().empty()) {
+            dormandPrinceCoupled(system, currentTime, deltaTime, workspace, options, counters, pool);
+        }
+        else {
+            // independent particles: each one follows its own step size
+            std::mutex countersMutex;
+
+            Parallel::parallelFor(pool, system.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                glm::vec3* positions = system.getPositions();
+                glm::vec3* velocities = system.getVelocities();
+                const float* masses = system.getMasses();
+                float* stepSizes = system.getStepSizes();
+                AdaptiveStatistics rangeCounters;
+
+                for (size_t i = begin; i < end; i++) {
+                    SystemParticleForce force(system, i);
+                    generalizedVector newState = dormandPrince45(
+                        &force,
+                        generalizedVector(positions[i], velocities[i]),
+                        masses[i],
+                        currentTime,
+                        deltaTime,
+                        stepSizes[i],
+                        options,
+                        &rangeCounters
+                    );
+
+                    positions[i] = newState.position;
+                    velocities[i] = newState.velocity;
+                }
+
+                std::lock_guard<std::mutex> lock(countersMutex);
+                counters.acceptedSteps += rangeCounters.acceptedSteps;
+                counters.rejectedSteps += rangeCounters.rejectedSteps;
+                counters.forceEvaluations += rangeCounters.forceEvaluations;
+            });
+        }
+
+        DSIM_PROFILE_COUNT("force evaluations", counters.forceEvaluations);
+        if (statistics) {
+            statistics->acceptedSteps += counters.acceptedSteps;
+            statistics->rejectedSteps += counters.rejectedSteps;
+            statistics->forceEvaluations += counters.forceEvaluations;
+        }
+    }
+
+    void dormandPrince45(Physics::ParticleSystem& system, const float currentTime, const float deltaTime,
+        const AdaptiveOptions& options, AdaptiveStatistics* statistics, Parallel::ThreadPool* pool) {
+        static thread_local DormandPrinceWorkspace workspace;
+        dormandPrince45(system, currentTime, deltaTime, workspace, options, statistics, pool);
+    }
+
+    namespace {
+        void defaultDormandPrince45(Physics::ParticleSystem& system, const float currentTime, const float deltaTime, Parallel::ThreadPool& pool) {
+            dormandPrince45(system, currentTime, deltaTime, AdaptiveOptions(), nullptr, &pool);
+        }
+
+        struct IntegratorEntry {
+            const char* name;
+            SystemIntegrator integrator;
+        };
+
+        const IntegratorEntry INTEGRATORS[] = {
+            { "euler", explicitEuler },
+            { "symplectic", simplecticEuler },
+            { "rk4", rungeKutta4 },
+            { "verlet", velocityVerlet },
+            { "yoshida4", yoshida4 },
+            { "dp45", defaultDormandPrince45 },
+        };
+    }
+
+    SystemIntegrator findSystemIntegrator(const std::string& name) {
+        for (const IntegratorEntry& entry : INTEGRATORS) {
+            if (name == entry.name) return entry.integrator;
+        }
+        return nullptr;
+    }
 
+}
\ No newline at end of file
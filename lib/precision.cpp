@@ -0,0 +1,581 @@
+#include "precision.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include "field.hpp"
+#include "interaction.hpp"
+#include "nbody.hpp"
+#include "profiler.hpp"
+#include "threadpool.hpp"
+
+namespace Physics {
+
+    namespace {
+        // Number of particles rounded to float at once by the single precision force evaluation
+        const size_t PRECISION_BATCH = 256;
+
+        // Number of particles claimed at once by a thread of the pool
+        const size_t PRECISION_GRAIN = 1024;
+
+        // Number of targets claimed at once by the direct N-body sum, whose cost per target grows with the system
+        const size_t NBODY_GRAIN = 64;
+
+        /// @brief Per-thread buffer of count elements, Slot telling apart the buffers of the same type used together
+        template <typename T, int Slot>
+        T* scratchBuffer(size_t count) {
+            static thread_local std::vector<T> buffer;
+            buffer.resize(count);
+            return buffer.data();
+        }
+
+        /// @brief State rounded to float, written to buffer unless it already is in float
+        template <typename Real>
+        const glm::vec3* roundedState(const glm::vec<3, Real>* state, size_t count, glm::vec3* buffer, Parallel::ThreadPool* pool) {
+            Parallel::parallelFor(pool, count, PRECISION_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) buffer[i] = glm::vec3(state[i]);
+            });
+            return buffer;
+        }
+
+        const glm::vec3* roundedState(const glm::vec3* state, size_t count, glm::vec3* buffer, Parallel::ThreadPool* pool) {
+            return state;
+        }
+
+        /**
+         * @brief Evaluate the applied forces and the fields acting on the particles [first, first + count) of a system into an output array
+         *
+         * Single precision: the state is rounded to float in small batches, which the batch methods evaluate while they are in cache.
+         */
+        template <typename Real>
+        void evaluateParticleForces(const ParticleSystem& system, size_t first, const glm::vec<3, Real>* positions, const glm::vec<3, Real>* velocities,
+            size_t count, double time, glm::vec3* forces) {
+
+            glm::vec3 batchPositions[PRECISION_BATCH], batchVelocities[PRECISION_BATCH];
+            for (size_t batch = 0; batch < count; batch += PRECISION_BATCH) {
+                const size_t batchCount = std::min(PRECISION_BATCH, count - batch);
+                for (size_t i = 0; i < batchCount; i++) {
+                    batchPositions[i] = glm::vec3(positions[batch + i]);
+                    batchVelocities[i] = glm::vec3(velocities[batch + i]);
+                }
+
+                glm::vec3* batchForces = forces + batch;
+                std::fill(batchForces, batchForces + batchCount, glm::vec3(0.0f));
+                system.appliedForces.computeForces(batchPositions, batchVelocities, batchCount, (float)time, batchForces);
+
+                for (const Field* field : system.getFields()) {
+                    field->computeForces(batchPositions, batchVelocities, system.getMasses() + first + batch, system.getCharges() + first + batch,
+                        batchCount, (float)time, batchForces);
+                }
+            }
+        }
+
+        /// @brief Double precision counterpart of evaluateParticleForces
+        void evaluateParticleForces(const ParticleSystem& system, size_t first, const glm::dvec3* positions, const glm::dvec3* velocities,
+            size_t count, double time, glm::dvec3* forces) {
+
+            std::fill(forces, forces + count, glm::dvec3(0.0));
+            system.appliedForces.computeForcesDouble(positions, velocities, count, time, forces);
+
+            for (const Field* field : system.getFields()) {
+                field->computeForcesDouble(positions, velocities, system.getMasses() + first, system.getCharges() + first, count, time, forces);
+            }
+        }
+
+        /// @brief Add the direct sum of the NBodyInteraction forces in double precision, with the softening of the interaction
+        void addDirectNBodyForces(const ParticleSystem& system, const glm::dvec3* positions, unsigned kinds, float softening, glm::dvec3* forces, Parallel::ThreadPool* pool) {
+            DSIM_PROFILE_SCOPE("addDirectNBodyForces");
+            const size_t count = system.size();
+            const float* masses = system.getMasses();
+            const float* charges = system.getCharges();
+
+            const double softeningSquared = (double)softening * softening;
+            const double gravity = (kinds & NBodyInteraction::Gravitational) ? G_double : 0.0;
+            const double electric = (kinds & NBodyInteraction::Electric) ? k_e_double : 0.0;
+
+            Parallel::parallelFor(pool, count, NBODY_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    glm::dvec3 gravityField(0.0), electricField(0.0);
+
+                    for (size_t j = 0; j < count; j++) {
+                        const glm::dvec3 distance = positions[j] - positions[i];
+                        const double distanceSquared = glm::dot(distance, distance);
+                        if (distanceSquared == 0.0) continue; // the target itself
+
+                        const double inverseDistance = 1.0 / std::sqrt(distanceSquared + softeningSquared);
+                        const double inverseDistanceCubed = inverseDistance * inverseDistance * inverseDistance;
+                        gravityField += ((double)masses[j] * inverseDistanceCubed) * distance;
+                        electricField -= ((double)charges[j] * inverseDistanceCubed) * distance;
+                    }
+
+                    forces[i] += (gravity * masses[i]) * gravityField + (electric * charges[i]) * electricField;
+                }
+            });
+        }
+
+        /// @brief Add the forces of the interactions, evaluated in single precision on the state rounded to float
+        template <typename Real>
+        void evaluateInteractions(const ParticleSystem& system, const glm::vec<3, Real>* positions, const glm::vec<3, Real>* velocities,
+            double time, glm::vec3* forces, Parallel::ThreadPool* pool) {
+
+            if (system.getInteractions().empty()) return;
+
+            const glm::vec3* roundedPositions = roundedState(positions, system.size(), scratchBuffer<glm::vec3, 0>(system.size()), pool);
+            const glm::vec3* roundedVelocities = roundedState(velocities, system.size(), scratchBuffer<glm::vec3, 1>(system.size()), pool);
+            for (const Interaction* interaction : system.getInteractions()) {
+                DSIM_PROFILE_SCOPE("Interaction::computeForces");
+                interaction->computeForces(system, roundedPositions, roundedVelocities, (float)time, forces, pool);
+            }
+        }
+
+        /**
+         * @brief Add the forces of the interactions in double precision
+         *
+         * An NBodyInteraction resolving to the direct sum is summed in double precision; the others, including the
+         * Barnes-Hut ones which would become quadratic, are evaluated on the state rounded to float.
+         */
+        void evaluateInteractions(const ParticleSystem& system, const glm::dvec3* positions, const glm::dvec3* velocities,
+            double time, glm::dvec3* forces, Parallel::ThreadPool* pool) {
+
+            const size_t count = system.size();
+            const glm::vec3* roundedPositions = nullptr;
+            const glm::vec3* roundedVelocities = nullptr;
+
+            for (const Interaction* interaction : system.getInteractions()) {
+                const NBodyInteraction* nbody = dynamic_cast<const NBodyInteraction*>(interaction);
+                if (nbody && nbody->resolveMethod(count) == NBodyInteraction::Direct) {
+                    addDirectNBodyForces(system, positions, nbody->getKinds(), nbody->getSoftening(), forces, pool);
+                    continue;
+                }
+
+                if (!roundedPositions) {
+                    roundedPositions = roundedState(positions, count, scratchBuffer<glm::vec3, 0>(count), pool);
+                    roundedVelocities = roundedState(velocities, count, scratchBuffer<glm::vec3, 1>(count), pool);
+                }
+
+                DSIM_PROFILE_SCOPE("Interaction::computeForces");
+                glm::vec3* interactionForces = scratchBuffer<glm::vec3, 2>(count);
+                std::fill(interactionForces, interactionForces + count, glm::vec3(0.0f));
+                interaction->computeForces(system, roundedPositions, roundedVelocities, (float)time, interactionForces, pool);
+
+                Parallel::parallelFor(pool, count, PRECISION_GRAIN, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) forces[i] += glm::dvec3(interactionForces[i]);
+                });
+            }
+        }
+    }
+
+    bool findPrecision(const std::string& name, Precision& precision) {
+        if (name == "single") precision = Precision::Single;
+        else if (name == "double") precision = Precision::Double;
+        else if (name == "mixed") precision = Precision::Mixed;
+        else return false;
+        return true;
+    }
+
+    const char* getPrecisionName(Precision precision) {
+        switch (precision) {
+            case Precision::Double: return "double";
+            case Precision::Mixed: return "mixed";
+            default: return "single";
+        }
+    }
+
+    // PrecisionSystem implementations
+    template <typename Policy>
+    PrecisionSystem<Policy>::PrecisionSystem(ParticleSystem& s) : system(&s), accelerationsValid(false) {
+        load();
+    }
+
+    template <typename Policy>
+    ParticleSystem& PrecisionSystem<Policy>::getSystem() const {
+        return *system;
+    }
+
+    template <typename Policy>
+    size_t PrecisionSystem<Policy>::size() const {
+        return positions.size();
+    }
+
+    template <typename Policy>
+    void PrecisionSystem<Policy>::load() {
+        const ParticleSystem& source = *system;
+        positions.resize(source.size());
+        velocities.resize(source.size());
+        accelerations.resize(source.size());
+
+        for (size_t i = 0; i < source.size(); i++) {
+            positions[i] = Vector(source.getPositions()[i]);
+            velocities[i] = Vector(source.getVelocities()[i]);
+        }
+        accelerationsValid = false;
+    }
+
+    template <typename Policy>
+    void PrecisionSystem<Policy>::store() const {
+        glm::vec3* targetPositions = system->getPositions();
+        glm::vec3* targetVelocities = system->getVelocities();
+
+        for (size_t i = 0; i < positions.size(); i++) {
+            targetPositions[i] = glm::vec3(positions[i]);
+            targetVelocities[i] = glm::vec3(velocities[i]);
+        }
+        system->invalidateAccelerations();
+    }
+
+    template <typename Policy>
+    typename PrecisionSystem<Policy>::Vector PrecisionSystem<Policy>::getPosition(size_t index) const {
+        return positions[index];
+    }
+
+    template <typename Policy>
+    typename PrecisionSystem<Policy>::Vector PrecisionSystem<Policy>::getVelocity(size_t index) const {
+        return velocities[index];
+    }
+
+    template <typename Policy>
+    void PrecisionSystem<Policy>::setPosition(size_t index, const Vector& pos) {
+        positions[index] = pos;
+        accelerationsValid = false;
+    }
+
+    template <typename Policy>
+    void PrecisionSystem<Policy>::setVelocity(size_t index, const Vector& vel) {
+        velocities[index] = vel;
+        accelerationsValid = false;
+    }
+
+    template <typename Policy>
+    typename PrecisionSystem<Policy>::Vector* PrecisionSystem<Policy>::getPositions() {
+        return positions.data();
+    }
+
+    template <typename Policy>
+    typename PrecisionSystem<Policy>::Vector* PrecisionSystem<Policy>::getVelocities() {
+        return velocities.data();
+    }
+
+    template <typename Policy>
+    const typename PrecisionSystem<Policy>::Vector* PrecisionSystem<Policy>::getPositions() const {
+        return positions.data();
+    }
+
+    template <typename Policy>
+    const typename PrecisionSystem<Policy>::Vector* PrecisionSystem<Policy>::getVelocities() const {
+        return velocities.data();
+    }
+
+    template <typename Policy>
+    bool PrecisionSystem<Policy>::hasAccelerations() const {
+        return accelerationsValid;
+    }
+
+    template <typename Policy>
+    typename PrecisionSystem<Policy>::Vector* PrecisionSystem<Policy>::getAccelerations() {
+        return accelerations.data();
+    }
+
+    template <typename Policy>
+    void PrecisionSystem<Policy>::validateAccelerations() {
+        accelerationsValid = true;
+    }
+
+    template <typename Policy>
+    void PrecisionSystem<Policy>::invalidateAccelerations() {
+        accelerationsValid = false;
+    }
+
+    template <typename Policy>
+    void evaluatePrecisionForces(const PrecisionSystem<Policy>& precisionSystem, const typename PrecisionSystem<Policy>::Vector* positions,
+        const typename PrecisionSystem<Policy>::Vector* velocities, double time, glm::vec<3, typename Policy::Accumulator>* forces, Parallel::ThreadPool* pool) {
+
+        DSIM_PROFILE_SCOPE("evaluatePrecisionForces");
+        const ParticleSystem& system = precisionSystem.getSystem();
+
+        Parallel::parallelFor(pool, system.size(), PRECISION_GRAIN, [&](size_t begin, size_t end) {
+            evaluateParticleForces(system, begin, positions + begin, velocities + begin, end - begin, time, forces + begin);
+        });
+        evaluateInteractions(system, positions, velocities, time, forces, pool);
+    }
+
+    template class PrecisionSystem<SinglePrecision>;
+    template class PrecisionSystem<DoublePrecision>;
+    template class PrecisionSystem<MixedPrecision>;
+
+    template void evaluatePrecisionForces<SinglePrecision>(const PrecisionSystem<SinglePrecision>&, const PrecisionSystem<SinglePrecision>::Vector*,
+        const PrecisionSystem<SinglePrecision>::Vector*, double, glm::vec3*, Parallel::ThreadPool*);
+    template void evaluatePrecisionForces<DoublePrecision>(const PrecisionSystem<DoublePrecision>&, const PrecisionSystem<DoublePrecision>::Vector*,
+        const PrecisionSystem<DoublePrecision>::Vector*, double, glm::dvec3*, Parallel::ThreadPool*);
+    template void evaluatePrecisionForces<MixedPrecision>(const PrecisionSystem<MixedPrecision>&, const PrecisionSystem<MixedPrecision>::Vector*,
+        const PrecisionSystem<MixedPrecision>::Vector*, double, glm::vec3*, Parallel::ThreadPool*);
+}
+
+namespace Propagation {
+
+    namespace {
+        // Number of particles claimed at once by a thread of the pool
+        const size_t PRECISION_GRAIN = 1024;
+
+        // nodes and weights of the Runge-Kutta 4 stages
+        const double RK4_NODES[4] = { 0.0, 0.5, 0.5, 1.0 };
+        const double RK4_WEIGHTS[4] = { 1.0, 2.0, 2.0, 1.0 };
+
+        const double YOSHIDA_WEIGHTS[3] = { 1.35120719195965777, -1.70241438391931554, 1.35120719195965777 };
+
+        /// @brief Per-thread force buffer, in the accumulator of the policy
+        template <typename Policy>
+        glm::vec<3, typename Policy::Accumulator>* forceBuffer(size_t count) {
+            static thread_local std::vector<glm::vec<3, typename Policy::Accumulator> > buffer;
+            buffer.resize(count);
+            return buffer.data();
+        }
+
+        /// @brief Scratch memory of the Runge-Kutta 4 method, in the state precision of the policy
+        template <typename Policy>
+        class PrecisionRK4Workspace {
+            public:
+                std::vector<typename Physics::PrecisionSystem<Policy>::Vector> stagePositions;
+                std::vector<typename Physics::PrecisionSystem<Policy>::Vector> stageVelocities;
+                std::vector<typename Physics::PrecisionSystem<Policy>::Vector> sumKx;
+                std::vector<typename Physics::PrecisionSystem<Policy>::Vector> sumKv;
+
+                void resize(size_t count) {
+                    stagePositions.resize(count);
+                    stageVelocities.resize(count);
+                    sumKx.resize(count);
+                    sumKv.resize(count);
+                }
+        };
+
+        /// @brief Compute the accelerations of the particles, unless they are already cached
+        template <typename Policy>
+        void ensureAccelerations(Physics::PrecisionSystem<Policy>& system, double currentTime, Parallel::ThreadPool* pool) {
+            typedef typename Physics::PrecisionSystem<Policy>::Vector Vector;
+            typedef typename Physics::PrecisionSystem<Policy>::Real Real;
+            if (system.hasAccelerations()) return;
+
+            DSIM_PROFILE_COUNT("force evaluations", system.size());
+            glm::vec<3, typename Policy::Accumulator>* forces = forceBuffer<Policy>(system.size());
+            Vector* accelerations = system.getAccelerations();
+            const float* masses = system.getSystem().getMasses();
+
+            Physics::evaluatePrecisionForces(system, system.getPositions(), system.getVelocities(), currentTime, forces, pool);
+            Parallel::parallelFor(pool, system.size(), PRECISION_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) accelerations[i] = Vector(forces[i]) / (Real)masses[i];
+            });
+        }
+
+        /// @brief Kick-drift-kick step over the cached accelerations, leaving the ones of the new state in the cache
+        template <typename Policy>
+        void verletStep(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool) {
+            typedef typename Physics::PrecisionSystem<Policy>::Vector Vector;
+            typedef typename Physics::PrecisionSystem<Policy>::Real Real;
+
+            DSIM_PROFILE_COUNT("force evaluations", system.size());
+            Vector* positions = system.getPositions();
+            Vector* velocities = system.getVelocities();
+            Vector* accelerations = system.getAccelerations();
+            const float* masses = system.getSystem().getMasses();
+            glm::vec<3, typename Policy::Accumulator>* forces = forceBuffer<Policy>(system.size());
+
+            const Real step = (Real)deltaTime;
+            const Real halfStep = (Real)(0.5 * deltaTime);
+
+            Parallel::parallelFor(pool, system.size(), PRECISION_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    velocities[i] += accelerations[i] * halfStep;
+                    positions[i] += velocities[i] * step;
+                }
+            });
+
+            Physics::evaluatePrecisionForces(system, positions, velocities, currentTime + deltaTime, forces, pool);
+
+            Parallel::parallelFor(pool, system.size(), PRECISION_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    accelerations[i] = Vector(forces[i]) / (Real)masses[i];
+                    velocities[i] += accelerations[i] * halfStep;
+                }
+            });
+        }
+
+        /// @brief Explicit Euler when symplectic is false, symplectic Euler (velocity first) otherwise
+        template <typename Policy>
+        void eulerStep(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, bool symplectic, Parallel::ThreadPool* pool) {
+            typedef typename Physics::PrecisionSystem<Policy>::Vector Vector;
+            typedef typename Physics::PrecisionSystem<Policy>::Real Real;
+
+            DSIM_PROFILE_COUNT("force evaluations", system.size());
+            Vector* positions = system.getPositions();
+            Vector* velocities = system.getVelocities();
+            const float* masses = system.getSystem().getMasses();
+            glm::vec<3, typename Policy::Accumulator>* forces = forceBuffer<Policy>(system.size());
+            const Real step = (Real)deltaTime;
+
+            Physics::evaluatePrecisionForces(system, positions, velocities, currentTime, forces, pool);
+
+            Parallel::parallelFor(pool, system.size(), PRECISION_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    const Vector acceleration = Vector(forces[i]) / (Real)masses[i];
+                    if (symplectic) {
+                        velocities[i] += acceleration * step;
+                        positions[i] += velocities[i] * step;
+                    }
+                    else {
+                        positions[i] += velocities[i] * step;
+                        velocities[i] += acceleration * step;
+                    }
+                }
+            });
+            system.invalidateAccelerations();
+        }
+    }
+
+    template <typename Policy>
+    void explicitEuler(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool) {
+        DSIM_PROFILE_SCOPE("explicitEuler");
+        eulerStep(system, currentTime, deltaTime, false, pool);
+    }
+
+    template <typename Policy>
+    void simplecticEuler(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool) {
+        DSIM_PROFILE_SCOPE("simplecticEuler");
+        eulerStep(system, currentTime, deltaTime, true, pool);
+    }
+
+    template <typename Policy>
+    void velocityVerlet(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool) {
+        DSIM_PROFILE_SCOPE("velocityVerletStep");
+        ensureAccelerations(system, currentTime, pool);
+        verletStep(system, currentTime, deltaTime, pool);
+        system.validateAccelerations();
+    }
+
+    template <typename Policy>
+    void yoshida4(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool) {
+        DSIM_PROFILE_SCOPE("yoshida4Step");
+        ensureAccelerations(system, currentTime, pool);
+
+        double time = currentTime;
+        for (int substep = 0; substep < 3; substep++) {
+            verletStep(system, time, YOSHIDA_WEIGHTS[substep] * deltaTime, pool);
+            time += YOSHIDA_WEIGHTS[substep] * deltaTime;
+        }
+        system.validateAccelerations();
+    }
+
+    template <typename Policy>
+    void rungeKutta4(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool) {
+        typedef typename Physics::PrecisionSystem<Policy>::Vector Vector;
+        typedef typename Physics::PrecisionSystem<Policy>::Real Real;
+        DSIM_PROFILE_SCOPE("rungeKutta4");
+
+        static thread_local PrecisionRK4Workspace<Policy> cachedWorkspace;
+        PrecisionRK4Workspace<Policy>& workspace = cachedWorkspace;
+        workspace.resize(system.size());
+
+        Vector* positions = system.getPositions();
+        Vector* velocities = system.getVelocities();
+        const float* masses = system.getSystem().getMasses();
+        glm::vec<3, typename Policy::Accumulator>* forces = forceBuffer<Policy>(system.size());
+
+        std::copy(positions, positions + system.size(), workspace.stagePositions.begin());
+        std::copy(velocities, velocities + system.size(), workspace.stageVelocities.begin());
+        std::fill(workspace.sumKx.begin(), workspace.sumKx.end(), Vector(0));
+        std::fill(workspace.sumKv.begin(), workspace.sumKv.end(), Vector(0));
+
+        for (int stage = 0; stage < 4; stage++) {
+            DSIM_PROFILE_COUNT("force evaluations", system.size());
+            Physics::evaluatePrecisionForces(system, workspace.stagePositions.data(), workspace.stageVelocities.data(), currentTime + RK4_NODES[stage] * deltaTime, forces, pool);
+
+            // the derivatives of this stage give the state of the next one
+            const Real weight = (Real)RK4_WEIGHTS[stage];
+            const Real nextStep = stage < 3 ? (Real)(RK4_NODES[stage + 1] * deltaTime) : (Real)0;
+            Parallel::parallelFor(pool, system.size(), PRECISION_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    const Vector kx = workspace.stageVelocities[i];
+                    const Vector kv = Vector(forces[i]) / (Real)masses[i];
+                    workspace.sumKx[i] += weight * kx;
+                    workspace.sumKv[i] += weight * kv;
+                    workspace.stagePositions[i] = positions[i] + nextStep * kx;
+                    workspace.stageVelocities[i] = velocities[i] + nextStep * kv;
+                }
+            });
+        }
+
+        const Real sixth = (Real)(deltaTime / 6.0);
+        Parallel::parallelFor(pool, system.size(), PRECISION_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                positions[i] += sixth * workspace.sumKx[i];
+                velocities[i] += sixth * workspace.sumKv[i];
+            }
+        });
+        system.invalidateAccelerations();
+    }
+
+    namespace {
+        /// @brief Stepper of a policy, calling one of the methods above
+        template <typename Policy>
+        class PolicyStepper : public PrecisionStepper {
+            public:
+                typedef void (*Method)(Physics::PrecisionSystem<Policy>& system, double currentTime, double deltaTime, Parallel::ThreadPool* pool);
+
+            private:
+                Physics::Precision precision;
+                Physics::PrecisionSystem<Policy> state;
+                Method method;
+
+            public:
+                PolicyStepper(Physics::Precision p, Physics::ParticleSystem& system, Method m) : precision(p), state(system), method(m) {}
+
+                Physics::Precision getPrecision() const override {
+                    return precision;
+                }
+
+                void step(double currentTime, double deltaTime, Parallel::ThreadPool* pool) override {
+                    method(state, currentTime, deltaTime, pool);
+                }
+
+                void load() override {
+                    state.load();
+                }
+
+                void store() const override {
+                    state.store();
+                }
+        };
+
+        template <typename Policy>
+        std::unique_ptr<PrecisionStepper> makeStepper(Physics::Precision precision, const std::string& integrator, Physics::ParticleSystem& system) {
+            typename PolicyStepper<Policy>::Method method = nullptr;
+            if (integrator == "euler") method = explicitEuler<Policy>;
+            else if (integrator == "symplectic") method = simplecticEuler<Policy>;
+            else if (integrator == "verlet") method = velocityVerlet<Policy>;
+            else if (integrator == "yoshida4") method = yoshida4<Policy>;
+            else if (integrator == "rk4") method = rungeKutta4<Policy>;
+            else return std::unique_ptr<PrecisionStepper>();
+
+            return std::unique_ptr<PrecisionStepper>(new PolicyStepper<Policy>(precision, system, method));
+        }
+    }
+
+    std::unique_ptr<PrecisionStepper> createPrecisionStepper(Physics::Precision precision, const std::string& integrator, Physics::ParticleSystem& system) {
+        switch (precision) {
+            case Physics::Precision::Double: return makeStepper<Physics::DoublePrecision>(precision, integrator, system);
+            case Physics::Precision::Mixed: return makeStepper<Physics::MixedPrecision>(precision, integrator, system);
+            default: return makeStepper<Physics::SinglePrecision>(precision, integrator, system);
+        }
+    }
+
+// Instantiation of the methods declared in precision.hpp for every policy
+#define DSIM_INSTANTIATE_PRECISION(Policy) \
+    template void explicitEuler<Policy>(Physics::PrecisionSystem<Policy>&, double, double, Parallel::ThreadPool*); \
+    template void simplecticEuler<Policy>(Physics::PrecisionSystem<Policy>&, double, double, Parallel::ThreadPool*); \
+    template void velocityVerlet<Policy>(Physics::PrecisionSystem<Policy>&, double, double, Parallel::ThreadPool*); \
+    template void yoshida4<Policy>(Physics::PrecisionSystem<Policy>&, double, double, Parallel::ThreadPool*); \
+    template void rungeKutta4<Policy>(Physics::PrecisionSystem<Policy>&, double, double, Parallel::ThreadPool*);
+
+    DSIM_INSTANTIATE_PRECISION(Physics::SinglePrecision)
+    DSIM_INSTANTIATE_PRECISION(Physics::DoublePrecision)
+    DSIM_INSTANTIATE_PRECISION(Physics::MixedPrecision)
+
+#undef DSIM_INSTANTIATE_PRECISION
+}
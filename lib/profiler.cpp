@@ -0,0 +1,251 @@
+#include "profiler.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Profiling {
+
+    namespace {
+        // Events kept per thread, about 20 MB; later events only update the totals
+        const size_t MAX_EVENTS = 1 << 19;
+
+        struct Event {
+            const char* name;
+            uint64_t start;
+            uint64_t duration;
+            double value;
+            bool counter;
+        };
+
+        struct Total {
+            const char* name;
+            uint64_t calls;
+            uint64_t time;
+            uint64_t maxTime;
+        };
+
+        struct Count {
+            const char* name;
+            double value;
+        };
+
+        // Log of a thread, only written by its thread; the mutex is uncontended except while the logs are written out
+        struct ThreadLog {
+            std::mutex mutex;
+            unsigned id;
+            std::string name;
+            std::vector<Event> events;
+            size_t dropped;
+            std::vector<Total> totals;
+            std::vector<Count> counts;
+
+            ThreadLog(unsigned threadId) : id(threadId), dropped(0) {}
+
+            void push(const Event& event) {
+                if (events.size() < MAX_EVENTS) events.push_back(event);
+                else dropped++;
+            }
+        };
+
+        struct Registry {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<ThreadLog>> logs; // never shrinks, the threads keep pointers to their log
+            std::chrono::steady_clock::time_point epoch;
+
+            Registry() : epoch(std::chrono::steady_clock::now()) {}
+        };
+
+        Registry& registry() {
+            static Registry instance;
+            return instance;
+        }
+
+        ThreadLog& threadLog() {
+            static thread_local ThreadLog* log = nullptr;
+            if (!log) {
+                Registry& logs = registry();
+                std::lock_guard<std::mutex> lock(logs.mutex);
+                logs.logs.push_back(std::unique_ptr<ThreadLog>(new ThreadLog((unsigned)logs.logs.size())));
+                log = logs.logs.back().get();
+            }
+            return *log;
+        }
+
+        bool sameName(const char* a, const char* b) {
+            return a == b || std::strcmp(a, b) == 0;
+        }
+
+        template<typename T>
+        T* find(std::vector<T>& entries, const char* name) {
+            for (T& entry : entries) {
+                if (sameName(entry.name, name)) return &entry;
+            }
+            return nullptr;
+        }
+
+        void writeString(std::ostream& out, const std::string& text) {
+            out << '"';
+            for (char c : text) {
+                if (c == '"' || c == '\\') out << '\\' << c;
+                else if ((unsigned char)c < 0x20) out << ' ';
+                else out << c;
+            }
+            out << '"';
+        }
+
+        void writeMicroseconds(std::ostream& out, uint64_t nanoseconds) {
+            out << nanoseconds / 1000 << '.' << std::setw(3) << std::setfill('0') << nanoseconds % 1000 << std::setfill(' ');
+        }
+    }
+
+    bool isEnabled() {
+#ifdef DYNAMICSSIM_PROFILE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    uint64_t now() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - registry().epoch).count();
+    }
+
+    // ScopedTimer implementations
+
+    ScopedTimer::ScopedTimer(const char* name) : name(name), start(now()) {}
+
+    ScopedTimer::~ScopedTimer() {
+        const uint64_t duration = now() - start;
+
+        ThreadLog& log = threadLog();
+        std::lock_guard<std::mutex> lock(log.mutex);
+
+        Event event = { name, start, duration, 0.0, false };
+        log.push(event);
+
+        Total* total = find(log.totals, name);
+        if (!total) {
+            Total entry = { name, 0, 0, 0 };
+            log.totals.push_back(entry);
+            total = &log.totals.back();
+        }
+        total->calls++;
+        total->time += duration;
+        if (duration > total->maxTime) total->maxTime = duration;
+    }
+
+    // Counter implementations
+
+    void addCount(const char* name, double value) {
+        ThreadLog& log = threadLog();
+        std::lock_guard<std::mutex> lock(log.mutex);
+
+        Count* count = find(log.counts, name);
+        if (count) count->value += value;
+        else {
+            Count entry = { name, value };
+            log.counts.push_back(entry);
+        }
+    }
+
+    void sampleCount(const char* name) {
+        ThreadLog& log = threadLog();
+        std::lock_guard<std::mutex> lock(log.mutex);
+
+        Count* count = find(log.counts, name);
+        Event event = { name, now(), 0, count ? count->value : 0.0, true };
+        log.push(event);
+        if (count) count->value = 0.0;
+    }
+
+    void recordCounter(const char* name, double value) {
+        ThreadLog& log = threadLog();
+        std::lock_guard<std::mutex> lock(log.mutex);
+
+        Event event = { name, now(), 0, value, true };
+        log.push(event);
+    }
+
+    void setThreadName(const std::string& name) {
+        ThreadLog& log = threadLog();
+        std::lock_guard<std::mutex> lock(log.mutex);
+        log.name = name;
+    }
+
+    // Output implementations
+
+    bool writeChromeTrace(const std::string& path) {
+        std::ofstream out(path.c_str());
+        if (!out) return false;
+
+        Registry& logs = registry();
+        std::lock_guard<std::mutex> registryLock(logs.mutex);
+
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        bool first = true;
+        for (const std::unique_ptr<ThreadLog>& log : logs.logs) {
+            std::lock_guard<std::mutex> lock(log->mutex);
+
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << log->id << ",\"args\":{\"name\":";
+            writeString(out, log->name.empty() ? "thread " + std::to_string(log->id) : log->name);
+            out << "}}";
+            first = false;
+
+            for (const Event& event : log->events) {
+                out << ",\n{\"name\":";
+                writeString(out, event.name);
+                out << ",\"ph\":\"" << (event.counter ? 'C' : 'X') << "\",\"pid\":0,\"tid\":" << log->id << ",\"ts\":";
+                writeMicroseconds(out, event.start);
+                if (event.counter) out << ",\"args\":{\"value\":" << event.value << "}}";
+                else {
+                    out << ",\"dur\":";
+                    writeMicroseconds(out, event.duration);
+                    out << '}';
+                }
+            }
+        }
+        out << "\n]}\n";
+
+        return (bool)out;
+    }
+
+    void writeSummary(std::ostream& out) {
+        Registry& logs = registry();
+        std::lock_guard<std::mutex> registryLock(logs.mutex);
+
+        for (const std::unique_ptr<ThreadLog>& log : logs.logs) {
+            std::lock_guard<std::mutex> lock(log->mutex);
+            if (log->totals.empty()) continue;
+
+            out << (log->name.empty() ? "thread " + std::to_string(log->id) : log->name);
+            if (log->dropped > 0) out << " (" << log->dropped << " events dropped from the trace)";
+            out << "\n";
+
+            for (const Total& total : log->totals) {
+                out << "  " << std::left << std::setw(32) << total.name << std::right
+                    << std::setw(10) << total.calls << " calls "
+                    << std::setw(12) << total.time * 1e-6 << " ms total "
+                    << std::setw(12) << total.time * 1e-3 / total.calls << " us mean "
+                    << std::setw(12) << total.maxTime * 1e-3 << " us max\n";
+            }
+        }
+    }
+
+    void reset() {
+        Registry& logs = registry();
+        std::lock_guard<std::mutex> registryLock(logs.mutex);
+
+        for (const std::unique_ptr<ThreadLog>& log : logs.logs) {
+            std::lock_guard<std::mutex> lock(log->mutex);
+            log->events.clear();
+            log->dropped = 0;
+            log->totals.clear();
+            log->counts.clear();
+        }
+    }
+}
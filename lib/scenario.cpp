@@ -0,0 +1,360 @@
+#include "scenario.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include "lennardjones.hpp"
+#include "mappedfile.hpp"
+#include "nbody.hpp"
+#include "timeprofile.hpp"
+
+namespace Storage {
+
+    const ScenarioType SCENARIO_TYPES[] = {
+        { "electric", ScenarioType::Force, Physics::ForceDescriptor::Electric },
+        { "gravitational", ScenarioType::Force, Physics::ForceDescriptor::Gravitational },
+        { "earth_gravitational", ScenarioType::Force, Physics::ForceDescriptor::EarthGravitational },
+        { "hooke", ScenarioType::Force, Physics::ForceDescriptor::Hooke },
+        { "air_resistance", ScenarioType::Force, Physics::ForceDescriptor::AirResistance },
+        { "driving", ScenarioType::Force, Physics::ForceDescriptor::Driving },
+        { "uniform_gravity", ScenarioType::Field, Physics::ForceDescriptor::UniformGravityField },
+        { "point_gravity", ScenarioType::Field, Physics::ForceDescriptor::PointGravityField },
+        { "uniform_electric", ScenarioType::Field, Physics::ForceDescriptor::UniformElectricField },
+        { "point_charge", ScenarioType::Field, Physics::ForceDescriptor::PointChargeField },
+        { "nbody", ScenarioType::Interaction, Physics::ForceDescriptor::NBody },
+        { "lennard_jones", ScenarioType::Interaction, Physics::ForceDescriptor::LennardJones },
+    };
+
+    const size_t SCENARIO_TYPE_COUNT = sizeof(SCENARIO_TYPES) / sizeof(SCENARIO_TYPES[0]);
+
+    const ScenarioType* findScenarioType(const std::string& name, ScenarioType::Category category) {
+        for (size_t i = 0; i < SCENARIO_TYPE_COUNT; i++) {
+            if (SCENARIO_TYPES[i].category == category && name == SCENARIO_TYPES[i].name) return &SCENARIO_TYPES[i];
+        }
+        return nullptr;
+    }
+
+    Physics::ForceDescriptor getDefaultDescriptor(uint32_t type) {
+        // the constructor arguments without a default are given as 0, a statement is expected to set them
+        switch (type) {
+            case Physics::ForceDescriptor::Electric: return Physics::ElectricForce(0.0f, 0.0f).describe();
+            case Physics::ForceDescriptor::Gravitational: return Physics::GravitationalForce(0.0f, 0.0f).describe();
+            case Physics::ForceDescriptor::EarthGravitational: return Physics::EarthGravitationalForce(0.0f).describe();
+            case Physics::ForceDescriptor::Hooke: return Physics::HookeForce(0.0f).describe();
+            case Physics::ForceDescriptor::AirResistance: return Physics::AirResistanceForce(0.0f).describe();
+            case Physics::ForceDescriptor::Driving: return Physics::DrivingForce(glm::vec3(0.0f), Physics::TimeProfile::sinusoidal(0.0f, 0.0f)).describe();
+            case Physics::ForceDescriptor::UniformGravityField: return Physics::UniformGravityField().describe();
+            case Physics::ForceDescriptor::PointGravityField: return Physics::PointGravityField(0.0f).describe();
+            case Physics::ForceDescriptor::UniformElectricField: return Physics::UniformElectricField(glm::vec3(0.0f)).describe();
+            case Physics::ForceDescriptor::PointChargeField: return Physics::PointChargeField(0.0f).describe();
+            case Physics::ForceDescriptor::NBody: return Physics::NBodyInteraction().describe();
+            case Physics::ForceDescriptor::LennardJones: return Physics::LennardJonesInteraction().describe();
+            default: return Physics::ForceDescriptor(type);
+        }
+    }
+
+    namespace {
+        const char* SCENARIO_MAGIC = "dynamicssim-scenario";
+
+        // Bytes per particle of the bulk section: position, velocity, mass, charge, radius
+        const uint64_t BULK_PARTICLE_SIZE = 2 * sizeof(glm::vec3) + 3 * sizeof(float);
+
+        struct ParticleRecord {
+            float mass;
+            glm::vec3 position;
+            glm::vec3 velocity;
+            float charge;
+            float radius;
+        };
+
+        /// @brief Write an array of the particles of a system in the order of their ids
+        template <typename T>
+        void writeBulkArray(std::ostream& out, const T* values, const Physics::ParticleSystem& system) {
+            const size_t count = system.size();
+            if (system.hasIdentityOrder()) {
+                out.write(reinterpret_cast<const char*>(values), (std::streamsize)(count * sizeof(T)));
+                return;
+            }
+
+            std::vector<T> ordered(count);
+            const uint32_t* indices = system.getIndices();
+            for (size_t id = 0; id < count; id++) ordered[id] = values[indices[id]];
+            out.write(reinterpret_cast<const char*>(ordered.data()), (std::streamsize)(count * sizeof(T)));
+        }
+
+        const ScenarioType* findType(uint32_t type) {
+            for (size_t i = 0; i < SCENARIO_TYPE_COUNT; i++) {
+                if (SCENARIO_TYPES[i].type == type) return &SCENARIO_TYPES[i];
+            }
+            return nullptr;
+        }
+
+        /// @brief Split a line in whitespace separated tokens, dropping the comment
+        void tokenize(const char* begin, const char* end, std::vector<std::string>& tokens) {
+            tokens.clear();
+            const char* c = begin;
+            while (c < end && *c != '#') {
+                while (c < end && (*c == ' ' || *c == '\t' || *c == '\r')) c++;
+                if (c == end || *c == '#') break;
+
+                const char* start = c;
+                while (c < end && *c != ' ' && *c != '\t' && *c != '\r' && *c != '#') c++;
+                tokens.push_back(std::string(start, c));
+            }
+        }
+
+        std::string linePrefix(size_t lineNumber) {
+            return "line " + std::to_string(lineNumber) + ": ";
+        }
+
+        bool parseNumber(const std::string& token, double& value) {
+            char* end = nullptr;
+            value = std::strtod(token.c_str(), &end);
+            return !token.empty() && *end == '\0';
+        }
+
+        bool parseFloats(const std::vector<std::string>& tokens, size_t first, float* values, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                double value;
+                if (!parseNumber(tokens[first + i], value)) return false;
+                values[i] = (float)value;
+            }
+            return true;
+        }
+
+        /// @brief Append the leaves of a force, false if one of them cannot be described
+        bool collectForces(const Physics::Force& force, std::vector<Physics::ForceDescriptor>& descriptors) {
+            Physics::ForceDescriptor descriptor = force.describe();
+
+            if (descriptor.type == Physics::ForceDescriptor::Composite) {
+                for (size_t i = 0; i < force.getComponentCount(); i++) {
+                    if (!collectForces(force.getComponent(i), descriptors)) return false;
+                }
+                return true;
+            }
+
+            descriptors.push_back(descriptor);
+            return findType(descriptor.type) != nullptr;
+        }
+
+        void writeStatement(std::ostream& out, const char* keyword, const Physics::ForceDescriptor& descriptor) {
+            out << keyword << ' ' << findType(descriptor.type)->name;
+            for (int i = 0; i < Physics::ForceDescriptor::MAX_PARAMETERS; i++) out << ' ' << descriptor.parameters[i];
+            out << '\n';
+        }
+    }
+
+    // ScenarioSettings implementations
+    ScenarioSettings::ScenarioSettings() : deltaTime(0.0f), duration(0.0) {}
+
+    // Scenario implementations
+
+    bool Scenario::load(const std::string& path, Physics::ParticleSystem& system) {
+        error.clear();
+
+        MappedFile file;
+        if (!file.open(path)) {
+            error = "cannot open " + path;
+            return false;
+        }
+
+        // parse into locals, the system and this scenario only change once the whole file is valid
+        ScenarioSettings parsedSettings;
+        std::vector<std::unique_ptr<Physics::Force>> parsedForces;
+        std::vector<std::unique_ptr<Physics::Field>> parsedFields;
+        std::vector<std::unique_ptr<Physics::Interaction>> parsedInteractions;
+        std::vector<ParticleRecord> particles;
+        uint64_t bulkCount = 0;
+        const unsigned char* bulk = nullptr;
+
+        const char* text = reinterpret_cast<const char*>(file.data());
+        const size_t size = file.size();
+        std::vector<std::string> tokens;
+        size_t lineNumber = 0;
+        bool versionSeen = false;
+
+        for (size_t offset = 0; offset < size && !bulk;) {
+            const char* lineEnd = static_cast<const char*>(std::memchr(text + offset, '\n', size - offset));
+            const size_t length = lineEnd ? (size_t)(lineEnd - (text + offset)) : size - offset;
+            tokenize(text + offset, text + offset + length, tokens);
+            const size_t next = offset + length + 1;
+            offset = next;
+            lineNumber++;
+
+            if (tokens.empty()) continue;
+            const std::string& keyword = tokens[0];
+            double value = 0.0;
+
+            if (!versionSeen) {
+                if (keyword != SCENARIO_MAGIC || tokens.size() != 2 || !parseNumber(tokens[1], value)) {
+                    error = linePrefix(lineNumber) + "expected '" + SCENARIO_MAGIC + " <version>'";
+                    return false;
+                }
+                if (value != SCENARIO_VERSION) {
+                    error = linePrefix(lineNumber) + "unsupported version " + tokens[1];
+                    return false;
+                }
+                versionSeen = true;
+            }
+            else if (keyword == "integrator" && tokens.size() == 2) parsedSettings.integrator = tokens[1];
+            else if (keyword == "precision" && tokens.size() == 2) parsedSettings.precision = tokens[1];
+            else if (keyword == "dt" && tokens.size() == 2 && parseNumber(tokens[1], value) && value > 0.0) parsedSettings.deltaTime = (float)value;
+            else if (keyword == "duration" && tokens.size() == 2 && parseNumber(tokens[1], value) && value > 0.0) parsedSettings.duration = value;
+            else if ((keyword == "force" || keyword == "field" || keyword == "interaction") && tokens.size() >= 2) {
+                const ScenarioType::Category category = keyword == "force" ? ScenarioType::Force : keyword == "field" ? ScenarioType::Field : ScenarioType::Interaction;
+                const ScenarioType* type = findScenarioType(tokens[1], category);
+                if (!type) {
+                    error = linePrefix(lineNumber) + "unknown " + keyword + " type " + tokens[1];
+                    return false;
+                }
+
+                Physics::ForceDescriptor descriptor = getDefaultDescriptor(type->type);
+                const size_t count = tokens.size() - 2;
+                if (count > (size_t)Physics::ForceDescriptor::MAX_PARAMETERS || !parseFloats(tokens, 2, descriptor.parameters, count)) {
+                    error = linePrefix(lineNumber) + "invalid parameters of " + tokens[1];
+                    return false;
+                }
+
+                bool created = false;
+                if (category == ScenarioType::Force) {
+                    parsedForces.push_back(Physics::createForce(descriptor));
+                    created = parsedForces.back() != nullptr;
+                }
+                else if (category == ScenarioType::Field) {
+                    parsedFields.push_back(Physics::createField(descriptor));
+                    created = parsedFields.back() != nullptr;
+                }
+                else {
+                    parsedInteractions.push_back(Physics::createInteraction(descriptor));
+                    created = parsedInteractions.back() != nullptr;
+                }
+                if (!created) {
+                    error = linePrefix(lineNumber) + "cannot create " + tokens[1];
+                    return false;
+                }
+            }
+            else if (keyword == "particle" && tokens.size() >= 8 && tokens.size() <= 10) {
+                float values[9] = { 0.0f };
+                if (!parseFloats(tokens, 1, values, tokens.size() - 1)) {
+                    error = linePrefix(lineNumber) + "invalid particle";
+                    return false;
+                }
+
+                ParticleRecord particle = { values[0], glm::vec3(values[1], values[2], values[3]), glm::vec3(values[4], values[5], values[6]), values[7], values[8] };
+                particles.push_back(particle);
+            }
+            else if (keyword == "bulk" && tokens.size() == 2 && parseNumber(tokens[1], value) && value >= 0.0 && value == (double)(uint64_t)value) {
+                bulkCount = (uint64_t)value;
+
+                const uint64_t start = (next + SCENARIO_BULK_ALIGNMENT - 1) / SCENARIO_BULK_ALIGNMENT * SCENARIO_BULK_ALIGNMENT;
+                if (!lineEnd || bulkCount > (std::numeric_limits<uint64_t>::max() - start) / BULK_PARTICLE_SIZE || start + bulkCount * BULK_PARTICLE_SIZE > size) {
+                    error = linePrefix(lineNumber) + "bulk section shorter than " + tokens[1] + " particles";
+                    return false;
+                }
+                bulk = file.data() + start;
+            }
+            else {
+                error = linePrefix(lineNumber) + "invalid statement '" + keyword + "'";
+                return false;
+            }
+        }
+
+        if (!versionSeen) {
+            error = "empty scenario";
+            return false;
+        }
+
+        const size_t textCount = particles.size();
+        const size_t count = (size_t)bulkCount;
+
+        system.clear();
+        system.reserve(textCount + count);
+        for (const ParticleRecord& particle : particles) system.addParticle(particle.mass, particle.position, particle.velocity, particle.charge, particle.radius);
+
+        // the bulk arrays are copied as they are, without looking at each particle
+        if (count > 0) {
+            system.resize(textCount + count);
+            const uint64_t vectorSize = count * sizeof(glm::vec3);
+            const uint64_t scalarSize = count * sizeof(float);
+            std::memcpy(system.getPositions() + textCount, bulk, vectorSize);
+            std::memcpy(system.getVelocities() + textCount, bulk + vectorSize, vectorSize);
+            std::memcpy(system.getMasses() + textCount, bulk + 2 * vectorSize, scalarSize);
+            std::memcpy(system.getCharges() + textCount, bulk + 2 * vectorSize + scalarSize, scalarSize);
+            std::memcpy(system.getRadii() + textCount, bulk + 2 * vectorSize + 2 * scalarSize, scalarSize);
+        }
+
+        system.appliedForces.clear();
+        for (const std::unique_ptr<Physics::Force>& force : parsedForces) system.appliedForces.addForce(*force);
+
+        const std::vector<const Physics::Field*> previousFields = system.getFields();
+        for (const Physics::Field* field : previousFields) system.removeField(*field);
+        for (const std::unique_ptr<Physics::Field>& field : parsedFields) system.addField(*field);
+
+        const std::vector<const Physics::Interaction*> previousInteractions = system.getInteractions();
+        for (const Physics::Interaction* interaction : previousInteractions) system.removeInteraction(*interaction);
+        for (const std::unique_ptr<Physics::Interaction>& interaction : parsedInteractions) system.addInteraction(*interaction);
+        system.invalidateAccelerations();
+
+        settings = parsedSettings;
+        forces = std::move(parsedForces);
+        fields = std::move(parsedFields);
+        interactions = std::move(parsedInteractions);
+        return true;
+    }
+
+    const std::string& Scenario::getError() const {
+        return error;
+    }
+
+    bool saveScenario(const std::string& path, const ScenarioSettings& settings, const Physics::ParticleSystem& system) {
+        std::vector<Physics::ForceDescriptor> forces;
+        if (!collectForces(system.appliedForces, forces)) return false;
+
+        std::vector<Physics::ForceDescriptor> fields;
+        for (const Physics::Field* field : system.getFields()) {
+            fields.push_back(field->describe());
+            if (!findType(fields.back().type)) return false;
+        }
+
+        std::vector<Physics::ForceDescriptor> interactions;
+        for (const Physics::Interaction* interaction : system.getInteractions()) {
+            interactions.push_back(interaction->describe());
+            if (!findType(interactions.back().type)) return false;
+        }
+
+        std::ofstream out(path.c_str(), std::ios::binary);
+        if (!out) return false;
+
+        // enough digits for every float to read back exactly
+        out.precision(std::numeric_limits<float>::max_digits10);
+        out << SCENARIO_MAGIC << ' ' << SCENARIO_VERSION << '\n';
+        if (!settings.integrator.empty()) out << "integrator " << settings.integrator << '\n';
+        if (!settings.precision.empty()) out << "precision " << settings.precision << '\n';
+        if (settings.deltaTime > 0.0f) out << "dt " << settings.deltaTime << '\n';
+        if (settings.duration > 0.0) out << "duration " << std::setprecision(std::numeric_limits<double>::max_digits10) << settings.duration << std::setprecision(std::numeric_limits<float>::max_digits10) << '\n';
+
+        for (const Physics::ForceDescriptor& force : forces) writeStatement(out, "force", force);
+        for (const Physics::ForceDescriptor& field : fields) writeStatement(out, "field", field);
+        for (const Physics::ForceDescriptor& interaction : interactions) writeStatement(out, "interaction", interaction);
+
+        const size_t count = system.size();
+        out << "bulk " << count << '\n';
+
+        const uint64_t position = (uint64_t)out.tellp();
+        const uint64_t start = (position + SCENARIO_BULK_ALIGNMENT - 1) / SCENARIO_BULK_ALIGNMENT * SCENARIO_BULK_ALIGNMENT;
+        const char padding[SCENARIO_BULK_ALIGNMENT] = { 0 };
+        out.write(padding, (std::streamsize)(start - position));
+
+        // a reordered system is saved in id order, so loading it gives the particles back their ids as indices
+        writeBulkArray(out, system.getPositions(), system);
+        writeBulkArray(out, system.getVelocities(), system);
+        writeBulkArray(out, system.getMasses(), system);
+        writeBulkArray(out, system.getCharges(), system);
+        writeBulkArray(out, system.getRadii(), system);
+
+        out.close();
+        return !out.fail();
+    }
+}
@@ -0,0 +1,89 @@
+#include "spatialhash.hpp"
+
+#include <limits>
+
+namespace Physics {
+
+    namespace {
+        const size_t MIN_BUCKETS = 64;
+
+        // Cells per point up to which the bounding box gets a bucket per cell
+        const size_t DENSE_CELLS_PER_POINT = 16;
+    }
+
+    SpatialHash::SpatialHash() : cellSize(1.0f), inverseCellSize(1.0f), dense(false), bucketMask(0) {
+        for (int axis = 0; axis < 3; axis++) {
+            minimum[axis] = 0;
+            extent[axis] = 0;
+        }
+    }
+
+    void SpatialHash::build(const glm::vec3* points, size_t count, float size) {
+        cellSize = size;
+        inverseCellSize = 1.0f / size;
+
+        int lower[3] = { std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), std::numeric_limits<int>::max() };
+        int upper[3] = { std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<int>::min() };
+        for (size_t i = 0; i < count; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                int c = cell(points[i][axis]);
+                lower[axis] = std::min(lower[axis], c);
+                upper[axis] = std::max(upper[axis], c);
+            }
+        }
+
+        // the box is measured in doubles, so huge boxes do not overflow before being rejected
+        double boxCells = 1.0;
+        for (int axis = 0; axis < 3; axis++) boxCells *= count ? (double)upper[axis] - lower[axis] + 1.0 : 0.0;
+        dense = count > 0 && boxCells <= (double)std::max(MIN_BUCKETS, DENSE_CELLS_PER_POINT * count);
+
+        size_t bucketCount;
+        if (dense) {
+            for (int axis = 0; axis < 3; axis++) {
+                minimum[axis] = lower[axis];
+                extent[axis] = upper[axis] - lower[axis] + 1;
+            }
+            bucketCount = (size_t)boxCells;
+        }
+        else {
+            // about two buckets per point keeps the collisions between cells rare
+            bucketCount = MIN_BUCKETS;
+            while (bucketCount < 2 * count) bucketCount *= 2;
+            bucketMask = bucketCount - 1;
+        }
+
+        bucketStarts.assign(bucketCount + 1, 0);
+        particleBuckets.resize(count);
+        indices.resize(count);
+        positions.resize(count);
+        cells.resize(dense ? 0 : count);
+
+        for (size_t i = 0; i < count; i++) {
+            const int x = cell(points[i].x), y = cell(points[i].y), z = cell(points[i].z);
+            size_t b = dense ? denseBucket(x, y, z) : hashBucket(x, y, z);
+            particleBuckets[i] = (unsigned)b;
+            bucketStarts[b + 1]++;
+        }
+        for (size_t b = 0; b < bucketCount; b++) bucketStarts[b + 1] += bucketStarts[b];
+
+        cursors.assign(bucketStarts.begin(), bucketStarts.end() - 1);
+        for (size_t i = 0; i < count; i++) {
+            unsigned entry = cursors[particleBuckets[i]]++;
+            indices[entry] = (unsigned)i;
+            positions[entry] = points[i];
+            if (!dense) cells[entry] = key(cell(points[i].x), cell(points[i].y), cell(points[i].z));
+        }
+    }
+
+    float SpatialHash::getCellSize() const {
+        return cellSize;
+    }
+
+    size_t SpatialHash::size() const {
+        return indices.size();
+    }
+
+    const std::vector<unsigned>& SpatialHash::getIndices() const {
+        return indices;
+    }
+}
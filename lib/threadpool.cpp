@@ -0,0 +1,137 @@
+#include "threadpool.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace Parallel {
+
+    namespace {
+        // Number of polls of an idle worker before it goes to sleep, and before it starts yielding its core
+        const int SPIN_COUNT = 4096;
+        const int YIELD_AFTER = 64;
+    }
+
+    ThreadPool::ThreadPool(unsigned threadCount)
+        : threadCount(threadCount), task(nullptr), grainSize(1), generation(0), pending(0), sleeping(0), stopping(false) {
+        if (this->threadCount == 0) this->threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        slices.reset(new Slice[this->threadCount]);
+        for (unsigned i = 0; i < this->threadCount; i++) {
+            slices[i].next.store(0);
+            slices[i].end = 0;
+        }
+
+        // the calling thread takes part in the loops as thread 0
+        workers.reserve(this->threadCount - 1);
+        for (unsigned i = 1; i < this->threadCount; i++) {
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        stopping.store(true);
+        generation.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+        }
+        wakeUp.notify_all();
+
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    unsigned ThreadPool::getThreadCount() const {
+        return threadCount;
+    }
+
+    void ThreadPool::parallelFor(size_t count, size_t grainSize, const RangeTask& task) {
+        if (count == 0) return;
+        if (grainSize == 0) grainSize = 1;
+
+        // not worth waking up the workers
+        if (threadCount == 1 || count <= grainSize) {
+            task(0, count);
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(dispatchMutex);
+
+        const size_t sliceSize = (count + threadCount - 1) / threadCount;
+        for (unsigned i = 0; i < threadCount; i++) {
+            size_t begin = std::min(count, i * sliceSize);
+            slices[i].next.store(begin, std::memory_order_relaxed);
+            slices[i].end = std::min(count, begin + sliceSize);
+        }
+
+        this->task = &task;
+        this->grainSize = grainSize;
+        pending.store((unsigned)workers.size());
+
+        // publish the new loop, waking up the workers which went to sleep
+        generation.fetch_add(1);
+        if (sleeping.load() > 0) {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+            }
+            wakeUp.notify_all();
+        }
+
+        runChunks(0);
+
+        int spin = 0;
+        while (pending.load(std::memory_order_acquire) != 0) {
+            if (++spin > YIELD_AFTER) std::this_thread::yield();
+        }
+
+        this->task = nullptr;
+    }
+
+    void ThreadPool::workerLoop(unsigned index) {
+        DSIM_PROFILE_THREAD_NAME("worker " + std::to_string(index));
+        unsigned seen = 0;
+
+        while (true) {
+            unsigned current = generation.load();
+            for (int spin = 0; current == seen && spin < SPIN_COUNT; spin++) {
+                if (spin > YIELD_AFTER) std::this_thread::yield();
+                current = generation.load();
+            }
+
+            if (current == seen) {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                sleeping.fetch_add(1);
+                wakeUp.wait(lock, [this, seen] { return generation.load() != seen; });
+                sleeping.fetch_sub(1);
+                current = generation.load();
+            }
+
+            if (stopping.load()) return;
+
+            seen = current;
+            runChunks(index);
+            pending.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void ThreadPool::runChunks(unsigned index) {
+        DSIM_PROFILE_SCOPE("ThreadPool::runChunks");
+        // consume the own slice first, then steal from the others
+        for (unsigned k = 0; k < threadCount; k++) {
+            Slice& slice = slices[(index + k) % threadCount];
+
+            while (true) {
+                size_t begin = slice.next.fetch_add(grainSize, std::memory_order_relaxed);
+                if (begin >= slice.end) break;
+
+                (*task)(begin, std::min(begin + grainSize, slice.end));
+            }
+        }
+    }
+
+    void parallelFor(ThreadPool* pool, size_t count, size_t grainSize, const ThreadPool::RangeTask& task) {
+        if (pool) pool->parallelFor(count, grainSize, task);
+        else if (count > 0) task(0, count);
+    }
+}
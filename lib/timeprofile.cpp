@@ -0,0 +1,214 @@
+#include "timeprofile.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Physics {
+
+    namespace {
+        // Number of particles whose base forces are buffered on the stack by ModulatedForce
+        const size_t MODULATED_BATCH = 256;
+    }
+
+    // TimeProfile implementations
+    TimeProfile::TimeProfile(float value)
+        : type(Sinusoidal), amplitude(0.0f), angularFrequency(0.0f), phase(0.0f), offset(value), start(0.0f), interval(0.0f), periodic(false) {}
+
+    TimeProfile TimeProfile::sinusoidal(float amplitude, float angularFrequency, float phase, float offset) {
+        TimeProfile profile(offset);
+        profile.amplitude = amplitude;
+        profile.angularFrequency = angularFrequency;
+        profile.phase = phase;
+        return profile;
+    }
+
+    TimeProfile TimeProfile::tabulated(const std::vector<float>& values, float start, float interval, bool periodic) {
+        TimeProfile profile(values.empty() ? 0.0f : values.front());
+        if (values.size() < 2 || interval <= 0.0f) return profile;
+
+        profile.type = Tabulated;
+        profile.values = values;
+        profile.start = start;
+        profile.interval = interval;
+        profile.periodic = periodic;
+        return profile;
+    }
+
+    TimeProfile TimeProfile::piecewiseLinear(const std::vector<float>& times, const std::vector<float>& values, bool periodic) {
+        const size_t count = std::min(times.size(), values.size());
+        TimeProfile profile(count == 0 ? 0.0f : values.front());
+        if (count < 2) return profile;
+
+        profile.type = Tabulated;
+        profile.times.assign(times.begin(), times.begin() + count);
+        profile.values.assign(values.begin(), values.begin() + count);
+        profile.start = times.front();
+        profile.periodic = periodic;
+        return profile;
+    }
+
+    float TimeProfile::evaluate(double time) const {
+        if (type == Sinusoidal) return offset + amplitude * (float)std::sin(angularFrequency * time + phase);
+
+        const size_t count = values.size();
+        if (times.empty()) {
+            // evenly spaced: the sample is found by its index, a periodic table wraps around to its first sample
+            const double period = (double)count * interval;
+            double local = time - start;
+            if (periodic) local -= period * std::floor(local / period);
+            else if (local <= 0.0) return values.front();
+            else if (local >= (count - 1) * (double)interval) return values.back();
+
+            const float position = (float)(local / interval);
+            const size_t index = std::min((size_t)position, count - 1);
+            const float next = index + 1 < count ? values[index + 1] : values.front();
+            return values[index] + (position - index) * (next - values[index]);
+        }
+
+        // breakpoints: binary search of the segment, a periodic profile repeating from the first to the last point
+        const double period = times.back() - times.front();
+        double local = time;
+        if (periodic && period > 0.0) local -= period * std::floor((local - times.front()) / period);
+        if (local <= times.front()) return values.front();
+        if (local >= times.back()) return values.back();
+
+        const size_t upper = (size_t)(std::upper_bound(times.begin(), times.end(), (float)local) - times.begin());
+        const size_t index = std::min(std::max(upper, (size_t)1), times.size() - 1) - 1;
+        const float fraction = (float)((local - times[index]) / (times[index + 1] - times[index]));
+        return values[index] + fraction * (values[index + 1] - values[index]);
+    }
+
+    TimeProfile::Type TimeProfile::getType() const {
+        return type;
+    }
+
+    float TimeProfile::getAmplitude() const {
+        return amplitude;
+    }
+
+    float TimeProfile::getAngularFrequency() const {
+        return angularFrequency;
+    }
+
+    float TimeProfile::getPhase() const {
+        return phase;
+    }
+
+    float TimeProfile::getOffset() const {
+        return offset;
+    }
+
+    // DrivingForce implementations
+    DrivingForce::DrivingForce(const glm::vec3& direction, const TimeProfile& profile) : direction(direction), profile(profile) {}
+
+    const TimeProfile& DrivingForce::getProfile() const {
+        return profile;
+    }
+
+    void DrivingForce::setProfile(const TimeProfile& p) {
+        profile = p;
+    }
+
+    glm::vec3 DrivingForce::computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const {
+        return profile.evaluate(time) * direction;
+    }
+
+    float DrivingForce::computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const {
+        return -profile.evaluate(time) * glm::dot(direction, position);
+    }
+
+    void DrivingForce::computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        const glm::vec3 force = profile.evaluate(time) * direction;
+
+        for (size_t i = 0; i < count; i++) {
+            forces[i] += force;
+        }
+    }
+
+    glm::dvec3 DrivingForce::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const {
+        return (double)profile.evaluate(time) * glm::dvec3(direction);
+    }
+
+    void DrivingForce::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const {
+        const glm::dvec3 force = (double)profile.evaluate(time) * glm::dvec3(direction);
+
+        for (size_t i = 0; i < count; i++) {
+            forces[i] += force;
+        }
+    }
+
+    unsigned DrivingForce::getDependencies() const {
+        return DependsOnTime;
+    }
+
+    ForceDescriptor DrivingForce::describe() const {
+        if (profile.getType() != TimeProfile::Sinusoidal) return ForceDescriptor();
+
+        ForceDescriptor descriptor(ForceDescriptor::Driving);
+        descriptor.parameters[0] = direction.x;
+        descriptor.parameters[1] = direction.y;
+        descriptor.parameters[2] = direction.z;
+        descriptor.parameters[3] = profile.getAmplitude();
+        descriptor.parameters[4] = profile.getAngularFrequency();
+        descriptor.parameters[5] = profile.getPhase();
+        descriptor.parameters[6] = profile.getOffset();
+        return descriptor;
+    }
+
+    // ModulatedForce implementations
+    ModulatedForce::ModulatedForce(const Force& base, const TimeProfile& profile) : base(base), profile(profile) {}
+
+    const TimeProfile& ModulatedForce::getProfile() const {
+        return profile;
+    }
+
+    void ModulatedForce::setProfile(const TimeProfile& p) {
+        profile = p;
+    }
+
+    glm::vec3 ModulatedForce::computeForce(const glm::vec3& position, const glm::vec3& velocity, float time) const {
+        return profile.evaluate(time) * base.computeForce(position, velocity, time);
+    }
+
+    float ModulatedForce::computeEnergy(const glm::vec3& position, const glm::vec3& velocity, float time) const {
+        return profile.evaluate(time) * base.computeEnergy(position, velocity, time);
+    }
+
+    void ModulatedForce::computeForces(const glm::vec3* positions, const glm::vec3* velocities, size_t count, float time, glm::vec3* forces) const {
+        const float scale = profile.evaluate(time);
+        glm::vec3 baseForces[MODULATED_BATCH];
+
+        for (size_t batch = 0; batch < count; batch += MODULATED_BATCH) {
+            const size_t batchCount = std::min(MODULATED_BATCH, count - batch);
+            std::fill(baseForces, baseForces + batchCount, glm::vec3(0.0f));
+            base.computeForces(positions + batch, velocities + batch, batchCount, time, baseForces);
+
+            for (size_t i = 0; i < batchCount; i++) {
+                forces[batch + i] += scale * baseForces[i];
+            }
+        }
+    }
+
+    glm::dvec3 ModulatedForce::computeForceDouble(const glm::dvec3& position, const glm::dvec3& velocity, double time) const {
+        return (double)profile.evaluate(time) * base.computeForceDouble(position, velocity, time);
+    }
+
+    void ModulatedForce::computeForcesDouble(const glm::dvec3* positions, const glm::dvec3* velocities, size_t count, double time, glm::dvec3* forces) const {
+        const double scale = profile.evaluate(time);
+        glm::dvec3 baseForces[MODULATED_BATCH];
+
+        for (size_t batch = 0; batch < count; batch += MODULATED_BATCH) {
+            const size_t batchCount = std::min(MODULATED_BATCH, count - batch);
+            std::fill(baseForces, baseForces + batchCount, glm::dvec3(0.0));
+            base.computeForcesDouble(positions + batch, velocities + batch, batchCount, time, baseForces);
+
+            for (size_t i = 0; i < batchCount; i++) {
+                forces[batch + i] += scale * baseForces[i];
+            }
+        }
+    }
+
+    unsigned ModulatedForce::getDependencies() const {
+        return base.getDependencies() | DependsOnTime;
+    }
+}
@@ -0,0 +1,295 @@
+#include "trajectory.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace Storage {
+
+    namespace {
+        size_t trajectoryFrameSize(size_t particleCount, bool velocities) {
+            return sizeof(TrajectoryFrameHeader) + particleCount * sizeof(glm::vec3) * (velocities ? 2 : 1);
+        }
+    }
+
+    // TrajectoryWriter implementations
+    TrajectoryWriter::TrajectoryWriter()
+        : file(nullptr), frameSize(0), decimation(1), frameCount(0), stallTime(0.0), current(-1), stopping(false), failed(false) {}
+
+    TrajectoryWriter::~TrajectoryWriter() {
+        close();
+    }
+
+    bool TrajectoryWriter::open(const std::string& path, size_t particleCount, bool velocities, unsigned long long decimation,
+        size_t chunkSize, unsigned bufferCount) {
+
+        close();
+
+        file = std::fopen(path.c_str(), "wb");
+        if (!file) return false;
+
+        // the chunks are already large, skip the stdio buffer
+        std::setvbuf(file, nullptr, _IONBF, 0);
+
+        std::memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+        header.version = TRAJECTORY_VERSION;
+        header.flags = velocities ? TRAJECTORY_VELOCITIES : 0;
+        header.particleCount = particleCount;
+        header.frameCount = 0;
+
+        failed = std::fwrite(&header, sizeof(header), 1, file) != 1;
+        stopping = false;
+
+        this->decimation = std::max(1ull, decimation);
+        frameSize = trajectoryFrameSize(particleCount, velocities);
+        frameCount = 0;
+        stallTime = 0.0;
+
+        const size_t framesPerChunk = std::max<size_t>(1, chunkSize / frameSize);
+        buffers.resize(std::max(1u, bufferCount));
+        for (unsigned i = 0; i < buffers.size(); i++) {
+            buffers[i].data.resize(framesPerChunk * frameSize);
+            buffers[i].used = 0;
+            freeBuffers.push_back(i);
+        }
+
+        ioThread = std::thread(&TrajectoryWriter::ioLoop, this);
+        return !failed;
+    }
+
+    unsigned char* TrajectoryWriter::beginFrame(unsigned long long step, double time) {
+        if (current < 0) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (freeBuffers.empty()) {
+                // the disk is behind: wait for the I/O thread to release a buffer
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                bufferFree.wait(lock, [this]() { return !freeBuffers.empty(); });
+                stallTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            current = (int)freeBuffers.front();
+            freeBuffers.pop_front();
+        }
+
+        Buffer& buffer = buffers[current];
+        unsigned char* frame = buffer.data.data() + buffer.used;
+
+        TrajectoryFrameHeader frameHeader;
+        frameHeader.magic = TRAJECTORY_FRAME_MAGIC;
+        frameHeader.flags = header.flags;
+        frameHeader.step = step;
+        frameHeader.time = time;
+        frameHeader.particleCount = header.particleCount;
+        std::memcpy(frame, &frameHeader, sizeof(frameHeader));
+        return frame + sizeof(frameHeader);
+    }
+
+    void TrajectoryWriter::endFrame() {
+        Buffer& buffer = buffers[current];
+        buffer.used += frameSize;
+        frameCount++;
+
+        if (buffer.used + frameSize > buffer.data.size()) submitCurrent();
+    }
+
+    bool TrajectoryWriter::record(unsigned long long step, double time, const glm::vec3* positions, const glm::vec3* velocities) {
+        if (!file) return false;
+        if (step % decimation != 0) return !hasFailed();
+
+        DSIM_PROFILE_SCOPE("TrajectoryWriter::record");
+        unsigned char* frame = beginFrame(step, time);
+
+        const size_t arraySize = (size_t)header.particleCount * sizeof(glm::vec3);
+        std::memcpy(frame, positions, arraySize);
+        if (header.flags & TRAJECTORY_VELOCITIES) std::memcpy(frame + arraySize, velocities, arraySize);
+
+        endFrame();
+        return !hasFailed();
+    }
+
+    bool TrajectoryWriter::record(unsigned long long step, double time, const Physics::ParticleSystem& system) {
+        if (system.size() != header.particleCount) return false;
+        if (system.hasIdentityOrder()) return record(step, time, system.getPositions(), system.getVelocities());
+
+        if (!file) return false;
+        if (step % decimation != 0) return !hasFailed();
+
+        // a reordered system is gathered into the frame in id order, so every frame lists the particles in the same order
+        DSIM_PROFILE_SCOPE("TrajectoryWriter::record");
+        glm::vec3* frame = reinterpret_cast<glm::vec3*>(beginFrame(step, time));
+
+        const size_t count = system.size();
+        const uint32_t* indices = system.getIndices();
+        const glm::vec3* positions = system.getPositions();
+        for (size_t id = 0; id < count; id++) std::memcpy(frame + id, positions + indices[id], sizeof(glm::vec3));
+        if (header.flags & TRAJECTORY_VELOCITIES) {
+            const glm::vec3* velocities = system.getVelocities();
+            for (size_t id = 0; id < count; id++) std::memcpy(frame + count + id, velocities + indices[id], sizeof(glm::vec3));
+        }
+
+        endFrame();
+        return !hasFailed();
+    }
+
+    bool TrajectoryWriter::close() {
+        if (!file) return true;
+
+        if (current >= 0 && buffers[current].used > 0) submitCurrent();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        bufferPending.notify_one();
+        ioThread.join();
+
+        // a complete file records its frame count
+        header.frameCount = frameCount;
+        if (std::fseek(file, 0, SEEK_SET) != 0 || std::fwrite(&header, sizeof(header), 1, file) != 1) failed = true;
+        if (std::fclose(file) != 0) failed = true;
+        file = nullptr;
+
+        current = -1;
+        buffers.clear();
+        freeBuffers.clear();
+        pendingBuffers.clear();
+
+        return !failed;
+    }
+
+    bool TrajectoryWriter::isOpen() const {
+        return file != nullptr;
+    }
+
+    bool TrajectoryWriter::hasFailed() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return failed;
+    }
+
+    unsigned long long TrajectoryWriter::getFrameCount() const {
+        return frameCount;
+    }
+
+    double TrajectoryWriter::getStallTime() const {
+        return stallTime;
+    }
+
+    void TrajectoryWriter::submitCurrent() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingBuffers.push_back((unsigned)current);
+        }
+        bufferPending.notify_one();
+        current = -1;
+    }
+
+    void TrajectoryWriter::ioLoop() {
+        DSIM_PROFILE_THREAD_NAME("trajectory I/O");
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            bufferPending.wait(lock, [this]() { return stopping || !pendingBuffers.empty(); });
+            if (pendingBuffers.empty()) return; // stopping with nothing left to write
+
+            unsigned index = pendingBuffers.front();
+            pendingBuffers.pop_front();
+            Buffer& buffer = buffers[index];
+
+            // write without holding the lock, so record can keep filling the other buffers
+            const bool skip = failed;
+            lock.unlock();
+            const bool written = skip || std::fwrite(buffer.data.data(), 1, buffer.used, file) == buffer.used;
+            lock.lock();
+
+            if (!written) failed = true;
+            buffer.used = 0;
+            freeBuffers.push_back(index);
+            bufferFree.notify_one();
+        }
+    }
+
+    // TrajectoryReader implementations
+    TrajectoryReader::TrajectoryReader() : particleCount(0), frameCount(0), frameSize(0), velocities(false) {}
+
+    bool TrajectoryReader::open(const std::string& path) {
+        close();
+        if (!file.open(path)) return false;
+
+        TrajectoryHeader header;
+        if (file.size() < sizeof(header)) {
+            close();
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic)) != 0 || header.version != TRAJECTORY_VERSION) {
+            close();
+            return false;
+        }
+
+        // the count comes from the file: bound it by the file size before the frame size is computed, so that it cannot wrap
+        velocities = (header.flags & TRAJECTORY_VELOCITIES) != 0;
+        if (header.particleCount > file.size() / (sizeof(glm::vec3) * (velocities ? 2 : 1))) {
+            close();
+            return false;
+        }
+
+        particleCount = (size_t)header.particleCount;
+        frameSize = trajectoryFrameSize(particleCount, velocities);
+
+        // an unfinished file has no frame count: keep its complete frames
+        const size_t storedFrames = (file.size() - sizeof(header)) / frameSize;
+        frameCount = header.frameCount > 0 ? std::min(storedFrames, (size_t)header.frameCount) : storedFrames;
+
+        if (frameCount > 0 && (frameHeader(0)->magic != TRAJECTORY_FRAME_MAGIC || frameHeader(frameCount - 1)->magic != TRAJECTORY_FRAME_MAGIC)) {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void TrajectoryReader::close() {
+        file.close();
+        particleCount = 0;
+        frameCount = 0;
+        frameSize = 0;
+        velocities = false;
+    }
+
+    bool TrajectoryReader::isOpen() const {
+        return file.isOpen();
+    }
+
+    size_t TrajectoryReader::getParticleCount() const {
+        return particleCount;
+    }
+
+    size_t TrajectoryReader::getFrameCount() const {
+        return frameCount;
+    }
+
+    bool TrajectoryReader::hasVelocities() const {
+        return velocities;
+    }
+
+    unsigned long long TrajectoryReader::getStep(size_t frame) const {
+        return frameHeader(frame)->step;
+    }
+
+    double TrajectoryReader::getTime(size_t frame) const {
+        return frameHeader(frame)->time;
+    }
+
+    const glm::vec3* TrajectoryReader::getPositions(size_t frame) const {
+        return reinterpret_cast<const glm::vec3*>(reinterpret_cast<const unsigned char*>(frameHeader(frame)) + sizeof(TrajectoryFrameHeader));
+    }
+
+    const glm::vec3* TrajectoryReader::getVelocities(size_t frame) const {
+        if (!velocities) return nullptr;
+        return getPositions(frame) + particleCount;
+    }
+
+    const TrajectoryFrameHeader* TrajectoryReader::frameHeader(size_t frame) const {
+        return reinterpret_cast<const TrajectoryFrameHeader*>(file.data() + sizeof(TrajectoryHeader) + frame * frameSize);
+    }
+}
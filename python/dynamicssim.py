@@ -0,0 +1,349 @@
+"""Python binding of the DynamicsSim C interface (include/dynamicssim.h).
+
+The positions, velocities, masses and charges of a Simulation are NumPy views of the arrays of the simulator,
+without any copy: read them after wait(), write them between two advances. The calls reallocating the arrays
+(add_particles, clear_particles, load_scenario and close) raise SimulationError while such a view, or an array
+derived from it, is alive: delete the views, or copy them, first. Leaving a with block only cancels the advance
+then, the simulation being destroyed with its last view.
+
+    import numpy as np
+    import dynamicssim
+
+    sim = dynamicssim.Simulation(threads=8)
+    sim.add_particles(masses=np.full(1000, 1e9, np.float32), positions=np.random.uniform(-100, 100, (1000, 3)))
+    sim.add_interaction("nbody")
+    sim.integrator = "verlet"
+    sim.advance(1000, 0.001)   # returns at once, the simulator steps on its own threads
+    sim.wait()
+    print(sim.positions.mean(axis=0), sim.diagnostics()["total_energy"])
+
+The shared library is looked up in DYNAMICSSIM_LIBRARY, then next to this file and in the build directories of the repository,
+then in the system paths.
+"""
+
+import asyncio
+import ctypes
+import ctypes.util
+import os
+import sys
+import weakref
+
+import numpy as np
+
+__all__ = ["Simulation", "SimulationError", "SimulationCancelled", "load_library"]
+
+_VERSION = 1
+
+_OK = 0
+_INVALID_ARGUMENT = -1
+_CANCELLED = -4
+
+
+class SimulationError(RuntimeError):
+    """Failure reported by the simulator, with its status code."""
+
+    def __init__(self, status, message):
+        super().__init__(message)
+        self.status = status
+
+
+class SimulationCancelled(SimulationError):
+    """The advance was cancelled before its last step."""
+
+
+class _Diagnostics(ctypes.Structure):
+    _fields_ = [
+        ("time", ctypes.c_double),
+        ("kinetic_energy", ctypes.c_double),
+        ("potential_energy", ctypes.c_double),
+        ("interaction_energy", ctypes.c_double),
+        ("total_energy", ctypes.c_double),
+        ("momentum", ctypes.c_double * 3),
+        ("angular_momentum", ctypes.c_double * 3),
+    ]
+
+
+def _library_names():
+    if sys.platform == "win32":
+        return ["dynamicssim.dll"]
+    if sys.platform == "darwin":
+        return ["libdynamicssim.dylib"]
+    return ["libdynamicssim.so"]
+
+
+def _candidate_paths():
+    path = os.environ.get("DYNAMICSSIM_LIBRARY")
+    if path:
+        yield path
+
+    here = os.path.dirname(os.path.abspath(__file__))
+    directories = [here]
+    for config in ("Release", "RelWithDebInfo", "Debug", "MinSizeRel", ""):
+        directories.append(os.path.join(here, os.pardir, "build", config))
+    for directory in directories:
+        for name in _library_names():
+            yield os.path.join(directory, name)
+
+    found = ctypes.util.find_library("dynamicssim")
+    if found:
+        yield found
+
+
+_library = None
+
+
+def load_library(path=None):
+    """Load the shared library once, from path if given, and declare the signatures of its functions."""
+    global _library
+    if _library is not None and path is None:
+        return _library
+
+    candidates = [path] if path else list(_candidate_paths())
+    library = None
+    for candidate in candidates:
+        if candidate and (os.path.exists(candidate) or not os.path.dirname(candidate)):
+            try:
+                library = ctypes.CDLL(candidate)
+                break
+            except OSError:
+                continue
+    if library is None:
+        raise OSError("cannot find the DynamicsSim shared library, set DYNAMICSSIM_LIBRARY to its path")
+
+    system = ctypes.c_void_p
+    floats = ctypes.POINTER(ctypes.c_float)
+    signatures = {
+        "dsim_version": (ctypes.c_int, []),
+        "dsim_create": (system, [ctypes.c_uint]),
+        "dsim_destroy": (None, [system]),
+        "dsim_get_error": (ctypes.c_char_p, [system]),
+        "dsim_load_scenario": (ctypes.c_int, [system, ctypes.c_char_p]),
+        "dsim_save_scenario": (ctypes.c_int, [system, ctypes.c_char_p]),
+        "dsim_add_particles": (ctypes.c_int, [system, ctypes.c_size_t, floats, floats, floats, floats, floats]),
+        "dsim_clear_particles": (ctypes.c_int, [system]),
+        "dsim_add_force": (ctypes.c_int, [system, ctypes.c_char_p, floats, ctypes.c_size_t]),
+        "dsim_add_field": (ctypes.c_int, [system, ctypes.c_char_p, floats, ctypes.c_size_t]),
+        "dsim_add_interaction": (ctypes.c_int, [system, ctypes.c_char_p, floats, ctypes.c_size_t]),
+        "dsim_set_integrator": (ctypes.c_int, [system, ctypes.c_char_p]),
+        "dsim_get_integrator": (ctypes.c_char_p, [system]),
+        "dsim_advance": (ctypes.c_int, [system, ctypes.c_uint64, ctypes.c_float]),
+        "dsim_wait": (ctypes.c_int, [system]),
+        "dsim_is_running": (ctypes.c_int, [system]),
+        "dsim_cancel": (None, [system]),
+        "dsim_get_step": (ctypes.c_uint64, [system]),
+        "dsim_get_time": (ctypes.c_double, [system]),
+        "dsim_size": (ctypes.c_size_t, [system]),
+        "dsim_positions": (floats, [system]),
+        "dsim_velocities": (floats, [system]),
+        "dsim_masses": (floats, [system]),
+        "dsim_charges": (floats, [system]),
+        "dsim_compute_diagnostics": (ctypes.c_int, [system, ctypes.POINTER(_Diagnostics)]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        function = getattr(library, name)
+        function.restype = restype
+        function.argtypes = argtypes
+
+    if library.dsim_version() != _VERSION:
+        raise OSError("the DynamicsSim library implements version %d of the interface, not %d" % (library.dsim_version(), _VERSION))
+
+    _library = library
+    return library
+
+
+class _Buffer:
+    """Array of a Simulation exposed to NumPy, the base of every view of it, which keeps the simulation alive."""
+
+    def __init__(self, owner, pointer, shape):
+        self._owner = owner
+        self.__array_interface__ = {
+            "data": (ctypes.addressof(pointer.contents), False),
+            "shape": shape,
+            "typestr": np.dtype(np.float32).str,
+            "version": 3,
+        }
+
+
+def _float_array(values, count, width, name):
+    """Contiguous float32 copy of an argument with count rows of width values, or None."""
+    if values is None:
+        return None
+    array = np.ascontiguousarray(values, dtype=np.float32)
+    if array.size != count * width:
+        raise ValueError("%s must have %d values per particle" % (name, width))
+    return array.reshape(count * width)
+
+
+def _pointer(array):
+    return None if array is None else array.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+
+
+class Simulation:
+    """Particle system stepped by the simulator on its own pool of threads.
+
+    advance() returns at once; wait(), or awaiting advance_async(), blocks until the steps are taken.
+    The library releases the GIL during its calls, so other Python threads keep running meanwhile.
+    """
+
+    def __init__(self, threads=0, library=None):
+        self._library = load_library(library)
+        # the buffers of the views of the arrays, that every array derived from a view keeps alive as its base
+        self._views = weakref.WeakSet()
+        self._handle = self._library.dsim_create(threads)
+        if not self._handle:
+            raise SimulationError(-1, "cannot create the simulation")
+
+    def close(self):
+        """Destroy the simulation, cancelling its advance; raises SimulationError while a view of its arrays is alive."""
+        if getattr(self, "_handle", None):
+            self._check_views("close")
+            self._destroy()
+
+    def _destroy(self):
+        if getattr(self, "_handle", None):
+            self._library.dsim_destroy(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        # a view refers to its simulation, so none is left unless the interpreter is shutting down
+        self._destroy()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exception):
+        # views still alive, e.g. in the variables of the with block, defer the destruction to the last of them
+        if getattr(self, "_handle", None) and len(self._views):
+            self._library.dsim_cancel(self._handle)
+            self._library.dsim_wait(self._handle)
+        else:
+            self.close()
+
+    def _check_views(self, operation):
+        """Refuse an operation reallocating the arrays while they are viewed."""
+        if len(self._views):
+            raise SimulationError(_INVALID_ARGUMENT, "cannot %s the simulation while views of its arrays are alive (%d), "
+                                  "delete or copy them first" % (operation, len(self._views)))
+
+    def _check(self, status):
+        if status != _OK:
+            message = self._library.dsim_get_error(self._handle).decode("utf-8", "replace")
+            raise (SimulationCancelled if status == _CANCELLED else SimulationError)(status, message)
+
+    def load_scenario(self, path):
+        """Replace the particles, forces, fields and interactions with the ones of a scenario file."""
+        self._check_views("load a scenario into")
+        self._check(self._library.dsim_load_scenario(self._handle, os.fsencode(path)))
+
+    def save_scenario(self, path):
+        self._check(self._library.dsim_save_scenario(self._handle, os.fsencode(path)))
+
+    def add_particles(self, masses, positions=None, velocities=None, charges=None, radii=None):
+        """Append particles, the arrays omitted giving zeros; positions and velocities have 3 values per particle."""
+        masses = _float_array(masses, np.size(masses), 1, "masses")
+        count = masses.size
+        positions = _float_array(positions, count, 3, "positions")
+        velocities = _float_array(velocities, count, 3, "velocities")
+        charges = _float_array(charges, count, 1, "charges")
+        radii = _float_array(radii, count, 1, "radii")
+        self._check_views("add particles to")
+        self._check(self._library.dsim_add_particles(self._handle, count, _pointer(masses), _pointer(positions),
+                                                     _pointer(velocities), _pointer(charges), _pointer(radii)))
+
+    def clear_particles(self):
+        self._check_views("clear the particles of")
+        self._check(self._library.dsim_clear_particles(self._handle))
+
+    def _add(self, function, type, parameters):
+        values = np.ascontiguousarray(parameters, dtype=np.float32).ravel()
+        self._check(function(self._handle, type.encode("utf-8"), _pointer(values) if values.size else None, values.size))
+
+    def add_force(self, type, *parameters):
+        """Add a force applied to every particle, with the parameters of a scenario statement, e.g. add_force("air_resistance", 0.5)."""
+        self._add(self._library.dsim_add_force, type, parameters)
+
+    def add_field(self, type, *parameters):
+        self._add(self._library.dsim_add_field, type, parameters)
+
+    def add_interaction(self, type, *parameters):
+        self._add(self._library.dsim_add_interaction, type, parameters)
+
+    @property
+    def integrator(self):
+        return self._library.dsim_get_integrator(self._handle).decode("utf-8")
+
+    @integrator.setter
+    def integrator(self, name):
+        self._check(self._library.dsim_set_integrator(self._handle, name.encode("utf-8")))
+
+    def advance(self, steps, dt):
+        """Start taking steps steps of dt seconds, returning at once."""
+        self._check(self._library.dsim_advance(self._handle, steps, dt))
+
+    def wait(self):
+        """Block until the steps are taken, raising SimulationCancelled if cancel() stopped them."""
+        self._check(self._library.dsim_wait(self._handle))
+
+    async def advance_async(self, steps, dt):
+        """Take steps steps of dt seconds, awaiting them without blocking the event loop."""
+        self.advance(steps, dt)
+        await asyncio.get_running_loop().run_in_executor(None, self.wait)
+
+    def cancel(self):
+        """Stop after the step being taken, without waiting."""
+        self._library.dsim_cancel(self._handle)
+
+    @property
+    def running(self):
+        return bool(self._library.dsim_is_running(self._handle))
+
+    @property
+    def step(self):
+        return self._library.dsim_get_step(self._handle)
+
+    @property
+    def time(self):
+        return self._library.dsim_get_time(self._handle)
+
+    def __len__(self):
+        return self._library.dsim_size(self._handle)
+
+    def _view(self, function, width):
+        """NumPy view of an array of the simulator, tracked so that the calls reallocating the array refuse to while it is alive."""
+        count = len(self)
+        pointer = function(self._handle)
+        if count == 0 or not pointer:
+            return np.zeros((0, width) if width > 1 else (0,), dtype=np.float32)
+        buffer = _Buffer(self, pointer, (count, width) if width > 1 else (count,))
+        self._views.add(buffer)
+        return np.asarray(buffer)
+
+    @property
+    def positions(self):
+        return self._view(self._library.dsim_positions, 3)
+
+    @property
+    def velocities(self):
+        return self._view(self._library.dsim_velocities, 3)
+
+    @property
+    def masses(self):
+        return self._view(self._library.dsim_masses, 1)
+
+    @property
+    def charges(self):
+        return self._view(self._library.dsim_charges, 1)
+
+    def diagnostics(self):
+        """Energy, momentum and angular momentum of the current state, as a dict."""
+        result = _Diagnostics()
+        self._check(self._library.dsim_compute_diagnostics(self._handle, ctypes.byref(result)))
+        return {
+            "time": result.time,
+            "kinetic_energy": result.kinetic_energy,
+            "potential_energy": result.potential_energy,
+            "interaction_energy": result.interaction_energy,
+            "total_energy": result.total_energy,
+            "momentum": tuple(result.momentum),
+            "angular_momentum": tuple(result.angular_momentum),
+        }
@@ -0,0 +1,281 @@
+// Distributed runner: splits an N-body simulation across the ranks of an MPI job, each rank stepping the particles of its domain
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+#include <glm/glm.hpp>
+#include "diagnostics.hpp"
+#include "distributed.hpp"
+#include "nbody.hpp"
+#include "physics.hpp"
+#include "scenario.hpp"
+#include "threadpool.hpp"
+
+namespace {
+    struct Options {
+        double duration;
+        float deltaTime;
+        std::string integrator;
+        size_t bodies;
+        unsigned threads;
+        std::string scenario;
+        std::string output;
+        unsigned long long rebalanceEvery;
+        std::string diagnostics;
+        unsigned long long diagnosticsEvery;
+
+        // set on the command line, taking precedence over the settings of a scenario
+        bool durationGiven;
+        bool deltaTimeGiven;
+        bool integratorGiven;
+
+        Options() : duration(1.0), deltaTime(0.001f), integrator("verlet"), bodies(100000), threads(0), rebalanceEvery(200), diagnosticsEvery(100),
+            durationGiven(false), deltaTimeGiven(false), integratorGiven(false) {}
+    };
+
+    void printUsage(const char* program) {
+        std::cerr << "Usage: mpirun -n <ranks> " << program << " [options]\n"
+            << "  --duration <s>       simulated time (default 1)\n"
+            << "  --dt <s>             time step (default 0.001)\n"
+            << "  --integrator <name>  euler, symplectic, rk4, verlet or yoshida4 (default verlet)\n"
+            << "  --bodies <n>         size of the random cluster of mutually attracting bodies (default 100000)\n"
+            << "  --scenario <file>    load the particles, forces and settings from a scenario file instead, see include/scenario.hpp\n"
+            << "  --threads <n>        number of threads of every rank, 0 for one per hardware thread (default 0)\n"
+            << "  --rebalance-every <n>  steps between two repartitions of the particles, 0 to keep the first one (default 200)\n"
+            << "  --diagnostics <file> write the energy, momentum and angular momentum of the whole system to a CSV file\n"
+            << "  --diagnostics-every <n>  steps between two diagnostics (default 100)\n"
+            << "  --output <file>      write the final state of every particle to a CSV file, gathered on the first rank\n";
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options, std::ostream& errors) {
+        for (int i = 1; i < argc; i++) {
+            const char* option = argv[i];
+            if (std::strcmp(option, "--help") == 0) return false;
+            if (i + 1 >= argc) {
+                errors << "Missing value for " << option << "\n";
+                return false;
+            }
+
+            const char* value = argv[++i];
+            if (std::strcmp(option, "--duration") == 0) {
+                options.duration = std::atof(value);
+                options.durationGiven = true;
+            }
+            else if (std::strcmp(option, "--dt") == 0) {
+                options.deltaTime = (float)std::atof(value);
+                options.deltaTimeGiven = true;
+            }
+            else if (std::strcmp(option, "--integrator") == 0) {
+                options.integrator = value;
+                options.integratorGiven = true;
+            }
+            else if (std::strcmp(option, "--bodies") == 0) options.bodies = (size_t)std::strtoull(value, nullptr, 10);
+            else if (std::strcmp(option, "--scenario") == 0) options.scenario = value;
+            else if (std::strcmp(option, "--threads") == 0) options.threads = (unsigned)std::atoi(value);
+            else if (std::strcmp(option, "--rebalance-every") == 0) options.rebalanceEvery = std::strtoull(value, nullptr, 10);
+            else if (std::strcmp(option, "--diagnostics") == 0) options.diagnostics = value;
+            else if (std::strcmp(option, "--diagnostics-every") == 0) options.diagnosticsEvery = std::strtoull(value, nullptr, 10);
+            else if (std::strcmp(option, "--output") == 0) options.output = value;
+            else {
+                errors << "Unknown option " << option << "\n";
+                return false;
+            }
+        }
+
+        if (options.duration <= 0.0 || options.deltaTime <= 0.0f) {
+            errors << "Duration and time step must be positive\n";
+            return false;
+        }
+        if (options.diagnosticsEvery == 0) options.diagnosticsEvery = 1;
+
+        return true;
+    }
+
+    /// @brief Error stream of the first rank, the others stay silent so that every message is printed once
+    std::ostream& errorStream(int rank) {
+        static std::ofstream discarded;
+        return rank == 0 ? std::cerr : discarded;
+    }
+
+    void writeDiagnostics(std::ostream& out, unsigned long long step, const Physics::SystemDiagnostics& diagnostics) {
+        out << diagnostics.time << ',' << step << ','
+            << diagnostics.kineticEnergy << ',' << diagnostics.potentialEnergy << ',' << diagnostics.interactionEnergy << ',' << diagnostics.totalEnergy() << ','
+            << diagnostics.momentum.x << ',' << diagnostics.momentum.y << ',' << diagnostics.momentum.z << ','
+            << diagnostics.angularMomentum.x << ',' << diagnostics.angularMomentum.y << ',' << diagnostics.angularMomentum.z << '\n';
+    }
+
+    void writeState(std::ostream& out, double time, const Physics::ParticleSystem& system) {
+        const glm::vec3* positions = system.getPositions();
+        const glm::vec3* velocities = system.getVelocities();
+
+        for (size_t i = 0; i < system.size(); i++) {
+            out << time << ',' << i << ','
+                << positions[i].x << ',' << positions[i].y << ',' << positions[i].z << ','
+                << velocities[i].x << ',' << velocities[i].y << ',' << velocities[i].z << '\n';
+        }
+    }
+
+    /// @brief Run of the simulation on every rank, returning the exit status
+    int run(int argc, char** argv) {
+        Parallel::DomainDecomposition decomposition;
+        const int rank = decomposition.getRank();
+        std::ostream& errors = errorStream(rank);
+
+        Options options;
+        if (!parseOptions(argc, argv, options, errors)) {
+            if (rank == 0) printUsage(argv[0]);
+            return 1;
+        }
+
+        // every rank fills the whole system, then keeps its share
+        Physics::ParticleSystem system;
+        Storage::Scenario scenario;
+        if (!options.scenario.empty()) {
+            if (!scenario.load(options.scenario, system)) {
+                errors << "Failed to load " << options.scenario << ": " << scenario.getError() << "\n";
+                return 1;
+            }
+            if (!options.durationGiven && scenario.settings.duration > 0.0) options.duration = scenario.settings.duration;
+            if (!options.deltaTimeGiven && scenario.settings.deltaTime > 0.0f) options.deltaTime = scenario.settings.deltaTime;
+            if (!options.integratorGiven && !scenario.settings.integrator.empty()) options.integrator = scenario.settings.integrator;
+        }
+
+        // the adaptive method would choose different steps on every rank
+        Propagation::SystemIntegrator integrator = options.integrator == "dp45" ? nullptr : Propagation::findSystemIntegrator(options.integrator);
+        if (!integrator) {
+            errors << "Integrator " << options.integrator << " cannot be distributed\n";
+            if (rank == 0) printUsage(argv[0]);
+            return 1;
+        }
+
+        Physics::NBodyInteraction gravity(Physics::NBodyInteraction::Gravitational, Physics::NBodyInteraction::BarnesHut, 0.5f, 0.1f);
+        const Physics::NBodyInteraction* nbody = nullptr;
+
+        if (options.scenario.empty()) {
+            // same collapsing sphere as the headless runner, generated identically on every rank
+            std::mt19937 generator(42);
+            std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+
+            system.reserve(options.bodies);
+            while (system.size() < options.bodies) {
+                glm::vec3 position(coordinate(generator), coordinate(generator), coordinate(generator));
+                if (glm::dot(position, position) <= 1.0f) system.addParticle(1.0e9f, 100.0f * position, glm::vec3(0.0f));
+            }
+            nbody = &gravity;
+        }
+        else {
+            for (const Physics::Interaction* interaction : system.getInteractions()) {
+                const Physics::NBodyInteraction* candidate = dynamic_cast<const Physics::NBodyInteraction*>(interaction);
+                if (!candidate || nbody) {
+                    errors << "Only a single N-body interaction can be distributed\n";
+                    return 1;
+                }
+                nbody = candidate;
+            }
+            if (nbody) system.removeInteraction(*nbody);
+        }
+
+        Parallel::ThreadPool pool(options.threads);
+        std::vector<uint64_t> ids;
+        decomposition.scatter(system, ids);
+        decomposition.rebalance(system, ids, &pool);
+
+        // without an interaction the ranks simply step their own particles
+        std::unique_ptr<Physics::DistributedNBodyInteraction> distributed;
+        if (nbody) {
+            distributed.reset(new Physics::DistributedNBodyInteraction(*nbody, decomposition));
+            system.addInteraction(*distributed);
+        }
+
+        // the diagnostics are collective, every rank computes its share and the first one writes the sums
+        std::ofstream diagnostics;
+        if (!options.diagnostics.empty() && rank == 0) {
+            diagnostics.open(options.diagnostics.c_str());
+            if (!diagnostics) errors << "Failed to open " << options.diagnostics << "\n";
+            diagnostics.precision(12);
+            diagnostics << "time,step,kinetic,potential,interaction,total,px,py,pz,lx,ly,lz\n";
+        }
+
+        Physics::SystemDiagnostics first, latest;
+        if (!options.diagnostics.empty()) {
+            first = latest = decomposition.reduce(Physics::computeDiagnostics(system, 0.0f, &pool));
+            if (rank == 0) writeDiagnostics(diagnostics, 0, first);
+        }
+
+        // tolerate the rounding of the float time step, e.g. 0.1 / 0.01f
+        const unsigned long long steps = (unsigned long long)std::ceil(options.duration / options.deltaTime * (1.0 - 1e-6));
+        size_t migrated = 0;
+
+        MPI_Barrier(decomposition.getCommunicator());
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned long long step = 0; step < steps; step++) {
+            integrator(system, (float)(step * (double)options.deltaTime), options.deltaTime, pool);
+
+            if (options.rebalanceEvery > 0 && (step + 1) % options.rebalanceEvery == 0 && step + 1 < steps) {
+                decomposition.rebalance(system, ids, &pool);
+                migrated += decomposition.getLastMigrated();
+            }
+
+            // the last state is always sampled, so the drift covers the whole run
+            if (!options.diagnostics.empty() && ((step + 1) % options.diagnosticsEvery == 0 || step + 1 == steps)) {
+                latest = decomposition.reduce(Physics::computeDiagnostics(system, (float)((step + 1) * (double)options.deltaTime), &pool));
+                if (rank == 0) writeDiagnostics(diagnostics, step + 1, latest);
+            }
+        }
+        MPI_Barrier(decomposition.getCommunicator());
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const double endTime = steps * (double)options.deltaTime;
+        const uint64_t particles = decomposition.sum(system.size());
+        const size_t imported = distributed ? distributed->getLastImported() : 0;
+        const uint64_t totalImported = decomposition.sum(imported);
+
+        if (!options.output.empty()) {
+            Physics::ParticleSystem gathered;
+            decomposition.gather(system, ids, gathered);
+
+            if (rank == 0) {
+                std::ofstream output(options.output.c_str());
+                if (!output) {
+                    errors << "Failed to open " << options.output << "\n";
+                    return 1;
+                }
+                output << "time,particle,x,y,z,vx,vy,vz\n";
+                writeState(output, endTime, gathered);
+            }
+        }
+
+        if (rank == 0) {
+            std::cout << "integrator: " << options.integrator << ", particles: " << particles << ", ranks: " << decomposition.getSize()
+                << ", threads per rank: " << pool.getThreadCount() << "\n"
+                << "steps: " << steps << ", simulated time: " << endTime << " s\n"
+                << "wall time: " << elapsed << " s, " << steps / elapsed << " steps/s\n"
+                << "migrated particles: " << migrated << ", imported sources per step: " << totalImported << "\n";
+            if (!options.diagnostics.empty() && first.totalEnergy() != 0.0) {
+                std::cout << "relative energy drift: " << (latest.totalEnergy() - first.totalEnergy()) / std::abs(first.totalEnergy()) << "\n";
+            }
+        }
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    // only the main thread of every rank calls MPI, the workers of the pool compute
+    int provided = 0;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    const int status = run(argc, argv);
+
+    MPI_Finalize();
+    return status;
+}
@@ -0,0 +1,324 @@
+// Ensemble runner: advances many independent copies of a small system in lockstep, sweeping their force parameters
+// and initial conditions, and summarizes the results over the members
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "ensemble.hpp"
+#include "physics.hpp"
+#include "profiler.hpp"
+#include "scenario.hpp"
+#include "threadpool.hpp"
+
+namespace {
+    /// @brief Values of a force parameter across the members, evenly spaced or drawn uniformly at random
+    struct Sweep {
+        size_t force;
+        int parameter;
+        float from;
+        float to;
+        bool random;
+    };
+
+    struct Options {
+        double duration;
+        float deltaTime;
+        std::string integrator;
+        size_t members;
+        unsigned threads;
+        std::string scenario;
+        std::string output;
+        std::vector<Sweep> sweeps;
+        float positionJitter;
+        float velocityJitter;
+        unsigned seed;
+        std::string profile;
+
+        // set on the command line, taking precedence over the settings of a scenario
+        bool durationGiven;
+        bool deltaTimeGiven;
+        bool integratorGiven;
+
+        Options() : duration(10.0), deltaTime(0.001f), integrator("rk4"), members(1024), threads(0), positionJitter(0.0f), velocityJitter(0.0f), seed(42),
+            durationGiven(false), deltaTimeGiven(false), integratorGiven(false) {}
+    };
+
+    void printUsage(const char* program) {
+        std::cerr << "Usage: " << program << " [options]\n"
+            << "  --members <n>        number of members of the ensemble (default 1024)\n"
+            << "  --scenario <file>    system copied into every member, see include/scenario.hpp (default: a damped spring)\n"
+            << "  --sweep <f>:<k>:<from>:<to>   spread parameter k of force f evenly from the first to the last member\n"
+            << "  --sample <f>:<k>:<from>:<to>  draw parameter k of force f uniformly in [from, to] for every member\n"
+            << "  --position-jitter <s>  add a normal perturbation of standard deviation s to the initial positions\n"
+            << "  --velocity-jitter <s>  add a normal perturbation of standard deviation s to the initial velocities\n"
+            << "  --seed <n>           seed of the random sampling (default 42)\n"
+            << "  --duration <s>       simulated time (default 10)\n"
+            << "  --dt <s>             time step (default 0.001)\n"
+            << "  --integrator <name>  euler, symplectic, verlet or rk4 (default rk4)\n"
+            << "  --threads <n>        number of threads, 0 for one per hardware thread (default 0)\n"
+            << "  --output <file>      write the parameters and the final results of every member to a CSV file\n"
+            << "  --profile <file>     write a Chrome trace of the run, needs a build with DYNAMICSSIM_ENABLE_PROFILER\n"
+            << "The forces are numbered in the order they are listed at start, as in the ensemble.\n";
+    }
+
+    bool parseSweep(const char* value, bool random, Sweep& sweep) {
+        unsigned long force = 0;
+        int parameter = 0;
+        if (std::sscanf(value, "%lu:%d:%f:%f", &force, &parameter, &sweep.from, &sweep.to) != 4) return false;
+        if (parameter < 0 || parameter >= Physics::ForceDescriptor::MAX_PARAMETERS) return false;
+
+        sweep.force = (size_t)force;
+        sweep.parameter = parameter;
+        sweep.random = random;
+        return true;
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; i++) {
+            const char* option = argv[i];
+            if (std::strcmp(option, "--help") == 0) return false;
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << option << "\n";
+                return false;
+            }
+
+            const char* value = argv[++i];
+            if (std::strcmp(option, "--duration") == 0) {
+                options.duration = std::atof(value);
+                options.durationGiven = true;
+            }
+            else if (std::strcmp(option, "--dt") == 0) {
+                options.deltaTime = (float)std::atof(value);
+                options.deltaTimeGiven = true;
+            }
+            else if (std::strcmp(option, "--integrator") == 0) {
+                options.integrator = value;
+                options.integratorGiven = true;
+            }
+            else if (std::strcmp(option, "--sweep") == 0 || std::strcmp(option, "--sample") == 0) {
+                Sweep sweep;
+                if (!parseSweep(value, std::strcmp(option, "--sample") == 0, sweep)) {
+                    std::cerr << "Invalid " << option << " " << value << ", expected <force>:<parameter>:<from>:<to>\n";
+                    return false;
+                }
+                options.sweeps.push_back(sweep);
+            }
+            else if (std::strcmp(option, "--members") == 0) options.members = (size_t)std::strtoull(value, nullptr, 10);
+            else if (std::strcmp(option, "--scenario") == 0) options.scenario = value;
+            else if (std::strcmp(option, "--position-jitter") == 0) options.positionJitter = (float)std::atof(value);
+            else if (std::strcmp(option, "--velocity-jitter") == 0) options.velocityJitter = (float)std::atof(value);
+            else if (std::strcmp(option, "--seed") == 0) options.seed = (unsigned)std::strtoul(value, nullptr, 10);
+            else if (std::strcmp(option, "--threads") == 0) options.threads = (unsigned)std::atoi(value);
+            else if (std::strcmp(option, "--output") == 0) options.output = value;
+            else if (std::strcmp(option, "--profile") == 0) options.profile = value;
+            else {
+                std::cerr << "Unknown option " << option << "\n";
+                return false;
+            }
+        }
+
+        if (options.duration <= 0.0 || options.deltaTime <= 0.0f) {
+            std::cerr << "Duration and time step must be positive\n";
+            return false;
+        }
+        if (options.members == 0) {
+            std::cerr << "The ensemble needs at least one member\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    const char* typeName(uint32_t type) {
+        for (size_t i = 0; i < Storage::SCENARIO_TYPE_COUNT; i++) {
+            if (Storage::SCENARIO_TYPES[i].type == type) return Storage::SCENARIO_TYPES[i].name;
+        }
+        return "unknown";
+    }
+
+    void printSummary(const char* name, const std::vector<double>& values) {
+        const Physics::EnsembleSummary summary = Physics::summarize(values.data(), values.size());
+        std::cout << "  " << std::left << std::setw(22) << name << std::right
+            << std::setw(14) << summary.mean << std::setw(14) << summary.standardDeviation
+            << std::setw(14) << summary.minimum << std::setw(14) << summary.lowerQuantile << std::setw(14) << summary.median
+            << std::setw(14) << summary.upperQuantile << std::setw(14) << summary.maximum << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Physics::ParticleSystem prototype;
+    Storage::Scenario scenario;
+    if (!options.scenario.empty()) {
+        if (!scenario.load(options.scenario, prototype)) {
+            std::cerr << "Failed to load " << options.scenario << ": " << scenario.getError() << "\n";
+            return 1;
+        }
+        if (!options.durationGiven && scenario.settings.duration > 0.0) options.duration = scenario.settings.duration;
+        if (!options.deltaTimeGiven && scenario.settings.deltaTime > 0.0f) options.deltaTime = scenario.settings.deltaTime;
+        if (!options.integratorGiven && !scenario.settings.integrator.empty()) options.integrator = scenario.settings.integrator;
+    }
+
+    Propagation::EnsembleMethod method;
+    if (!Propagation::findEnsembleMethod(options.integrator, method)) {
+        std::cerr << "Integrator " << options.integrator << " is not available for ensembles\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // a damped spring, the parameters to sweep being its spring constant (force 0) and its drag coefficient (force 1)
+    Physics::HookeForce spring(4.0f);
+    Physics::AirResistanceForce drag(0.1f);
+    if (options.scenario.empty()) {
+        prototype.addParticle(1.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+        prototype.appliedForces.addForce(spring);
+        prototype.appliedForces.addForce(drag);
+    }
+
+    Physics::Ensemble ensemble;
+    if (!ensemble.assign(prototype, options.members)) {
+        std::cerr << "The system uses a force, field or interaction which is not supported by the ensembles\n";
+        return 1;
+    }
+
+    std::cout << "forces:";
+    for (size_t force = 0; force < ensemble.getForceCount(); force++) std::cout << " " << force << " " << typeName(ensemble.getForce(force).type);
+    std::cout << "\n";
+
+    // parameters and initial conditions of the members
+    std::mt19937 generator(options.seed);
+    for (const Sweep& sweep : options.sweeps) {
+        if (sweep.force >= ensemble.getForceCount()) {
+            std::cerr << "No force " << sweep.force << " to sweep\n";
+            return 1;
+        }
+
+        std::uniform_real_distribution<float> uniform(sweep.from, sweep.to);
+        for (size_t member = 0; member < ensemble.getMemberCount(); member++) {
+            const float fraction = ensemble.getMemberCount() > 1 ? (float)member / (ensemble.getMemberCount() - 1) : 0.0f;
+            const float value = sweep.random ? uniform(generator) : sweep.from + fraction * (sweep.to - sweep.from);
+            ensemble.setForceParameter(sweep.force, member, sweep.parameter, value);
+        }
+    }
+
+    if (options.positionJitter > 0.0f || options.velocityJitter > 0.0f) {
+        std::normal_distribution<float> positionNoise(0.0f, options.positionJitter > 0.0f ? options.positionJitter : 1.0f);
+        std::normal_distribution<float> velocityNoise(0.0f, options.velocityJitter > 0.0f ? options.velocityJitter : 1.0f);
+
+        for (size_t member = 0; member < ensemble.getMemberCount(); member++) {
+            for (size_t particle = 0; particle < ensemble.getParticleCount(); particle++) {
+                if (options.positionJitter > 0.0f) {
+                    glm::vec3 noise(positionNoise(generator), positionNoise(generator), positionNoise(generator));
+                    ensemble.setPosition(member, particle, ensemble.getPosition(member, particle) + noise);
+                }
+                if (options.velocityJitter > 0.0f) {
+                    glm::vec3 noise(velocityNoise(generator), velocityNoise(generator), velocityNoise(generator));
+                    ensemble.setVelocity(member, particle, ensemble.getVelocity(member, particle) + noise);
+                }
+            }
+        }
+    }
+
+    if (!options.profile.empty() && !Profiling::isEnabled()) {
+        std::cerr << "Built without DYNAMICSSIM_ENABLE_PROFILER, " << options.profile << " will not be written\n";
+    }
+    DSIM_PROFILE_THREAD_NAME("main");
+
+    Parallel::ThreadPool pool(options.threads);
+
+    const size_t memberCount = ensemble.getMemberCount();
+    std::vector<double> initialKinetic(memberCount), initialPotential(memberCount);
+    Physics::computeEnsembleEnergies(ensemble, 0.0f, initialKinetic.data(), initialPotential.data(), &pool);
+
+    // tolerate the rounding of the float time step, e.g. 0.1 / 0.01f
+    const unsigned long long steps = (unsigned long long)std::ceil(options.duration / options.deltaTime * (1.0 - 1e-6));
+    const double endTime = steps * (double)options.deltaTime;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Propagation::advance(ensemble, method, 0.0, options.deltaTime, steps, &pool);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // final results of every member
+    std::vector<double> kinetic(memberCount), potential(memberCount), total(memberCount), drift(memberCount), centerDistance(memberCount);
+    Physics::computeEnsembleEnergies(ensemble, (float)endTime, kinetic.data(), potential.data(), &pool);
+
+    std::vector<glm::dvec3> centers(memberCount, glm::dvec3(0.0));
+    for (size_t member = 0; member < memberCount; member++) {
+        total[member] = kinetic[member] + potential[member];
+        const double initialTotal = initialKinetic[member] + initialPotential[member];
+        drift[member] = initialTotal != 0.0 ? (total[member] - initialTotal) / std::abs(initialTotal) : 0.0;
+
+        double mass = 0.0;
+        for (size_t particle = 0; particle < ensemble.getParticleCount(); particle++) {
+            centers[member] = centers[member] + (double)ensemble.getMass(member, particle) * glm::dvec3(ensemble.getPosition(member, particle));
+            mass += ensemble.getMass(member, particle);
+        }
+        if (mass != 0.0) centers[member] = centers[member] / mass;
+        centerDistance[member] = std::sqrt(glm::dot(centers[member], centers[member]));
+    }
+
+    if (!options.output.empty()) {
+        std::ofstream output(options.output.c_str());
+        if (!output) {
+            std::cerr << "Failed to open " << options.output << "\n";
+            return 1;
+        }
+        output.precision(9);
+
+        output << "member";
+        for (const Sweep& sweep : options.sweeps) output << ",f" << sweep.force << "_p" << sweep.parameter;
+        output << ",kinetic,potential,total,energy_drift,cx,cy,cz\n";
+
+        for (size_t member = 0; member < memberCount; member++) {
+            output << member;
+            for (const Sweep& sweep : options.sweeps) output << ',' << ensemble.getForceParameter(sweep.force, member, sweep.parameter);
+            output << ',' << kinetic[member] << ',' << potential[member] << ',' << total[member] << ',' << drift[member] << ','
+                << centers[member].x << ',' << centers[member].y << ',' << centers[member].z << '\n';
+        }
+        if (!output) {
+            std::cerr << "Failed to write " << options.output << "\n";
+            return 1;
+        }
+    }
+
+    const double particleSteps = (double)memberCount * ensemble.getParticleCount() * steps;
+    std::cout << "integrator: " << options.integrator << ", members: " << memberCount << ", particles per member: " << ensemble.getParticleCount()
+        << ", threads: " << pool.getThreadCount() << "\n"
+        << "steps: " << steps << ", simulated time: " << endTime << " s\n"
+        << "wall time: " << elapsed << " s, " << elapsed * 1e9 / particleSteps << " ns per particle step\n";
+
+    std::cout << "  " << std::left << std::setw(22) << "final" << std::right;
+    const char* columns[] = { "mean", "std dev", "min", "5%", "median", "95%", "max" };
+    for (const char* column : columns) std::cout << std::setw(14) << column;
+    std::cout << "\n";
+    printSummary("kinetic energy", kinetic);
+    printSummary("potential energy", potential);
+    printSummary("total energy", total);
+    printSummary("relative energy drift", drift);
+    printSummary("center of mass |r|", centerDistance);
+
+    if (!options.profile.empty() && Profiling::isEnabled()) {
+        Profiling::writeSummary(std::cout);
+        if (!Profiling::writeChromeTrace(options.profile)) {
+            std::cerr << "Failed to write " << options.profile << "\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
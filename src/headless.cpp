@@ -0,0 +1,378 @@
+// Headless runner: steps a simulation as fast as possible, without a window, and writes the results
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+#include <glm/glm.hpp>
+#include "checkpoint.hpp"
+#include "collision.hpp"
+#include "diagnostics.hpp"
+#include "morton.hpp"
+#include "nbody.hpp"
+#include "physics.hpp"
+#include "precision.hpp"
+#include "profiler.hpp"
+#include "scenario.hpp"
+#include "threadpool.hpp"
+#include "trajectory.hpp"
+
+namespace {
+    struct Options {
+        double duration;
+        float deltaTime;
+        std::string integrator;
+        std::string precision;
+        size_t bodies;
+        unsigned threads;
+        std::string output;
+        std::string trajectory;
+        unsigned long long outputEvery;
+        std::string checkpoint;
+        unsigned long long checkpointEvery;
+        std::string restart;
+        std::string profile;
+        std::string diagnostics;
+        unsigned long long diagnosticsEvery;
+        std::string scenario;
+        unsigned long long reorderEvery;
+        float radius;
+        float restitution;
+
+        // set on the command line, taking precedence over the settings of a scenario
+        bool durationGiven;
+        bool deltaTimeGiven;
+        bool integratorGiven;
+        bool precisionGiven;
+
+        Options() : duration(100.0), deltaTime(0.001f), integrator("rk4"), precision("single"), bodies(0), threads(0), outputEvery(100), checkpointEvery(0), diagnosticsEvery(100), reorderEvery(0), radius(0.0f), restitution(1.0f),
+            durationGiven(false), deltaTimeGiven(false), integratorGiven(false), precisionGiven(false) {}
+    };
+
+    void printUsage(const char* program) {
+        std::cerr << "Usage: " << program << " [options]\n"
+            << "  --duration <s>       simulated time (default 100)\n"
+            << "  --dt <s>             time step (default 0.001)\n"
+            << "  --integrator <name>  euler, symplectic, rk4, verlet, yoshida4 or dp45 (default rk4)\n"
+            << "  --precision <name>   single, double or mixed (double state, float forces), see include/precision.hpp (default single)\n"
+            << "  --bodies <n>         simulate a random cluster of n mutually attracting bodies instead of the Sun-Earth orbit\n"
+            << "  --scenario <file>    load the particles, forces and settings from a scenario file instead, see include/scenario.hpp\n"
+            << "  --radius <r>         radius of the bodies, resolving their collisions after every step (default 0, no collisions)\n"
+            << "  --restitution <e>    coefficient of restitution of the collisions (default 1)\n"
+            << "  --threads <n>        number of threads, 0 for one per hardware thread (default 0)\n"
+            << "  --reorder-every <n>  steps between two reorderings of the particles along the Morton curve, 0 never (default 0)\n"
+            << "  --output <file>      write the state of every particle to a CSV file\n"
+            << "  --trajectory <file>  stream the state of every particle to a binary trajectory file\n"
+            << "  --output-every <n>   steps between two outputs (default 100)\n"
+            << "  --checkpoint <file>  save the simulation state at the end of the run\n"
+            << "  --checkpoint-every <n>  also save it every n steps\n"
+            << "  --restart <file>     resume the run from a checkpoint, the duration includes the steps already taken\n"
+            << "  --diagnostics <file> write the energy, momentum and angular momentum of the system to a CSV file\n"
+            << "  --diagnostics-every <n>  steps between two diagnostics (default 100)\n"
+            << "  --profile <file>     write a Chrome trace of the run, needs a build with DYNAMICSSIM_ENABLE_PROFILER\n";
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; i++) {
+            const char* option = argv[i];
+            if (std::strcmp(option, "--help") == 0) return false;
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << option << "\n";
+                return false;
+            }
+
+            const char* value = argv[++i];
+            if (std::strcmp(option, "--duration") == 0) {
+                options.duration = std::atof(value);
+                options.durationGiven = true;
+            }
+            else if (std::strcmp(option, "--dt") == 0) {
+                options.deltaTime = (float)std::atof(value);
+                options.deltaTimeGiven = true;
+            }
+            else if (std::strcmp(option, "--integrator") == 0) {
+                options.integrator = value;
+                options.integratorGiven = true;
+            }
+            else if (std::strcmp(option, "--precision") == 0) {
+                options.precision = value;
+                options.precisionGiven = true;
+            }
+            else if (std::strcmp(option, "--scenario") == 0) options.scenario = value;
+            else if (std::strcmp(option, "--bodies") == 0) options.bodies = (size_t)std::strtoull(value, nullptr, 10);
+            else if (std::strcmp(option, "--radius") == 0) options.radius = (float)std::atof(value);
+            else if (std::strcmp(option, "--restitution") == 0) options.restitution = (float)std::atof(value);
+            else if (std::strcmp(option, "--threads") == 0) options.threads = (unsigned)std::atoi(value);
+            else if (std::strcmp(option, "--reorder-every") == 0) options.reorderEvery = std::strtoull(value, nullptr, 10);
+            else if (std::strcmp(option, "--output") == 0) options.output = value;
+            else if (std::strcmp(option, "--trajectory") == 0) options.trajectory = value;
+            else if (std::strcmp(option, "--output-every") == 0) options.outputEvery = std::strtoull(value, nullptr, 10);
+            else if (std::strcmp(option, "--checkpoint") == 0) options.checkpoint = value;
+            else if (std::strcmp(option, "--checkpoint-every") == 0) options.checkpointEvery = std::strtoull(value, nullptr, 10);
+            else if (std::strcmp(option, "--restart") == 0) options.restart = value;
+            else if (std::strcmp(option, "--profile") == 0) options.profile = value;
+            else if (std::strcmp(option, "--diagnostics") == 0) options.diagnostics = value;
+            else if (std::strcmp(option, "--diagnostics-every") == 0) options.diagnosticsEvery = std::strtoull(value, nullptr, 10);
+            else {
+                std::cerr << "Unknown option " << option << "\n";
+                return false;
+            }
+        }
+
+        if (options.duration <= 0.0 || options.deltaTime <= 0.0f) {
+            std::cerr << "Duration and time step must be positive\n";
+            return false;
+        }
+        if (options.outputEvery == 0) options.outputEvery = 1;
+
+        return true;
+    }
+
+    bool saveCheckpoint(const std::string& path, double time, unsigned long long step, const Physics::ParticleSystem& system) {
+        Storage::CheckpointWriter writer;
+        return writer.open(path) && writer.writeClock(time, step) && writer.writeSystem(system) && writer.commit();
+    }
+
+    void writeDiagnostics(std::ostream& out, unsigned long long step, const Physics::SystemDiagnostics& diagnostics) {
+        out << diagnostics.time << ',' << step << ','
+            << diagnostics.kineticEnergy << ',' << diagnostics.potentialEnergy << ',' << diagnostics.interactionEnergy << ',' << diagnostics.totalEnergy() << ','
+            << diagnostics.momentum.x << ',' << diagnostics.momentum.y << ',' << diagnostics.momentum.z << ','
+            << diagnostics.angularMomentum.x << ',' << diagnostics.angularMomentum.y << ',' << diagnostics.angularMomentum.z << '\n';
+    }
+
+    /// @brief Write the state of every particle in the order of their ids, which the reorderings keep
+    void writeState(std::ostream& out, double time, const Physics::ParticleSystem& system) {
+        const glm::vec3* positions = system.getPositions();
+        const glm::vec3* velocities = system.getVelocities();
+
+        for (uint32_t id = 0; id < system.size(); id++) {
+            const size_t i = system.getIndex(id);
+            out << time << ',' << id << ','
+                << positions[i].x << ',' << positions[i].y << ',' << positions[i].z << ','
+                << velocities[i].x << ',' << velocities[i].y << ',' << velocities[i].z << '\n';
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Physics::ParticleSystem system;
+    Storage::Scenario scenario;
+    if (!options.scenario.empty()) {
+        if (!scenario.load(options.scenario, system)) {
+            std::cerr << "Failed to load " << options.scenario << ": " << scenario.getError() << "\n";
+            return 1;
+        }
+        if (!options.durationGiven && scenario.settings.duration > 0.0) options.duration = scenario.settings.duration;
+        if (!options.deltaTimeGiven && scenario.settings.deltaTime > 0.0f) options.deltaTime = scenario.settings.deltaTime;
+        if (!options.integratorGiven && !scenario.settings.integrator.empty()) options.integrator = scenario.settings.integrator;
+        if (!options.precisionGiven && !scenario.settings.precision.empty()) options.precision = scenario.settings.precision;
+    }
+
+    Propagation::SystemIntegrator integrator = Propagation::findSystemIntegrator(options.integrator);
+    if (!integrator) {
+        std::cerr << "Unknown integrator " << options.integrator << "\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Physics::Precision precision;
+    if (!Physics::findPrecision(options.precision, precision)) {
+        std::cerr << "Unknown precision " << options.precision << "\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (!options.profile.empty() && !Profiling::isEnabled()) {
+        std::cerr << "Built without DYNAMICSSIM_ENABLE_PROFILER, " << options.profile << " will not be written\n";
+    }
+    DSIM_PROFILE_THREAD_NAME("main");
+
+    Parallel::ThreadPool pool(options.threads);
+
+    // same orbit as the viewer
+    const float earthMass = 5.97219e8f; // mass of Earth in kg / 1e16
+    Physics::GravitationalForce sunGravity(1.98847e14f, earthMass); // mass of Sun in kg / 1e16
+    Physics::NBodyInteraction gravity(Physics::NBodyInteraction::Gravitational, Physics::NBodyInteraction::Automatic, 0.5f, 0.1f);
+
+    // a scenario already filled the system
+    if (options.scenario.empty() && options.bodies == 0) {
+        system.addParticle(earthMass, glm::vec3(20.0f, 20.0f, 0.0f), glm::vec3(0.0f, -20.0f, 0.0f));
+        system.appliedForces.addForce(sunGravity);
+    }
+    else if (options.scenario.empty()) {
+        // uniform sphere of bodies at rest, collapsing under their own gravity
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+
+        system.reserve(options.bodies);
+        while (system.size() < options.bodies) {
+            glm::vec3 position(coordinate(generator), coordinate(generator), coordinate(generator));
+            if (glm::dot(position, position) <= 1.0f) system.addParticle(1.0e9f, 100.0f * position, glm::vec3(0.0f), 0.0f, options.radius);
+        }
+        system.addInteraction(gravity);
+    }
+
+    unsigned long long firstStep = 0;
+    Storage::CheckpointObjects restored;
+    if (!options.restart.empty()) {
+        Storage::Checkpoint checkpoint;
+        if (!checkpoint.open(options.restart) || !checkpoint.restoreSystem(0, system, restored)) {
+            std::cerr << "Failed to restore " << options.restart << "\n";
+            return 1;
+        }
+        firstStep = checkpoint.getStep();
+    }
+    const double firstTime = firstStep * (double)options.deltaTime;
+
+    // double and mixed precision keep their own state, rounded into the system after every step for the outputs
+    std::unique_ptr<Propagation::PrecisionStepper> stepper;
+    if (precision != Physics::Precision::Single) {
+        stepper = Propagation::createPrecisionStepper(precision, options.integrator, system);
+        if (!stepper) {
+            std::cerr << "Integrator " << options.integrator << " is not available in " << Physics::getPrecisionName(precision) << " precision\n";
+            return 1;
+        }
+    }
+
+    // the stepper keeps the double state in the order it was created with
+    if (stepper && options.reorderEvery > 0) {
+        std::cerr << "Reordering is not available in " << Physics::getPrecisionName(precision) << " precision, --reorder-every is ignored\n";
+        options.reorderEvery = 0;
+    }
+
+    // a checkpoint holds the float state, a run resumed from it would not continue the double one
+    if (stepper && !options.checkpoint.empty()) {
+        if (options.checkpointEvery > 0) {
+            std::cerr << "Intermediate checkpoints are not available in " << Physics::getPrecisionName(precision) << " precision, --checkpoint-every is ignored\n";
+            options.checkpointEvery = 0;
+        }
+        std::cerr << "The checkpoint stores the state rounded to float, a run restarted from it loses the " << Physics::getPrecisionName(precision) << " precision state\n";
+    }
+
+    Physics::CollisionSolver collisions(options.restitution);
+    const bool colliding = options.scenario.empty()
+        ? options.bodies > 0 && options.radius > 0.0f
+        : std::any_of(system.getRadii(), system.getRadii() + system.size(), [](float radius) { return radius > 0.0f; });
+    size_t contacts = 0;
+
+    std::ofstream output;
+    if (!options.output.empty()) {
+        output.open(options.output.c_str());
+        if (!output) {
+            std::cerr << "Failed to open " << options.output << "\n";
+            return 1;
+        }
+        output << "time,particle,x,y,z,vx,vy,vz\n";
+        writeState(output, firstTime, system);
+    }
+
+    Physics::DiagnosticsMonitor monitor(options.diagnosticsEvery);
+    std::ofstream diagnostics;
+    if (!options.diagnostics.empty()) {
+        diagnostics.open(options.diagnostics.c_str());
+        if (!diagnostics) {
+            std::cerr << "Failed to open " << options.diagnostics << "\n";
+            return 1;
+        }
+        diagnostics.precision(12);
+        diagnostics << "time,step,kinetic,potential,interaction,total,px,py,pz,lx,ly,lz\n";
+        monitor.sample(firstTime, system, &pool);
+        writeDiagnostics(diagnostics, firstStep, monitor.getLatest());
+    }
+
+    Storage::TrajectoryWriter trajectory;
+    if (!options.trajectory.empty()) {
+        if (!trajectory.open(options.trajectory, system.size(), true, options.outputEvery)) {
+            std::cerr << "Failed to open " << options.trajectory << "\n";
+            return 1;
+        }
+        trajectory.record(firstStep, firstTime, system);
+    }
+
+    // tolerate the rounding of the float time step, e.g. 0.1 / 0.01f
+    const unsigned long long steps = (unsigned long long)std::ceil(options.duration / options.deltaTime * (1.0 - 1e-6));
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned long long step = firstStep; step < steps; step++) {
+        DSIM_PROFILE_SCOPE("step");
+        // before the step, so that a run resumed from a checkpoint reorders at the same steps
+        if (options.reorderEvery > 0 && step % options.reorderEvery == 0) Physics::reorderByMortonKey(system, &pool);
+        // the time is computed from the step count, so it does not accumulate rounding errors
+        if (stepper) {
+            stepper->step(step * (double)options.deltaTime, options.deltaTime, &pool);
+            stepper->store();
+        }
+        else integrator(system, (float)(step * (double)options.deltaTime), options.deltaTime, pool);
+        DSIM_PROFILE_SAMPLE("force evaluations");
+        if (colliding) {
+            // the collisions change the float state, which the stepper takes over
+            const size_t resolved = collisions.resolve(system, &pool);
+            if (resolved > 0 && stepper) stepper->load();
+            contacts += resolved;
+        }
+
+        if (output.is_open() && ((step + 1) % options.outputEvery == 0 || step + 1 == steps)) {
+            writeState(output, (step + 1) * (double)options.deltaTime, system);
+        }
+        if (trajectory.isOpen()) trajectory.record(step + 1, (step + 1) * (double)options.deltaTime, system);
+        if (diagnostics.is_open()) {
+            // the last state is always sampled, so the drift covers the whole run
+            bool sampled = monitor.update(step + 1, (step + 1) * (double)options.deltaTime, system, &pool);
+            if (!sampled && step + 1 == steps) {
+                monitor.sample((step + 1) * (double)options.deltaTime, system, &pool);
+                sampled = true;
+            }
+            if (sampled) writeDiagnostics(diagnostics, step + 1, monitor.getLatest());
+        }
+
+        if (!options.checkpoint.empty() && options.checkpointEvery > 0 && (step + 1) % options.checkpointEvery == 0 && step + 1 < steps) {
+            if (!saveCheckpoint(options.checkpoint, (step + 1) * (double)options.deltaTime, step + 1, system)) std::cerr << "Failed to write " << options.checkpoint << "\n";
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const unsigned long long lastStep = std::max(firstStep, steps);
+    if (!options.checkpoint.empty() && !saveCheckpoint(options.checkpoint, lastStep * (double)options.deltaTime, lastStep, system)) {
+        std::cerr << "Failed to write " << options.checkpoint << "\n";
+        return 1;
+    }
+
+    if (trajectory.isOpen()) {
+        std::cout << "trajectory: " << trajectory.getFrameCount() << " frames, " << trajectory.getStallTime() << " s waiting for the disk\n";
+        if (!trajectory.close()) {
+            std::cerr << "Failed to write " << options.trajectory << "\n";
+            return 1;
+        }
+    }
+
+    const unsigned long long taken = lastStep - firstStep;
+    std::cout << "integrator: " << options.integrator << " (" << Physics::getPrecisionName(precision) << " precision), particles: " << system.size() << ", threads: " << pool.getThreadCount() << "\n"
+        << "steps: " << taken << ", simulated time: " << taken * (double)options.deltaTime << " s\n"
+        << "wall time: " << elapsed << " s, " << taken / elapsed << " steps/s, "
+        << taken * (double)options.deltaTime / elapsed << "x real time\n";
+    if (colliding) std::cout << "contacts: " << contacts << "\n";
+    if (monitor.hasSample()) std::cout << "relative energy drift: " << monitor.getRelativeEnergyDrift() << "\n";
+
+    if (!options.profile.empty() && Profiling::isEnabled()) {
+        Profiling::writeSummary(std::cout);
+        if (!Profiling::writeChromeTrace(options.profile)) {
+            std::cerr << "Failed to write " << options.profile << "\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
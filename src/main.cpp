@@ -1,23 +1,158 @@
 // !V1
 
 #define _USE_MATH_DEFINES
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <deque>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #include <glm/glm.hpp>
 
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
 #include "camera.hpp"
+#include "forceregistry.hpp"
+#include "gpuphysics.hpp"
 #include "graphics.hpp"
 #include "physics.hpp"
+#include "profiler.hpp"
+#include "scenario.hpp"
+#include "threadpool.hpp"
+#include "triplebuffer.hpp"
 
 static CameraController camera;
 
 const int MAX_POINTS = 10000;
-std::deque<glm::vec3> trajectory;
+static std::unique_ptr<Graphics::TrajectoryBuffer> trajectory;
+static std::unique_ptr<Graphics::SphereRenderer> spheres;
+static std::vector<float> displayRadii; // radius of each sphere, the particles without one are drawn with DEFAULT_RADIUS
+
+const float DEFAULT_RADIUS = 5.0f;
+
+// Most steps taken at once by the physics thread: beyond it the backlog is dropped, so a stall cannot snowball
+const int MAX_SUBSTEPS = 250;
+
+// State published by the physics thread after its steps
+struct Snapshot {
+	unsigned long long step;
+	double publishTime;          // glfwGetTime at the publication
+	std::vector<glm::vec3> previousPositions; // positions one step before
+	std::vector<glm::vec3> positions;
+	unsigned long long firstTrailStep;
+	std::vector<glm::vec3> trail; // positions of the first particle not drawn yet by the render loop, from firstTrailStep to step
+
+	Snapshot() : step(0), publishTime(0.0), firstTrailStep(1) {}
+};
+
+static Parallel::TripleBuffer<Snapshot> snapshots;
+static std::atomic<unsigned long long> drawnStep(0); // last step whose position was pushed to the trajectory
+static std::atomic<bool> simulating(true);
+
+// Physics loop: runs the fixed-timestep integration at its own cadence, on its own thread
+void simulate(Physics::ParticleSystem* system, Propagation::SystemIntegrator integrator, float deltaTime) {
+	DSIM_PROFILE_THREAD_NAME("physics");
+	Parallel::ThreadPool pool;
+	std::vector<glm::vec3> previousPositions;
+	std::deque<glm::vec3> pending; // positions not yet drawn, from pendingStep on
+	unsigned long long pendingStep = 1;
+	unsigned long long step = 0;
+
+	double lastTime = glfwGetTime();
+	double accumulator = 0.0;
+
+	while (simulating.load(std::memory_order_relaxed)) {
+		double now = glfwGetTime();
+		accumulator += now - lastTime;
+		lastTime = now;
+
+		int substeps = 0;
+		while (accumulator >= deltaTime && substeps < MAX_SUBSTEPS) {
+			DSIM_PROFILE_SCOPE("substep");
+			// only the state before the last substep is displayed, the copy is skipped for the others
+			if (accumulator < 2.0 * deltaTime || substeps + 1 == MAX_SUBSTEPS) previousPositions.assign(system->getPositions(), system->getPositions() + system->size());
+
+			// the time is computed from the step count, so it does not accumulate rounding errors
+			integrator(*system, (float)(step * (double)deltaTime), deltaTime, pool);
+			pending.push_back(system->getPosition(0));
+
+			step++;
+			accumulator -= deltaTime;
+			substeps++;
+		}
+		if (substeps == MAX_SUBSTEPS) accumulator = 0.0;
+
+		if (substeps > 0) {
+			DSIM_PROFILE_SCOPE("publish snapshot");
+			DSIM_PROFILE_COUNTER("substeps", substeps);
+			DSIM_PROFILE_SAMPLE("force evaluations");
+
+			// forget the points already drawn and the ones that would not fit in the trajectory anyway
+			unsigned long long drawn = drawnStep.load(std::memory_order_acquire);
+			while (!pending.empty() && (pendingStep <= drawn || pending.size() > (size_t)MAX_POINTS)) {
+				pending.pop_front();
+				pendingStep++;
+			}
+
+			Snapshot& snapshot = snapshots.getWriteBuffer();
+			snapshot.step = step;
+			snapshot.publishTime = glfwGetTime();
+			snapshot.previousPositions.swap(previousPositions);
+			snapshot.positions.assign(system->getPositions(), system->getPositions() + system->size());
+			snapshot.firstTrailStep = pendingStep;
+			snapshot.trail.assign(pending.begin(), pending.end());
+			snapshots.publish();
+		}
+
+		// sleep until the next step is due
+		double wait = deltaTime - accumulator;
+		if (wait > 0.0) std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+	}
+}
+
+// Take the latest snapshot and return the positions to display, interpolated between its last two steps
+const std::vector<glm::vec3>& consumeSnapshot(float deltaTime) {
+	static std::vector<glm::vec3> displayed;
+
+	DSIM_PROFILE_SCOPE("consumeSnapshot");
+	if (snapshots.update()) {
+		const Snapshot& snapshot = snapshots.getReadBuffer();
+		unsigned long long drawn = drawnStep.load(std::memory_order_relaxed);
 
-void drawScene() {
+		for (size_t i = 0; i < snapshot.trail.size(); i++) {
+			if (snapshot.firstTrailStep + i > drawn) trajectory->push(snapshot.trail[i]);
+		}
+		drawnStep.store(std::max(drawn, snapshot.step), std::memory_order_release);
+	}
+
+	// one step behind the physics, so the display moves smoothly between the published steps
+	const Snapshot& snapshot = snapshots.getReadBuffer();
+	float alpha = std::min(std::max((float)((glfwGetTime() - snapshot.publishTime) / deltaTime), 0.0f), 1.0f);
+
+	displayed.resize(snapshot.positions.size());
+	for (size_t i = 0; i < displayed.size(); i++) displayed[i] = glm::mix(snapshot.previousPositions[i], snapshot.positions[i], alpha);
+	return displayed;
+}
+
+// Steps of the GPU propagation due since the last frame, at the same cadence as the physics thread
+unsigned takeGpuSteps(float deltaTime) {
+	static double lastTime = glfwGetTime();
+	static double accumulator = 0.0;
+
+	double now = glfwGetTime();
+	accumulator += now - lastTime;
+	lastTime = now;
+
+	unsigned steps = (unsigned)std::min(accumulator / deltaTime, (double)MAX_SUBSTEPS);
+	accumulator = steps == (unsigned)MAX_SUBSTEPS ? 0.0 : accumulator - steps * (double)deltaTime;
+	return steps;
+}
+
+void beginScene() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glClearColor(1.0, 1.0, 1.0, 0.0);
 
@@ -27,17 +162,30 @@ void drawScene() {
     glLineWidth(2.0);
 
 	Graphics::drawAxis();
+}
+
+void drawScene(const std::vector<glm::vec3>& positions) {
+	DSIM_PROFILE_SCOPE("drawScene");
+    beginScene();
 
     // -- Draw Trajectory --
-    size_t size = trajectory.size();
-    glBegin(GL_LINE_STRIP);
     glColor3f(1.0, 0.0, 0.0);
-    for (size_t i = 0; i < size; i++) {
-        glVertex3f(trajectory[i].x, trajectory[i].y, trajectory[i].z);
+    trajectory->draw();
+
+    if (spheres->isValid()) spheres->draw(positions.data(), displayRadii.data(), positions.size(), DEFAULT_RADIUS, glm::vec3(1.0f, 0.0f, 0.0f));
+    else {
+        for (size_t i = 0; i < positions.size(); i++) Graphics::drawSphere(displayRadii[i], positions[i]);
     }
-    glEnd();
 
-    Graphics::drawSphere(5.0f, trajectory.back());
+    glFlush();
+}
+
+// The spheres are drawn straight from the position buffer of the GPU state, whose w is the mass: the radius is given
+void drawGpuScene(const Physics::GpuParticleSystem& gpu, float radius) {
+	DSIM_PROFILE_SCOPE("drawScene");
+    beginScene();
+
+    spheres->drawBuffer(gpu.getPositionBuffer(), gpu.size(), radius, glm::vec3(1.0f, 0.0f, 0.0f));
 
     glFlush();
 }
@@ -65,7 +213,54 @@ void resize(GLFWwindow* window, int w, int h) {
 	glLoadIdentity();
 }
 
-int main() {
+int main(int argc, char** argv) {
+	Physics::ParticleSystem system;
+	Propagation::SystemIntegrator integrator = Propagation::rungeKutta4;
+	static float deltaTime = 0.001f; // deltat expressed in s
+
+	// the scenario owns the forces acting on the particles it loads, the registry the ones of the default setup
+	Storage::Scenario scenario;
+	Physics::ForceRegistry forces;
+
+	// DynamicsSim [--gpu] [scenario]; --gpu propagates the system in compute shaders and draws it without copies
+	const char* scenarioPath = nullptr;
+	bool useGpu = false;
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--gpu") == 0) useGpu = true;
+		else scenarioPath = argv[i];
+	}
+
+	if (scenarioPath) {
+		if (!scenario.load(scenarioPath, system)) {
+			std::cerr << "Failed to load " << scenarioPath << ": " << scenario.getError() << "\n";
+			return -1;
+		}
+		if (system.size() == 0) {
+			std::cerr << scenarioPath << " has no particles\n";
+			return -1;
+		}
+
+		if (scenario.settings.deltaTime > 0.0f) deltaTime = scenario.settings.deltaTime;
+		if (!scenario.settings.integrator.empty()) {
+			integrator = Propagation::findSystemIntegrator(scenario.settings.integrator);
+			if (!integrator) {
+				std::cerr << "Unknown integrator " << scenario.settings.integrator << "\n";
+				return -1;
+			}
+		}
+	} else {
+		static const float mass = 5.97219e8f; // mass of Earth in kg / 1e16
+		static glm::vec3 currentPos(20.0f, 20.0f, 0.0f); // x_0 expressed in m
+		static glm::vec3 currentVel(0.0f, -20.0f, 0.0f); // x_0 expressed in m/s
+
+		system.addParticle(mass, currentPos, currentVel);
+		forces.add(Physics::GravitationalForce(1.98847e14f, mass)); // mass of Sun in kg / 1e16
+		system.appliedForces.addForce(forces);
+	}
+
+	displayRadii.resize(system.size());
+	for (size_t i = 0; i < system.size(); i++) displayRadii[i] = system.getRadius(i) > 0.0f ? system.getRadius(i) : DEFAULT_RADIUS;
+
 	// Initialize the window
 	if (!glfwInit()) {
 		std::cerr << "Failed to initialize GLFW\n";
@@ -91,54 +286,67 @@ int main() {
 
 	setup();
 
+	trajectory.reset(new Graphics::TrajectoryBuffer(MAX_POINTS));
+	spheres.reset(new Graphics::SphereRenderer());
+
 	glfwSetFramebufferSizeCallback(window, resize);
 	resize(window, 600, 600); // Set initial viewport size
 	
-	// Setup animation variables
-	// Animation timing
-	double lastTime = glfwGetTime();
-	double accumulator = 0.0;
-
 	camera = CameraController(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), 1.0f, 0.025f, 0.05f, 0.001f);
 
-	static const float mass = 5.97219e8f; // mass of Earth in kg / 1e16
-	static glm::vec3 currentPos(20.0f, 20.0f, 0.0f); // x_0 expressed in m
-	static glm::vec3 currentVel(0.0f, -20.0f, 0.0f); // x_0 expressed in m/s
+	// the GPU state is uploaded once and stepped by the render loop, the physics thread is not started
+	std::unique_ptr<Physics::GpuParticleSystem> gpu;
+	float gpuRadius = displayRadii[0];
+	if (useGpu) {
+		gpu.reset(new Physics::GpuParticleSystem());
+		if (!gpu->isValid() || !spheres->isValid() || !gpu->upload(system)) {
+			std::cerr << "The system cannot be propagated on the GPU, it is propagated on the CPU instead\n";
+			gpu.reset();
+		}
+		else {
+			if (integrator != Propagation::findSystemIntegrator("verlet")) std::cerr << "The GPU propagates the system with velocity Verlet steps\n";
+			if (std::any_of(displayRadii.begin(), displayRadii.end(), [&](float radius) { return radius != gpuRadius; })) {
+				std::cerr << "The GPU path draws every particle with the radius of the first one\n";
+			}
+		}
+	}
+
+	trajectory->push(system.getPosition(0));
 
-	Physics::Particle particle(mass, currentPos, currentVel);
-	trajectory.push_back(currentPos);
+	// initial state, shown until the physics thread publishes its first steps
+	Snapshot& initial = snapshots.getWriteBuffer();
+	initial.positions.assign(system.getPositions(), system.getPositions() + system.size());
+	initial.previousPositions = initial.positions;
+	snapshots.publish();
+	snapshots.update();
 
-	static float currentTime = 0; // t_0 expressed in s
-	static float deltaTime = 0.001f; // deltat expressed in s
-	static float deltaFrame = 0.02f; // deltat expressed in s
+	// the system belongs to the physics thread from here on
+	std::thread physics;
+	if (!gpu) physics = std::thread(simulate, &system, integrator, deltaTime);
 
-	Physics::Force* force = new Physics::GravitationalForce(1.98847e14f, mass); // mass of Sun in kg / 1e16
-	particle.appliedForces.addForce(*force);
+	DSIM_PROFILE_THREAD_NAME("render");
 
 	// Enter the update cycle
 	while (!glfwWindowShouldClose(window)) {
-		double currentTime = glfwGetTime();
-		double frameTime = currentTime - lastTime;
-
-		lastTime = currentTime;
-		accumulator += frameTime;
-
-		while (accumulator >= deltaTime) {
-			Propagation::rungeKutta4(particle, currentTime, deltaTime);
-
-			if(trajectory.size() >= MAX_POINTS) trajectory.pop_front();
-			trajectory.push_back(particle.getPosition());
-
-			currentTime += deltaTime;
-			accumulator -= deltaTime;
-		}
-
 		camera.moveCamera(window);
-		drawScene();
+		if (gpu) {
+			gpu->step(deltaTime, takeGpuSteps(deltaTime));
+			drawGpuScene(*gpu, gpuRadius);
+		}
+		else drawScene(consumeSnapshot(deltaTime));
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
+	simulating.store(false);
+	if (physics.joinable()) physics.join();
+
+	if (Profiling::isEnabled() && !Profiling::writeChromeTrace("DynamicsSim_trace.json")) std::cerr << "Failed to write DynamicsSim_trace.json\n";
+
+	// the buffers must be released while the context is still alive
+	gpu.reset();
+	spheres.reset();
+	trajectory.reset();
 	Graphics::deleteGraphics();
 
 	glfwDestroyWindow(window);